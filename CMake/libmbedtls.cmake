@@ -97,17 +97,60 @@ set(MBEDTLS_INC
     ${MBEDTLS_DIR}/include
 )
 
+# Let Polly_setAllocator() route the allocations of mbedtls by mbedtls_platform_set_calloc_free()
+set(MBEDTLS_DEFS
+    MBEDTLS_PLATFORM_MEMORY
+)
+
+# Replace the SHA-256 block function of mbedtls by one which picks SHA-NI or ARMv8 crypto extensions at runtime
+if(${USE_SHA256_ALT})
+    list(APPEND MBEDTLS_SRC_CRYPTO ${CMAKE_CURRENT_SOURCE_DIR}/src/source/sha256_alt.c)
+    list(APPEND MBEDTLS_DEFS MBEDTLS_SHA256_PROCESS_ALT)
+endif()
+
+# Low-memory TLS profile. Requests are small, so outgoing records are limited to 4 KB. The incoming buffer starts at 16 KB for the handshake,
+# and it shrinks to the max_fragment_length negotiated with the server (see uTlsMaxFragmentLen) once the handshake is done.
+# The definitions change the layout of the SSL context, so they are public like the others.
+if(${USE_TLS_LOW_MEMORY})
+    list(APPEND MBEDTLS_DEFS
+        MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+        MBEDTLS_SSL_OUT_CONTENT_LEN=4096
+    )
+endif()
+
+# Minimal profile. mbedtls is configured by src/config/polly_mbedtls_config.h instead of its default config.h, with only what a Polly client
+# needs, and the modules which it disables are not compiled. The configuration changes the layout of the contexts, so it's public like the others.
+if(${USE_TLS_MINIMAL})
+    list(APPEND MBEDTLS_DEFS
+        MBEDTLS_CONFIG_FILE="${CMAKE_CURRENT_SOURCE_DIR}/src/config/polly_mbedtls_config.h"
+    )
+    foreach(MODULE arc4 aria blowfish camellia ccm cmac des dhm ecjpake error havege hkdf hmac_drbg md2 md4 md5 memory_buffer_alloc nist_kw
+                   padlock pkcs12 pkcs5 pkwrite psa_crypto psa_crypto_se psa_crypto_slot_management psa_crypto_storage psa_its_file ripemd160 sha1
+                   threading timing version version_features xtea)
+        list(REMOVE_ITEM MBEDTLS_SRC_CRYPTO ${MBEDTLS_DIR}/library/${MODULE}.c)
+    endforeach()
+    foreach(MODULE certs pkcs11 x509_create x509_crl x509_csr x509write_crt x509write_csr)
+        list(REMOVE_ITEM MBEDTLS_SRC_X509 ${MBEDTLS_DIR}/library/${MODULE}.c)
+    endforeach()
+    foreach(MODULE debug ssl_cache ssl_cookie ssl_srv ssl_ticket)
+        list(REMOVE_ITEM MBEDTLS_SRC_TLS ${MBEDTLS_DIR}/library/${MODULE}.c)
+    endforeach()
+endif()
+
 # setup mbedcrypto static library
 add_library(mbedcrypto STATIC ${MBEDTLS_SRC_CRYPTO})
 target_include_directories(mbedcrypto PUBLIC ${MBEDTLS_INC})
+target_compile_definitions(mbedcrypto PUBLIC ${MBEDTLS_DEFS})
 
 # setup mbedx509 static library
 add_library(mbedx509 STATIC ${MBEDTLS_SRC_X509})
 target_include_directories(mbedx509 PUBLIC ${MBEDTLS_INC})
+target_compile_definitions(mbedx509 PUBLIC ${MBEDTLS_DEFS})
 
 # setup mbedtls static library
 add_library(mbedtls STATIC ${MBEDTLS_SRC_TLS})
 target_include_directories(mbedtls PUBLIC ${MBEDTLS_INC})
+target_compile_definitions(mbedtls PUBLIC ${MBEDTLS_DEFS})
 
 include(GNUInstallDirs)
 
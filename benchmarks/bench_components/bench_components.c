@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "polly/polly.h"
+
+#include "arena.h"
+#include "http_parser.h"
+#include "request.h"
+#include "sigv4.h"
+
+#define BENCH_MIN_DURATION_NS   (200 * 1000 * 1000ULL)
+
+/* The body of the recorded responses, and the size of the chunks of the chunked one */
+#define BENCH_BODY_LEN          (4096)
+#define BENCH_CHUNK_LEN         (1000)
+#define BENCH_RESPONSE_MAX_LEN  (BENCH_BODY_LEN + 1024)
+
+/* SigV4 signs a short JSON payload, a long SSML payload, and anything in between */
+static const size_t guPayloadLens[] = { 64, 512, 4096, 16384 };
+
+/* From a word to the longest text of a request */
+static const size_t guTextLens[] = { 16, 100, 1000, 3000 };
+
+typedef int (*BenchOp_t)(void *pCtx, size_t *puBytes);
+
+typedef struct
+{
+    HttpParserHandle xHttpParser;
+    const char *pResponse;
+    size_t uResponseLen;
+    size_t uSplit; // The response arrives in two reads split here, and every op moves to the next boundary
+    char pRecvBuf[BENCH_RESPONSE_MAX_LEN];
+} ParseCtx_t;
+
+typedef struct
+{
+    SigV4Para_t xPara;
+} SignCtx_t;
+
+typedef struct
+{
+    PollyServiceParameter_t xServPara;
+    PollySynthesizeSpeechParameter_t xPara;
+} BuildCtx_t;
+
+static size_t guAllocs = 0;
+static bool gbCountAllocs = false;
+
+static void *prvCountingMalloc(size_t uSize)
+{
+    guAllocs++;
+    return malloc(uSize);
+}
+
+static void *prvCountingRealloc(void *ptr, size_t uSize)
+{
+    guAllocs++;
+    return realloc(ptr, uSize);
+}
+
+static unsigned long long prvGetTimeNs(void)
+{
+    struct timespec xNow = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (unsigned long long)xNow.tv_sec * 1000000000ULL + (unsigned long long)xNow.tv_nsec;
+}
+
+/* Run an op until the minimum duration has passed, and report the cost of one op */
+static int prvBenchmark(const char *pName, BenchOp_t fnOp, void *pCtx)
+{
+    int res = 0;
+    unsigned long long uStartNs = 0;
+    unsigned long long uElapsedNs = 0;
+    unsigned long long uOps = 0;
+    size_t uBytes = 0;
+    size_t uTotalBytes = 0;
+    size_t uAllocsBefore = guAllocs;
+
+    uStartNs = prvGetTimeNs();
+    while (res == 0 && uElapsedNs < BENCH_MIN_DURATION_NS)
+    {
+        if ((res = fnOp(pCtx, &uBytes)) == 0)
+        {
+            uTotalBytes += uBytes;
+            uOps++;
+        }
+        uElapsedNs = prvGetTimeNs() - uStartNs;
+    }
+
+    if (res != 0)
+    {
+        printf("%-32s failed\n", pName);
+    }
+    else if (gbCountAllocs)
+    {
+        printf("%-32s %10.1f ns/op %10.1f MB/s %8.2f allocs/op\n", pName, (double)uElapsedNs / uOps, uTotalBytes * 1000.0 / uElapsedNs,
+               (double)(guAllocs - uAllocsBefore) / uOps);
+    }
+    else
+    {
+        printf("%-32s %10.1f ns/op %10.1f MB/s        n/a allocs/op\n", pName, (double)uElapsedNs / uOps, uTotalBytes * 1000.0 / uElapsedNs);
+    }
+
+    return res;
+}
+
+/* Parse what is buffered like the receive loop of a request, and count the body bytes */
+static int prvParseBuffered(ParseCtx_t *pxCtx, size_t *puBuffered, size_t *puBodyLen)
+{
+    int res = HTTP_PARSER_ERRNO_NONE;
+    size_t uBytesParsed = 0;
+    unsigned int uStatusCode = 0;
+    const char *pChunkLoc = NULL;
+    size_t uChunkLen = 0;
+
+    while (*puBuffered > 0 && res == HTTP_PARSER_ERRNO_NONE && !Hp_isMessageComplete(pxCtx->xHttpParser))
+    {
+        if ((res = Hp_parse(pxCtx->xHttpParser, pxCtx->pRecvBuf, *puBuffered, &uBytesParsed, &uStatusCode, &pChunkLoc, &uChunkLen)) == HTTP_PARSER_ERRNO_NONE)
+        {
+            *puBodyLen += (pChunkLoc != NULL) ? uChunkLen : 0;
+            *puBuffered -= uBytesParsed;
+            memmove(pxCtx->pRecvBuf, pxCtx->pRecvBuf + uBytesParsed, *puBuffered);
+        }
+    }
+
+    return (res == HTTP_PARSER_ERRNO_WANT_MORE_DATA) ? HTTP_PARSER_ERRNO_NONE : res;
+}
+
+static int prvParseOp(void *pCtx, size_t *puBytes)
+{
+    int res = 0;
+    ParseCtx_t *pxCtx = (ParseCtx_t *)pCtx;
+    size_t uBuffered = 0;
+    size_t uBodyLen = 0;
+
+    Hp_reset(pxCtx->xHttpParser);
+
+    memcpy(pxCtx->pRecvBuf, pxCtx->pResponse, pxCtx->uSplit);
+    uBuffered = pxCtx->uSplit;
+    if (prvParseBuffered(pxCtx, &uBuffered, &uBodyLen) != HTTP_PARSER_ERRNO_NONE)
+    {
+        res = -1;
+    }
+    else
+    {
+        memcpy(pxCtx->pRecvBuf + uBuffered, pxCtx->pResponse + pxCtx->uSplit, pxCtx->uResponseLen - pxCtx->uSplit);
+        uBuffered += pxCtx->uResponseLen - pxCtx->uSplit;
+        if (prvParseBuffered(pxCtx, &uBuffered, &uBodyLen) != HTTP_PARSER_ERRNO_NONE ||
+            !Hp_isMessageComplete(pxCtx->xHttpParser) || uBodyLen != BENCH_BODY_LEN)
+        {
+            res = -1;
+        }
+    }
+
+    pxCtx->uSplit = (pxCtx->uSplit + 1) % (pxCtx->uResponseLen + 1);
+    *puBytes = pxCtx->uResponseLen;
+
+    return res;
+}
+
+static int prvSignOp(void *pCtx, size_t *puBytes)
+{
+    int res = 0;
+    SignCtx_t *pxCtx = (SignCtx_t *)pCtx;
+    char *pAuth = NULL;
+    size_t uAuthLen = 0;
+
+    /* The arena is sized like the one of a request */
+    if ((pxCtx->xPara.xArena = Arena_create(REQUEST_ARENA_OVERHEAD + REQUEST_ARENA_TEXT_FACTOR * pxCtx->xPara.uPayloadLen)) == NULL ||
+        SigV4_Sign(&(pxCtx->xPara), &pAuth, &uAuthLen) != SIGV4_ERRNO_NONE)
+    {
+        res = -1;
+    }
+    Arena_terminate(pxCtx->xPara.xArena);
+    *puBytes = pxCtx->xPara.uPayloadLen;
+
+    return res;
+}
+
+static int prvBuildPayloadOp(void *pCtx, size_t *puBytes)
+{
+    int res = 0;
+    BuildCtx_t *pxCtx = (BuildCtx_t *)pCtx;
+    ArenaHandle xArena = NULL;
+    char *pPayload = NULL;
+    size_t uPayloadLen = 0;
+
+    if ((xArena = Arena_create(REQUEST_ARENA_OVERHEAD + REQUEST_ARENA_TEXT_FACTOR * strlen(pxCtx->xPara.pText))) == NULL ||
+        Request_genPayload(xArena, &(pxCtx->xPara), &pPayload, &uPayloadLen) != POLLY_ERRNO_NONE)
+    {
+        res = -1;
+    }
+    Arena_terminate(xArena);
+    *puBytes = uPayloadLen;
+
+    return res;
+}
+
+static int prvBuildHttpReqOp(void *pCtx, size_t *puBytes)
+{
+    int res = 0;
+    BuildCtx_t *pxCtx = (BuildCtx_t *)pCtx;
+    ArenaHandle xArena = NULL;
+    char *pHttpReq = NULL;
+    size_t uHttpReqLen = 0;
+
+    if ((xArena = Arena_create(REQUEST_ARENA_OVERHEAD + REQUEST_ARENA_TEXT_FACTOR * strlen(pxCtx->xPara.pText))) == NULL ||
+        Request_genHttpReq(xArena, &(pxCtx->xServPara), &(pxCtx->xPara), &pHttpReq, &uHttpReqLen) != POLLY_ERRNO_NONE)
+    {
+        res = -1;
+    }
+    Arena_terminate(xArena);
+    *puBytes = uHttpReqLen;
+
+    return res;
+}
+
+static int prvBuildHttp2ReqOp(void *pCtx, size_t *puBytes)
+{
+    int res = 0;
+    BuildCtx_t *pxCtx = (BuildCtx_t *)pCtx;
+    ArenaHandle xArena = NULL;
+    Http2Request_t xReq;
+
+    memset(&xReq, 0, sizeof(xReq));
+    if ((xArena = Arena_create(REQUEST_ARENA_OVERHEAD + REQUEST_ARENA_TEXT_FACTOR * strlen(pxCtx->xPara.pText))) == NULL ||
+        Request_genHttp2Req(xArena, &(pxCtx->xServPara), &(pxCtx->xPara), &xReq) != POLLY_ERRNO_NONE)
+    {
+        res = -1;
+    }
+    Arena_terminate(xArena);
+    *puBytes = xReq.uHeaderBlockLen + xReq.uBodyLen;
+
+    return res;
+}
+
+static size_t prvGenResponse(char *pBuf, bool bChunked)
+{
+    size_t uLen = 0;
+    size_t uChunkLen = 0;
+    size_t i = 0;
+
+    uLen += sprintf(pBuf + uLen, "HTTP/1.1 200 OK\r\n");
+    uLen += sprintf(pBuf + uLen, "x-amzn-RequestId: 0a3d5c4e-8f1b-4e8a-9d2c-6b7f1e2a3c4d\r\n");
+    uLen += sprintf(pBuf + uLen, "x-amzn-RequestCharacters: 42\r\n");
+    uLen += sprintf(pBuf + uLen, "Content-Type: audio/mpeg\r\n");
+    uLen += sprintf(pBuf + uLen, "Date: Mon, 19 Oct 2026 08:00:00 GMT\r\n");
+    if (bChunked)
+    {
+        uLen += sprintf(pBuf + uLen, "Transfer-Encoding: chunked\r\n\r\n");
+        for (i = 0; i < BENCH_BODY_LEN; i += uChunkLen)
+        {
+            uChunkLen = (BENCH_BODY_LEN - i < BENCH_CHUNK_LEN) ? BENCH_BODY_LEN - i : BENCH_CHUNK_LEN;
+            uLen += sprintf(pBuf + uLen, "%zx\r\n", uChunkLen);
+            memset(pBuf + uLen, 0xA5, uChunkLen);
+            uLen += uChunkLen;
+            uLen += sprintf(pBuf + uLen, "\r\n");
+        }
+        uLen += sprintf(pBuf + uLen, "0\r\n\r\n");
+    }
+    else
+    {
+        uLen += sprintf(pBuf + uLen, "Content-Length: %d\r\n\r\n", BENCH_BODY_LEN);
+        memset(pBuf + uLen, 0xA5, BENCH_BODY_LEN);
+        uLen += BENCH_BODY_LEN;
+    }
+
+    return uLen;
+}
+
+static int prvBenchmarkParser(void)
+{
+    int res = 0;
+    ParseCtx_t *pxCtx = NULL;
+    char *pResponse = NULL;
+
+    if ((pxCtx = (ParseCtx_t *)calloc(1, sizeof(ParseCtx_t))) == NULL || (pResponse = (char *)malloc(BENCH_RESPONSE_MAX_LEN)) == NULL ||
+        (pxCtx->xHttpParser = Hp_create()) == NULL)
+    {
+        printf("Out of memory\n");
+        res = -1;
+    }
+    else
+    {
+        pxCtx->pResponse = pResponse;
+        pxCtx->uResponseLen = prvGenResponse(pResponse, false);
+        res = prvBenchmark("Hp_parse content-length", prvParseOp, pxCtx);
+
+        pxCtx->uResponseLen = prvGenResponse(pResponse, true);
+        pxCtx->uSplit = 0;
+        res = (res == 0) ? prvBenchmark("Hp_parse chunked", prvParseOp, pxCtx) : res;
+    }
+
+    if (pxCtx != NULL)
+    {
+        Hp_terminate(pxCtx->xHttpParser);
+        free(pxCtx);
+    }
+    free(pResponse);
+
+    return res;
+}
+
+static int prvBenchmarkSigner(void)
+{
+    int res = 0;
+    SignCtx_t xCtx;
+    char *pPayload = NULL;
+    char pName[64];
+    size_t i = 0;
+
+    memset(&xCtx, 0, sizeof(xCtx));
+    xCtx.xPara.pAccessKey = "AKIDEXAMPLE";
+    xCtx.xPara.pSecretKey = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+    xCtx.xPara.pRegion = "us-east-1";
+    xCtx.xPara.pService = "polly";
+    xCtx.xPara.pDateIso8601 = "20261019T080000Z";
+    xCtx.xPara.pHttpMethod = "POST";
+    xCtx.xPara.pPath = "/v1/speech";
+    xCtx.xPara.pHost = "polly.us-east-1.amazonaws.com";
+
+    if ((pPayload = (char *)malloc(guPayloadLens[sizeof(guPayloadLens) / sizeof(guPayloadLens[0]) - 1])) == NULL)
+    {
+        printf("Out of memory\n");
+        res = -1;
+    }
+    else
+    {
+        memset(pPayload, 'x', guPayloadLens[sizeof(guPayloadLens) / sizeof(guPayloadLens[0]) - 1]);
+        xCtx.xPara.pPayload = pPayload;
+        for (i = 0; i < sizeof(guPayloadLens) / sizeof(guPayloadLens[0]) && res == 0; i++)
+        {
+            xCtx.xPara.uPayloadLen = guPayloadLens[i];
+            snprintf(pName, sizeof(pName), "SigV4_Sign %zu B", guPayloadLens[i]);
+            res = prvBenchmark(pName, prvSignOp, &xCtx);
+        }
+        free(pPayload);
+    }
+
+    return res;
+}
+
+static int prvBenchmarkRequestBuilder(void)
+{
+    int res = 0;
+    BuildCtx_t xCtx;
+    char *pText = NULL;
+    char pName[64];
+    size_t i = 0;
+
+    memset(&xCtx, 0, sizeof(xCtx));
+    xCtx.xServPara.pAccessKey = "AKIDEXAMPLE";
+    xCtx.xServPara.pSecretKey = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+    xCtx.xServPara.pRegion = "us-east-1";
+    xCtx.xServPara.pService = "polly";
+    xCtx.xServPara.pHost = "polly.us-east-1.amazonaws.com";
+    xCtx.xPara.pOutputFormat = "mp3";
+    xCtx.xPara.pVoiceId = "Joanna";
+
+    if ((pText = (char *)malloc(guTextLens[sizeof(guTextLens) / sizeof(guTextLens[0]) - 1] + 1)) == NULL)
+    {
+        printf("Out of memory\n");
+        res = -1;
+    }
+    else
+    {
+        xCtx.xPara.pText = pText;
+        for (i = 0; i < sizeof(guTextLens) / sizeof(guTextLens[0]) && res == 0; i++)
+        {
+            memset(pText, 'a', guTextLens[i]);
+            pText[guTextLens[i]] = '\0';
+
+            snprintf(pName, sizeof(pName), "Request_genPayload %zu chars", guTextLens[i]);
+            res = prvBenchmark(pName, prvBuildPayloadOp, &xCtx);
+
+            snprintf(pName, sizeof(pName), "Request_genHttpReq %zu chars", guTextLens[i]);
+            res = (res == 0) ? prvBenchmark(pName, prvBuildHttpReqOp, &xCtx) : res;
+
+            snprintf(pName, sizeof(pName), "Request_genHttp2Req %zu chars", guTextLens[i]);
+            res = (res == 0) ? prvBenchmark(pName, prvBuildHttp2ReqOp, &xCtx) : res;
+        }
+        free(pText);
+    }
+
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    PollyAllocator_t xAllocator = { prvCountingMalloc, prvCountingRealloc, free };
+
+    /* Allocations are counted through the allocator of the library, which can't be replaced when it uses static pools. */
+    gbCountAllocs = (Polly_setAllocator(&xAllocator) == POLLY_ERRNO_NONE);
+
+    if ((res = prvBenchmarkParser()) != 0)
+    {
+        /* Propagate the error code */
+    }
+    else if ((res = prvBenchmarkSigner()) != 0)
+    {
+        /* Propagate the error code */
+    }
+    else
+    {
+        res = prvBenchmarkRequestBuilder();
+    }
+
+    return (res == 0) ? 0 : 1;
+}
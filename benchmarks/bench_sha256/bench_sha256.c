@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mbedtls/sha256.h"
+
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+#include "sha256_alt.h"
+#endif
+
+#define BENCH_MIN_DURATION_NS   (200 * 1000 * 1000ULL)
+#define BENCH_MAX_MSG_LEN       (1024 * 1024)
+
+typedef struct
+{
+    const char *pMsg;
+    size_t uRepeat; // The message is hashed this many times as one input
+    const char *pDigestHex;
+} KnownAnswer_t;
+
+/* FIPS 180-2 test vectors */
+static const KnownAnswer_t gxKnownAnswers[] =
+{
+    { "", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+/* The lengths of a short JSON payload, a long SSML payload, and bulk data */
+static const size_t guMsgLens[] = { 64, 256, 1024, 16 * 1024, BENCH_MAX_MSG_LEN };
+
+static unsigned long long prvGetTimeNs(void)
+{
+    struct timespec xNow = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (unsigned long long)xNow.tv_sec * 1000000000ULL + (unsigned long long)xNow.tv_nsec;
+}
+
+static int prvCheckKnownAnswers(void)
+{
+    int res = 0;
+    size_t i = 0;
+    size_t j = 0;
+    mbedtls_sha256_context xCtx;
+    unsigned char pDigest[32];
+    char pDigestHex[65];
+
+    for (i = 0; i < sizeof(gxKnownAnswers) / sizeof(gxKnownAnswers[0]) && res == 0; i++)
+    {
+        mbedtls_sha256_init(&xCtx);
+        mbedtls_sha256_starts_ret(&xCtx, 0);
+        for (j = 0; j < gxKnownAnswers[i].uRepeat; j++)
+        {
+            mbedtls_sha256_update_ret(&xCtx, (const unsigned char *)gxKnownAnswers[i].pMsg, strlen(gxKnownAnswers[i].pMsg));
+        }
+        mbedtls_sha256_finish_ret(&xCtx, pDigest);
+        mbedtls_sha256_free(&xCtx);
+
+        for (j = 0; j < sizeof(pDigest); j++)
+        {
+            snprintf(pDigestHex + 2 * j, 3, "%02x", pDigest[j]);
+        }
+        if (strcmp(pDigestHex, gxKnownAnswers[i].pDigestHex) != 0)
+        {
+            printf("Known answer %zu mismatched: %s\n", i, pDigestHex);
+            res = -1;
+        }
+    }
+
+    return res;
+}
+
+static void prvBenchmark(const char *pName, const unsigned char *pMsg)
+{
+    size_t i = 0;
+    unsigned long long uStart = 0;
+    unsigned long long uElapsed = 0;
+    unsigned long long uOps = 0;
+    unsigned char pDigest[32];
+
+    for (i = 0; i < sizeof(guMsgLens) / sizeof(guMsgLens[0]); i++)
+    {
+        uOps = 0;
+        uStart = prvGetTimeNs();
+        do
+        {
+            mbedtls_sha256_ret(pMsg, guMsgLens[i], pDigest, 0);
+            uOps++;
+        } while ((uElapsed = prvGetTimeNs() - uStart) < BENCH_MIN_DURATION_NS);
+
+        printf("%-10s %8zu bytes %12.1f ns/op %10.1f MB/s\n", pName, guMsgLens[i], (double)uElapsed / uOps, (double)guMsgLens[i] * uOps * 1000.0 / uElapsed);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    unsigned char *pMsg = NULL;
+    size_t i = 0;
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+    Sha256Backend_t eDefault = Sha256Alt_getBackend();
+    Sha256Backend_t peBackends[] = { SHA256_BACKEND_PORTABLE, SHA256_BACKEND_SHA_NI, SHA256_BACKEND_ARMV8_CE };
+#endif
+
+    if ((pMsg = (unsigned char *)malloc(BENCH_MAX_MSG_LEN)) == NULL)
+    {
+        printf("Out of memory\n");
+        res = -1;
+    }
+    else
+    {
+        for (i = 0; i < BENCH_MAX_MSG_LEN; i++)
+        {
+            pMsg[i] = (unsigned char)(i * 31 + 7);
+        }
+
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+        printf("Default backend: %s\n", Sha256Alt_getBackendName(eDefault));
+        for (i = 0; i < sizeof(peBackends) / sizeof(peBackends[0]) && res == 0; i++)
+        {
+            if (Sha256Alt_setBackend(peBackends[i]) != SHA256_ALT_ERRNO_NONE)
+            {
+                printf("%-10s not supported\n", Sha256Alt_getBackendName(peBackends[i]));
+            }
+            else if ((res = prvCheckKnownAnswers()) == 0)
+            {
+                prvBenchmark(Sha256Alt_getBackendName(peBackends[i]), pMsg);
+            }
+        }
+        Sha256Alt_setBackend(eDefault);
+#else
+        if ((res = prvCheckKnownAnswers()) == 0)
+        {
+            prvBenchmark("mbedtls", pMsg);
+        }
+#endif
+
+        free(pMsg);
+    }
+
+    return (res == 0) ? 0 : 1;
+}
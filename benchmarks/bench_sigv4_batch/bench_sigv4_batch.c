@@ -0,0 +1,184 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "sha256_mb.h"
+#include "sigv4.h"
+
+#define BENCH_MIN_DURATION_NS   (200 * 1000 * 1000ULL)
+
+#define BENCH_MAX_BATCH_LEN     (256)
+#define BENCH_MAX_PAYLOAD_LEN   (4096)
+
+/* SigV4 signs a short JSON payload, a long SSML payload, and anything in between */
+static const size_t guPayloadLens[] = { 64, 512, 4096 };
+
+/* A small batch fills the lanes once, and a large one keeps them busy */
+static const size_t guBatchLens[] = { 16, BENCH_MAX_BATCH_LEN };
+
+static const Sha256MbBackend_t geBackends[] = { SHA256_MB_BACKEND_SCALAR, SHA256_MB_BACKEND_AVX2, SHA256_MB_BACKEND_AVX512, SHA256_MB_BACKEND_NEON };
+
+static SigV4Para_t gxParas[BENCH_MAX_BATCH_LEN];
+static char *gppAuths[BENCH_MAX_BATCH_LEN];
+static size_t guAuthLens[BENCH_MAX_BATCH_LEN];
+
+static unsigned long long prvGetTimeNs(void)
+{
+    struct timespec xNow = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (unsigned long long)xNow.tv_sec * 1000000000ULL + (unsigned long long)xNow.tv_nsec;
+}
+
+/* The payloads differ in content, and every fifth request carries a session token */
+static void prvInitParas(const char *pPayload, size_t uPayloadLen, size_t uCount)
+{
+    size_t i = 0;
+
+    memset(gxParas, 0, sizeof(gxParas));
+    for (i = 0; i < uCount; i++)
+    {
+        gxParas[i].pAccessKey = "AKIDEXAMPLE";
+        gxParas[i].pSecretKey = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+        gxParas[i].pToken = (i % 5 == 0) ? "FwoGZXIvYXdzEXAMPLETOKEN" : NULL;
+        gxParas[i].pRegion = "us-east-1";
+        gxParas[i].pService = "polly";
+        gxParas[i].pDateIso8601 = "20261019T080000Z";
+        gxParas[i].pHttpMethod = "POST";
+        gxParas[i].pPath = "/v1/speech";
+        gxParas[i].pHost = "polly.us-east-1.amazonaws.com";
+        gxParas[i].pPayload = pPayload + i % 64;
+        gxParas[i].uPayloadLen = uPayloadLen;
+    }
+}
+
+static void prvFreeAuths(size_t uCount)
+{
+    size_t i = 0;
+
+    for (i = 0; i < uCount; i++)
+    {
+        if (gppAuths[i] != NULL)
+        {
+            Arena_free(NULL, gppAuths[i]);
+            gppAuths[i] = NULL;
+        }
+    }
+}
+
+/* Sign the batch until the minimum duration has passed, one request after another or at once */
+static int prvBenchmark(const char *pName, size_t uBatchLen, bool bBatch)
+{
+    int res = 0;
+    unsigned long long uStartNs = 0;
+    unsigned long long uElapsedNs = 0;
+    unsigned long long uRequests = 0;
+    size_t uBytes = 0;
+    size_t i = 0;
+
+    uStartNs = prvGetTimeNs();
+    while (res == 0 && uElapsedNs < BENCH_MIN_DURATION_NS)
+    {
+        if (bBatch)
+        {
+            res = SigV4_signBatch(gxParas, uBatchLen, gppAuths, guAuthLens);
+        }
+        else
+        {
+            for (i = 0; i < uBatchLen && res == 0; i++)
+            {
+                res = SigV4_Sign(&(gxParas[i]), &(gppAuths[i]), &(guAuthLens[i]));
+            }
+        }
+        prvFreeAuths(uBatchLen);
+
+        for (i = 0; i < uBatchLen; i++)
+        {
+            uBytes += gxParas[i].uPayloadLen;
+        }
+        uRequests += uBatchLen;
+        uElapsedNs = prvGetTimeNs() - uStartNs;
+    }
+
+    if (res != 0)
+    {
+        printf("%-36s failed\n", pName);
+    }
+    else
+    {
+        printf("%-36s %10.1f ns/req %10.1f MB/s\n", pName, (double)uElapsedNs / uRequests, uBytes * 1000.0 / uElapsedNs);
+    }
+
+    return res;
+}
+
+static int prvBenchmarkBackend(const char *pPayload, Sha256MbBackend_t eBackend)
+{
+    int res = 0;
+    char pName[64];
+    size_t i = 0;
+    size_t j = 0;
+
+    for (i = 0; i < sizeof(guPayloadLens) / sizeof(guPayloadLens[0]) && res == 0; i++)
+    {
+        for (j = 0; j < sizeof(guBatchLens) / sizeof(guBatchLens[0]) && res == 0; j++)
+        {
+            prvInitParas(pPayload, guPayloadLens[i], guBatchLens[j]);
+
+            if (eBackend == SHA256_MB_BACKEND_SCALAR)
+            {
+                snprintf(pName, sizeof(pName), "SigV4_Sign x%zu %zu B", guBatchLens[j], guPayloadLens[i]);
+                res = prvBenchmark(pName, guBatchLens[j], false);
+            }
+
+            snprintf(pName, sizeof(pName), "SigV4_signBatch %s x%zu %zu B", Sha256Mb_getBackendName(eBackend), guBatchLens[j], guPayloadLens[i]);
+            res = (res == 0) ? prvBenchmark(pName, guBatchLens[j], true) : res;
+        }
+    }
+
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    char *pPayload = NULL;
+    Sha256MbBackend_t eDefault = Sha256Mb_getBackend();
+    size_t i = 0;
+
+    /* The payloads start at different offsets of the first 64 bytes */
+    if ((pPayload = (char *)malloc(BENCH_MAX_PAYLOAD_LEN + 64)) == NULL)
+    {
+        printf("Out of memory\n");
+        res = -1;
+    }
+    else
+    {
+        for (i = 0; i < BENCH_MAX_PAYLOAD_LEN + 64; i++)
+        {
+            pPayload[i] = (char)('a' + (i * 7) % 26);
+        }
+
+        printf("Default backend: %s\n", Sha256Mb_getBackendName(eDefault));
+        for (i = 0; i < sizeof(geBackends) / sizeof(geBackends[0]) && res == 0; i++)
+        {
+            if (Sha256Mb_setBackend(geBackends[i]) != SHA256_MB_ERRNO_NONE)
+            {
+                printf("%-10s not supported\n", Sha256Mb_getBackendName(geBackends[i]));
+            }
+            else
+            {
+                res = prvBenchmarkBackend(pPayload, geBackends[i]);
+            }
+        }
+        Sha256Mb_setBackend(eDefault);
+
+        free(pPayload);
+    }
+
+    return (res == 0) ? 0 : 1;
+}
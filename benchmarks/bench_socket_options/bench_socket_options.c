@@ -0,0 +1,225 @@
+/* The TCP tuning options are not part of POSIX */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "polly/polly.h"
+
+#define BENCH_ITERATIONS        (50)
+
+/* A request is written as headers and then a payload, like a signed SynthesizeSpeech request, and the response comes the same way. */
+#define BENCH_REQ_HEADER_LEN    (400)
+#define BENCH_REQ_BODY_LEN      (120)
+#define BENCH_RSP_HEADER_LEN    (200)
+#define BENCH_RSP_BODY_LEN      (4096)
+
+typedef struct
+{
+    const char *pName;
+    PollySocketOptions_t xOptions;
+} BenchCase_t;
+
+static unsigned long long prvGetTimeNs(void)
+{
+    struct timespec xNow = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (unsigned long long)xNow.tv_sec * 1000000000ULL + (unsigned long long)xNow.tv_nsec;
+}
+
+static void prvSetSocketOption(int fd, int level, int name, int value)
+{
+    (void)setsockopt(fd, level, name, &value, sizeof(value));
+}
+
+/* The latency-related subset of what NetIo applies to its sockets */
+static void prvApplySocketOptions(int fd, const PollySocketOptions_t *pxOpts)
+{
+    if (pxOpts->bTcpNoDelay)
+    {
+        prvSetSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+    }
+#if defined(TCP_QUICKACK)
+    if (pxOpts->bTcpQuickAck)
+    {
+        prvSetSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+    }
+#endif
+#if defined(SO_BUSY_POLL)
+    if (pxOpts->uBusyPollUs > 0)
+    {
+        prvSetSocketOption(fd, SOL_SOCKET, SO_BUSY_POLL, (int)pxOpts->uBusyPollUs);
+    }
+#endif
+}
+
+static int prvSendAll(int fd, const char *pBuf, size_t uLen)
+{
+    ssize_t n = 0;
+
+    while (uLen > 0 && (n = send(fd, pBuf, uLen, 0)) > 0)
+    {
+        pBuf += n;
+        uLen -= (size_t)n;
+    }
+
+    return (uLen == 0) ? 0 : -1;
+}
+
+static int prvRecvAll(int fd, char *pBuf, size_t uLen)
+{
+    ssize_t n = 0;
+
+    while (uLen > 0 && (n = recv(fd, pBuf, uLen, 0)) > 0)
+    {
+        pBuf += n;
+        uLen -= (size_t)n;
+    }
+
+    return (uLen == 0) ? 0 : -1;
+}
+
+/* The server writes with TCP_NODELAY like HTTPS endpoints do, so only the options of the client make a difference. */
+static void *prvServerThread(void *pArg)
+{
+    int fdListen = *(int *)pArg;
+    int fd = -1;
+    char pBuf[BENCH_RSP_BODY_LEN];
+
+    memset(pBuf, 'a', sizeof(pBuf));
+    while ((fd = accept(fdListen, NULL, NULL)) >= 0)
+    {
+        prvSetSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+        while (prvRecvAll(fd, pBuf, BENCH_REQ_HEADER_LEN + BENCH_REQ_BODY_LEN) == 0 &&
+               prvSendAll(fd, pBuf, BENCH_RSP_HEADER_LEN) == 0 &&
+               prvSendAll(fd, pBuf, BENCH_RSP_BODY_LEN) == 0)
+        {
+        }
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static int prvCompare(const void *pA, const void *pB)
+{
+    unsigned long long a = *(const unsigned long long *)pA;
+    unsigned long long b = *(const unsigned long long *)pB;
+
+    return (a > b) - (a < b);
+}
+
+static int prvBenchmark(const BenchCase_t *pxCase, const struct sockaddr_in *pxAddr)
+{
+    int res = 0;
+    int fd = -1;
+    char pBuf[BENCH_RSP_BODY_LEN];
+    unsigned long long puLatencyNs[BENCH_ITERATIONS];
+    unsigned long long uStartNs = 0;
+    size_t i = 0;
+
+    memset(pBuf, 'q', sizeof(pBuf));
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || connect(fd, (const struct sockaddr *)pxAddr, sizeof(*pxAddr)) != 0)
+    {
+        printf("Unable to connect\n");
+        res = -1;
+    }
+    else
+    {
+        prvApplySocketOptions(fd, &(pxCase->xOptions));
+        for (i = 0; i < BENCH_ITERATIONS && res == 0; i++)
+        {
+            uStartNs = prvGetTimeNs();
+            if (prvSendAll(fd, pBuf, BENCH_REQ_HEADER_LEN) != 0 ||
+                prvSendAll(fd, pBuf, BENCH_REQ_BODY_LEN) != 0 ||
+                prvRecvAll(fd, pBuf, BENCH_RSP_HEADER_LEN) != 0 ||
+                prvRecvAll(fd, pBuf, BENCH_RSP_BODY_LEN) != 0)
+            {
+                printf("Connection lost\n");
+                res = -1;
+            }
+            else
+            {
+                puLatencyNs[i] = prvGetTimeNs() - uStartNs;
+#if defined(TCP_QUICKACK)
+                /* Quick ACK mode is cleared by the kernel, and NetIo arms it again before every read too. */
+                if (pxCase->xOptions.bTcpQuickAck)
+                {
+                    prvSetSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+                }
+#endif
+            }
+        }
+    }
+
+    if (res == 0)
+    {
+        qsort(puLatencyNs, BENCH_ITERATIONS, sizeof(puLatencyNs[0]), prvCompare);
+        printf("%-24s p50 %9.1f us   p90 %9.1f us   max %9.1f us\n", pxCase->pName,
+               puLatencyNs[BENCH_ITERATIONS / 2] / 1000.0, puLatencyNs[BENCH_ITERATIONS * 9 / 10] / 1000.0, puLatencyNs[BENCH_ITERATIONS - 1] / 1000.0);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int fdListen = -1;
+    struct sockaddr_in xAddr;
+    socklen_t uAddrLen = sizeof(xAddr);
+    pthread_t xServer;
+    BenchCase_t pxCases[3];
+    size_t i = 0;
+
+    memset(pxCases, 0, sizeof(pxCases));
+    pxCases[0].pName = "OS defaults";
+    pxCases[1].pName = "TCP_NODELAY";
+    pxCases[1].xOptions.bTcpNoDelay = true;
+    pxCases[2].pName = "TCP_NODELAY + QUICKACK";
+    pxCases[2].xOptions.bTcpNoDelay = true;
+    pxCases[2].xOptions.bTcpQuickAck = true;
+
+    memset(&xAddr, 0, sizeof(xAddr));
+    xAddr.sin_family = AF_INET;
+    xAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((fdListen = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        bind(fdListen, (struct sockaddr *)&xAddr, sizeof(xAddr)) != 0 ||
+        listen(fdListen, 4) != 0 ||
+        getsockname(fdListen, (struct sockaddr *)&xAddr, &uAddrLen) != 0 ||
+        pthread_create(&xServer, NULL, prvServerThread, &fdListen) != 0)
+    {
+        printf("Unable to start the loopback server\n");
+        res = -1;
+    }
+    else
+    {
+        pthread_detach(xServer);
+        printf("Request latency on loopback, %d requests per case\n", BENCH_ITERATIONS);
+        for (i = 0; i < sizeof(pxCases) / sizeof(pxCases[0]) && res == 0; i++)
+        {
+            res = prvBenchmark(&(pxCases[i]), &xAddr);
+        }
+    }
+
+    return (res == 0) ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "polly/polly.h"
+
+#include "netio.h"
+
+#define DEFAULT_HOST            "polly.us-east-1.amazonaws.com"
+#define DEFAULT_HANDSHAKES      (20)
+#define MAX_HANDSHAKES          (1000)
+
+static unsigned long long prvGetTimeNs(clockid_t xClock)
+{
+    struct timespec xNow = {0};
+
+    clock_gettime(xClock, &xNow);
+
+    return (unsigned long long)xNow.tv_sec * 1000000000ULL + (unsigned long long)xNow.tv_nsec;
+}
+
+static int prvCompare(const void *pA, const void *pB)
+{
+    unsigned long long uA = *(const unsigned long long *)pA;
+    unsigned long long uB = *(const unsigned long long *)pB;
+
+    return (uA > uB) - (uA < uB);
+}
+
+static void prvPrintUsage(const char *pName)
+{
+    printf("Usage: %s [options]\n", pName);
+    printf("  -H <host>         Endpoint, default %s\n", DEFAULT_HOST);
+    printf("  -p <port>         Port, default %s\n", POLLY_DEFAULT_PORT);
+    printf("  -n <handshakes>   Handshakes to time, default %d\n", DEFAULT_HANDSHAKES);
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int iOpt = 0;
+    const char *pHost = DEFAULT_HOST;
+    const char *pPort = POLLY_DEFAULT_PORT;
+    const char *pCiphersuite = NULL;
+    unsigned int uHandshakes = DEFAULT_HANDSHAKES;
+    static unsigned long long puWallNs[MAX_HANDSHAKES];
+    unsigned long long uCpuNs = 0;
+    unsigned long long uStartNs = 0;
+    unsigned long long uStartCpuNs = 0;
+    NetIoHandle xNetIo = NULL;
+    unsigned int i = 0;
+
+    while (res == 0 && (iOpt = getopt(argc, argv, "H:p:n:h")) != -1)
+    {
+        switch (iOpt)
+        {
+            case 'H': pHost = optarg; break;
+            case 'p': pPort = optarg; break;
+            case 'n': uHandshakes = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default: res = -1; break;
+        }
+    }
+
+    if (res != 0 || uHandshakes == 0 || uHandshakes > MAX_HANDSHAKES)
+    {
+        prvPrintUsage(argv[0]);
+        res = -1;
+    }
+    else
+    {
+#if defined(MBEDTLS_CONFIG_FILE)
+        printf("mbedtls profile: minimal\n");
+#else
+        printf("mbedtls profile: default\n");
+#endif
+
+        for (i = 0; i < uHandshakes && res == 0; i++)
+        {
+            /* The wall time includes DNS and the round trips, the CPU time is what the profile changes. */
+            uStartNs = prvGetTimeNs(CLOCK_MONOTONIC);
+            uStartCpuNs = prvGetTimeNs(CLOCK_PROCESS_CPUTIME_ID);
+            if ((xNetIo = NetIo_create()) == NULL || NetIo_connect(xNetIo, pHost, pPort) != NETIO_ERRNO_NONE)
+            {
+                printf("Unable to connect to %s:%s\n", pHost, pPort);
+                res = -1;
+            }
+            else
+            {
+                puWallNs[i] = prvGetTimeNs(CLOCK_MONOTONIC) - uStartNs;
+                uCpuNs += prvGetTimeNs(CLOCK_PROCESS_CPUTIME_ID) - uStartCpuNs;
+                pCiphersuite = NetIo_getCiphersuite(xNetIo);
+                if (i == 0)
+                {
+                    printf("Ciphersuite: %s\n", (pCiphersuite != NULL) ? pCiphersuite : "unknown");
+                }
+                NetIo_disconnect(xNetIo);
+            }
+            NetIo_terminate(xNetIo);
+            xNetIo = NULL;
+        }
+
+        if (res == 0)
+        {
+            qsort(puWallNs, uHandshakes, sizeof(puWallNs[0]), prvCompare);
+            printf("%u handshakes with %s:%s\n", uHandshakes, pHost, pPort);
+            printf("  wall ms   min %8.2f  p50 %8.2f  p90 %8.2f  max %8.2f\n", puWallNs[0] / 1e6, puWallNs[uHandshakes / 2] / 1e6,
+                   puWallNs[uHandshakes * 9 / 10] / 1e6, puWallNs[uHandshakes - 1] / 1e6);
+            printf("  cpu ms    avg %8.2f\n", uCpuNs / 1e6 / uHandshakes);
+        }
+    }
+
+    return (res == 0) ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "mbedtls/certs.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+
+#include "mock_server.h"
+
+/* About 12 ms of 128 kbps MP3 per character, close to the speaking rate of the neural voices */
+#define MOCK_AUDIO_BYTES_PER_CHAR   (200)
+#define MOCK_AUDIO_CHUNK_LEN        (4096)
+#define MOCK_REQUEST_MAX_LEN        (16 * 1024)
+
+#define MOCK_THROTTLING_BODY        "{\"message\":\"Rate exceeded\"}"
+
+typedef struct MockServer
+{
+    mbedtls_net_context xListenFd;
+    pthread_t xAcceptThread;
+    volatile bool bStop;
+    unsigned int uLatencyMs;
+    unsigned int uErrorPercent;
+    bool bPlain;
+} MockServer_t;
+
+/* A connection keeps its own copy of the settings, because it may be served after the server is stopped. */
+typedef struct
+{
+    mbedtls_net_context xFd;
+    unsigned int uSeed;
+    unsigned int uLatencyMs;
+    unsigned int uErrorPercent;
+    bool bPlain;
+    mbedtls_ssl_context *pxSsl; // NULL over plain TCP
+} MockConn_t;
+
+static void prvSleepMs(unsigned int uMs)
+{
+    struct timespec xTime = { 0 };
+
+    xTime.tv_sec = uMs / 1000;
+    xTime.tv_nsec = (long)(uMs % 1000) * 1000000L;
+    nanosleep(&xTime, NULL);
+}
+
+static int prvRead(MockConn_t *pxConn, unsigned char *pBuf, size_t uLen)
+{
+    return (pxConn->pxSsl != NULL) ? mbedtls_ssl_read(pxConn->pxSsl, pBuf, uLen) : mbedtls_net_recv(&(pxConn->xFd), pBuf, uLen);
+}
+
+static int prvWrite(MockConn_t *pxConn, const unsigned char *pBuf, size_t uLen)
+{
+    return (pxConn->pxSsl != NULL) ? mbedtls_ssl_write(pxConn->pxSsl, pBuf, uLen) : mbedtls_net_send(&(pxConn->xFd), pBuf, uLen);
+}
+
+static int prvWriteAll(MockConn_t *pxConn, const unsigned char *pBuf, size_t uLen)
+{
+    int n = 0;
+
+    while (uLen > 0 && (n = prvWrite(pxConn, pBuf, uLen)) > 0)
+    {
+        pBuf += n;
+        uLen -= (size_t)n;
+    }
+
+    return (uLen == 0) ? 0 : -1;
+}
+
+/* Read one request, and return the length of its text, or -1 if the connection is closed */
+static int prvReadRequest(MockConn_t *pxConn, char *pBuf, size_t uBufSize)
+{
+    int iTextLen = -1;
+    size_t uLen = 0;
+    size_t uHeadLen = 0;
+    size_t uBodyLen = 0;
+    char *pHeadEnd = NULL;
+    char *pField = NULL;
+    char *pText = NULL;
+    int n = 0;
+    size_t i = 0;
+
+    /* The client writes one request at a time, so there is never more than one in the buffer. */
+    while (pHeadEnd == NULL || uLen < uHeadLen + uBodyLen)
+    {
+        if (uLen >= uBufSize - 1 || (n = prvRead(pxConn, (unsigned char *)pBuf + uLen, uBufSize - 1 - uLen)) <= 0)
+        {
+            return -1;
+        }
+        uLen += (size_t)n;
+        pBuf[uLen] = '\0';
+
+        if (pHeadEnd == NULL && (pHeadEnd = strstr(pBuf, "\r\n\r\n")) != NULL)
+        {
+            uHeadLen = (size_t)(pHeadEnd - pBuf) + 4;
+            for (i = 0; i < uHeadLen; i++)
+            {
+                pBuf[i] = (char)tolower((unsigned char)pBuf[i]);
+            }
+            if ((pField = strstr(pBuf, "content-length:")) != NULL && pField < pHeadEnd)
+            {
+                uBodyLen = (size_t)strtoul(pField + sizeof("content-length:") - 1, NULL, 10);
+            }
+        }
+    }
+
+    if ((pText = strstr(pBuf + uHeadLen, "\"Text\": \"")) != NULL)
+    {
+        pText += sizeof("\"Text\": \"") - 1;
+        for (iTextLen = 0; pText[iTextLen] != '\0' && !(pText[iTextLen] == '"' && (iTextLen == 0 || pText[iTextLen - 1] != '\\')); iTextLen++)
+        {
+        }
+    }
+    else
+    {
+        iTextLen = 0;
+    }
+
+    return iTextLen;
+}
+
+static int prvWriteResponse(MockConn_t *pxConn, int iTextLen, bool bThrottle)
+{
+    int res = 0;
+    char pHead[256];
+    unsigned char pChunk[MOCK_AUDIO_CHUNK_LEN + 16];
+    size_t uAudioLen = (size_t)iTextLen * MOCK_AUDIO_BYTES_PER_CHAR;
+    size_t uChunkLen = 0;
+    int iLen = 0;
+
+    if (bThrottle)
+    {
+        iLen = snprintf(pHead, sizeof(pHead), "HTTP/1.1 429 Too Many Requests\r\nx-amzn-ErrorType: ThrottlingException:\r\n"
+                        "Content-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s", sizeof(MOCK_THROTTLING_BODY) - 1, MOCK_THROTTLING_BODY);
+        res = prvWriteAll(pxConn, (const unsigned char *)pHead, (size_t)iLen);
+    }
+    else
+    {
+        iLen = snprintf(pHead, sizeof(pHead), "HTTP/1.1 200 OK\r\nContent-Type: audio/mpeg\r\nTransfer-Encoding: chunked\r\n\r\n");
+        res = prvWriteAll(pxConn, (const unsigned char *)pHead, (size_t)iLen);
+
+        while (res == 0 && uAudioLen > 0)
+        {
+            uChunkLen = (uAudioLen < MOCK_AUDIO_CHUNK_LEN) ? uAudioLen : MOCK_AUDIO_CHUNK_LEN;
+            iLen = snprintf((char *)pChunk, sizeof(pChunk), "%zx\r\n", uChunkLen);
+            memset(pChunk + iLen, 0, uChunkLen);
+            memcpy(pChunk + iLen + uChunkLen, "\r\n", 2);
+            res = prvWriteAll(pxConn, pChunk, (size_t)iLen + uChunkLen + 2);
+            uAudioLen -= uChunkLen;
+        }
+
+        if (res == 0)
+        {
+            res = prvWriteAll(pxConn, (const unsigned char *)"0\r\n\r\n", 5);
+        }
+    }
+
+    return res;
+}
+
+/* Serve requests until the client closes the connection */
+static void prvServe(MockConn_t *pxConn, char *pBuf)
+{
+    int iTextLen = 0;
+
+    while ((iTextLen = prvReadRequest(pxConn, pBuf, MOCK_REQUEST_MAX_LEN)) >= 0)
+    {
+        prvSleepMs(pxConn->uLatencyMs);
+        if (prvWriteResponse(pxConn, iTextLen, (unsigned int)(rand_r(&(pxConn->uSeed)) % 100) < pxConn->uErrorPercent) != 0)
+        {
+            break;
+        }
+    }
+}
+
+/* Every connection has its own TLS state, key included, because mbedtls is not built thread-safe. */
+static void *prvConnThread(void *pArg)
+{
+    MockConn_t *pxConn = (MockConn_t *)pArg;
+    mbedtls_entropy_context xEntropy;
+    mbedtls_ctr_drbg_context xCtrDrbg;
+    mbedtls_ssl_config xConf;
+    mbedtls_ssl_context xSsl;
+    mbedtls_x509_crt xCert;
+    mbedtls_pk_context xKey;
+    char *pBuf = NULL;
+
+    mbedtls_entropy_init(&xEntropy);
+    mbedtls_ctr_drbg_init(&xCtrDrbg);
+    mbedtls_ssl_config_init(&xConf);
+    mbedtls_ssl_init(&xSsl);
+    mbedtls_x509_crt_init(&xCert);
+    mbedtls_pk_init(&xKey);
+
+    if ((pBuf = (char *)malloc(MOCK_REQUEST_MAX_LEN)) == NULL)
+    {
+        printf("Mock server: out of memory\n");
+    }
+    else if (pxConn->bPlain)
+    {
+        prvServe(pxConn, pBuf);
+    }
+    else if (mbedtls_ctr_drbg_seed(&xCtrDrbg, mbedtls_entropy_func, &xEntropy, NULL, 0) != 0 ||
+        mbedtls_x509_crt_parse(&xCert, (const unsigned char *)mbedtls_test_srv_crt, mbedtls_test_srv_crt_len) != 0 ||
+        mbedtls_pk_parse_key(&xKey, (const unsigned char *)mbedtls_test_srv_key, mbedtls_test_srv_key_len, NULL, 0) != 0 ||
+        mbedtls_ssl_config_defaults(&xConf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+    {
+        printf("Mock server: unable to set up TLS\n");
+    }
+    else
+    {
+        mbedtls_ssl_conf_rng(&xConf, mbedtls_ctr_drbg_random, &xCtrDrbg);
+        if (mbedtls_ssl_conf_own_cert(&xConf, &xCert, &xKey) == 0 && mbedtls_ssl_setup(&xSsl, &xConf) == 0)
+        {
+            mbedtls_ssl_set_bio(&xSsl, &(pxConn->xFd), mbedtls_net_send, mbedtls_net_recv, NULL);
+            if (mbedtls_ssl_handshake(&xSsl) == 0)
+            {
+                pxConn->pxSsl = &xSsl;
+                prvServe(pxConn, pBuf);
+                mbedtls_ssl_close_notify(&xSsl);
+            }
+        }
+    }
+
+    mbedtls_ssl_free(&xSsl);
+    mbedtls_ssl_config_free(&xConf);
+    mbedtls_pk_free(&xKey);
+    mbedtls_x509_crt_free(&xCert);
+    mbedtls_ctr_drbg_free(&xCtrDrbg);
+    mbedtls_entropy_free(&xEntropy);
+    mbedtls_net_free(&(pxConn->xFd));
+    free(pBuf);
+    free(pxConn);
+
+    return NULL;
+}
+
+static void *prvAcceptThread(void *pArg)
+{
+    MockServer_t *pxMockServer = (MockServer_t *)pArg;
+    MockConn_t *pxConn = NULL;
+    pthread_t xThread;
+    unsigned int uSeed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)pxMockServer;
+
+    while (!pxMockServer->bStop)
+    {
+        if ((pxConn = (MockConn_t *)malloc(sizeof(MockConn_t))) == NULL)
+        {
+            break;
+        }
+
+        mbedtls_net_init(&(pxConn->xFd));
+        pxConn->uSeed = rand_r(&uSeed);
+        pxConn->uLatencyMs = pxMockServer->uLatencyMs;
+        pxConn->uErrorPercent = pxMockServer->uErrorPercent;
+        pxConn->bPlain = pxMockServer->bPlain;
+        pxConn->pxSsl = NULL;
+        if (mbedtls_net_accept(&(pxMockServer->xListenFd), &(pxConn->xFd), NULL, 0, NULL) != 0 || pxMockServer->bStop)
+        {
+            mbedtls_net_free(&(pxConn->xFd));
+            free(pxConn);
+        }
+        else if (pthread_create(&xThread, NULL, prvConnThread, pxConn) != 0)
+        {
+            mbedtls_net_free(&(pxConn->xFd));
+            free(pxConn);
+        }
+        else
+        {
+            pthread_detach(xThread);
+        }
+    }
+
+    return NULL;
+}
+
+MockServerHandle MockServer_start(const char *pPort, unsigned int uLatencyMs, unsigned int uErrorPercent, bool bPlain)
+{
+    MockServer_t *pxMockServer = NULL;
+
+    if ((pxMockServer = (MockServer_t *)calloc(1, sizeof(MockServer_t))) != NULL)
+    {
+        pxMockServer->uLatencyMs = uLatencyMs;
+        pxMockServer->uErrorPercent = uErrorPercent;
+        pxMockServer->bPlain = bPlain;
+
+        mbedtls_net_init(&(pxMockServer->xListenFd));
+        if (mbedtls_net_bind(&(pxMockServer->xListenFd), "127.0.0.1", pPort, MBEDTLS_NET_PROTO_TCP) != 0)
+        {
+            printf("Mock server: unable to listen on port %s\n", pPort);
+            mbedtls_net_free(&(pxMockServer->xListenFd));
+            free(pxMockServer);
+            pxMockServer = NULL;
+        }
+        else if (pthread_create(&(pxMockServer->xAcceptThread), NULL, prvAcceptThread, pxMockServer) != 0)
+        {
+            mbedtls_net_free(&(pxMockServer->xListenFd));
+            free(pxMockServer);
+            pxMockServer = NULL;
+        }
+    }
+
+    return pxMockServer;
+}
+
+void MockServer_stop(MockServerHandle xMockServer)
+{
+    MockServer_t *pxMockServer = (MockServer_t *)xMockServer;
+
+    if (pxMockServer != NULL)
+    {
+        pxMockServer->bStop = true;
+
+        /* Closing the socket wakes up the accept */
+        shutdown(pxMockServer->xListenFd.fd, SHUT_RDWR);
+        pthread_join(pxMockServer->xAcceptThread, NULL);
+        mbedtls_net_free(&(pxMockServer->xListenFd));
+        free(pxMockServer);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef MOCK_SERVER_H
+#define MOCK_SERVER_H
+
+#include <stdbool.h>
+
+typedef struct MockServer *MockServerHandle;
+
+/**
+ * @brief Start a local stand-in of the Polly /v1/speech endpoint. It speaks HTTPS with the test certificate of mbedtls, or plain
+ * HTTP, and answers every request with chunked audio whose length grows with the text. Signatures are not checked.
+ *
+ * @param[in] pPort The port to listen on 127.0.0.1
+ * @param[in] uLatencyMs How long the server "synthesizes" before the response headers are sent
+ * @param[in] uErrorPercent The percentage of requests answered with 429 ThrottlingException
+ * @param[in] bPlain Serve plain HTTP, for the clients which use PollyTransport_getPlain()
+ * @return The mock server handle, or NULL if it can't listen
+ */
+MockServerHandle MockServer_start(const char *pPort, unsigned int uLatencyMs, unsigned int uErrorPercent, bool bPlain);
+
+/**
+ * @brief Stop accepting connections. Connections which are open are served until the client closes them.
+ *
+ * @param[in] xMockServer The mock server handle
+ */
+void MockServer_stop(MockServerHandle xMockServer);
+
+#endif /* MOCK_SERVER_H */
@@ -0,0 +1,717 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "polly/polly.h"
+
+#include "mock_server.h"
+
+#define DEFAULT_AWS_ACCESS_KEY          "xxxxxxxxxxxxxxxxxxxx"
+#define DEFAULT_AWS_SECRET_KEY          "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+#define DEFAULT_AWS_REGION              "us-east-1"
+
+#define AWS_ACCESS_KEY_ENV_VAR          "AWS_ACCESS_KEY_ID"
+#define AWS_SECRET_KEY_ENV_VAR          "AWS_SECRET_ACCESS_KEY"
+#define AWS_SESSION_TOKEN_ENV_VAR       "AWS_SESSION_TOKEN"
+#define AWS_DEFAULT_REGION_ENV_VAR      "AWS_DEFAULT_REGION"
+
+#define MAX_HOST_NAME_LEN               128
+#define MAX_LIST_ITEMS                  16
+#define MAX_TEXT_LEN                    3000
+#define MAX_ERROR_CODES                 32
+
+#define DEFAULT_MOCK_PORT               "8443"
+
+/* A request which starts this late was held back by busy workers, and its latency includes the wait. */
+#define LATE_START_NS                   (10 * 1000 * 1000ULL)
+
+/* Latencies are kept in log-linear buckets in microseconds: exact below 32, then 32 buckets per power of two, about 3% wide. */
+#define HISTOGRAM_SUB_BUCKETS           32
+#define HISTOGRAM_GROUPS                36
+#define HISTOGRAM_BUCKETS               (HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_GROUPS + 1))
+
+static const char *gpWords = "the quick brown fox jumps over the lazy dog while a gentle voice reads the news of the day aloud ";
+
+typedef struct
+{
+    unsigned long long puCounts[HISTOGRAM_BUCKETS];
+    unsigned long long uTotal;
+    unsigned long long uMaxUs;
+} Histogram_t;
+
+typedef struct
+{
+    size_t uTextLens[MAX_LIST_ITEMS];
+    unsigned int uWeights[MAX_LIST_ITEMS];
+    unsigned int uTotalWeight;
+    size_t uTextLenCount;
+    char *ppVoices[MAX_LIST_ITEMS];
+    size_t uVoiceCount;
+    char *ppFormats[MAX_LIST_ITEMS];
+    size_t uFormatCount;
+
+    unsigned int uQps;
+    unsigned int uDurationSec;
+    unsigned int uConcurrency;
+    unsigned int uPoolConnections;
+    unsigned int uTimeoutMs;
+    unsigned int uBulkPercent;
+    unsigned int uConcurrencyLimit;
+    unsigned int uReserved;
+    bool bMock;
+    const char *pPort;
+    unsigned int uMockLatencyMs;
+    unsigned int uMockErrorPercent;
+    const char *pHost;
+    bool bPlain;
+    const char *pRecordFile;
+    const char *pReplayFile;
+
+    /* Stand-in endpoints behind an endpoint router, each with its own latency and error rate */
+    unsigned int puRouteLatencyMs[MAX_LIST_ITEMS];
+    unsigned int puRouteErrorPercent[MAX_LIST_ITEMS];
+    size_t uRouteCount;
+} LoadGenOptions_t;
+
+typedef struct
+{
+    LoadGenOptions_t *pxOpts;
+    PollyServiceParameter_t *pServPara;
+    unsigned long long uStartNs;
+    unsigned long long uTotalRequests;
+
+    pthread_mutex_t xLock;
+    unsigned long long uNextRequest;
+    Histogram_t xLatency; // From the scheduled start to the last byte, so a request delayed by busy workers is not hidden
+    Histogram_t xTtfb; // From the scheduled start to the first byte
+    Histogram_t xServiceTime; // From the actual start to the last byte
+    Histogram_t pxClassLatency[2]; // Latency by PollyPriority_t
+    unsigned long long uSucceeded;
+    unsigned long long uLateStarts;
+    unsigned long long uAudioBytes;
+    unsigned long long puErrors[MAX_ERROR_CODES];
+    unsigned long long uThrottled;
+    unsigned long long uLastDoneNs;
+} LoadGen_t;
+
+typedef struct
+{
+    unsigned long long uFirstByteNs;
+    size_t uBytes;
+} RequestCtx_t;
+
+static char pPollyHostName[MAX_HOST_NAME_LEN] = {0};
+
+static unsigned long long prvGetTimeNs(void)
+{
+    struct timespec xNow = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (unsigned long long)xNow.tv_sec * 1000000000ULL + (unsigned long long)xNow.tv_nsec;
+}
+
+static void prvSleepUntilNs(unsigned long long uDeadlineNs)
+{
+    unsigned long long uNowNs = prvGetTimeNs();
+    struct timespec xTime = { 0 };
+
+    if (uDeadlineNs > uNowNs)
+    {
+        xTime.tv_sec = (time_t)((uDeadlineNs - uNowNs) / 1000000000ULL);
+        xTime.tv_nsec = (long)((uDeadlineNs - uNowNs) % 1000000000ULL);
+        nanosleep(&xTime, NULL);
+    }
+}
+
+static size_t prvGetBucket(unsigned long long uValueUs)
+{
+    size_t uGroup = 0;
+
+    while ((uValueUs >> uGroup) >= 2 * HISTOGRAM_SUB_BUCKETS && uGroup < HISTOGRAM_GROUPS - 1)
+    {
+        uGroup++;
+    }
+
+    /* Group g > 0 covers [32 << (g - 1), 32 << g) with a step of 1 << (g - 1), so it's the values above 32 after the shift. */
+    return (uValueUs < HISTOGRAM_SUB_BUCKETS) ? (size_t)uValueUs :
+           (uGroup + 1) * HISTOGRAM_SUB_BUCKETS + (size_t)((uValueUs >> uGroup) - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS;
+}
+
+static unsigned long long prvGetBucketUpperUs(size_t uBucket)
+{
+    size_t uGroup = uBucket / HISTOGRAM_SUB_BUCKETS;
+    unsigned long long uSub = uBucket % HISTOGRAM_SUB_BUCKETS;
+
+    return (uGroup == 0) ? uSub : (((HISTOGRAM_SUB_BUCKETS + uSub + 1) << (uGroup - 1)) - 1);
+}
+
+static void prvRecord(Histogram_t *pxHistogram, unsigned long long uValueNs)
+{
+    unsigned long long uValueUs = uValueNs / 1000;
+
+    pxHistogram->puCounts[prvGetBucket(uValueUs)]++;
+    pxHistogram->uTotal++;
+    if (uValueUs > pxHistogram->uMaxUs)
+    {
+        pxHistogram->uMaxUs = uValueUs;
+    }
+}
+
+static double prvGetPercentileMs(Histogram_t *pxHistogram, double fPercentile)
+{
+    unsigned long long uRank = (unsigned long long)(pxHistogram->uTotal * fPercentile / 100.0);
+    unsigned long long uCount = 0;
+    unsigned long long uValueUs = 0;
+    size_t i = 0;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS && pxHistogram->uTotal > 0; i++)
+    {
+        uCount += pxHistogram->puCounts[i];
+        if (uCount > uRank || uCount == pxHistogram->uTotal)
+        {
+            uValueUs = prvGetBucketUpperUs(i);
+            break;
+        }
+    }
+
+    return ((uValueUs < pxHistogram->uMaxUs) ? uValueUs : pxHistogram->uMaxUs) / 1000.0;
+}
+
+static void prvPrintHistogram(const char *pName, Histogram_t *pxHistogram)
+{
+    printf("%-14s %9.2f %9.2f %9.2f %9.2f %9.2f\n", pName,
+           prvGetPercentileMs(pxHistogram, 50), prvGetPercentileMs(pxHistogram, 90), prvGetPercentileMs(pxHistogram, 99),
+           prvGetPercentileMs(pxHistogram, 99.9), pxHistogram->uMaxUs / 1000.0);
+}
+
+/* Split a comma separated list in place */
+static size_t prvSplitList(char *pList, char **ppItems, size_t uMaxItems)
+{
+    size_t uCount = 0;
+    char *pItem = strtok(pList, ",");
+
+    while (pItem != NULL && uCount < uMaxItems)
+    {
+        ppItems[uCount++] = pItem;
+        pItem = strtok(NULL, ",");
+    }
+
+    return uCount;
+}
+
+/* Text lengths with optional weights, ex: "20:70,100:25,400:5" */
+static int prvParseTextLens(char *pList, LoadGenOptions_t *pxOpts)
+{
+    int res = 0;
+    char *ppItems[MAX_LIST_ITEMS];
+    char *pWeight = NULL;
+    size_t i = 0;
+
+    pxOpts->uTextLenCount = prvSplitList(pList, ppItems, MAX_LIST_ITEMS);
+    pxOpts->uTotalWeight = 0;
+    for (i = 0; i < pxOpts->uTextLenCount && res == 0; i++)
+    {
+        pxOpts->uTextLens[i] = (size_t)strtoul(ppItems[i], &pWeight, 10);
+        pxOpts->uWeights[i] = (*pWeight == ':') ? (unsigned int)strtoul(pWeight + 1, NULL, 10) : 1;
+        pxOpts->uTotalWeight += pxOpts->uWeights[i];
+        if (pxOpts->uTextLens[i] == 0 || pxOpts->uTextLens[i] > MAX_TEXT_LEN)
+        {
+            printf("Text lengths must be 1 to %d\n", MAX_TEXT_LEN);
+            res = -1;
+        }
+    }
+
+    return (res == 0 && pxOpts->uTotalWeight > 0) ? 0 : -1;
+}
+
+/* Latencies of stand-in endpoints with optional error percentages, ex: "20,60:10,150" */
+static int prvParseRoutes(char *pList, LoadGenOptions_t *pxOpts)
+{
+    char *ppItems[MAX_LIST_ITEMS];
+    char *pErrorPercent = NULL;
+    size_t i = 0;
+
+    pxOpts->uRouteCount = prvSplitList(pList, ppItems, MAX_LIST_ITEMS);
+    for (i = 0; i < pxOpts->uRouteCount; i++)
+    {
+        pxOpts->puRouteLatencyMs[i] = (unsigned int)strtoul(ppItems[i], &pErrorPercent, 10);
+        pxOpts->puRouteErrorPercent[i] = (*pErrorPercent == ':') ? (unsigned int)strtoul(pErrorPercent + 1, NULL, 10) : 0;
+    }
+
+    return (pxOpts->uRouteCount > 0) ? 0 : -1;
+}
+
+static void prvGenText(char *pText, size_t uLen)
+{
+    size_t uWordsLen = strlen(gpWords);
+    size_t i = 0;
+
+    for (i = 0; i < uLen; i++)
+    {
+        pText[i] = gpWords[i % uWordsLen];
+    }
+    pText[uLen] = '\0';
+}
+
+static int prvOnData(uint8_t *pData, size_t uLen, void *pUserData)
+{
+    RequestCtx_t *pxCtx = (RequestCtx_t *)pUserData;
+
+    if (pxCtx->uFirstByteNs == 0)
+    {
+        pxCtx->uFirstByteNs = prvGetTimeNs();
+    }
+    pxCtx->uBytes += uLen;
+
+    return 0;
+}
+
+static void *prvWorker(void *pArg)
+{
+    LoadGen_t *pxLoadGen = (LoadGen_t *)pArg;
+    LoadGenOptions_t *pxOpts = pxLoadGen->pxOpts;
+    PollySynthesizeSpeechParameter_t xPara;
+    PollySynthesizeSpeechOutput_t xOut;
+    RequestCtx_t xCtx;
+    char pText[MAX_TEXT_LEN + 1];
+    unsigned int uSeed = (unsigned int)(uintptr_t)&xPara;
+    unsigned long long uRequest = 0;
+    unsigned long long uScheduledNs = 0;
+    unsigned long long uStartedNs = 0;
+    unsigned long long uDoneNs = 0;
+    unsigned int uPick = 0;
+    PollyPriority_t ePriority = POLLY_PRIORITY_INTERACTIVE;
+    size_t i = 0;
+    int res = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&(pxLoadGen->xLock));
+        uRequest = pxLoadGen->uNextRequest++;
+        pthread_mutex_unlock(&(pxLoadGen->xLock));
+        if (uRequest >= pxLoadGen->uTotalRequests)
+        {
+            break;
+        }
+
+        /* Open loop: every request has its start time from the target rate, whether or not the previous ones are done. */
+        uScheduledNs = pxLoadGen->uStartNs + uRequest * 1000000000ULL / pxOpts->uQps;
+        prvSleepUntilNs(uScheduledNs);
+
+        uPick = (unsigned int)rand_r(&uSeed) % pxOpts->uTotalWeight;
+        for (i = 0; i < pxOpts->uTextLenCount - 1 && uPick >= pxOpts->uWeights[i]; i++)
+        {
+            uPick -= pxOpts->uWeights[i];
+        }
+        prvGenText(pText, pxOpts->uTextLens[i]);
+
+        memset(&xPara, 0, sizeof(xPara));
+        xPara.pText = pText;
+        xPara.pVoiceId = pxOpts->ppVoices[(unsigned int)rand_r(&uSeed) % pxOpts->uVoiceCount];
+        xPara.pOutputFormat = pxOpts->ppFormats[(unsigned int)rand_r(&uSeed) % pxOpts->uFormatCount];
+        xPara.uTimeoutMs = pxOpts->uTimeoutMs;
+        ePriority = ((unsigned int)rand_r(&uSeed) % 100 < pxOpts->uBulkPercent) ? POLLY_PRIORITY_BULK : POLLY_PRIORITY_INTERACTIVE;
+        xPara.ePriority = ePriority;
+
+        memset(&xCtx, 0, sizeof(xCtx));
+        memset(&xOut, 0, sizeof(xOut));
+        xOut.onDataCallback = prvOnData;
+        xOut.pUserData = &xCtx;
+
+        uStartedNs = prvGetTimeNs();
+        res = Polly_synthesizeSpeech(pxLoadGen->pServPara, &xPara, &xOut);
+        uDoneNs = prvGetTimeNs();
+
+        pthread_mutex_lock(&(pxLoadGen->xLock));
+        if (res == POLLY_ERRNO_NONE)
+        {
+            pxLoadGen->uSucceeded++;
+            prvRecord(&(pxLoadGen->xLatency), uDoneNs - uScheduledNs);
+            prvRecord(&(pxLoadGen->pxClassLatency[ePriority]), uDoneNs - uScheduledNs);
+            prvRecord(&(pxLoadGen->xServiceTime), uDoneNs - uStartedNs);
+            if (xCtx.uFirstByteNs != 0)
+            {
+                prvRecord(&(pxLoadGen->xTtfb), xCtx.uFirstByteNs - uScheduledNs);
+            }
+        }
+        else
+        {
+            pxLoadGen->puErrors[(-res < MAX_ERROR_CODES) ? -res : MAX_ERROR_CODES - 1]++;
+            if (xOut.uStatusCode == 429 || strstr(xOut.pErrorType, "Throttl") != NULL)
+            {
+                pxLoadGen->uThrottled++;
+            }
+        }
+        if (uStartedNs - uScheduledNs > LATE_START_NS)
+        {
+            pxLoadGen->uLateStarts++;
+        }
+        pxLoadGen->uAudioBytes += xCtx.uBytes;
+        if (uDoneNs > pxLoadGen->uLastDoneNs)
+        {
+            pxLoadGen->uLastDoneNs = uDoneNs;
+        }
+        pthread_mutex_unlock(&(pxLoadGen->xLock));
+    }
+
+    return NULL;
+}
+
+static void prvPrintReport(LoadGen_t *pxLoadGen)
+{
+    unsigned long long uFailed = pxLoadGen->uTotalRequests - pxLoadGen->uSucceeded;
+    double fElapsedSec = (pxLoadGen->uLastDoneNs - pxLoadGen->uStartNs) / 1e9;
+    size_t i = 0;
+
+    printf("\nRequests: %llu, succeeded %llu, failed %llu (%.2f%%), throttled %llu\n", pxLoadGen->uTotalRequests, pxLoadGen->uSucceeded,
+           uFailed, 100.0 * uFailed / pxLoadGen->uTotalRequests, pxLoadGen->uThrottled);
+    printf("Throughput: %.1f req/s (target %u), %.2f MB/s of audio\n", pxLoadGen->uTotalRequests / fElapsedSec, pxLoadGen->pxOpts->uQps,
+           pxLoadGen->uAudioBytes / fElapsedSec / 1e6);
+    if (pxLoadGen->uLateStarts > 0)
+    {
+        printf("Late starts: %llu requests waited for a free worker, raise the concurrency (-c)\n", pxLoadGen->uLateStarts);
+    }
+
+    printf("\n%-14s %9s %9s %9s %9s %9s   (ms)\n", "", "p50", "p90", "p99", "p99.9", "max");
+    prvPrintHistogram("latency", &(pxLoadGen->xLatency));
+    prvPrintHistogram("ttfb", &(pxLoadGen->xTtfb));
+    prvPrintHistogram("service time", &(pxLoadGen->xServiceTime));
+    if (pxLoadGen->pxOpts->uBulkPercent > 0)
+    {
+        prvPrintHistogram("interactive", &(pxLoadGen->pxClassLatency[POLLY_PRIORITY_INTERACTIVE]));
+        prvPrintHistogram("bulk", &(pxLoadGen->pxClassLatency[POLLY_PRIORITY_BULK]));
+    }
+
+    for (i = 1; i < MAX_ERROR_CODES; i++)
+    {
+        if (pxLoadGen->puErrors[i] > 0)
+        {
+            printf("Error %d: %llu\n", -(int)i, pxLoadGen->puErrors[i]);
+        }
+    }
+}
+
+static void prvPrintRoutes(PollyEndpointRouterHandle xEndpointRouter, LoadGenOptions_t *pxOpts)
+{
+    static const char *ppStates[] = { "healthy", "open", "half-open" };
+    PollyEndpointStats_t xStats;
+    size_t i = 0;
+
+    printf("\n%-10s %9s %9s %12s %12s %10s\n", "endpoint", "latency", "errors", "requests", "avg ttfb", "state");
+    for (i = 0; i < pxOpts->uRouteCount; i++)
+    {
+        if (PollyEndpointRouter_getStats(xEndpointRouter, (unsigned int)i, &xStats) == POLLY_ERRNO_NONE)
+        {
+            printf("%-10zu %6u ms %8u%% %12llu %9u ms %10s\n", i, pxOpts->puRouteLatencyMs[i], pxOpts->puRouteErrorPercent[i],
+                   (unsigned long long)xStats.uRequests, xStats.uLatencyMs, ppStates[xStats.eState]);
+        }
+    }
+}
+
+static void prvPrintUsage(const char *pName)
+{
+    printf("Usage: %s [options]\n", pName);
+    printf("  -q <qps>          Target requests per second, default 10\n");
+    printf("  -d <seconds>      Duration, default 10\n");
+    printf("  -c <workers>      Concurrent requests at most, default 16\n");
+    printf("  -t <lens>         Text lengths with optional weights, ex: 20:70,100:25,400:5, default 50\n");
+    printf("  -v <voices>       Voices, ex: Joanna,Matthew, default Joanna\n");
+    printf("  -f <formats>      Output formats, ex: mp3,pcm, default mp3\n");
+    printf("  -P <connections>  Keep connections alive in a pool of this size, default 0\n");
+    printf("  -T <ms>           Deadline of every request, default none\n");
+    printf("  -B <percent>      Requests sent as bulk, the others as interactive, default 0\n");
+    printf("  -L <requests>     Limit the requests in flight by a rate limiter, default no limit\n");
+    printf("  -r <reserved>     Slots of -L and connections of -P reserved for interactive requests, default 0\n");
+    printf("  -H <host>         Endpoint, default polly.<region>.amazonaws.com\n");
+    printf("  -p <port>         Port, default 443, or %s with -m\n", DEFAULT_MOCK_PORT);
+    printf("  -m                Start a local stand-in server and send the requests to it\n");
+    printf("  -l <ms>           Latency of the stand-in server, default 20\n");
+    printf("  -e <percent>      Requests throttled by the stand-in server, default 0\n");
+    printf("  -R <endpoints>    With -m, route over several stand-in servers on consecutive ports, given their latencies\n");
+    printf("                    and optional error percentages, ex: 20,60:10,150\n");
+    printf("  -x                Plain HTTP without TLS, to the stand-in server or another local server\n");
+    printf("  -W <file>         Record what the servers send to a file\n");
+    printf("  -Y <file>         Play back a recording of -W instead of connecting to a server\n");
+}
+
+static int prvParseOptions(int argc, char *argv[], LoadGenOptions_t *pxOpts)
+{
+    int res = 0;
+    int iOpt = 0;
+    static char pTextLens[] = "50";
+    static char pVoices[] = "Joanna";
+    static char pFormats[] = "mp3";
+    char *pTextLensArg = pTextLens;
+    char *pVoicesArg = pVoices;
+    char *pFormatsArg = pFormats;
+    char *pRoutesArg = NULL;
+
+    memset(pxOpts, 0, sizeof(LoadGenOptions_t));
+    pxOpts->uQps = 10;
+    pxOpts->uDurationSec = 10;
+    pxOpts->uConcurrency = 16;
+    pxOpts->uMockLatencyMs = 20;
+
+    while (res == 0 && (iOpt = getopt(argc, argv, "q:d:c:t:v:f:P:T:B:L:r:H:p:ml:e:R:xW:Y:h")) != -1)
+    {
+        switch (iOpt)
+        {
+            case 'q': pxOpts->uQps = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'd': pxOpts->uDurationSec = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'c': pxOpts->uConcurrency = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 't': pTextLensArg = optarg; break;
+            case 'v': pVoicesArg = optarg; break;
+            case 'f': pFormatsArg = optarg; break;
+            case 'P': pxOpts->uPoolConnections = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'T': pxOpts->uTimeoutMs = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'B': pxOpts->uBulkPercent = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'L': pxOpts->uConcurrencyLimit = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'r': pxOpts->uReserved = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'H': pxOpts->pHost = optarg; break;
+            case 'p': pxOpts->pPort = optarg; break;
+            case 'm': pxOpts->bMock = true; break;
+            case 'l': pxOpts->uMockLatencyMs = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'e': pxOpts->uMockErrorPercent = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'R': pRoutesArg = optarg; break;
+            case 'x': pxOpts->bPlain = true; break;
+            case 'W': pxOpts->pRecordFile = optarg; break;
+            case 'Y': pxOpts->pReplayFile = optarg; break;
+            default: res = -1; break;
+        }
+    }
+
+    if (res != 0 || pxOpts->uQps == 0 || pxOpts->uDurationSec == 0 || pxOpts->uConcurrency == 0 || pxOpts->uBulkPercent > 100 ||
+        (pxOpts->pReplayFile != NULL && (pxOpts->bMock || pxOpts->pRecordFile != NULL)))
+    {
+        res = -1;
+    }
+    else if (prvParseTextLens(pTextLensArg, pxOpts) != 0 ||
+             (pxOpts->uVoiceCount = prvSplitList(pVoicesArg, pxOpts->ppVoices, MAX_LIST_ITEMS)) == 0 ||
+             (pxOpts->uFormatCount = prvSplitList(pFormatsArg, pxOpts->ppFormats, MAX_LIST_ITEMS)) == 0 ||
+             (pRoutesArg != NULL && (!pxOpts->bMock || prvParseRoutes(pRoutesArg, pxOpts) != 0)))
+    {
+        res = -1;
+    }
+    else if (pxOpts->bMock)
+    {
+        pxOpts->pHost = "localhost";
+        pxOpts->pPort = (pxOpts->pPort != NULL) ? pxOpts->pPort : DEFAULT_MOCK_PORT;
+    }
+
+    return res;
+}
+
+static void prvInitPollyServiceParameter(PollyServiceParameter_t *pServPara, LoadGenOptions_t *pxOpts)
+{
+    const char *pRegion = NULL;
+
+    memset(pServPara, 0, sizeof(PollyServiceParameter_t));
+    pServPara->pAccessKey = (getenv(AWS_ACCESS_KEY_ENV_VAR) != NULL) ? getenv(AWS_ACCESS_KEY_ENV_VAR) : DEFAULT_AWS_ACCESS_KEY;
+    pServPara->pSecretKey = (getenv(AWS_SECRET_KEY_ENV_VAR) != NULL) ? getenv(AWS_SECRET_KEY_ENV_VAR) : DEFAULT_AWS_SECRET_KEY;
+    pServPara->pToken = getenv(AWS_SESSION_TOKEN_ENV_VAR);
+    pRegion = (getenv(AWS_DEFAULT_REGION_ENV_VAR) != NULL) ? getenv(AWS_DEFAULT_REGION_ENV_VAR) : DEFAULT_AWS_REGION;
+    pServPara->pRegion = pRegion;
+    pServPara->pService = AWS_POLLY_SERVICE_NAME;
+    if (pxOpts->pHost == NULL)
+    {
+        snprintf(pPollyHostName, MAX_HOST_NAME_LEN, "%s.%s.amazonaws.com", AWS_POLLY_SERVICE_NAME, pRegion);
+        pxOpts->pHost = pPollyHostName;
+    }
+    pServPara->pHost = pxOpts->pHost;
+    pServPara->pPort = pxOpts->pPort;
+    pServPara->uRecvTimeoutMs = 5000;
+    pServPara->xSocketOptions.bTcpNoDelay = true;
+}
+
+/* Every stand-in endpoint listens on its own port from the base port up, and has its own pool if connections are pooled. */
+static PollyEndpointRouterHandle prvCreateEndpointRouter(PollyServiceParameter_t *pServPara, LoadGenOptions_t *pxOpts,
+                                                         char ppPorts[][8], PollyEndpoint_t *pxEndpoints)
+{
+    PollyEndpointRouterConfig_t xRouterConfig = { 0 };
+    PollyConnPoolConfig_t xPoolConfig = { 0 };
+    PollyServiceParameter_t xEndpointPara;
+    size_t i = 0;
+
+    for (i = 0; i < pxOpts->uRouteCount; i++)
+    {
+        pxEndpoints[i].pRegion = pServPara->pRegion;
+        pxEndpoints[i].pHost = pServPara->pHost;
+        pxEndpoints[i].pPort = ppPorts[i];
+        if (pxOpts->uPoolConnections > 0)
+        {
+            memcpy(&xEndpointPara, pServPara, sizeof(PollyServiceParameter_t));
+            xEndpointPara.pPort = ppPorts[i];
+            xPoolConfig.uMaxConnections = pxOpts->uPoolConnections;
+            xPoolConfig.uReservedConnections = pxOpts->uReserved;
+            pxEndpoints[i].xConnPool = PollyConnPool_create(&xEndpointPara, &xPoolConfig);
+        }
+    }
+
+    xRouterConfig.pxEndpoints = pxEndpoints;
+    xRouterConfig.uEndpointCount = (unsigned int)pxOpts->uRouteCount;
+
+    return PollyEndpointRouter_create(pServPara, &xRouterConfig);
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    LoadGenOptions_t xOpts;
+    PollyServiceParameter_t xServPara;
+    PollyConnPoolConfig_t xPoolConfig = { 0 };
+    PollyRateLimiterConfig_t xRateLimiterConfig = { 0 };
+    PollyTransportHandle xTransport = NULL;
+    LoadGen_t *pxLoadGen = NULL;
+    pthread_t *pxWorkers = NULL;
+    MockServerHandle pxMockServers[MAX_LIST_ITEMS] = { NULL };
+    size_t uMockServerCount = 0;
+    char ppRoutePorts[MAX_LIST_ITEMS][8];
+    PollyEndpoint_t pxEndpoints[MAX_LIST_ITEMS];
+    unsigned int uStarted = 0;
+    unsigned int i = 0;
+
+    if (prvParseOptions(argc, argv, &xOpts) != 0)
+    {
+        prvPrintUsage(argv[0]);
+        return 1;
+    }
+
+    prvInitPollyServiceParameter(&xServPara, &xOpts);
+    memset(pxEndpoints, 0, sizeof(pxEndpoints));
+
+    /* The transport is set before the pools and the router copy the service parameters. */
+    xServPara.xTransport = (xOpts.bPlain) ? PollyTransport_getPlain() : NULL;
+    if (xOpts.pRecordFile != NULL && (xTransport = PollyTransport_createRecorder(xServPara.xTransport, xOpts.pRecordFile)) == NULL)
+    {
+        printf("Unable to record to %s\n", xOpts.pRecordFile);
+        res = 1;
+    }
+    else if (xOpts.pReplayFile != NULL && (xTransport = PollyTransport_createReplayer(xOpts.pReplayFile)) == NULL)
+    {
+        printf("Unable to play back %s\n", xOpts.pReplayFile);
+        res = 1;
+    }
+    else if (xTransport != NULL)
+    {
+        xServPara.xTransport = xTransport;
+    }
+
+    if (res != 0)
+    {
+        /* Propagate the error code */
+    }
+    else if (xOpts.uRouteCount > 0)
+    {
+        for (uMockServerCount = 0; uMockServerCount < xOpts.uRouteCount; uMockServerCount++)
+        {
+            snprintf(ppRoutePorts[uMockServerCount], sizeof(ppRoutePorts[uMockServerCount]), "%lu", strtoul(xOpts.pPort, NULL, 10) + uMockServerCount);
+            if ((pxMockServers[uMockServerCount] = MockServer_start(ppRoutePorts[uMockServerCount], xOpts.puRouteLatencyMs[uMockServerCount],
+                                                                    xOpts.puRouteErrorPercent[uMockServerCount], xOpts.bPlain)) == NULL)
+            {
+                res = 1;
+                break;
+            }
+        }
+        if (res == 0 && (xServPara.xEndpointRouter = prvCreateEndpointRouter(&xServPara, &xOpts, ppRoutePorts, pxEndpoints)) == NULL)
+        {
+            printf("Unable to create the endpoint router\n");
+            res = 1;
+        }
+    }
+    else if (xOpts.bMock)
+    {
+        if ((pxMockServers[uMockServerCount++] = MockServer_start(xOpts.pPort, xOpts.uMockLatencyMs, xOpts.uMockErrorPercent, xOpts.bPlain)) == NULL)
+        {
+            res = 1;
+        }
+    }
+
+    if (res == 0 && xOpts.uPoolConnections > 0 && xOpts.uRouteCount == 0)
+    {
+        xPoolConfig.uMaxConnections = xOpts.uPoolConnections;
+        xPoolConfig.uReservedConnections = xOpts.uReserved;
+        xServPara.xConnPool = PollyConnPool_create(&xServPara, &xPoolConfig);
+    }
+
+    if (res == 0 && xOpts.uConcurrencyLimit > 0)
+    {
+        /* A fixed limit, so the classes share the same capacity through the run */
+        xRateLimiterConfig.uInitialConcurrency = xOpts.uConcurrencyLimit;
+        xRateLimiterConfig.uMinConcurrency = xOpts.uConcurrencyLimit;
+        xRateLimiterConfig.uMaxConcurrency = xOpts.uConcurrencyLimit;
+        xRateLimiterConfig.uReservedConcurrency = xOpts.uReserved;
+        xServPara.xRateLimiter = PollyRateLimiter_create(&xRateLimiterConfig);
+    }
+
+    if (res != 0)
+    {
+        /* Propagate the error code */
+    }
+    else if ((pxLoadGen = (LoadGen_t *)calloc(1, sizeof(LoadGen_t))) == NULL ||
+             (pxWorkers = (pthread_t *)calloc(xOpts.uConcurrency, sizeof(pthread_t))) == NULL)
+    {
+        printf("Out of memory\n");
+        res = 1;
+    }
+    else
+    {
+        pxLoadGen->pxOpts = &xOpts;
+        pxLoadGen->pServPara = &xServPara;
+        pxLoadGen->uTotalRequests = (unsigned long long)xOpts.uQps * xOpts.uDurationSec;
+        pthread_mutex_init(&(pxLoadGen->xLock), NULL);
+
+        if (xOpts.uRouteCount > 0)
+        {
+            printf("Sending %llu requests to %zu endpoints on %s:%s-%s at %u req/s with at most %u in flight\n", pxLoadGen->uTotalRequests,
+                   xOpts.uRouteCount, xServPara.pHost, ppRoutePorts[0], ppRoutePorts[xOpts.uRouteCount - 1], xOpts.uQps, xOpts.uConcurrency);
+        }
+        else
+        {
+            printf("Sending %llu requests to %s:%s at %u req/s with at most %u in flight\n", pxLoadGen->uTotalRequests, xServPara.pHost,
+                   (xServPara.pPort != NULL) ? xServPara.pPort : POLLY_DEFAULT_PORT, xOpts.uQps, xOpts.uConcurrency);
+        }
+
+        pxLoadGen->uStartNs = prvGetTimeNs();
+        for (uStarted = 0; uStarted < xOpts.uConcurrency; uStarted++)
+        {
+            if (pthread_create(&(pxWorkers[uStarted]), NULL, prvWorker, pxLoadGen) != 0)
+            {
+                break;
+            }
+        }
+        for (i = 0; i < uStarted; i++)
+        {
+            pthread_join(pxWorkers[i], NULL);
+        }
+
+        prvPrintReport(pxLoadGen);
+        if (xServPara.xEndpointRouter != NULL)
+        {
+            prvPrintRoutes(xServPara.xEndpointRouter, &xOpts);
+        }
+        pthread_mutex_destroy(&(pxLoadGen->xLock));
+    }
+
+    PollyEndpointRouter_terminate(xServPara.xEndpointRouter);
+    for (i = 0; i < xOpts.uRouteCount; i++)
+    {
+        PollyConnPool_terminate(pxEndpoints[i].xConnPool);
+    }
+    PollyConnPool_terminate(xServPara.xConnPool);
+    PollyRateLimiter_terminate(xServPara.xRateLimiter);
+    PollyTransport_terminate(xTransport);
+    for (i = 0; i < uMockServerCount; i++)
+    {
+        MockServer_stop(pxMockServers[i]);
+    }
+    free(pxWorkers);
+    free(pxLoadGen);
+
+    return res;
+}
@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "polly/polly.h"
 
 #define DEFAULT_AWS_ACCESS_KEY          "xxxxxxxxxxxxxxxxxxxx"
@@ -52,21 +55,6 @@ static const char *prvOptGetRegion()
     return pAwsRegion;
 }
 
-static int prvPollySynthesizeSpeechCallback(uint8_t *pData, size_t uLen, void *pUserData)
-{
-    FILE *fp = (FILE *)pUserData;
-    if (fp != NULL)
-    {
-        if (fwrite(pData, 1, uLen, fp) != uLen)
-        {
-            printf("%s(): Failed to write data to file\n", __FUNCTION__);
-            fclose(fp);
-            fp = NULL;
-        }
-    }
-    return 0;
-}
-
 static int prvInitPollyServiceParameter(PollyServiceParameter_t *pServPara)
 {
     memset(pServPara, 0, sizeof(PollyServiceParameter_t));
@@ -79,6 +67,9 @@ static int prvInitPollyServiceParameter(PollyServiceParameter_t *pServPara)
     pServPara->pHost = pPollyHostName;
     pServPara->uRecvTimeoutMs = 1000;
 
+    /* The audio is spliced from the socket to the file where the kernel can decrypt the TLS records. */
+    pServPara->xSocketOptions.bKernelTls = true;
+
     return 0;
 }
 
@@ -105,6 +96,7 @@ int main(int argc, char *argv[])
     PollyServiceParameter_t xServPara = { 0 };
     PollySynthesizeSpeechParameter_t xPara = { 0 };
     PollySynthesizeSpeechOutput_t xOut = { 0 };
+    int xFd = -1;
 
     if (argc < 3)
     {
@@ -119,19 +111,16 @@ int main(int argc, char *argv[])
     prvInitPollyServiceParameter(&xServPara);
     prvInitPollySynthesizeSpeechParameter(&xPara, pText);
 
-    FILE *fp = fopen(pOutputFilename, "wb");
-    if (fp == NULL)
+    if ((xFd = open(pOutputFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
     {
         printf("Failed to open file %s\n", pOutputFilename);
         return 0;
     }
 
-    xOut.onDataCallback = prvPollySynthesizeSpeechCallback;
-    xOut.pUserData = fp;
     xOut.uStatusCode = 0;
 
     printf("Polly synthesize speech begin...\n");
-    if ((res = Polly_synthesizeSpeech(&xServPara, &xPara, &xOut)) != POLLY_ERRNO_NONE)
+    if ((res = Polly_synthesizeSpeechToFile(&xServPara, &xPara, &xOut, xFd)) != POLLY_ERRNO_NONE)
     {
         printf("Failed to execute Polly synthesize speech. (res:%d)\n", res);
         if (xOut.uStatusCode != 0)
@@ -140,12 +129,14 @@ int main(int argc, char *argv[])
         }
     }
 
-    printf("Polly synthesize speech end\n");
-
-    if (fp != NULL)
+    else
     {
-        fclose(fp);
+        printf("Spliced %zu bytes of the audio\n", xOut.uBytesSpliced);
     }
 
+    printf("Polly synthesize speech end\n");
+
+    close(xFd);
+
     return 0;
 }
\ No newline at end of file
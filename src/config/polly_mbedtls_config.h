@@ -0,0 +1,88 @@
+/*
+ * The mbedtls configuration of USE_TLS_MINIMAL. It replaces the default config.h of mbedtls with what a Polly client needs:
+ * a TLS 1.2 client with ECDHE key exchange, AES-GCM and ChaCha20-Poly1305, SHA-256/384 and X.509 chain verification.
+ * RSA stays, as the certificates of the AWS endpoints are signed with it.
+ *
+ * MBEDTLS_PLATFORM_MEMORY, MBEDTLS_SHA256_PROCESS_ALT and the record buffer lengths are set by CMake, as with the default config.
+ */
+#ifndef POLLY_MBEDTLS_CONFIG_H
+#define POLLY_MBEDTLS_CONFIG_H
+
+/* System support */
+#define MBEDTLS_HAVE_ASM
+#define MBEDTLS_HAVE_TIME
+#define MBEDTLS_HAVE_TIME_DATE // Certificates are checked for expiry
+#define MBEDTLS_FS_IO // The trust store loads a CA bundle from a file
+
+/* Platform */
+#define MBEDTLS_PLATFORM_C
+#define MBEDTLS_NET_C
+
+/* Random numbers */
+#define MBEDTLS_ENTROPY_C
+#define MBEDTLS_CTR_DRBG_C
+
+/* Hashes. SHA-512 is for the suites and certificates which use SHA-384. */
+#define MBEDTLS_MD_C
+#define MBEDTLS_SHA256_C
+#define MBEDTLS_SHA512_C
+
+/* Ciphers. AES-NI is picked at runtime on x86. */
+#define MBEDTLS_CIPHER_C
+#define MBEDTLS_AES_C
+#define MBEDTLS_AESNI_C
+#define MBEDTLS_GCM_C
+#define MBEDTLS_CHACHA20_C
+#define MBEDTLS_POLY1305_C
+#define MBEDTLS_CHACHAPOLY_C
+
+/* Public keys */
+#define MBEDTLS_BIGNUM_C
+#define MBEDTLS_OID_C
+#define MBEDTLS_ASN1_PARSE_C
+#define MBEDTLS_ASN1_WRITE_C
+#define MBEDTLS_PK_C
+#define MBEDTLS_PK_PARSE_C
+#define MBEDTLS_RSA_C
+#define MBEDTLS_PKCS1_V15
+#define MBEDTLS_PKCS1_V21
+#define MBEDTLS_ECP_C
+#define MBEDTLS_ECP_NIST_OPTIM
+#define MBEDTLS_ECP_DP_SECP256R1_ENABLED
+#define MBEDTLS_ECP_DP_SECP384R1_ENABLED
+#define MBEDTLS_ECP_DP_CURVE25519_ENABLED
+#define MBEDTLS_ECDH_C
+#define MBEDTLS_ECDSA_C
+
+/* X.509 */
+#define MBEDTLS_BASE64_C
+#define MBEDTLS_PEM_PARSE_C
+#define MBEDTLS_X509_USE_C
+#define MBEDTLS_X509_CRT_PARSE_C
+
+/* TLS client */
+#define MBEDTLS_SSL_TLS_C
+#define MBEDTLS_SSL_CLI_C
+#define MBEDTLS_SSL_PROTO_TLS1_2
+#define MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
+#define MBEDTLS_KEY_EXCHANGE_ECDHE_RSA_ENABLED
+#define MBEDTLS_SSL_SERVER_NAME_INDICATION
+#define MBEDTLS_SSL_ALPN // h2 for Polly_synthesizeSpeechMulti()
+#define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH // uTlsMaxFragmentLen
+#define MBEDTLS_SSL_KEEP_PEER_CERTIFICATE // The trust store verifies the chain after the handshake
+#define MBEDTLS_SSL_ENCRYPT_THEN_MAC
+#define MBEDTLS_SSL_EXTENDED_MASTER_SECRET
+#define MBEDTLS_SSL_EXPORT_KEYS // bKernelTls hands the receive key to the kernel
+
+/* Only the suites which NetIo offers are compiled, so the suite table and the ClientHello stay short. NetIo orders them for the CPU. */
+#define MBEDTLS_SSL_CIPHERSUITES                                \
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,            \
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,              \
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,            \
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,              \
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,      \
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256
+
+#include "mbedtls/check_config.h"
+
+#endif /* POLLY_MBEDTLS_CONFIG_H */
@@ -1,6 +1,7 @@
 #ifndef POLLY_H
 #define POLLY_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
 
@@ -16,42 +17,482 @@
 #define POLLY_ERRNO_HTTP_WANT_MORE                  (-9)
 #define POLLY_ERRNO_HTTP_PARSE_FAILURE              (-10)
 #define POLLY_ERRNO_HTTP_REQ_FAILURE                (-11)
+#define POLLY_ERRNO_NO_CREDENTIALS                  (-12)
+#define POLLY_ERRNO_RATE_LIMITED                    (-13)
+#define POLLY_ERRNO_DEADLINE_EXCEEDED               (-14)
+#define POLLY_ERRNO_CANCELLED                       (-15)
+#define POLLY_ERRNO_WRITE_FAILED                    (-16)
+#define POLLY_ERRNO_BUFFER_TOO_SMALL                (-17)
 
 #define AWS_POLLY_SERVICE_NAME                      "polly"
+#define POLLY_DEFAULT_PORT                          "443"
+
+#define POLLY_ERROR_TYPE_MAX_LEN                    (64)
+
+typedef struct
+{
+    void *(*pfnMalloc)(size_t uSize);
+    void *(*pfnRealloc)(void *ptr, size_t uSize);
+    void (*pfnFree)(void *ptr);
+} PollyAllocator_t;
+
+typedef struct
+{
+    size_t uBlockSize;
+    size_t uBlockCount;
+    size_t uBlocksInUse;
+    size_t uPeakBlocksInUse;
+    size_t uFailures; // Allocations this pool couldn't serve because all its blocks were in use
+} PollyMemoryPoolStats_t;
+
+typedef struct PollyRetryPolicy *PollyRetryPolicyHandle;
+
+typedef struct
+{
+    unsigned int uMaxAttempts; // Attempts including the first one, 0 or 1 disables retry
+    unsigned int uBaseBackoffMs;
+    unsigned int uMaxBackoffMs;
+
+    /* Retries and hedged requests are paid from a budget, so they can't multiply the load of a struggling service. */
+    unsigned int uBudgetPercent; // Percentage of requests which can be retried or hedged
+    unsigned int uBudgetBurst; // Retries or hedged requests allowed beyond the percentage
+
+    /* Send a second attempt if the first byte doesn't arrive within the p95 latency of previous requests. */
+    bool bHedge;
+    unsigned int uHedgeMinDelayMs;
+} PollyRetryPolicyConfig_t;
+
+/* Zero values keep the defaults of the OS */
+typedef struct
+{
+    bool bTcpNoDelay; // Send small writes right away instead of waiting for the ACK of the previous one (Nagle)
+    unsigned int uRecvBufferSize; // SO_RCVBUF in bytes, larger buffers keep high-latency links busy
+    unsigned int uSendBufferSize; // SO_SNDBUF in bytes
+
+    /* TCP keepalive finds idle pooled connections which are dropped silently by the network. It's enabled if uKeepAliveIdleSec is set. */
+    unsigned int uKeepAliveIdleSec;
+    unsigned int uKeepAliveIntervalSec;
+    unsigned int uKeepAliveCount;
+
+    /* Linux only */
+    bool bTcpQuickAck; // ACK every read right away instead of delaying it
+    unsigned int uBusyPollUs; // Busy poll the device queue on reads for this long, it trades CPU for latency
+    unsigned int uUserTimeoutMs; // Drop the connection when sent data stays unacknowledged this long
+
+    /* Linux only. The kernel decrypts the received TLS records (kTLS), so Polly_synthesizeSpeechToFile() splices the audio without a copy
+     * and Polly_synthesizeSpeechToBuffer() has it decrypted into its buffer. It takes TLS 1.2 with AES-GCM and the tls module, and the connections which don't have them stay with mbedtls. */
+    bool bKernelTls;
+} PollySocketOptions_t;
+
+typedef struct PollyRateLimiter *PollyRateLimiterHandle;
+
+typedef struct
+{
+    /* Token bucket. The refill rate drops on throttles and recovers gradually up to uRequestsPerSecond. */
+    unsigned int uRequestsPerSecond; // 0 disables the rate limit, and only the concurrency is limited
+    unsigned int uBurst; // 0 means uRequestsPerSecond
+
+    /* Concurrency limit. It grows while requests succeed, and shrinks on throttles and when latency rises. */
+    unsigned int uInitialConcurrency; // 0 means 8
+    unsigned int uMinConcurrency; // 0 means 1
+    unsigned int uMaxConcurrency; // 0 means 64
+
+    /* Requests which can't be sent wait in a queue. They fail with POLLY_ERRNO_RATE_LIMITED if it's full or the wait times out. */
+    unsigned int uMaxQueued; // 0 means 256
+    unsigned int uMaxQueueWaitMs; // 0 means 5 seconds
+
+    /* Capacity which only POLLY_PRIORITY_INTERACTIVE requests use, so bulk requests can't starve them. An interactive request never waits
+     * for a bulk one. A bulk request waits while interactive ones are queued, unless uInteractiveWeight gives it a turn. */
+    unsigned int uReservedConcurrency; // Slots of the concurrency limit
+    unsigned int uReservedBurst; // Tokens of the bucket
+    unsigned int uInteractiveWeight; // 0 is strict priority, N lets a bulk request through after every N interactive ones
+} PollyRateLimiterConfig_t;
+
+typedef struct PollyConnPool *PollyConnPoolHandle;
+
+typedef struct
+{
+    unsigned int uMaxConnections;
+    unsigned int uServerIdleTimeoutMs; // Idle connections are refreshed before the server closes them
+
+    /* Idle connections kept for POLLY_PRIORITY_INTERACTIVE requests. A bulk request opens a connection of its own rather than take one of
+     * them, so interactive requests skip the handshakes while bulk jobs run. It should be less than uMaxConnections. */
+    unsigned int uReservedConnections;
+} PollyConnPoolConfig_t;
+
+typedef struct PollyEndpointRouter *PollyEndpointRouterHandle;
+
+typedef struct
+{
+    const char *pRegion; // Requests sent to the endpoint are signed for this region
+    const char *pHost;
+    const char *pPort; // Optional, NULL means POLLY_DEFAULT_PORT
+    PollyConnPoolHandle xConnPool; // Optional, a pool created for this endpoint
+} PollyEndpoint_t;
+
+typedef struct
+{
+    const PollyEndpoint_t *pxEndpoints; // In order of preference, which breaks ties before latencies are known
+    unsigned int uEndpointCount;
+
+    unsigned int uSampleWeightPercent; // Weight of a new request in the moving averages of latency and errors, 0 means 20
+    unsigned int uExplorePercent; // Requests sent to other healthy endpoints to keep their latency current, 0 means 5
+
+    /* The circuit of an endpoint opens on consecutive failures or a high error rate, and it takes no requests until a probe succeeds. */
+    unsigned int uFailureThreshold; // 0 means 5
+    unsigned int uMaxErrorPercent; // 0 means 50
+    unsigned int uOpenMs; // How long an open circuit waits before it's probed, 0 means 10 seconds
+} PollyEndpointRouterConfig_t;
+
+typedef enum
+{
+    POLLY_ENDPOINT_HEALTHY,
+    POLLY_ENDPOINT_OPEN, // Requests avoid it until a probe succeeds
+    POLLY_ENDPOINT_HALF_OPEN // A probe succeeded, and the next request decides whether it's healthy again
+} PollyEndpointState_t;
+
+typedef struct
+{
+    PollyEndpointState_t eState;
+    unsigned int uLatencyMs; // Moving average of the time to first byte, 0 until a request succeeds
+    unsigned int uErrorPercent; // Moving average of the failures
+    uint64_t uRequests;
+} PollyEndpointStats_t;
+
+typedef struct PollyTrustStore *PollyTrustStoreHandle;
+
+typedef struct
+{
+    const char *pCaFile; // A bundle of trusted CAs in PEM or DER, ex: /etc/ssl/certs/ca-certificates.crt
+    const char *pCaPem; // Or a NUL-terminated PEM bundle in memory. Both can be set.
+
+    /* Verified server chains are remembered, so connections to the same host skip chain validation. 0 disables the cache. */
+    unsigned int uVerifiedChainCacheSize;
+    unsigned int uVerifiedChainTtlMs; // 0 means 1 hour
+} PollyTrustStoreConfig_t;
+
+typedef struct PollyTransport *PollyTransportHandle;
+
+typedef struct PollyCredentialProvider *PollyCredentialProviderHandle;
+
+typedef struct
+{
+    /* Sources are tried in this order, and the first one which has credentials is used. */
+    bool bFromEnvironment; // AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and AWS_SESSION_TOKEN
+    const char *pFile; // Optional, a shared credentials file, ex: ~/.aws/credentials
+    const char *pProfile; // Optional, NULL means "default"
+    const char *pEndpointHost; // Optional, a plain HTTP endpoint returning JSON credentials, ex: the container credentials endpoint 169.254.170.2
+    const char *pEndpointPort; // Optional, NULL means "80"
+    const char *pEndpointPath;
+    const char *pEndpointAuthorization; // Optional, sent as the authorization header to the endpoint
+
+    unsigned int uRefreshBeforeExpiryMs; // Refresh temporary credentials this long before they expire, 0 means 5 minutes
+    unsigned int uRefreshIntervalMs; // Reload credentials without an expiration this often, 0 means 15 minutes
+} PollyCredentialProviderConfig_t;
+
+typedef struct PollyBatcher *PollyBatcherHandle;
+
+typedef struct
+{
+    unsigned int uWindowMs; // How long the first request of a batch waits for others to join, 0 means 20 ms
+    unsigned int uMaxBatchSize; // 0 means 16
+    unsigned int uMaxTextLen; // Longer texts are sent on their own, 0 means 100
+} PollyBatcherConfig_t;
 
 typedef struct
 {
     const char *pAccessKey;
     const char *pSecretKey;
-    const char *pToken;
+    const char *pToken; // Optional, the session token of temporary credentials
+
+    /* Optional. If it's set, credentials are taken from it and pAccessKey, pSecretKey and pToken are ignored. */
+    PollyCredentialProviderHandle xCredentialProvider;
 
     const char *pRegion;
     const char *pService;
     const char *pHost;
+    const char *pPort; // Optional, NULL means POLLY_DEFAULT_PORT
 
     unsigned int uRecvTimeoutMs;
+
+    /* Optional, bounds a connect and its TLS handshake together, within the deadline of the request. 0 is 10 seconds. */
+    unsigned int uConnectTimeoutMs;
+
+    /* Optional. If it's set, the server certificate is verified against it, otherwise the server is not authenticated. */
+    PollyTrustStoreHandle xTrustStore;
+
+    /* Optional, 512, 1024, 2048 or 4096. It asks the server for TLS records of at most this length, so the record buffers of a connection
+     * can shrink from 16 KB. 0 keeps full-size records. */
+    unsigned int uTlsMaxFragmentLen;
+
+    PollySocketOptions_t xSocketOptions;
+
+    /* Optional, NULL is TLS. Another transport carries the requests without TLS or a server, ex: for reproducible benchmarks. */
+    PollyTransportHandle xTransport;
+
+    /* Requests in flight on one HTTP/1.1 connection in Polly_synthesizeSpeechMulti(). 0 or 1 sends them one by one. */
+    unsigned int uPipelineDepth;
+
+    PollyRetryPolicyHandle xRetryPolicy; // Optional, NULL disables retry
+    PollyRateLimiterHandle xRateLimiter; // Optional, NULL sends requests without limit. Share it among the threads of an account.
+    PollyConnPoolHandle xConnPool; // Optional, NULL opens a new connection for every request
+
+    /* Optional. If it's set, every attempt goes to the endpoint it picks, with the region and the pool of that endpoint,
+     * and pRegion, pHost, pPort and xConnPool are ignored. */
+    PollyEndpointRouterHandle xEndpointRouter;
 } PollyServiceParameter_t;
 
+typedef struct PollyCancelToken *PollyCancelTokenHandle;
+
+typedef enum
+{
+    POLLY_PRIORITY_INTERACTIVE, // Latency matters, ex: a user waits for the speech
+    POLLY_PRIORITY_BULK // Throughput matters, ex: a batch job. It's deferred while interactive requests need the capacity.
+} PollyPriority_t;
+
 typedef struct
 {
     const char *pEngine;
     const char *pLanguageCode;
-    const char *pLexiconNames;
+    const char *pLexiconNames; // Comma separated, ex: "lexA,lexB"
     const char *pOutputFormat; // Required, json | mp3 | ogg_vorbis | pcm
     const char *pSampleRate;
-    const char *pSpeechMarkTypes;
+    const char *pSpeechMarkTypes; // Comma separated, ex: "sentence,word". It requires the json output format.
     const char *pText; // Required
     const char *pTextType;
     const char *pVoiceId; // Required
+
+    /* Optional. The request, with its retries, fails with POLLY_ERRNO_DEADLINE_EXCEEDED if it isn't done this long after the call,
+     * whichever of resolve, connect, handshake, send or receive it's in. 0 means no deadline. */
+    unsigned int uTimeoutMs;
+
+    /* Optional. Another thread stops the request by PollyCancelToken_cancel(), and it fails with POLLY_ERRNO_CANCELLED. */
+    PollyCancelTokenHandle xCancelToken;
+
+    /* Optional. The class which the request gets the permits of the rate limiter and the connections of the pool by. */
+    PollyPriority_t ePriority;
 } PollySynthesizeSpeechParameter_t;
 
+typedef struct PollyBuffer *PollyBufferHandle;
+
+typedef struct
+{
+    const uint8_t *pData;
+    size_t uLen;
+    PollyBufferHandle xBuffer; // The buffer which holds pData
+} PollyBufferSlice_t;
+
 typedef struct
 {
     int (*onDataCallback)(uint8_t *pData, size_t uLen, void *pUserData);
+
+    /* Optional. If it's set, the audio is delivered here instead of onDataCallback, as whole MP3 frames or Ogg pages which can be decoded
+     * right away. Every call has one or more consecutive frames. pOutputFormat must be mp3 or ogg_vorbis. */
+    int (*onFramesCallback)(const uint8_t **ppFrames, const size_t *puFrameLens, size_t uFrameCount, void *pUserData);
+
+    /* Optional. If it's set, the audio is delivered here instead of onDataCallback, as slices of the receive buffer without a copy.
+     * A slice is valid during the call, or until PollyBuffer_release() if its buffer is kept by PollyBuffer_retain().
+     * It can't be used with onFramesCallback. */
+    int (*onBufferCallback)(const PollyBufferSlice_t *pxSlice, void *pUserData);
+
     void *pUserData;
     unsigned int uStatusCode;
+    char pErrorType[POLLY_ERROR_TYPE_MAX_LEN]; // ex: ThrottlingException, empty if the request succeeded
+    unsigned int uAttempts;
+    size_t uPeakMemBytes; // Peak heap usage of the request. TLS buffers are included only if Polly_setAllocator() is used.
+    size_t uConnMemBytes; // Memory held by the connection which served the request, mostly its TLS record buffers
+    size_t uBytesSpliced; // Audio which Polly_synthesizeSpeechToFile() moved from the socket to the file without a copy
 } PollySynthesizeSpeechOutput_t;
 
+/**
+ * Route all allocations of the library, including the ones of mbedtls, to a custom allocator.
+ * It must be called before any other function of the library.
+ */
+int Polly_setAllocator(const PollyAllocator_t *pAllocator);
+
+/**
+ * Get the usage of the static memory pools, so their sizes can be tuned from a real workload.
+ * It's only meaningful if the library is built with USE_STATIC_MEMORY.
+ *
+ * @param[out] pxStats The usage of every pool, from the smallest block size
+ * @param[in] uMaxCount The number of elements of pxStats
+ * @return The number of pools, 0 if the library uses the heap
+ */
+size_t Polly_getMemoryPoolStats(PollyMemoryPoolStats_t *pxStats, size_t uMaxCount);
+
+PollyRetryPolicyHandle PollyRetryPolicy_create(const PollyRetryPolicyConfig_t *pConfig);
+
+void PollyRetryPolicy_terminate(PollyRetryPolicyHandle xRetryPolicy);
+
+/**
+ * Create a client-side limiter, which keeps the request rate and the concurrency right under the limits of the account,
+ * so requests are not throttled and retries don't pile up on a saturated service. Every attempt, including retries, takes a permit.
+ */
+PollyRateLimiterHandle PollyRateLimiter_create(const PollyRateLimiterConfig_t *pConfig);
+
+/**
+ * Get the current adaptive limits, for monitoring
+ */
+int PollyRateLimiter_getLimits(PollyRateLimiterHandle xRateLimiter, unsigned int *puConcurrency, unsigned int *puRequestsPerSecond);
+
+void PollyRateLimiter_terminate(PollyRateLimiterHandle xRateLimiter);
+
+PollyConnPoolHandle PollyConnPool_create(PollyServiceParameter_t *pServPara, const PollyConnPoolConfig_t *pConfig);
+
+/**
+ * Ask the pool to keep uConnections connections ready to be used, so the next requests skip DNS, TCP and TLS handshakes.
+ * It returns immediately, and connections are established and refreshed by a background thread.
+ */
+int PollyConnPool_prewarm(PollyConnPoolHandle xConnPool, unsigned int uConnections);
+
+void PollyConnPool_terminate(PollyConnPoolHandle xConnPool);
+
+/**
+ * Create a router over several endpoints, ex: the same service in two regions. Every attempt goes to the healthy endpoint with the
+ * lowest time to first byte, and an endpoint which fails is skipped until a background probe reaches it again.
+ * pServPara gives the TLS and socket settings of the probes. The strings of the endpoints are copied.
+ */
+PollyEndpointRouterHandle PollyEndpointRouter_create(PollyServiceParameter_t *pServPara, const PollyEndpointRouterConfig_t *pConfig);
+
+/**
+ * Get the health of an endpoint, for monitoring
+ *
+ * @param[in] uIndex The index of the endpoint in the config
+ */
+int PollyEndpointRouter_getStats(PollyEndpointRouterHandle xEndpointRouter, unsigned int uIndex, PollyEndpointStats_t *pxStats);
+
+void PollyEndpointRouter_terminate(PollyEndpointRouterHandle xEndpointRouter);
+
+/**
+ * Create a trust store. The CA bundle is parsed once, and the store is shared by all connections which use it.
+ * Connections hold a reference, so the store can be terminated while they are still open.
+ */
+PollyTrustStoreHandle PollyTrustStore_create(const PollyTrustStoreConfig_t *pConfig);
+
+void PollyTrustStore_terminate(PollyTrustStoreHandle xTrustStore);
+
+/**
+ * Get the transport of plain TCP, without TLS, ex: to a local stand-in of the service. It's built in, and needs no terminate.
+ */
+PollyTransportHandle PollyTransport_getPlain(void);
+
+/**
+ * Create a transport which records every connection it carries to a file, so the sessions can be played back by
+ * PollyTransport_createReplayer(). Only what the server sends is recorded, as the requests carry the credentials.
+ *
+ * @param[in] xInner The transport which carries the connections, or NULL for TLS. It must outlive the recorder.
+ * @param[in] pFileName The file is truncated
+ */
+PollyTransportHandle PollyTransport_createRecorder(PollyTransportHandle xInner, const char *pFileName);
+
+/**
+ * Create a transport which plays back the sessions of a recording from memory, without a network. Every connection plays the next
+ * session in the order they were opened, and starts over from the first one after the last. Every receive returns the bytes of the
+ * recorded receive, so the responses are parsed the same way on every run. What the client sends is discarded.
+ */
+PollyTransportHandle PollyTransport_createReplayer(const char *pFileName);
+
+/**
+ * Terminate a recorder or a replayer. No connection may be using it anymore.
+ */
+void PollyTransport_terminate(PollyTransportHandle xTransport);
+
+/**
+ * Create a credential provider. Credentials are loaded once here and then refreshed by a background thread before they expire,
+ * and requests in flight keep signing with the credentials they started with.
+ * It succeeds even if the first load fails, and requests fail with POLLY_ERRNO_NO_CREDENTIALS until a load succeeds.
+ */
+PollyCredentialProviderHandle PollyCredentialProvider_create(const PollyCredentialProviderConfig_t *pConfig);
+
+void PollyCredentialProvider_terminate(PollyCredentialProviderHandle xCredentialProvider);
+
+/**
+ * Create a cancellation token. Give it to one or more requests by xCancelToken, and cancel them all from any thread.
+ */
+PollyCancelTokenHandle PollyCancelToken_create(void);
+
+/**
+ * Cancel the requests of a token. A request blocked in the network or waiting to retry returns right away with POLLY_ERRNO_CANCELLED,
+ * and requests started with the token afterwards fail at once. It can be called from any thread, and more than once.
+ */
+int PollyCancelToken_cancel(PollyCancelTokenHandle xCancelToken);
+
+/**
+ * Terminate a token. No request may be using it anymore.
+ */
+void PollyCancelToken_terminate(PollyCancelTokenHandle xCancelToken);
+
 int Polly_synthesizeSpeech(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut);
 
+/**
+ * Synthesize a text like Polly_synthesizeSpeech(), and write the audio to a file descriptor, ex: a file or a pipe, instead of the callbacks
+ * of pOut. Only the HTTP framing is parsed by the library. On Linux, the audio goes from the socket to the file by splice() when the
+ * connection allows it, which is a plain one or a TLS one with bKernelTls. Otherwise it's received and written.
+ *
+ * @return POLLY_ERRNO_WRITE_FAILED if the file descriptor doesn't take the audio
+ */
+int Polly_synthesizeSpeechToFile(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut, int xFd);
+
+/**
+ * Synthesize a text like Polly_synthesizeSpeech(), and return the whole audio in one buffer instead of the callbacks of pOut.
+ * The buffer is sized once from the Content-Length of the response, or from an estimate of the text length and the output format if the
+ * response is chunked, and the audio is received straight into it. A failed attempt is retried even if a part of the audio was received.
+ *
+ * @param[in] pBuf A buffer of the caller, or NULL to have the library allocate one
+ * @param[in] uBufSize The size of pBuf
+ * @param[out] ppAudio The audio, which is pBuf or a buffer to free by Polly_freeAudio(). NULL if the audio is empty or the request failed.
+ * @param[out] puAudioLen The length of the audio. If pBuf is too small, it's the length the response announced, or 0 if it's chunked.
+ * @return POLLY_ERRNO_BUFFER_TOO_SMALL if the audio doesn't fit pBuf
+ */
+int Polly_synthesizeSpeechToBuffer(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut,
+                                   uint8_t *pBuf, size_t uBufSize, uint8_t **ppAudio, size_t *puAudioLen);
+
+/**
+ * Free the audio which Polly_synthesizeSpeechToBuffer() allocated.
+ */
+void Polly_freeAudio(uint8_t *pAudio);
+
+/**
+ * Keep the buffer of a slice delivered by onBufferCallback after the callback returns, so the audio can be queued or handed to another
+ * thread without a copy. The library receives into other buffers meanwhile.
+ */
+void PollyBuffer_retain(PollyBufferHandle xBuffer);
+
+/**
+ * Drop a buffer kept by PollyBuffer_retain(). The last reference gives it back to the library to receive into again.
+ * It can be called from any thread.
+ */
+void PollyBuffer_release(PollyBufferHandle xBuffer);
+
+/**
+ * Create a batcher which merges short requests into one, so they share the signing, the connection and the service overhead.
+ * It must not be terminated while requests are in flight.
+ */
+PollyBatcherHandle PollyBatcher_create(const PollyBatcherConfig_t *pConfig);
+
+void PollyBatcher_terminate(PollyBatcherHandle xBatcher);
+
+/**
+ * Synthesize a text like Polly_synthesizeSpeech(), batched with the short texts which other threads synthesize meanwhile with the same
+ * service parameter, voice, engine, language, lexicons, output format and sample rate.
+ * The texts of a batch are synthesized as one SSML request with a mark before each of them, and the marks tell where the audio of each
+ * text starts. Every caller receives only its own audio, through its own callbacks, which may be called from the thread of another caller.
+ * Only plain texts in mp3 or pcm are batched. Others are sent on their own.
+ *
+ * @return The result of the batch, or POLLY_ERRNO_NONE if the audio of the text was delivered
+ */
+int PollyBatcher_synthesizeSpeech(PollyBatcherHandle xBatcher, PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut);
+
+/**
+ * Synthesize several texts at once. If the server negotiates HTTP/2, all requests are multiplexed as concurrent streams of one connection,
+ * and their audio is delivered to the callbacks as it arrives. Otherwise the requests are sent over HTTP/1.1 on the same connection,
+ * pipelined up to uPipelineDepth of the service parameter, and the responses are delivered in order.
+ * Requests which the server refused or didn't answer are sent again by Polly_synthesizeSpeech().
+ * For requests served on the shared connection, uPeakMemBytes is the peak of the whole batch.
+ *
+ * @param[out] pResults Optional, the result of every request
+ * @return POLLY_ERRNO_NONE if all requests succeeded, the result of the first failed request otherwise
+ */
+int Polly_synthesizeSpeechMulti(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pParas, PollySynthesizeSpeechOutput_t *pOuts, size_t uCount, int *pResults);
+
 #endif /* POLLY_H */
\ No newline at end of file
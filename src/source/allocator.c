@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "mbedtls/platform.h"
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#if defined(POLLY_STATIC_MEMORY)
+#include "mem_pool.h"
+#endif
+
+/* Every allocation is prefixed with its size, so we can account the usage on free. It keeps the payload aligned for any type. */
+#define ALLOCATOR_HEADER_SIZE   (16)
+
+#if defined(POLLY_STATIC_MEMORY)
+#if !defined(MBEDTLS_PLATFORM_MEMORY)
+#error "POLLY_STATIC_MEMORY needs MBEDTLS_PLATFORM_MEMORY, otherwise mbedtls allocates from the heap"
+#endif
+
+/* The pools can't be replaced, and mbedtls is routed to them before anything is allocated. Every entry point of the library allocates
+ * its handle before it touches mbedtls, so the first allocation is early enough. */
+static PollyAllocator_t gxAllocator = { MemPool_malloc, MemPool_realloc, MemPool_free };
+static pthread_once_t gxMbedtlsOnce = PTHREAD_ONCE_INIT;
+
+static void prvRouteMbedtls(void)
+{
+    mbedtls_platform_set_calloc_free(Allocator_calloc, Allocator_free);
+}
+#else
+static PollyAllocator_t gxAllocator = { malloc, realloc, free };
+#endif
+
+static __thread int64_t giThreadUsage = 0;
+static __thread int64_t giThreadPeak = 0;
+
+static void prvAccount(int64_t iDelta)
+{
+    giThreadUsage += iDelta;
+    if (giThreadUsage > giThreadPeak)
+    {
+        giThreadPeak = giThreadUsage;
+    }
+}
+
+void *Allocator_malloc(size_t uSize)
+{
+    uint8_t *p = NULL;
+
+#if defined(POLLY_STATIC_MEMORY)
+    pthread_once(&gxMbedtlsOnce, prvRouteMbedtls);
+#endif
+
+    if (uSize <= SIZE_MAX - ALLOCATOR_HEADER_SIZE && (p = (uint8_t *)gxAllocator.pfnMalloc(uSize + ALLOCATOR_HEADER_SIZE)) != NULL)
+    {
+        *(size_t *)p = uSize;
+        prvAccount((int64_t)uSize);
+        p += ALLOCATOR_HEADER_SIZE;
+    }
+
+    return p;
+}
+
+void *Allocator_calloc(size_t uNum, size_t uSize)
+{
+    void *p = NULL;
+
+    if ((uSize == 0 || uNum <= SIZE_MAX / uSize) && (p = Allocator_malloc(uNum * uSize)) != NULL)
+    {
+        memset(p, 0, uNum * uSize);
+    }
+
+    return p;
+}
+
+void *Allocator_realloc(void *ptr, size_t uSize)
+{
+    uint8_t *p = NULL;
+    size_t uOldSize = 0;
+
+    if (ptr == NULL)
+    {
+        p = Allocator_malloc(uSize);
+    }
+    else if (uSize <= SIZE_MAX - ALLOCATOR_HEADER_SIZE)
+    {
+        p = (uint8_t *)ptr - ALLOCATOR_HEADER_SIZE;
+        uOldSize = *(size_t *)p;
+        if ((p = (uint8_t *)gxAllocator.pfnRealloc(p, uSize + ALLOCATOR_HEADER_SIZE)) != NULL)
+        {
+            *(size_t *)p = uSize;
+            prvAccount((int64_t)uSize - (int64_t)uOldSize);
+            p += ALLOCATOR_HEADER_SIZE;
+        }
+    }
+
+    return p;
+}
+
+void Allocator_free(void *ptr)
+{
+    uint8_t *p = NULL;
+
+    if (ptr != NULL)
+    {
+        p = (uint8_t *)ptr - ALLOCATOR_HEADER_SIZE;
+        prvAccount(-(int64_t)(*(size_t *)p));
+        gxAllocator.pfnFree(p);
+    }
+}
+
+int64_t Allocator_getThreadUsage(void)
+{
+    return giThreadUsage;
+}
+
+void Allocator_resetThreadPeak(void)
+{
+    giThreadPeak = giThreadUsage;
+}
+
+int64_t Allocator_getThreadPeak(void)
+{
+    return giThreadPeak;
+}
+
+int Polly_setAllocator(const PollyAllocator_t *pAllocator)
+{
+    int res = POLLY_ERRNO_NONE;
+
+#if defined(POLLY_STATIC_MEMORY)
+    /* Blocks allocated from the pools would be handed to the new allocator on free */
+    (void)pAllocator;
+    res = POLLY_ERRNO_INVALID_PARAMETER;
+#else
+    if (pAllocator == NULL || pAllocator->pfnMalloc == NULL || pAllocator->pfnRealloc == NULL || pAllocator->pfnFree == NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        memcpy(&gxAllocator, pAllocator, sizeof(PollyAllocator_t));
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+        mbedtls_platform_set_calloc_free(Allocator_calloc, Allocator_free);
+#endif
+    }
+#endif
+
+    return res;
+}
+
+size_t Polly_getMemoryPoolStats(PollyMemoryPoolStats_t *pxStats, size_t uMaxCount)
+{
+#if defined(POLLY_STATIC_MEMORY)
+    return MemPool_getStats(pxStats, uMaxCount);
+#else
+    (void)pxStats;
+    (void)uMaxCount;
+    return 0;
+#endif
+}
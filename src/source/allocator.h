@@ -0,0 +1,35 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* All allocations of the library go through these functions, so they can be routed to the allocator set by Polly_setAllocator(). */
+void *Allocator_malloc(size_t uSize);
+
+void *Allocator_calloc(size_t uNum, size_t uSize);
+
+void *Allocator_realloc(void *ptr, size_t uSize);
+
+void Allocator_free(void *ptr);
+
+/**
+ * @brief Get the bytes currently allocated by the calling thread
+ *
+ * @return Bytes in use. It may be negative if the thread frees memory allocated by other threads.
+ */
+int64_t Allocator_getThreadUsage(void);
+
+/**
+ * @brief Restart the peak tracking of the calling thread from its current usage
+ */
+void Allocator_resetThreadPeak(void);
+
+/**
+ * @brief Get the peak bytes allocated by the calling thread since the last Allocator_resetThreadPeak()
+ *
+ * @return Peak bytes in use
+ */
+int64_t Allocator_getThreadPeak(void);
+
+#endif /* ALLOCATOR_H */
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "arena.h"
+
+#define ARENA_ALIGNMENT         (sizeof(void *))
+#define ARENA_ALIGN(x)          (((x) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *pNext;
+    size_t uSize;
+    size_t uUsed;
+} ArenaBlock_t;
+
+typedef struct Arena
+{
+    ArenaBlock_t *pBlocks;
+    size_t uBlockSize;
+} Arena_t;
+
+#define ARENA_BLOCK_HEADER_SIZE     ARENA_ALIGN(sizeof(ArenaBlock_t))
+
+static ArenaBlock_t *prvCreateBlock(size_t uSize)
+{
+    ArenaBlock_t *pxBlock = NULL;
+
+    if (uSize <= SIZE_MAX - ARENA_BLOCK_HEADER_SIZE && (pxBlock = (ArenaBlock_t *)Allocator_malloc(ARENA_BLOCK_HEADER_SIZE + uSize)) != NULL)
+    {
+        pxBlock->pNext = NULL;
+        pxBlock->uSize = uSize;
+        pxBlock->uUsed = 0;
+    }
+
+    return pxBlock;
+}
+
+ArenaHandle Arena_create(size_t uBlockSize)
+{
+    Arena_t *pxArena = NULL;
+
+    if ((pxArena = (Arena_t *)Allocator_malloc(sizeof(Arena_t))) != NULL)
+    {
+        memset(pxArena, 0, sizeof(Arena_t));
+        pxArena->uBlockSize = ARENA_ALIGN(uBlockSize);
+
+        if ((pxArena->pBlocks = prvCreateBlock(pxArena->uBlockSize)) == NULL)
+        {
+            Arena_terminate(pxArena);
+            pxArena = NULL;
+        }
+    }
+
+    return pxArena;
+}
+
+void Arena_terminate(ArenaHandle xArena)
+{
+    Arena_t *pxArena = (Arena_t *)xArena;
+    ArenaBlock_t *pxBlock = NULL;
+
+    if (pxArena != NULL)
+    {
+        while ((pxBlock = pxArena->pBlocks) != NULL)
+        {
+            pxArena->pBlocks = pxBlock->pNext;
+            Allocator_free(pxBlock);
+        }
+        Allocator_free(pxArena);
+    }
+}
+
+void *Arena_alloc(ArenaHandle xArena, size_t uSize)
+{
+    Arena_t *pxArena = (Arena_t *)xArena;
+    ArenaBlock_t *pxBlock = NULL;
+    void *p = NULL;
+
+    if (pxArena == NULL)
+    {
+        p = Allocator_malloc(uSize);
+    }
+    else if (uSize <= SIZE_MAX - ARENA_ALIGNMENT)
+    {
+        uSize = ARENA_ALIGN(uSize);
+        pxBlock = pxArena->pBlocks;
+        if (pxBlock == NULL || pxBlock->uSize - pxBlock->uUsed < uSize)
+        {
+            /* Oversized allocations get a dedicated block. */
+            if ((pxBlock = prvCreateBlock((uSize > pxArena->uBlockSize) ? uSize : pxArena->uBlockSize)) != NULL)
+            {
+                pxBlock->pNext = pxArena->pBlocks;
+                pxArena->pBlocks = pxBlock;
+            }
+        }
+
+        if (pxBlock != NULL)
+        {
+            p = (uint8_t *)pxBlock + ARENA_BLOCK_HEADER_SIZE + pxBlock->uUsed;
+            pxBlock->uUsed += uSize;
+        }
+    }
+
+    return p;
+}
+
+void Arena_free(ArenaHandle xArena, void *ptr)
+{
+    if (xArena == NULL)
+    {
+        Allocator_free(ptr);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct Arena *ArenaHandle;
+
+/**
+ * @brief Create a bump allocator. Memory is allocated by moving a pointer, and all of it is released at once on terminate.
+ *
+ * @param[in] uBlockSize The size of the first block. Other blocks are allocated on demand.
+ * @return The arena handle
+ */
+ArenaHandle Arena_create(size_t uBlockSize);
+
+/**
+ * @brief Terminate an arena and release all memory allocated from it
+ *
+ * @param[in] xArena The arena handle
+ */
+void Arena_terminate(ArenaHandle xArena);
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * @param[in] xArena The arena handle, or NULL to allocate from the heap
+ * @param[in] uSize The size to allocate
+ * @return The allocated memory
+ */
+void *Arena_alloc(ArenaHandle xArena, size_t uSize);
+
+/**
+ * @brief Free memory allocated by Arena_alloc(). It's a no-op for an arena, and the memory is released on terminate.
+ *
+ * @param[in] xArena The arena handle, or NULL if the memory is allocated from the heap
+ * @param[in] ptr The memory to free
+ */
+void Arena_free(ArenaHandle xArena, void *ptr);
+
+#endif /* ARENA_H */
@@ -0,0 +1,629 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "frame_aligner.h"
+#include "port.h"
+
+#define DEFAULT_BATCH_WINDOW_MS         (20)
+#define DEFAULT_MAX_BATCH_SIZE          (16)
+#define DEFAULT_MAX_BATCHED_TEXT_LEN    (100)
+
+/* The service limits the text of a request to 3000 characters, tags excluded. */
+#define MAX_BATCH_TEXT_LEN              (3000)
+
+/* Every request is preceded by a mark named by its index in the batch, and followed by a space so words don't run together. */
+#define SSML_BEGIN                      "<speak>"
+#define SSML_END                        "</speak>"
+#define SSML_MARK_FORMAT                "<mark name='%u'/>"
+#define SSML_MARK_MAX_LEN               (sizeof("<mark name='4294967295'/>") - 1)
+
+/* Every character of the text is escaped to at most this many, ex: '&' to "&amp;" */
+#define SSML_ESCAPE_MAX_LEN             (5)
+
+#define DEFAULT_PCM_SAMPLE_RATE         (16000)
+#define PCM_BYTES_PER_SAMPLE            (2)
+
+#define SPEECH_MARKS_INITIAL_BUFSIZE    (1024)
+
+typedef struct
+{
+    PollySynthesizeSpeechParameter_t *pPara;
+    PollySynthesizeSpeechOutput_t *pOut;
+    uint32_t uStartMs; // Where its audio starts in the audio of the batch
+    int res;
+    bool bDone;
+} BatchItem_t;
+
+typedef struct Batch
+{
+    PollyServiceParameter_t *pServPara;
+    BatchItem_t **ppxItems;
+    unsigned int uCount;
+    size_t uTextLen;
+    bool bClosed;
+    struct Batch *pxNext;
+} Batch_t;
+
+typedef struct PollyBatcher
+{
+    PollyBatcherConfig_t xConfig;
+
+    /* Callers wait on the same condition, for their batch to fill up or for their result. */
+    pthread_mutex_t xLock;
+    pthread_cond_t xCond;
+    Batch_t *pxOpen; // Batches which still accept requests
+} PollyBatcher_t;
+
+typedef struct
+{
+    char *pBuf;
+    size_t uLen;
+    size_t uSize;
+    bool bOutOfMemory;
+} SpeechMarks_t;
+
+/* Route the audio of a batch to the requests it was made of */
+typedef struct
+{
+    Batch_t *pxBatch;
+    unsigned int uItem;
+    uint64_t uPosition; // Bytes of PCM, or samples of MP3, delivered so far
+    uint32_t uPcmSampleRate;
+} AudioSplitter_t;
+
+static bool prvStrEq(const char *pA, const char *pB)
+{
+    return (pA == NULL && pB == NULL) || (pA != NULL && pB != NULL && strcmp(pA, pB) == 0);
+}
+
+static bool prvIsBatchable(PollyBatcher_t *pxBatcher, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut)
+{
+    /* The audio is split at frame boundaries of MP3 and at sample boundaries of PCM. An Ogg stream can't be split without re-muxing.
+     * Slices of the receive buffer are only handed out by requests of their own, and so is a deadline or a cancellation of one caller. */
+    return pOut->onBufferCallback == NULL && pPara->uTimeoutMs == 0 && pPara->xCancelToken == NULL && pPara->pText != NULL && pPara->pVoiceId != NULL && pPara->pOutputFormat != NULL &&
+           (strcmp(pPara->pOutputFormat, "mp3") == 0 || (strcmp(pPara->pOutputFormat, "pcm") == 0 && pOut->onFramesCallback == NULL)) &&
+           (pPara->pTextType == NULL || strcmp(pPara->pTextType, "text") == 0) &&
+           pPara->pSpeechMarkTypes == NULL &&
+           strlen(pPara->pText) <= pxBatcher->xConfig.uMaxTextLen;
+}
+
+static bool prvCanJoin(PollyBatcher_t *pxBatcher, Batch_t *pxBatch, PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara)
+{
+    PollySynthesizeSpeechParameter_t *pFirst = pxBatch->ppxItems[0]->pPara;
+
+    return !pxBatch->bClosed && pxBatch->uCount < pxBatcher->xConfig.uMaxBatchSize && pxBatch->pServPara == pServPara && pFirst->ePriority == pPara->ePriority &&
+           pxBatch->uTextLen + strlen(pPara->pText) <= MAX_BATCH_TEXT_LEN &&
+           strcmp(pFirst->pVoiceId, pPara->pVoiceId) == 0 && strcmp(pFirst->pOutputFormat, pPara->pOutputFormat) == 0 &&
+           prvStrEq(pFirst->pEngine, pPara->pEngine) && prvStrEq(pFirst->pLanguageCode, pPara->pLanguageCode) &&
+           prvStrEq(pFirst->pSampleRate, pPara->pSampleRate) && prvStrEq(pFirst->pLexiconNames, pPara->pLexiconNames);
+}
+
+/* Wait for a wakeup or a timeout. It has to be called with the lock held. */
+static void prvTimedWait(PollyBatcher_t *pxBatcher, uint64_t uWaitMs)
+{
+    struct timespec xDeadline = {0};
+
+    clock_gettime(CLOCK_REALTIME, &xDeadline);
+    xDeadline.tv_sec += uWaitMs / 1000;
+    xDeadline.tv_nsec += (long)(uWaitMs % 1000) * 1000000;
+    if (xDeadline.tv_nsec >= 1000000000)
+    {
+        xDeadline.tv_sec++;
+        xDeadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&(pxBatcher->xCond), &(pxBatcher->xLock), &xDeadline);
+}
+
+static char *prvGenSsml(Batch_t *pxBatch)
+{
+    char *pSsml = NULL;
+    size_t uSize = sizeof(SSML_BEGIN) + sizeof(SSML_END);
+    size_t uLen = 0;
+    const char *p = NULL;
+    unsigned int i = 0;
+
+    for (i = 0; i < pxBatch->uCount; i++)
+    {
+        uSize += SSML_MARK_MAX_LEN + SSML_ESCAPE_MAX_LEN * strlen(pxBatch->ppxItems[i]->pPara->pText) + 1;
+    }
+
+    if ((pSsml = (char *)Allocator_malloc(uSize)) != NULL)
+    {
+        uLen += snprintf(pSsml + uLen, uSize - uLen, SSML_BEGIN);
+        for (i = 0; i < pxBatch->uCount; i++)
+        {
+            uLen += snprintf(pSsml + uLen, uSize - uLen, SSML_MARK_FORMAT, i);
+
+            /* The text is already escaped for JSON, so only the characters special to XML are escaped here. */
+            for (p = pxBatch->ppxItems[i]->pPara->pText; *p != '\0'; p++)
+            {
+                if (*p == '&')
+                {
+                    uLen += snprintf(pSsml + uLen, uSize - uLen, "&amp;");
+                }
+                else if (*p == '<')
+                {
+                    uLen += snprintf(pSsml + uLen, uSize - uLen, "&lt;");
+                }
+                else if (*p == '>')
+                {
+                    uLen += snprintf(pSsml + uLen, uSize - uLen, "&gt;");
+                }
+                else
+                {
+                    pSsml[uLen++] = *p;
+                }
+            }
+            pSsml[uLen++] = ' ';
+        }
+        snprintf(pSsml + uLen, uSize - uLen, SSML_END);
+    }
+
+    return pSsml;
+}
+
+static int prvOnSpeechMarksData(uint8_t *pData, size_t uLen, void *pUserData)
+{
+    SpeechMarks_t *pxMarks = (SpeechMarks_t *)pUserData;
+    char *pTemp = NULL;
+    size_t uNewSize = 0;
+
+    if (!pxMarks->bOutOfMemory && pxMarks->uLen + uLen + 1 > pxMarks->uSize)
+    {
+        uNewSize = (pxMarks->uSize == 0) ? SPEECH_MARKS_INITIAL_BUFSIZE : pxMarks->uSize;
+        while (pxMarks->uLen + uLen + 1 > uNewSize)
+        {
+            uNewSize *= 2;
+        }
+
+        if ((pTemp = (char *)Allocator_realloc(pxMarks->pBuf, uNewSize)) == NULL)
+        {
+            pxMarks->bOutOfMemory = true;
+        }
+        else
+        {
+            pxMarks->pBuf = pTemp;
+            pxMarks->uSize = uNewSize;
+        }
+    }
+
+    if (!pxMarks->bOutOfMemory)
+    {
+        memcpy(pxMarks->pBuf + pxMarks->uLen, pData, uLen);
+        pxMarks->uLen += uLen;
+        pxMarks->pBuf[pxMarks->uLen] = '\0';
+    }
+
+    return 0;
+}
+
+/* The marks are JSON lines, ex: {"time":370,"type":"ssml","start":163,"end":181,"value":"2"} */
+static bool prvParseSpeechMarks(Batch_t *pxBatch, char *pMarks)
+{
+    bool *pbFound = NULL;
+    bool bComplete = false;
+    char *pLine = pMarks;
+    char *pEnd = NULL;
+    const char *pTime = NULL;
+    const char *pValue = NULL;
+    unsigned long uIndex = 0;
+    unsigned int i = 0;
+
+    if ((pbFound = (bool *)Allocator_calloc(pxBatch->uCount, sizeof(bool))) != NULL)
+    {
+        for (; pLine != NULL && *pLine != '\0'; pLine = (pEnd != NULL) ? pEnd + 1 : NULL)
+        {
+            if ((pEnd = strchr(pLine, '\n')) != NULL)
+            {
+                *pEnd = '\0';
+            }
+
+            if (strstr(pLine, "\"type\":\"ssml\"") != NULL &&
+                (pTime = strstr(pLine, "\"time\":")) != NULL &&
+                (pValue = strstr(pLine, "\"value\":\"")) != NULL &&
+                (uIndex = strtoul(pValue + sizeof("\"value\":\"") - 1, NULL, 10)) < pxBatch->uCount)
+            {
+                pxBatch->ppxItems[uIndex]->uStartMs = (uint32_t)strtoul(pTime + sizeof("\"time\":") - 1, NULL, 10);
+                pbFound[uIndex] = true;
+            }
+        }
+
+        bComplete = true;
+        for (i = 0; i < pxBatch->uCount; i++)
+        {
+            bComplete = bComplete && pbFound[i];
+        }
+
+        /* Whatever comes before the first mark, like leading silence, belongs to the first request. */
+        pxBatch->ppxItems[0]->uStartMs = 0;
+
+        Allocator_free(pbFound);
+    }
+
+    return bComplete;
+}
+
+/* The sample where the audio of a request starts */
+static uint64_t prvGetStartSample(AudioSplitter_t *pxSplitter, unsigned int uItem, uint32_t uSampleRate)
+{
+    return (uint64_t)pxSplitter->pxBatch->ppxItems[uItem]->uStartMs * uSampleRate / 1000;
+}
+
+/* Move to the last request which starts at or before the given sample */
+static void prvSeek(AudioSplitter_t *pxSplitter, uint64_t uSample, uint32_t uSampleRate)
+{
+    while (pxSplitter->uItem + 1 < pxSplitter->pxBatch->uCount && prvGetStartSample(pxSplitter, pxSplitter->uItem + 1, uSampleRate) <= uSample)
+    {
+        pxSplitter->uItem++;
+    }
+}
+
+static int prvOnPcmData(uint8_t *pData, size_t uLen, void *pUserData)
+{
+    AudioSplitter_t *pxSplitter = (AudioSplitter_t *)pUserData;
+    PollySynthesizeSpeechOutput_t *pOut = NULL;
+    uint64_t uNextStart = 0;
+    size_t uSliceLen = 0;
+
+    while (uLen > 0)
+    {
+        prvSeek(pxSplitter, pxSplitter->uPosition / PCM_BYTES_PER_SAMPLE, pxSplitter->uPcmSampleRate);
+
+        /* The slice ends where the next request starts, at a sample boundary. It's past the current position, so every slice has data. */
+        uSliceLen = uLen;
+        if (pxSplitter->uItem + 1 < pxSplitter->pxBatch->uCount)
+        {
+            uNextStart = prvGetStartSample(pxSplitter, pxSplitter->uItem + 1, pxSplitter->uPcmSampleRate) * PCM_BYTES_PER_SAMPLE;
+            if (uNextStart - pxSplitter->uPosition < uSliceLen)
+            {
+                uSliceLen = (size_t)(uNextStart - pxSplitter->uPosition);
+            }
+        }
+
+        pOut = pxSplitter->pxBatch->ppxItems[pxSplitter->uItem]->pOut;
+        if (pOut->onDataCallback != NULL)
+        {
+            pOut->onDataCallback(pData, uSliceLen, pOut->pUserData);
+        }
+        pxSplitter->uPosition += uSliceLen;
+        pData += uSliceLen;
+        uLen -= uSliceLen;
+    }
+
+    return 0;
+}
+
+static void prvDeliverMp3Frames(PollySynthesizeSpeechOutput_t *pOut, const uint8_t **ppFrames, const size_t *puFrameLens, size_t uFrameCount)
+{
+    size_t i = 0;
+
+    if (pOut->onFramesCallback != NULL)
+    {
+        pOut->onFramesCallback(ppFrames, puFrameLens, uFrameCount, pOut->pUserData);
+    }
+    else if (pOut->onDataCallback != NULL)
+    {
+        for (i = 0; i < uFrameCount; i++)
+        {
+            pOut->onDataCallback((uint8_t *)ppFrames[i], puFrameLens[i], pOut->pUserData);
+        }
+    }
+}
+
+static int prvOnMp3Frames(const uint8_t **ppFrames, const size_t *puFrameLens, size_t uFrameCount, void *pUserData)
+{
+    AudioSplitter_t *pxSplitter = (AudioSplitter_t *)pUserData;
+    uint32_t uSamples = 0;
+    uint32_t uSampleRate = 0;
+    unsigned int uItem = 0;
+    size_t uRunStart = 0;
+    size_t i = 0;
+
+    /* A frame belongs to the request which is being spoken when the frame starts. Consecutive frames of a request are delivered at once. */
+    for (i = 0; i < uFrameCount; i++)
+    {
+        if (FrameAligner_getMp3Duration(ppFrames[i], puFrameLens[i], &uSamples, &uSampleRate) == FRAME_ALIGNER_ERRNO_NONE)
+        {
+            uItem = pxSplitter->uItem;
+            prvSeek(pxSplitter, pxSplitter->uPosition, uSampleRate);
+            if (pxSplitter->uItem != uItem && i > uRunStart)
+            {
+                prvDeliverMp3Frames(pxSplitter->pxBatch->ppxItems[uItem]->pOut, ppFrames + uRunStart, puFrameLens + uRunStart, i - uRunStart);
+                uRunStart = i;
+            }
+            pxSplitter->uPosition += uSamples;
+        }
+    }
+
+    if (uFrameCount > uRunStart)
+    {
+        prvDeliverMp3Frames(pxSplitter->pxBatch->ppxItems[pxSplitter->uItem]->pOut, ppFrames + uRunStart, puFrameLens + uRunStart, uFrameCount - uRunStart);
+    }
+
+    return 0;
+}
+
+static void prvSetResult(BatchItem_t *pxItem, int res, PollySynthesizeSpeechOutput_t *pBatchOut)
+{
+    pxItem->res = res;
+    pxItem->pOut->uStatusCode = pBatchOut->uStatusCode;
+    memcpy(pxItem->pOut->pErrorType, pBatchOut->pErrorType, POLLY_ERROR_TYPE_MAX_LEN);
+    pxItem->pOut->uAttempts = pBatchOut->uAttempts;
+    pxItem->pOut->uPeakMemBytes = pBatchOut->uPeakMemBytes;
+    pxItem->pOut->uConnMemBytes = pBatchOut->uConnMemBytes;
+}
+
+/* Synthesize the texts of a batch as one SSML request with a mark before each of them. The speech marks of the same SSML tell where
+ * the audio of every request starts, so the marks are requested first and the audio is split as it streams. */
+static void prvExecuteBatch(Batch_t *pxBatch)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollySynthesizeSpeechParameter_t xPara;
+    PollySynthesizeSpeechOutput_t xOut;
+    SpeechMarks_t xMarks = { 0 };
+    AudioSplitter_t xSplitter = { 0 };
+    char *pSsml = NULL;
+    unsigned int i = 0;
+
+    memcpy(&xPara, pxBatch->ppxItems[0]->pPara, sizeof(PollySynthesizeSpeechParameter_t));
+    memset(&xOut, 0, sizeof(PollySynthesizeSpeechOutput_t));
+
+    if ((pSsml = prvGenSsml(pxBatch)) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        xPara.pText = pSsml;
+        xPara.pTextType = "ssml";
+        xPara.pOutputFormat = "json";
+        xPara.pSampleRate = NULL;
+        xPara.pSpeechMarkTypes = "ssml";
+        xOut.onDataCallback = prvOnSpeechMarksData;
+        xOut.pUserData = &xMarks;
+
+        res = Polly_synthesizeSpeech(pxBatch->pServPara, &xPara, &xOut);
+        if (res == POLLY_ERRNO_NONE && xMarks.bOutOfMemory)
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+    }
+
+    if (res == POLLY_ERRNO_NONE && (xMarks.pBuf == NULL || !prvParseSpeechMarks(pxBatch, xMarks.pBuf)))
+    {
+        /* The audio can't be split without every mark, so the requests are sent on their own. */
+        for (i = 0; i < pxBatch->uCount; i++)
+        {
+            pxBatch->ppxItems[i]->res = Polly_synthesizeSpeech(pxBatch->pServPara, pxBatch->ppxItems[i]->pPara, pxBatch->ppxItems[i]->pOut);
+        }
+    }
+    else
+    {
+        if (res == POLLY_ERRNO_NONE)
+        {
+            xPara.pOutputFormat = pxBatch->ppxItems[0]->pPara->pOutputFormat;
+            xPara.pSampleRate = pxBatch->ppxItems[0]->pPara->pSampleRate;
+            xPara.pSpeechMarkTypes = NULL;
+            memset(&xOut, 0, sizeof(PollySynthesizeSpeechOutput_t));
+            xSplitter.pxBatch = pxBatch;
+            xOut.pUserData = &xSplitter;
+
+            if (strcmp(xPara.pOutputFormat, "pcm") == 0)
+            {
+                xSplitter.uPcmSampleRate = (xPara.pSampleRate != NULL) ? (uint32_t)strtoul(xPara.pSampleRate, NULL, 10) : DEFAULT_PCM_SAMPLE_RATE;
+                xSplitter.uPcmSampleRate = (xSplitter.uPcmSampleRate != 0) ? xSplitter.uPcmSampleRate : DEFAULT_PCM_SAMPLE_RATE;
+                xOut.onDataCallback = prvOnPcmData;
+            }
+            else
+            {
+                xOut.onFramesCallback = prvOnMp3Frames;
+            }
+
+            res = Polly_synthesizeSpeech(pxBatch->pServPara, &xPara, &xOut);
+        }
+
+        for (i = 0; i < pxBatch->uCount; i++)
+        {
+            prvSetResult(pxBatch->ppxItems[i], res, &xOut);
+        }
+    }
+
+    if (xMarks.pBuf != NULL)
+    {
+        Allocator_free(xMarks.pBuf);
+    }
+    if (pSsml != NULL)
+    {
+        Allocator_free(pSsml);
+    }
+}
+
+static void prvRemoveOpenBatch(PollyBatcher_t *pxBatcher, Batch_t *pxBatch)
+{
+    Batch_t **ppxPrev = &(pxBatcher->pxOpen);
+
+    while (*ppxPrev != NULL && *ppxPrev != pxBatch)
+    {
+        ppxPrev = &((*ppxPrev)->pxNext);
+    }
+    if (*ppxPrev != NULL)
+    {
+        *ppxPrev = pxBatch->pxNext;
+    }
+    pxBatch->bClosed = true;
+}
+
+static Batch_t *prvCreateBatch(PollyBatcher_t *pxBatcher, PollyServiceParameter_t *pServPara)
+{
+    Batch_t *pxBatch = NULL;
+
+    if ((pxBatch = (Batch_t *)Allocator_malloc(sizeof(Batch_t))) != NULL)
+    {
+        memset(pxBatch, 0, sizeof(Batch_t));
+        pxBatch->pServPara = pServPara;
+        if ((pxBatch->ppxItems = (BatchItem_t **)Allocator_calloc(pxBatcher->xConfig.uMaxBatchSize, sizeof(BatchItem_t *))) == NULL)
+        {
+            Allocator_free(pxBatch);
+            pxBatch = NULL;
+        }
+    }
+
+    return pxBatch;
+}
+
+static void prvDestroyBatch(Batch_t *pxBatch)
+{
+    if (pxBatch != NULL)
+    {
+        Allocator_free(pxBatch->ppxItems);
+        Allocator_free(pxBatch);
+    }
+}
+
+PollyBatcherHandle PollyBatcher_create(const PollyBatcherConfig_t *pConfig)
+{
+    PollyBatcher_t *pxBatcher = NULL;
+    bool bLockInited = false;
+
+    if (pConfig != NULL && (pxBatcher = (PollyBatcher_t *)Allocator_malloc(sizeof(PollyBatcher_t))) != NULL)
+    {
+        memset(pxBatcher, 0, sizeof(PollyBatcher_t));
+        memcpy(&(pxBatcher->xConfig), pConfig, sizeof(PollyBatcherConfig_t));
+
+        if (pxBatcher->xConfig.uWindowMs == 0)
+        {
+            pxBatcher->xConfig.uWindowMs = DEFAULT_BATCH_WINDOW_MS;
+        }
+        if (pxBatcher->xConfig.uMaxBatchSize == 0)
+        {
+            pxBatcher->xConfig.uMaxBatchSize = DEFAULT_MAX_BATCH_SIZE;
+        }
+        if (pxBatcher->xConfig.uMaxTextLen == 0)
+        {
+            pxBatcher->xConfig.uMaxTextLen = DEFAULT_MAX_BATCHED_TEXT_LEN;
+        }
+
+        if (!(bLockInited = (pthread_mutex_init(&(pxBatcher->xLock), NULL) == 0)) ||
+            pthread_cond_init(&(pxBatcher->xCond), NULL) != 0)
+        {
+            if (bLockInited)
+            {
+                pthread_mutex_destroy(&(pxBatcher->xLock));
+            }
+            Allocator_free(pxBatcher);
+            pxBatcher = NULL;
+        }
+    }
+
+    return pxBatcher;
+}
+
+void PollyBatcher_terminate(PollyBatcherHandle xBatcher)
+{
+    PollyBatcher_t *pxBatcher = (PollyBatcher_t *)xBatcher;
+
+    if (pxBatcher != NULL)
+    {
+        pthread_cond_destroy(&(pxBatcher->xCond));
+        pthread_mutex_destroy(&(pxBatcher->xLock));
+        Allocator_free(pxBatcher);
+    }
+}
+
+int PollyBatcher_synthesizeSpeech(PollyBatcherHandle xBatcher, PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollyBatcher_t *pxBatcher = (PollyBatcher_t *)xBatcher;
+    Batch_t *pxBatch = NULL;
+    BatchItem_t xItem = { 0 };
+    uint64_t uDeadlineMs = 0;
+    uint64_t uNowMs = 0;
+
+    if (pxBatcher == NULL || pServPara == NULL || pPara == NULL || pOut == NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else if (!prvIsBatchable(pxBatcher, pPara, pOut))
+    {
+        res = Polly_synthesizeSpeech(pServPara, pPara, pOut);
+    }
+    else
+    {
+        xItem.pPara = pPara;
+        xItem.pOut = pOut;
+
+        pthread_mutex_lock(&(pxBatcher->xLock));
+        for (pxBatch = pxBatcher->pxOpen; pxBatch != NULL && !prvCanJoin(pxBatcher, pxBatch, pServPara, pPara); pxBatch = pxBatch->pxNext)
+        {
+        }
+
+        if (pxBatch != NULL)
+        {
+            /* Join the batch, and wait for the request which opened it to deliver the audio */
+            pxBatch->ppxItems[pxBatch->uCount++] = &xItem;
+            pxBatch->uTextLen += strlen(pPara->pText);
+            if (pxBatch->uCount == pxBatcher->xConfig.uMaxBatchSize)
+            {
+                pthread_cond_broadcast(&(pxBatcher->xCond));
+            }
+            while (!xItem.bDone)
+            {
+                pthread_cond_wait(&(pxBatcher->xCond), &(pxBatcher->xLock));
+            }
+            pthread_mutex_unlock(&(pxBatcher->xLock));
+            res = xItem.res;
+        }
+        else if ((pxBatch = prvCreateBatch(pxBatcher, pServPara)) == NULL)
+        {
+            pthread_mutex_unlock(&(pxBatcher->xLock));
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            /* Open a batch, and collect the requests which arrive within the window */
+            pxBatch->ppxItems[pxBatch->uCount++] = &xItem;
+            pxBatch->uTextLen = strlen(pPara->pText);
+            pxBatch->pxNext = pxBatcher->pxOpen;
+            pxBatcher->pxOpen = pxBatch;
+
+            uDeadlineMs = Port_getTimeMs() + pxBatcher->xConfig.uWindowMs;
+            while (pxBatch->uCount < pxBatcher->xConfig.uMaxBatchSize && (uNowMs = Port_getTimeMs()) < uDeadlineMs)
+            {
+                prvTimedWait(pxBatcher, uDeadlineMs - uNowMs);
+            }
+            prvRemoveOpenBatch(pxBatcher, pxBatch);
+            pthread_mutex_unlock(&(pxBatcher->xLock));
+
+            if (pxBatch->uCount == 1)
+            {
+                /* Nobody joined, so the marks would be pure overhead */
+                xItem.res = Polly_synthesizeSpeech(pServPara, pPara, pOut);
+            }
+            else
+            {
+                prvExecuteBatch(pxBatch);
+            }
+
+            pthread_mutex_lock(&(pxBatcher->xLock));
+            while (pxBatch->uCount > 0)
+            {
+                pxBatch->ppxItems[--(pxBatch->uCount)]->bDone = true;
+            }
+            pthread_cond_broadcast(&(pxBatcher->xCond));
+            pthread_mutex_unlock(&(pxBatcher->xLock));
+
+            prvDestroyBatch(pxBatch);
+            res = xItem.res;
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "buffer_pool.h"
+
+/* Sizes are rounded up to a power of two, so a recycled buffer fits the next request of the same kind. */
+#define BUFFER_POOL_MIN_SIZE    2048
+
+/* Buffers released beyond this are freed, so a burst of retained slices doesn't pin memory forever. */
+#define BUFFER_POOL_MAX_IDLE    8
+
+typedef struct PollyBuffer
+{
+    struct PollyBuffer *pxNext; // Only used while the buffer is idle
+    size_t uSize;
+    uint32_t uRefs;
+    uint8_t pData[];
+} PollyBuffer_t;
+
+static pthread_mutex_t gxIdleLock = PTHREAD_MUTEX_INITIALIZER;
+static PollyBuffer_t *gpxIdleBuffers = NULL;
+static unsigned int guIdleCount = 0;
+
+static size_t prvRoundUpSize(size_t uSize)
+{
+    size_t uRounded = BUFFER_POOL_MIN_SIZE;
+
+    while (uRounded < uSize)
+    {
+        uRounded *= 2;
+    }
+
+    return uRounded;
+}
+
+PollyBufferHandle BufferPool_acquire(size_t uSize)
+{
+    PollyBuffer_t *pxBuffer = NULL;
+    PollyBuffer_t **ppxIter = NULL;
+
+    uSize = prvRoundUpSize(uSize);
+
+    pthread_mutex_lock(&gxIdleLock);
+    for (ppxIter = &gpxIdleBuffers; *ppxIter != NULL; ppxIter = &((*ppxIter)->pxNext))
+    {
+        if ((*ppxIter)->uSize >= uSize)
+        {
+            pxBuffer = *ppxIter;
+            *ppxIter = pxBuffer->pxNext;
+            guIdleCount--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gxIdleLock);
+
+    if (pxBuffer == NULL && (pxBuffer = (PollyBuffer_t *)Allocator_malloc(sizeof(PollyBuffer_t) + uSize)) != NULL)
+    {
+        pxBuffer->uSize = uSize;
+    }
+
+    if (pxBuffer != NULL)
+    {
+        pxBuffer->pxNext = NULL;
+        pxBuffer->uRefs = 1;
+    }
+
+    return pxBuffer;
+}
+
+uint8_t *BufferPool_getData(PollyBufferHandle xBuffer)
+{
+    return ((PollyBuffer_t *)xBuffer)->pData;
+}
+
+size_t BufferPool_getSize(PollyBufferHandle xBuffer)
+{
+    return ((PollyBuffer_t *)xBuffer)->uSize;
+}
+
+bool BufferPool_isShared(PollyBufferHandle xBuffer)
+{
+    return __atomic_load_n(&(((PollyBuffer_t *)xBuffer)->uRefs), __ATOMIC_ACQUIRE) > 1;
+}
+
+void PollyBuffer_retain(PollyBufferHandle xBuffer)
+{
+    PollyBuffer_t *pxBuffer = (PollyBuffer_t *)xBuffer;
+
+    if (pxBuffer != NULL)
+    {
+        __atomic_add_fetch(&(pxBuffer->uRefs), 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+void PollyBuffer_release(PollyBufferHandle xBuffer)
+{
+    PollyBuffer_t *pxBuffer = (PollyBuffer_t *)xBuffer;
+
+    if (pxBuffer != NULL && __atomic_sub_fetch(&(pxBuffer->uRefs), 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_lock(&gxIdleLock);
+        if (guIdleCount < BUFFER_POOL_MAX_IDLE)
+        {
+            pxBuffer->pxNext = gpxIdleBuffers;
+            gpxIdleBuffers = pxBuffer;
+            guIdleCount++;
+            pxBuffer = NULL;
+        }
+        pthread_mutex_unlock(&gxIdleLock);
+
+        Allocator_free(pxBuffer);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "polly/polly.h"
+
+/**
+ * @brief Take a buffer of at least uSize bytes, from the recycled ones if one is large enough. The caller holds its only reference,
+ * and drops it by PollyBuffer_release().
+ *
+ * @param[in] uSize The minimum size of the buffer
+ * @return The buffer handle, or NULL if it runs out of memory
+ */
+PollyBufferHandle BufferPool_acquire(size_t uSize);
+
+/**
+ * @brief Get the data of a buffer
+ *
+ * @param[in] xBuffer The buffer handle
+ * @return The data of the buffer
+ */
+uint8_t *BufferPool_getData(PollyBufferHandle xBuffer);
+
+/**
+ * @brief Get the size of a buffer, which may be larger than the size it was acquired with
+ *
+ * @param[in] xBuffer The buffer handle
+ * @return The size of the buffer
+ */
+size_t BufferPool_getSize(PollyBufferHandle xBuffer);
+
+/**
+ * @brief Tell whether anyone else holds a reference of a buffer, so its data must not be overwritten
+ *
+ * @param[in] xBuffer The buffer handle
+ * @return true if the buffer has more than one reference
+ */
+bool BufferPool_isShared(PollyBufferHandle xBuffer);
+
+#endif /* BUFFER_POOL_H */
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "cancel_token.h"
+#include "port.h"
+
+typedef struct PollyCancelToken
+{
+    bool bCancelled;
+
+    /* The read end becomes readable once cancelled. Nothing ever reads it, so it stays readable for every poll(). */
+    int xPipe[2];
+} PollyCancelToken_t;
+
+static int prvSetNonBlocking(int fd)
+{
+    int xFlags = fcntl(fd, F_GETFL, 0);
+
+    return (xFlags < 0) ? -1 : fcntl(fd, F_SETFL, xFlags | O_NONBLOCK);
+}
+
+PollyCancelTokenHandle PollyCancelToken_create(void)
+{
+    PollyCancelToken_t *pxToken = NULL;
+
+    if ((pxToken = (PollyCancelToken_t *)Allocator_calloc(1, sizeof(PollyCancelToken_t))) == NULL)
+    {
+        /* Propagate the error */
+    }
+    else if (pipe(pxToken->xPipe) != 0)
+    {
+        Allocator_free(pxToken);
+        pxToken = NULL;
+    }
+    else if (prvSetNonBlocking(pxToken->xPipe[0]) != 0 || prvSetNonBlocking(pxToken->xPipe[1]) != 0)
+    {
+        PollyCancelToken_terminate(pxToken);
+        pxToken = NULL;
+    }
+
+    return pxToken;
+}
+
+int PollyCancelToken_cancel(PollyCancelTokenHandle xCancelToken)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollyCancelToken_t *pxToken = (PollyCancelToken_t *)xCancelToken;
+    uint8_t uByte = 1;
+
+    if (pxToken == NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else if (!__atomic_exchange_n(&(pxToken->bCancelled), true, __ATOMIC_ACQ_REL))
+    {
+        /* Only the first call writes, so the pipe never fills up. */
+        while (write(pxToken->xPipe[1], &uByte, 1) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    return res;
+}
+
+void PollyCancelToken_terminate(PollyCancelTokenHandle xCancelToken)
+{
+    PollyCancelToken_t *pxToken = (PollyCancelToken_t *)xCancelToken;
+
+    if (pxToken != NULL)
+    {
+        close(pxToken->xPipe[0]);
+        close(pxToken->xPipe[1]);
+        Allocator_free(pxToken);
+    }
+}
+
+bool CancelToken_isCancelled(PollyCancelTokenHandle xCancelToken)
+{
+    PollyCancelToken_t *pxToken = (PollyCancelToken_t *)xCancelToken;
+
+    return pxToken != NULL && __atomic_load_n(&(pxToken->bCancelled), __ATOMIC_ACQUIRE);
+}
+
+int CancelToken_getFd(PollyCancelTokenHandle xCancelToken)
+{
+    PollyCancelToken_t *pxToken = (PollyCancelToken_t *)xCancelToken;
+
+    return (pxToken == NULL) ? -1 : pxToken->xPipe[0];
+}
+
+bool CancelToken_sleepMs(PollyCancelTokenHandle xCancelToken, uint32_t uMs)
+{
+    struct pollfd xPollFd = {0};
+    uint64_t uEndMs = 0;
+    uint64_t uNowMs = 0;
+
+    if (xCancelToken == NULL)
+    {
+        Port_sleepMs(uMs);
+    }
+    else
+    {
+        xPollFd.fd = CancelToken_getFd(xCancelToken);
+        xPollFd.events = POLLIN;
+        uEndMs = Port_getTimeMs() + uMs;
+        while (!CancelToken_isCancelled(xCancelToken) && (uNowMs = Port_getTimeMs()) < uEndMs)
+        {
+            /* Woken up early by a signal or by the cancellation, which the loop condition tells apart. */
+            (void)poll(&xPollFd, 1, (int)(uEndMs - uNowMs));
+        }
+    }
+
+    return !CancelToken_isCancelled(xCancelToken);
+}
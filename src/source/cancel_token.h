@@ -0,0 +1,35 @@
+#ifndef CANCEL_TOKEN_H
+#define CANCEL_TOKEN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "polly/polly.h"
+
+/**
+ * @brief Tell whether a token has been cancelled
+ *
+ * @param[in] xCancelToken The cancellation token handle, or NULL if the request can't be cancelled
+ * @return true if PollyCancelToken_cancel() has been called on the token
+ */
+bool CancelToken_isCancelled(PollyCancelTokenHandle xCancelToken);
+
+/**
+ * @brief Get a file descriptor which becomes readable, and stays readable, once the token is cancelled. It's meant to be polled
+ * together with a socket.
+ *
+ * @param[in] xCancelToken The cancellation token handle, or NULL if the request can't be cancelled
+ * @return The file descriptor, or -1 if the handle is NULL
+ */
+int CancelToken_getFd(PollyCancelTokenHandle xCancelToken);
+
+/**
+ * @brief Suspend the calling thread until the time is up or the token is cancelled
+ *
+ * @param[in] xCancelToken The cancellation token handle, or NULL if the request can't be cancelled
+ * @param[in] uMs Milliseconds to sleep
+ * @return false if the sleep was cut short by the cancellation
+ */
+bool CancelToken_sleepMs(PollyCancelTokenHandle xCancelToken, uint32_t uMs);
+
+#endif /* CANCEL_TOKEN_H */
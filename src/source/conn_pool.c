@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "conn_pool.h"
+#include "netio.h"
+#include "port.h"
+#include "trust_store.h"
+
+#define DEFAULT_MAX_CONNECTIONS         (4)
+
+/* AWS front-ends close a keep-alive connection which is idle for about a minute. */
+#define DEFAULT_SERVER_IDLE_TIMEOUT_MS  (60 * 1000)
+
+/* Connections are refreshed once they are idle for this percentage of the server idle timeout. */
+#define REFRESH_IDLE_PERCENT            (75)
+
+/* The longest time the maintenance thread sleeps if nothing wakes it up */
+#define MAINTENANCE_INTERVAL_MS         (1000)
+
+typedef struct
+{
+    NetIoHandle xNetIo;
+    uint64_t uIdleSinceMs;
+} PooledConn_t;
+
+typedef struct PollyConnPool
+{
+    PollyConnPoolConfig_t xConfig;
+    char *pHost;
+    char *pPort; // It shares the allocation of pHost
+    unsigned int uRecvTimeoutMs;
+    unsigned int uConnectTimeoutMs;
+    unsigned int uTlsMaxFragmentLen;
+    PollySocketOptions_t xSocketOptions;
+    PollyTrustStoreHandle xTrustStore;
+    PollyTransportHandle xTransport;
+    uint32_t uRefreshMs;
+
+    pthread_mutex_t xLock;
+    pthread_cond_t xCond;
+    pthread_t xThread;
+    bool bThreadStarted;
+    bool bStop;
+
+    /* The idle connections are a stack, so the most recently used one is handed out first. */
+    PooledConn_t *pxIdle;
+    unsigned int uIdleCount;
+    unsigned int uTarget;
+    unsigned int uConnecting;
+} PollyConnPool_t;
+
+static NetIoHandle prvConnect(PollyConnPool_t *pxConnPool)
+{
+    NetIoHandle xNetIo = NULL;
+
+    if ((xNetIo = NetIo_create()) != NULL)
+    {
+        if (NetIo_setRecvTimeout(xNetIo, pxConnPool->uRecvTimeoutMs) != NETIO_ERRNO_NONE ||
+            NetIo_setConnectTimeout(xNetIo, pxConnPool->uConnectTimeoutMs) != NETIO_ERRNO_NONE ||
+            NetIo_setMaxFragmentLength(xNetIo, pxConnPool->uTlsMaxFragmentLen) != NETIO_ERRNO_NONE ||
+            NetIo_setSocketOptions(xNetIo, &(pxConnPool->xSocketOptions)) != NETIO_ERRNO_NONE ||
+            NetIo_setTrustStore(xNetIo, pxConnPool->xTrustStore) != NETIO_ERRNO_NONE ||
+            NetIo_setTransport(xNetIo, pxConnPool->xTransport) != NETIO_ERRNO_NONE ||
+            NetIo_connect(xNetIo, pxConnPool->pHost, pxConnPool->pPort) != NETIO_ERRNO_NONE)
+        {
+            NetIo_terminate(xNetIo);
+            xNetIo = NULL;
+        }
+    }
+
+    return xNetIo;
+}
+
+static bool prvPushIdle(PollyConnPool_t *pxConnPool, NetIoHandle xNetIo)
+{
+    bool bPushed = false;
+
+    if (pxConnPool->uIdleCount < pxConnPool->xConfig.uMaxConnections)
+    {
+        pxConnPool->pxIdle[pxConnPool->uIdleCount].xNetIo = xNetIo;
+        pxConnPool->pxIdle[pxConnPool->uIdleCount].uIdleSinceMs = Port_getTimeMs();
+        pxConnPool->uIdleCount++;
+        bPushed = true;
+    }
+
+    return bPushed;
+}
+
+/* Take out a connection which is about to expire or is closed by the server. It has to be called with the lock held. */
+static NetIoHandle prvTakeExpired(PollyConnPool_t *pxConnPool, uint64_t uNowMs, uint64_t *puNextExpiryMs)
+{
+    NetIoHandle xNetIo = NULL;
+    uint64_t uExpiryMs = 0;
+    unsigned int i = 0;
+
+    for (i = 0; i < pxConnPool->uIdleCount; i++)
+    {
+        uExpiryMs = pxConnPool->pxIdle[i].uIdleSinceMs + pxConnPool->uRefreshMs;
+        if (uExpiryMs <= uNowMs || !NetIo_isIdleConnectionAlive(pxConnPool->pxIdle[i].xNetIo))
+        {
+            xNetIo = pxConnPool->pxIdle[i].xNetIo;
+            memmove(&(pxConnPool->pxIdle[i]), &(pxConnPool->pxIdle[i + 1]), (pxConnPool->uIdleCount - i - 1) * sizeof(PooledConn_t));
+            pxConnPool->uIdleCount--;
+            break;
+        }
+        else if (uExpiryMs < *puNextExpiryMs)
+        {
+            *puNextExpiryMs = uExpiryMs;
+        }
+    }
+
+    return xNetIo;
+}
+
+/* Wait for a wakeup or a timeout. It has to be called with the lock held. */
+static void prvTimedWait(PollyConnPool_t *pxConnPool, uint64_t uWaitMs)
+{
+    struct timespec xDeadline = {0};
+
+    clock_gettime(CLOCK_REALTIME, &xDeadline);
+    xDeadline.tv_sec += uWaitMs / 1000;
+    xDeadline.tv_nsec += (long)(uWaitMs % 1000) * 1000000;
+    if (xDeadline.tv_nsec >= 1000000000)
+    {
+        xDeadline.tv_sec++;
+        xDeadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&(pxConnPool->xCond), &(pxConnPool->xLock), &xDeadline);
+}
+
+static void *prvMaintenanceThread(void *pArg)
+{
+    PollyConnPool_t *pxConnPool = (PollyConnPool_t *)pArg;
+    NetIoHandle xNetIo = NULL;
+    uint64_t uNowMs = 0;
+    uint64_t uNextExpiryMs = 0;
+
+    pthread_mutex_lock(&(pxConnPool->xLock));
+    while (!pxConnPool->bStop)
+    {
+        uNowMs = Port_getTimeMs();
+        uNextExpiryMs = uNowMs + MAINTENANCE_INTERVAL_MS;
+
+        if ((xNetIo = prvTakeExpired(pxConnPool, uNowMs, &uNextExpiryMs)) != NULL)
+        {
+            /* Close it before the server does, and let the next round open a fresh one. */
+            pthread_mutex_unlock(&(pxConnPool->xLock));
+            NetIo_terminate(xNetIo);
+            pthread_mutex_lock(&(pxConnPool->xLock));
+        }
+        else if (pxConnPool->uIdleCount + pxConnPool->uConnecting < pxConnPool->uTarget)
+        {
+            /* DNS, TCP and TLS handshakes are slow, so do them without the lock. */
+            pxConnPool->uConnecting++;
+            pthread_mutex_unlock(&(pxConnPool->xLock));
+            xNetIo = prvConnect(pxConnPool);
+            pthread_mutex_lock(&(pxConnPool->xLock));
+            pxConnPool->uConnecting--;
+
+            if (xNetIo == NULL)
+            {
+                /* Back off a while if the host is not reachable. */
+                prvTimedWait(pxConnPool, MAINTENANCE_INTERVAL_MS);
+            }
+            else if (!prvPushIdle(pxConnPool, xNetIo))
+            {
+                pthread_mutex_unlock(&(pxConnPool->xLock));
+                NetIo_terminate(xNetIo);
+                pthread_mutex_lock(&(pxConnPool->xLock));
+            }
+        }
+        else
+        {
+            prvTimedWait(pxConnPool, uNextExpiryMs - uNowMs);
+        }
+    }
+    pthread_mutex_unlock(&(pxConnPool->xLock));
+
+    return NULL;
+}
+
+PollyConnPoolHandle PollyConnPool_create(PollyServiceParameter_t *pServPara, const PollyConnPoolConfig_t *pConfig)
+{
+    PollyConnPool_t *pxConnPool = NULL;
+    size_t uHostLen = 0;
+    const char *pPort = NULL;
+    size_t uPortLen = 0;
+    bool bLockInited = false;
+    bool bCondInited = false;
+
+    if (pServPara != NULL && pServPara->pHost != NULL && pConfig != NULL &&
+        (pxConnPool = (PollyConnPool_t *)Allocator_malloc(sizeof(PollyConnPool_t))) != NULL)
+    {
+        memset(pxConnPool, 0, sizeof(PollyConnPool_t));
+        memcpy(&(pxConnPool->xConfig), pConfig, sizeof(PollyConnPoolConfig_t));
+
+        if (pxConnPool->xConfig.uMaxConnections == 0)
+        {
+            pxConnPool->xConfig.uMaxConnections = DEFAULT_MAX_CONNECTIONS;
+        }
+        if (pxConnPool->xConfig.uServerIdleTimeoutMs == 0)
+        {
+            pxConnPool->xConfig.uServerIdleTimeoutMs = DEFAULT_SERVER_IDLE_TIMEOUT_MS;
+        }
+        pxConnPool->uRefreshMs = pxConnPool->xConfig.uServerIdleTimeoutMs / 100 * REFRESH_IDLE_PERCENT;
+        pxConnPool->uRecvTimeoutMs = pServPara->uRecvTimeoutMs;
+        pxConnPool->uConnectTimeoutMs = pServPara->uConnectTimeoutMs;
+        pxConnPool->uTlsMaxFragmentLen = pServPara->uTlsMaxFragmentLen;
+        memcpy(&(pxConnPool->xSocketOptions), &(pServPara->xSocketOptions), sizeof(PollySocketOptions_t));
+        pxConnPool->xTrustStore = TrustStore_acquire(pServPara->xTrustStore);
+        pxConnPool->xTransport = pServPara->xTransport;
+        uHostLen = strlen(pServPara->pHost);
+        pPort = (pServPara->pPort != NULL) ? pServPara->pPort : POLLY_DEFAULT_PORT;
+        uPortLen = strlen(pPort);
+
+        if ((pxConnPool->pHost = (char *)Allocator_malloc(uHostLen + 1 + uPortLen + 1)) == NULL ||
+            (pxConnPool->pxIdle = (PooledConn_t *)Allocator_calloc(pxConnPool->xConfig.uMaxConnections, sizeof(PooledConn_t))) == NULL ||
+            !(bLockInited = (pthread_mutex_init(&(pxConnPool->xLock), NULL) == 0)) ||
+            !(bCondInited = (pthread_cond_init(&(pxConnPool->xCond), NULL) == 0)) ||
+            pthread_create(&(pxConnPool->xThread), NULL, prvMaintenanceThread, pxConnPool) != 0)
+        {
+            if (bCondInited)
+            {
+                pthread_cond_destroy(&(pxConnPool->xCond));
+            }
+            if (bLockInited)
+            {
+                pthread_mutex_destroy(&(pxConnPool->xLock));
+            }
+            TrustStore_release(pxConnPool->xTrustStore);
+            Allocator_free(pxConnPool->pxIdle);
+            Allocator_free(pxConnPool->pHost);
+            Allocator_free(pxConnPool);
+            pxConnPool = NULL;
+        }
+        else
+        {
+            memcpy(pxConnPool->pHost, pServPara->pHost, uHostLen + 1);
+            pxConnPool->pPort = pxConnPool->pHost + uHostLen + 1;
+            memcpy(pxConnPool->pPort, pPort, uPortLen + 1);
+            pxConnPool->bThreadStarted = true;
+        }
+    }
+
+    return pxConnPool;
+}
+
+int PollyConnPool_prewarm(PollyConnPoolHandle xConnPool, unsigned int uConnections)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollyConnPool_t *pxConnPool = (PollyConnPool_t *)xConnPool;
+
+    if (pxConnPool == NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pthread_mutex_lock(&(pxConnPool->xLock));
+        pxConnPool->uTarget = (uConnections < pxConnPool->xConfig.uMaxConnections) ? uConnections : pxConnPool->xConfig.uMaxConnections;
+        pthread_cond_signal(&(pxConnPool->xCond));
+        pthread_mutex_unlock(&(pxConnPool->xLock));
+    }
+
+    return res;
+}
+
+void PollyConnPool_terminate(PollyConnPoolHandle xConnPool)
+{
+    PollyConnPool_t *pxConnPool = (PollyConnPool_t *)xConnPool;
+    unsigned int i = 0;
+
+    if (pxConnPool != NULL)
+    {
+        if (pxConnPool->bThreadStarted)
+        {
+            pthread_mutex_lock(&(pxConnPool->xLock));
+            pxConnPool->bStop = true;
+            pthread_cond_signal(&(pxConnPool->xCond));
+            pthread_mutex_unlock(&(pxConnPool->xLock));
+            pthread_join(pxConnPool->xThread, NULL);
+        }
+
+        for (i = 0; i < pxConnPool->uIdleCount; i++)
+        {
+            NetIo_terminate(pxConnPool->pxIdle[i].xNetIo);
+        }
+
+        pthread_cond_destroy(&(pxConnPool->xCond));
+        pthread_mutex_destroy(&(pxConnPool->xLock));
+        TrustStore_release(pxConnPool->xTrustStore);
+        Allocator_free(pxConnPool->pxIdle);
+        Allocator_free(pxConnPool->pHost);
+        Allocator_free(pxConnPool);
+    }
+}
+
+NetIoHandle ConnPool_acquire(PollyConnPoolHandle xConnPool, PollyPriority_t ePriority)
+{
+    PollyConnPool_t *pxConnPool = (PollyConnPool_t *)xConnPool;
+    NetIoHandle xNetIo = NULL;
+    NetIoHandle xDead = NULL;
+    unsigned int uReserved = 0;
+
+    if (pxConnPool != NULL)
+    {
+        /* The reserved connections stay for interactive requests, and a bulk request opens its own. */
+        uReserved = (ePriority == POLLY_PRIORITY_BULK) ? pxConnPool->xConfig.uReservedConnections : 0;
+
+        pthread_mutex_lock(&(pxConnPool->xLock));
+        while (xNetIo == NULL && pxConnPool->uIdleCount > uReserved)
+        {
+            pxConnPool->uIdleCount--;
+            xNetIo = pxConnPool->pxIdle[pxConnPool->uIdleCount].xNetIo;
+            if (!NetIo_isIdleConnectionAlive(xNetIo))
+            {
+                xDead = xNetIo;
+                xNetIo = NULL;
+                pthread_mutex_unlock(&(pxConnPool->xLock));
+                NetIo_terminate(xDead);
+                pthread_mutex_lock(&(pxConnPool->xLock));
+            }
+        }
+
+        /* Let the maintenance thread replenish the pool */
+        pthread_cond_signal(&(pxConnPool->xCond));
+        pthread_mutex_unlock(&(pxConnPool->xLock));
+    }
+
+    return xNetIo;
+}
+
+void ConnPool_release(PollyConnPoolHandle xConnPool, NetIoHandle xNetIo)
+{
+    PollyConnPool_t *pxConnPool = (PollyConnPool_t *)xConnPool;
+    bool bPushed = false;
+
+    if (pxConnPool != NULL && xNetIo != NULL)
+    {
+        pthread_mutex_lock(&(pxConnPool->xLock));
+        bPushed = prvPushIdle(pxConnPool, xNetIo);
+        pthread_mutex_unlock(&(pxConnPool->xLock));
+    }
+
+    if (!bPushed)
+    {
+        NetIo_terminate(xNetIo);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include <stdbool.h>
+
+#include "polly/polly.h"
+
+#include "netio.h"
+
+/**
+ * @brief Take a ready connection from the pool
+ *
+ * @param[in] xConnPool The connection pool handle
+ * @param[in] ePriority The class of the request. A bulk request doesn't take the connections reserved for interactive ones.
+ * @return A connected network I/O handle, or NULL if there is no ready connection
+ */
+NetIoHandle ConnPool_acquire(PollyConnPoolHandle xConnPool, PollyPriority_t ePriority);
+
+/**
+ * @brief Return a connection to the pool after a request
+ *
+ * @param[in] xConnPool The connection pool handle
+ * @param[in] xNetIo The network I/O handle. It's terminated if the pool is full.
+ */
+void ConnPool_release(PollyConnPoolHandle xConnPool, NetIoHandle xNetIo);
+
+#endif /* CONN_POOL_H */
@@ -0,0 +1,827 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <pthread.h>
+
+#include "mbedtls/net_sockets.h"
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "credential_provider.h"
+#include "http_parser.h"
+#include "port.h"
+#include "sigv4.h"
+
+#define ENV_ACCESS_KEY                      "AWS_ACCESS_KEY_ID"
+#define ENV_SECRET_KEY                      "AWS_SECRET_ACCESS_KEY"
+#define ENV_SESSION_TOKEN                   "AWS_SESSION_TOKEN"
+
+#define DEFAULT_PROFILE                     "default"
+#define DEFAULT_ENDPOINT_PORT               "80"
+
+#define DEFAULT_REFRESH_BEFORE_EXPIRY_MS    (5 * 60 * 1000)
+#define DEFAULT_REFRESH_INTERVAL_MS         (15 * 60 * 1000)
+
+/* A failed refresh is retried with a doubling delay in this range, while the current credentials stay in use. */
+#define RETRY_MIN_DELAY_MS                  (1000)
+#define RETRY_MAX_DELAY_MS                  (60 * 1000)
+
+#define ENDPOINT_TIMEOUT_MS                 (5 * 1000)
+#define ENDPOINT_RESPONSE_MAX_LEN           (8 * 1024)
+
+/* Session tokens are long, so the fields are sized for the longest one. */
+#define CREDENTIAL_FIELD_MAX_LEN            (2048)
+#define FILE_LINE_MAX_LEN                   (CREDENTIAL_FIELD_MAX_LEN + 64)
+
+typedef struct PollyCredentialProvider
+{
+    PollyCredentialProviderConfig_t xConfig;
+
+    /* The published snapshot. It's swapped atomically, and the previous ones are freed by later rotations. */
+    Credentials_t *pxCurrent;
+    Credentials_t *pxRetired;
+
+    pthread_mutex_t xLock;
+    pthread_cond_t xCond;
+    pthread_t xThread;
+    bool bThreadStarted;
+    bool bStop;
+} PollyCredentialProvider_t;
+
+static char *prvStrDup(const char *pStr)
+{
+    char *pDup = NULL;
+    size_t uLen = 0;
+
+    if (pStr != NULL)
+    {
+        uLen = strlen(pStr);
+        if ((pDup = (char *)Allocator_malloc(uLen + 1)) != NULL)
+        {
+            memcpy(pDup, pStr, uLen + 1);
+        }
+    }
+
+    return pDup;
+}
+
+static void prvFreeConfig(PollyCredentialProviderConfig_t *pxConfig)
+{
+    Allocator_free((void *)pxConfig->pFile);
+    Allocator_free((void *)pxConfig->pProfile);
+    Allocator_free((void *)pxConfig->pEndpointHost);
+    Allocator_free((void *)pxConfig->pEndpointPort);
+    Allocator_free((void *)pxConfig->pEndpointPath);
+    Allocator_free((void *)pxConfig->pEndpointAuthorization);
+}
+
+static Credentials_t *prvNewCredentials(const char *pAccessKey, const char *pSecretKey, const char *pToken, time_t xExpiration)
+{
+    Credentials_t *pxCredentials = NULL;
+    size_t uAccessKeyLen = strlen(pAccessKey);
+    size_t uSecretKeyLen = strlen(pSecretKey);
+    size_t uTokenLen = (pToken != NULL) ? strlen(pToken) : 0;
+    char *p = NULL;
+
+    /* The strings are stored right after the structure, so a snapshot is a single allocation. */
+    if ((pxCredentials = (Credentials_t *)Allocator_malloc(sizeof(Credentials_t) + uAccessKeyLen + 1 + uSecretKeyLen + 1 + uTokenLen + 1)) != NULL)
+    {
+        memset(pxCredentials, 0, sizeof(Credentials_t));
+        p = (char *)(pxCredentials + 1);
+
+        memcpy(p, pAccessKey, uAccessKeyLen + 1);
+        pxCredentials->pAccessKey = p;
+        p += uAccessKeyLen + 1;
+
+        memcpy(p, pSecretKey, uSecretKeyLen + 1);
+        pxCredentials->pSecretKey = p;
+        p += uSecretKeyLen + 1;
+
+        if (pToken != NULL)
+        {
+            memcpy(p, pToken, uTokenLen + 1);
+            pxCredentials->pToken = p;
+        }
+
+        pxCredentials->xExpiration = xExpiration;
+        pxCredentials->uRefs = 1;
+    }
+
+    return pxCredentials;
+}
+
+static void prvFreeCredentials(Credentials_t *pxCredentials)
+{
+    size_t uLen = 0;
+
+    if (pxCredentials != NULL)
+    {
+        /* Wipe the secret before the memory is reused */
+        uLen = strlen(pxCredentials->pAccessKey) + 1 + strlen(pxCredentials->pSecretKey) + 1 + ((pxCredentials->pToken != NULL) ? strlen(pxCredentials->pToken) : 0) + 1;
+        memset(pxCredentials + 1, 0, uLen);
+        Allocator_free(pxCredentials);
+    }
+}
+
+static bool prvIsSameCredentials(Credentials_t *pxA, Credentials_t *pxB)
+{
+    return strcmp(pxA->pAccessKey, pxB->pAccessKey) == 0 && strcmp(pxA->pSecretKey, pxB->pSecretKey) == 0 &&
+           ((pxA->pToken == NULL && pxB->pToken == NULL) || (pxA->pToken != NULL && pxB->pToken != NULL && strcmp(pxA->pToken, pxB->pToken) == 0));
+}
+
+static Credentials_t *prvLoadFromEnvironment(void)
+{
+    Credentials_t *pxCredentials = NULL;
+    const char *pAccessKey = getenv(ENV_ACCESS_KEY);
+    const char *pSecretKey = getenv(ENV_SECRET_KEY);
+    const char *pToken = getenv(ENV_SESSION_TOKEN);
+
+    if (pAccessKey != NULL && pAccessKey[0] != '\0' && pSecretKey != NULL && pSecretKey[0] != '\0')
+    {
+        pxCredentials = prvNewCredentials(pAccessKey, pSecretKey, (pToken != NULL && pToken[0] != '\0') ? pToken : NULL, 0);
+    }
+
+    return pxCredentials;
+}
+
+static char *prvTrim(char *pStr)
+{
+    size_t uLen = 0;
+
+    while (*pStr == ' ' || *pStr == '\t')
+    {
+        pStr++;
+    }
+
+    uLen = strlen(pStr);
+    while (uLen > 0 && (pStr[uLen - 1] == ' ' || pStr[uLen - 1] == '\t' || pStr[uLen - 1] == '\r' || pStr[uLen - 1] == '\n'))
+    {
+        pStr[--uLen] = '\0';
+    }
+
+    return pStr;
+}
+
+static void prvCopyField(char *pDst, const char *pSrc)
+{
+    snprintf(pDst, CREDENTIAL_FIELD_MAX_LEN, "%s", pSrc);
+}
+
+static Credentials_t *prvLoadFromFile(const char *pFile, const char *pProfile)
+{
+    Credentials_t *pxCredentials = NULL;
+    FILE *fp = NULL;
+    char *pLine = NULL;
+    char *pFields = NULL;
+    char *pAccessKey = NULL;
+    char *pSecretKey = NULL;
+    char *pToken = NULL;
+    char *p = NULL;
+    char *pKey = NULL;
+    char *pValue = NULL;
+    bool bInProfile = false;
+
+    /* The shared credentials file is an INI file:
+     *
+     * [default]
+     * aws_access_key_id = ...
+     * aws_secret_access_key = ...
+     * aws_session_token = ...
+     */
+    if ((fp = fopen(pFile, "r")) != NULL &&
+        (pLine = (char *)Allocator_malloc(FILE_LINE_MAX_LEN)) != NULL &&
+        (pFields = (char *)Allocator_calloc(3, CREDENTIAL_FIELD_MAX_LEN)) != NULL)
+    {
+        pAccessKey = pFields;
+        pSecretKey = pFields + CREDENTIAL_FIELD_MAX_LEN;
+        pToken = pFields + 2 * CREDENTIAL_FIELD_MAX_LEN;
+
+        while (fgets(pLine, FILE_LINE_MAX_LEN, fp) != NULL)
+        {
+            p = prvTrim(pLine);
+            if (p[0] == '\0' || p[0] == '#' || p[0] == ';')
+            {
+                continue;
+            }
+            else if (p[0] == '[')
+            {
+                if ((pValue = strchr(p, ']')) != NULL)
+                {
+                    *pValue = '\0';
+                }
+                bInProfile = (strcmp(prvTrim(p + 1), pProfile) == 0);
+            }
+            else if (bInProfile && (pValue = strchr(p, '=')) != NULL)
+            {
+                *pValue = '\0';
+                pKey = prvTrim(p);
+                pValue = prvTrim(pValue + 1);
+
+                if (strcmp(pKey, "aws_access_key_id") == 0)
+                {
+                    prvCopyField(pAccessKey, pValue);
+                }
+                else if (strcmp(pKey, "aws_secret_access_key") == 0)
+                {
+                    prvCopyField(pSecretKey, pValue);
+                }
+                else if (strcmp(pKey, "aws_session_token") == 0)
+                {
+                    prvCopyField(pToken, pValue);
+                }
+            }
+        }
+
+        if (pAccessKey[0] != '\0' && pSecretKey[0] != '\0')
+        {
+            pxCredentials = prvNewCredentials(pAccessKey, pSecretKey, (pToken[0] != '\0') ? pToken : NULL, 0);
+        }
+    }
+
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    if (pLine != NULL)
+    {
+        memset(pLine, 0, FILE_LINE_MAX_LEN);
+        Allocator_free(pLine);
+    }
+    if (pFields != NULL)
+    {
+        memset(pFields, 0, 3 * CREDENTIAL_FIELD_MAX_LEN);
+        Allocator_free(pFields);
+    }
+
+    return pxCredentials;
+}
+
+bool CredentialProvider_getJsonString(const char *pJson, const char *pName, char *pValue, size_t uValueSize)
+{
+    bool bFound = false;
+    bool bMatched = false;
+    const char *p = pJson;
+    size_t uNameLen = strlen(pName);
+    size_t uLen = 0;
+
+    /* The credentials are flat string fields, ex: {"AccessKeyId":"...","SecretAccessKey":"...","Token":"...","Expiration":"2021-01-01T00:00:00Z"} */
+    while (!bMatched && (p = strchr(p, '"')) != NULL)
+    {
+        p++;
+        if (strncmp(p, pName, uNameLen) == 0 && p[uNameLen] == '"')
+        {
+            p += uNameLen + 1;
+            while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+            {
+                p++;
+            }
+            /* It's the field, so the search ends here whether its value is a valid string or not */
+            if ((bMatched = (*p == ':')))
+            {
+                p++;
+                while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+                {
+                    p++;
+                }
+            }
+            if (bMatched && *p == '"')
+            {
+                p++;
+                while (p[uLen] != '\0' && p[uLen] != '"' && uLen < uValueSize - 1)
+                {
+                    uLen++;
+                }
+                if (p[uLen] == '"')
+                {
+                    memcpy(pValue, p, uLen);
+                    pValue[uLen] = '\0';
+                    bFound = true;
+                }
+            }
+        }
+        else if ((p = strchr(p, '"')) != NULL)
+        {
+            /* Skip the rest of this string */
+            p++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return bFound;
+}
+
+time_t CredentialProvider_parseIso8601(const char *pDateTime)
+{
+    time_t xTime = 0;
+    int iYear = 0;
+    int iMonth = 0;
+    int iDay = 0;
+    int iHour = 0;
+    int iMinute = 0;
+    int iSecond = 0;
+    int64_t iDays = 0;
+    int iEra = 0;
+    int iYearOfEra = 0;
+    int iDayOfYear = 0;
+
+    if (sscanf(pDateTime, "%4d-%2d-%2dT%2d:%2d:%2d", &iYear, &iMonth, &iDay, &iHour, &iMinute, &iSecond) == 6 &&
+        iMonth >= 1 && iMonth <= 12 && iDay >= 1 && iDay <= 31)
+    {
+        /* Days since 1970-01-01 in the proleptic Gregorian calendar. It avoids timegm(), which is not in POSIX. */
+        iYear -= (iMonth <= 2) ? 1 : 0;
+        iEra = iYear / 400;
+        iYearOfEra = iYear - iEra * 400;
+        iDayOfYear = (153 * (iMonth + ((iMonth > 2) ? -3 : 9)) + 2) / 5 + iDay - 1;
+        iDays = (int64_t)iEra * 146097 + (int64_t)iYearOfEra * 365 + iYearOfEra / 4 - iYearOfEra / 100 + iDayOfYear - 719468;
+        xTime = (time_t)(iDays * 86400 + iHour * 3600 + iMinute * 60 + iSecond);
+    }
+
+    return xTime;
+}
+
+static int prvOnEndpointData(HttpParserHandle xHttpParser, char *pRecvBuf, size_t *puRecvLen, unsigned int *puStatusCode, char *pBody, size_t *puBodyLen)
+{
+    int res = POLLY_ERRNO_HTTP_WANT_MORE;
+    size_t uBytesParsed = 0;
+    const char *pChunkLoc = NULL;
+    size_t uChunkLen = 0;
+    size_t uCopyLen = 0;
+
+    /* Parse until the parser wants more data, even after the last byte is parsed, as the message may complete without data. */
+    while (res == POLLY_ERRNO_HTTP_WANT_MORE)
+    {
+        if ((res = Hp_parse(xHttpParser, pRecvBuf, *puRecvLen, &uBytesParsed, puStatusCode, &pChunkLoc, &uChunkLen)) == HTTP_PARSER_ERRNO_WANT_MORE_DATA)
+        {
+            res = POLLY_ERRNO_HTTP_WANT_MORE;
+            break;
+        }
+        else if (res != HTTP_PARSER_ERRNO_NONE)
+        {
+            res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+        }
+        else
+        {
+            res = POLLY_ERRNO_HTTP_WANT_MORE;
+            if (pChunkLoc != NULL && uChunkLen > 0)
+            {
+                uCopyLen = ENDPOINT_RESPONSE_MAX_LEN - *puBodyLen;
+                uCopyLen = (uChunkLen < uCopyLen) ? uChunkLen : uCopyLen;
+                memcpy(pBody + *puBodyLen, pChunkLoc, uCopyLen);
+                *puBodyLen += uCopyLen;
+            }
+
+            *puRecvLen -= uBytesParsed;
+            memmove(pRecvBuf, pRecvBuf + uBytesParsed, *puRecvLen);
+
+            if (Hp_isMessageComplete(xHttpParser))
+            {
+                res = (*puStatusCode / 100 == 2) ? POLLY_ERRNO_NONE : POLLY_ERRNO_HTTP_REQ_FAILURE;
+            }
+        }
+    }
+
+    return res;
+}
+
+/* Like mbedtls_net_connect(), but the connect is bounded by ENDPOINT_TIMEOUT_MS like the reads, so an endpoint which drops it can't hold
+ * the refresh for the minutes of the TCP retries. The addresses share the timeout, and the socket is blocking again once connected. */
+static int prvConnectEndpoint(mbedtls_net_context *pxFd, const char *pcHost, const char *pcPort)
+{
+    int res = POLLY_ERRNO_NET_CONNECT_FAILED;
+    struct addrinfo xHints;
+    struct addrinfo *pxAddrList = NULL;
+    struct addrinfo *pxAddr = NULL;
+    struct pollfd xPollFd;
+    uint64_t uEndMs = Port_getTimeMs() + ENDPOINT_TIMEOUT_MS;
+    uint64_t uNowMs = 0;
+    int xError = 0;
+    socklen_t uErrorLen = 0;
+    int retVal = 0;
+
+    memset(&xHints, 0, sizeof(xHints));
+    xHints.ai_family = AF_UNSPEC;
+    xHints.ai_socktype = SOCK_STREAM;
+    xHints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(pcHost, pcPort, &xHints, &pxAddrList) != 0)
+    {
+        /* Propagate the res error */
+    }
+    else
+    {
+        for (pxAddr = pxAddrList; pxAddr != NULL && res != POLLY_ERRNO_NONE; pxAddr = pxAddr->ai_next)
+        {
+            if ((pxFd->fd = (int)socket(pxAddr->ai_family, pxAddr->ai_socktype, pxAddr->ai_protocol)) < 0 || mbedtls_net_set_nonblock(pxFd) != 0)
+            {
+                /* Try the next address */
+            }
+            else if (connect(pxFd->fd, pxAddr->ai_addr, pxAddr->ai_addrlen) == 0)
+            {
+                res = POLLY_ERRNO_NONE;
+            }
+            else if (errno == EINPROGRESS)
+            {
+                xPollFd.fd = pxFd->fd;
+                xPollFd.events = POLLOUT;
+                retVal = -1;
+                while (retVal < 0 && (uNowMs = Port_getTimeMs()) < uEndMs)
+                {
+                    xPollFd.revents = 0;
+                    if ((retVal = poll(&xPollFd, 1, (int)(uEndMs - uNowMs))) < 0 && errno != EINTR)
+                    {
+                        break;
+                    }
+                }
+
+                uErrorLen = sizeof(xError);
+                if (retVal > 0 && getsockopt(pxFd->fd, SOL_SOCKET, SO_ERROR, &xError, &uErrorLen) == 0 && xError == 0)
+                {
+                    res = POLLY_ERRNO_NONE;
+                }
+            }
+
+            if (res == POLLY_ERRNO_NONE && mbedtls_net_set_block(pxFd) != 0)
+            {
+                res = POLLY_ERRNO_NET_CONNECT_FAILED;
+            }
+            if (res != POLLY_ERRNO_NONE)
+            {
+                /* It closes the socket, if any, so the next address starts over. */
+                mbedtls_net_free(pxFd);
+            }
+        }
+        freeaddrinfo(pxAddrList);
+    }
+
+    return res;
+}
+
+static Credentials_t *prvLoadFromEndpoint(PollyCredentialProviderConfig_t *pxConfig)
+{
+    Credentials_t *pxCredentials = NULL;
+    int res = POLLY_ERRNO_HTTP_WANT_MORE;
+    mbedtls_net_context xFd;
+    HttpParserHandle xHttpParser = NULL;
+    char *pBuf = NULL;
+    char *pRecvBuf = NULL;
+    char *pBody = NULL;
+    char *pFields = NULL;
+    size_t uReqLen = 0;
+    size_t uRecvLen = 0;
+    size_t uBodyLen = 0;
+    unsigned int uStatusCode = 0;
+    int n = 0;
+
+    mbedtls_net_init(&xFd);
+
+    /* One buffer holds the request, the received data and the body, and another the parsed fields. */
+    if ((pBuf = (char *)Allocator_malloc(3 * ENDPOINT_RESPONSE_MAX_LEN + 1)) == NULL ||
+        (pFields = (char *)Allocator_calloc(4, CREDENTIAL_FIELD_MAX_LEN)) == NULL ||
+        (xHttpParser = Hp_create()) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        pRecvBuf = pBuf + ENDPOINT_RESPONSE_MAX_LEN;
+        pBody = pRecvBuf + ENDPOINT_RESPONSE_MAX_LEN;
+
+        /* Metadata endpoints are link-local plain HTTP, so it doesn't go through NetIo, which is TLS only. */
+        uReqLen = snprintf(pBuf, ENDPOINT_RESPONSE_MAX_LEN, "GET %s HTTP/1.1\r\nhost: %s\r\n%s%s%saccept: application/json\r\nconnection: close\r\n\r\n",
+            pxConfig->pEndpointPath,
+            pxConfig->pEndpointHost,
+            (pxConfig->pEndpointAuthorization != NULL) ? "authorization: " : "",
+            (pxConfig->pEndpointAuthorization != NULL) ? pxConfig->pEndpointAuthorization : "",
+            (pxConfig->pEndpointAuthorization != NULL) ? "\r\n" : ""
+        );
+
+        if (uReqLen >= ENDPOINT_RESPONSE_MAX_LEN)
+        {
+            res = POLLY_ERRNO_INVALID_PARAMETER;
+        }
+        else if (prvConnectEndpoint(&xFd, pxConfig->pEndpointHost, pxConfig->pEndpointPort) != POLLY_ERRNO_NONE)
+        {
+            res = POLLY_ERRNO_NET_CONNECT_FAILED;
+        }
+        else
+        {
+            for (n = 0; uRecvLen < uReqLen && n >= 0; uRecvLen += n)
+            {
+                n = mbedtls_net_send(&xFd, (const unsigned char *)(pBuf + uRecvLen), uReqLen - uRecvLen);
+            }
+            uRecvLen = 0;
+
+            if (n < 0)
+            {
+                res = POLLY_ERRNO_NET_SEND_FAILED;
+            }
+
+            while (res == POLLY_ERRNO_HTTP_WANT_MORE)
+            {
+                if (uRecvLen == ENDPOINT_RESPONSE_MAX_LEN ||
+                    (n = mbedtls_net_recv_timeout(&xFd, (unsigned char *)(pRecvBuf + uRecvLen), ENDPOINT_RESPONSE_MAX_LEN - uRecvLen, ENDPOINT_TIMEOUT_MS)) <= 0)
+                {
+                    res = POLLY_ERRNO_NET_RECV_FAILED;
+                }
+                else
+                {
+                    uRecvLen += n;
+                    res = prvOnEndpointData(xHttpParser, pRecvBuf, &uRecvLen, &uStatusCode, pBody, &uBodyLen);
+                }
+            }
+        }
+    }
+
+    if (res == POLLY_ERRNO_NONE)
+    {
+        pBody[uBodyLen] = '\0';
+
+        if (CredentialProvider_getJsonString(pBody, "AccessKeyId", pFields, CREDENTIAL_FIELD_MAX_LEN) &&
+            CredentialProvider_getJsonString(pBody, "SecretAccessKey", pFields + CREDENTIAL_FIELD_MAX_LEN, CREDENTIAL_FIELD_MAX_LEN))
+        {
+            CredentialProvider_getJsonString(pBody, "Token", pFields + 2 * CREDENTIAL_FIELD_MAX_LEN, CREDENTIAL_FIELD_MAX_LEN);
+            CredentialProvider_getJsonString(pBody, "Expiration", pFields + 3 * CREDENTIAL_FIELD_MAX_LEN, CREDENTIAL_FIELD_MAX_LEN);
+
+            pxCredentials = prvNewCredentials(pFields, pFields + CREDENTIAL_FIELD_MAX_LEN,
+                (pFields[2 * CREDENTIAL_FIELD_MAX_LEN] != '\0') ? pFields + 2 * CREDENTIAL_FIELD_MAX_LEN : NULL,
+                CredentialProvider_parseIso8601(pFields + 3 * CREDENTIAL_FIELD_MAX_LEN));
+        }
+    }
+
+    mbedtls_net_free(&xFd);
+    Hp_terminate(xHttpParser);
+    if (pBuf != NULL)
+    {
+        memset(pBuf, 0, 3 * ENDPOINT_RESPONSE_MAX_LEN + 1);
+        Allocator_free(pBuf);
+    }
+    if (pFields != NULL)
+    {
+        memset(pFields, 0, 4 * CREDENTIAL_FIELD_MAX_LEN);
+        Allocator_free(pFields);
+    }
+
+    return pxCredentials;
+}
+
+static Credentials_t *prvLoad(PollyCredentialProviderConfig_t *pxConfig)
+{
+    Credentials_t *pxCredentials = NULL;
+
+    /* The first source which has credentials wins. */
+    if (pxConfig->bFromEnvironment)
+    {
+        pxCredentials = prvLoadFromEnvironment();
+    }
+    if (pxCredentials == NULL && pxConfig->pFile != NULL)
+    {
+        pxCredentials = prvLoadFromFile(pxConfig->pFile, pxConfig->pProfile);
+    }
+    if (pxCredentials == NULL && pxConfig->pEndpointHost != NULL)
+    {
+        pxCredentials = prvLoadFromEndpoint(pxConfig);
+    }
+
+    return pxCredentials;
+}
+
+/* Publish a new snapshot. It has to be called with the lock held. */
+static void prvPublish(PollyCredentialProvider_t *pxProvider, Credentials_t *pxCredentials)
+{
+    Credentials_t *pxOld = NULL;
+    Credentials_t **ppxRetired = NULL;
+    Credentials_t *pxRetired = NULL;
+
+    pxOld = __atomic_exchange_n(&(pxProvider->pxCurrent), pxCredentials, __ATOMIC_ACQ_REL);
+
+    /* A reader may still be between loading the pointer and taking its reference, so the snapshot retired just now is kept for a whole refresh
+     * period. The ones retired earlier are freed once no request holds them. */
+    ppxRetired = &(pxProvider->pxRetired);
+    while ((pxRetired = *ppxRetired) != NULL)
+    {
+        if (__atomic_load_n(&(pxRetired->uRefs), __ATOMIC_ACQUIRE) == 0)
+        {
+            *ppxRetired = pxRetired->pxNext;
+            prvFreeCredentials(pxRetired);
+        }
+        else
+        {
+            ppxRetired = &(pxRetired->pxNext);
+        }
+    }
+
+    if (pxOld != NULL)
+    {
+        pxOld->pxNext = pxProvider->pxRetired;
+        pxProvider->pxRetired = pxOld;
+        CredentialProvider_release(pxOld);
+    }
+
+    /* Signing keys derived from the old secret must not be used any more. */
+    SigV4_invalidateSigningKeys();
+}
+
+static uint64_t prvGetRefreshDelayMs(PollyCredentialProvider_t *pxProvider, Credentials_t *pxCredentials)
+{
+    uint64_t uDelayMs = pxProvider->xConfig.uRefreshIntervalMs;
+    time_t xNow = time(NULL);
+    uint64_t uLeftMs = 0;
+
+    if (pxCredentials != NULL && pxCredentials->xExpiration != 0)
+    {
+        /* Refresh ahead of the expiration, so requests never sign with expired credentials. */
+        uLeftMs = (pxCredentials->xExpiration > xNow) ? (uint64_t)(pxCredentials->xExpiration - xNow) * 1000 : 0;
+        uDelayMs = (uLeftMs > pxProvider->xConfig.uRefreshBeforeExpiryMs + RETRY_MIN_DELAY_MS) ? uLeftMs - pxProvider->xConfig.uRefreshBeforeExpiryMs : RETRY_MIN_DELAY_MS;
+    }
+
+    return uDelayMs;
+}
+
+/* Wait for a wakeup or a timeout. It has to be called with the lock held. */
+static void prvTimedWait(PollyCredentialProvider_t *pxProvider, uint64_t uWaitMs)
+{
+    struct timespec xDeadline = {0};
+
+    clock_gettime(CLOCK_REALTIME, &xDeadline);
+    xDeadline.tv_sec += uWaitMs / 1000;
+    xDeadline.tv_nsec += (long)(uWaitMs % 1000) * 1000000;
+    if (xDeadline.tv_nsec >= 1000000000)
+    {
+        xDeadline.tv_sec++;
+        xDeadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&(pxProvider->xCond), &(pxProvider->xLock), &xDeadline);
+}
+
+static void *prvRefreshThread(void *pArg)
+{
+    PollyCredentialProvider_t *pxProvider = (PollyCredentialProvider_t *)pArg;
+    Credentials_t *pxCredentials = NULL;
+    uint64_t uRetryDelayMs = RETRY_MIN_DELAY_MS;
+    uint64_t uDeadlineMs = 0;
+    uint64_t uNowMs = 0;
+
+    pthread_mutex_lock(&(pxProvider->xLock));
+    uDeadlineMs = Port_getTimeMs() + ((pxProvider->pxCurrent != NULL) ? prvGetRefreshDelayMs(pxProvider, pxProvider->pxCurrent) : RETRY_MIN_DELAY_MS);
+
+    while (!pxProvider->bStop)
+    {
+        if ((uNowMs = Port_getTimeMs()) < uDeadlineMs)
+        {
+            prvTimedWait(pxProvider, uDeadlineMs - uNowMs);
+            continue;
+        }
+
+        /* Files and endpoints are slow, so load them without the lock. */
+        pthread_mutex_unlock(&(pxProvider->xLock));
+        pxCredentials = prvLoad(&(pxProvider->xConfig));
+        pthread_mutex_lock(&(pxProvider->xLock));
+
+        if (pxCredentials == NULL)
+        {
+            uDeadlineMs = Port_getTimeMs() + uRetryDelayMs;
+            uRetryDelayMs = (uRetryDelayMs * 2 < RETRY_MAX_DELAY_MS) ? uRetryDelayMs * 2 : RETRY_MAX_DELAY_MS;
+        }
+        else
+        {
+            uRetryDelayMs = RETRY_MIN_DELAY_MS;
+            uDeadlineMs = Port_getTimeMs() + prvGetRefreshDelayMs(pxProvider, pxCredentials);
+
+            if (pxProvider->pxCurrent != NULL && prvIsSameCredentials(pxProvider->pxCurrent, pxCredentials))
+            {
+                /* Nothing rotated, so the derived signing keys stay valid. */
+                prvFreeCredentials(pxCredentials);
+            }
+            else
+            {
+                prvPublish(pxProvider, pxCredentials);
+            }
+            pxCredentials = NULL;
+        }
+    }
+    pthread_mutex_unlock(&(pxProvider->xLock));
+
+    return NULL;
+}
+
+PollyCredentialProviderHandle PollyCredentialProvider_create(const PollyCredentialProviderConfig_t *pConfig)
+{
+    PollyCredentialProvider_t *pxProvider = NULL;
+    PollyCredentialProviderConfig_t *pxConfig = NULL;
+    Credentials_t *pxCredentials = NULL;
+    bool bLockInited = false;
+    bool bCondInited = false;
+
+    if (pConfig != NULL && (pConfig->bFromEnvironment || pConfig->pFile != NULL || (pConfig->pEndpointHost != NULL && pConfig->pEndpointPath != NULL)) &&
+        (pxProvider = (PollyCredentialProvider_t *)Allocator_malloc(sizeof(PollyCredentialProvider_t))) != NULL)
+    {
+        memset(pxProvider, 0, sizeof(PollyCredentialProvider_t));
+        pxConfig = &(pxProvider->xConfig);
+        pxConfig->bFromEnvironment = pConfig->bFromEnvironment;
+        pxConfig->uRefreshBeforeExpiryMs = (pConfig->uRefreshBeforeExpiryMs != 0) ? pConfig->uRefreshBeforeExpiryMs : DEFAULT_REFRESH_BEFORE_EXPIRY_MS;
+        pxConfig->uRefreshIntervalMs = (pConfig->uRefreshIntervalMs != 0) ? pConfig->uRefreshIntervalMs : DEFAULT_REFRESH_INTERVAL_MS;
+
+        if ((pConfig->pFile != NULL && (pxConfig->pFile = prvStrDup(pConfig->pFile)) == NULL) ||
+            (pxConfig->pProfile = prvStrDup((pConfig->pProfile != NULL) ? pConfig->pProfile : DEFAULT_PROFILE)) == NULL ||
+            (pConfig->pEndpointHost != NULL && (pxConfig->pEndpointHost = prvStrDup(pConfig->pEndpointHost)) == NULL) ||
+            (pxConfig->pEndpointPort = prvStrDup((pConfig->pEndpointPort != NULL) ? pConfig->pEndpointPort : DEFAULT_ENDPOINT_PORT)) == NULL ||
+            (pConfig->pEndpointPath != NULL && (pxConfig->pEndpointPath = prvStrDup(pConfig->pEndpointPath)) == NULL) ||
+            (pConfig->pEndpointAuthorization != NULL && (pxConfig->pEndpointAuthorization = prvStrDup(pConfig->pEndpointAuthorization)) == NULL) ||
+            !(bLockInited = (pthread_mutex_init(&(pxProvider->xLock), NULL) == 0)) ||
+            !(bCondInited = (pthread_cond_init(&(pxProvider->xCond), NULL) == 0)))
+        {
+            if (bLockInited)
+            {
+                pthread_mutex_destroy(&(pxProvider->xLock));
+            }
+            prvFreeConfig(pxConfig);
+            Allocator_free(pxProvider);
+            pxProvider = NULL;
+        }
+        else
+        {
+            /* The first load is done here, so the first request doesn't wait for the thread. If it fails, the thread keeps trying. */
+            if ((pxCredentials = prvLoad(pxConfig)) != NULL)
+            {
+                prvPublish(pxProvider, pxCredentials);
+            }
+
+            if (pthread_create(&(pxProvider->xThread), NULL, prvRefreshThread, pxProvider) != 0)
+            {
+                PollyCredentialProvider_terminate(pxProvider);
+                pxProvider = NULL;
+            }
+            else
+            {
+                pxProvider->bThreadStarted = true;
+            }
+        }
+    }
+
+    return pxProvider;
+}
+
+void PollyCredentialProvider_terminate(PollyCredentialProviderHandle xCredentialProvider)
+{
+    PollyCredentialProvider_t *pxProvider = (PollyCredentialProvider_t *)xCredentialProvider;
+    Credentials_t *pxRetired = NULL;
+
+    if (pxProvider != NULL)
+    {
+        if (pxProvider->bThreadStarted)
+        {
+            pthread_mutex_lock(&(pxProvider->xLock));
+            pxProvider->bStop = true;
+            pthread_cond_signal(&(pxProvider->xCond));
+            pthread_mutex_unlock(&(pxProvider->xLock));
+            pthread_join(pxProvider->xThread, NULL);
+        }
+
+        /* No request may be running any more, so all snapshots are freed regardless of their references. */
+        prvFreeCredentials(pxProvider->pxCurrent);
+        while ((pxRetired = pxProvider->pxRetired) != NULL)
+        {
+            pxProvider->pxRetired = pxRetired->pxNext;
+            prvFreeCredentials(pxRetired);
+        }
+
+        pthread_cond_destroy(&(pxProvider->xCond));
+        pthread_mutex_destroy(&(pxProvider->xLock));
+        prvFreeConfig(&(pxProvider->xConfig));
+        Allocator_free(pxProvider);
+    }
+}
+
+Credentials_t *CredentialProvider_acquire(PollyCredentialProviderHandle xCredentialProvider)
+{
+    PollyCredentialProvider_t *pxProvider = (PollyCredentialProvider_t *)xCredentialProvider;
+    Credentials_t *pxCredentials = NULL;
+
+    if (pxProvider != NULL && (pxCredentials = __atomic_load_n(&(pxProvider->pxCurrent), __ATOMIC_ACQUIRE)) != NULL)
+    {
+        __atomic_add_fetch(&(pxCredentials->uRefs), 1, __ATOMIC_ACQ_REL);
+    }
+
+    return pxCredentials;
+}
+
+void CredentialProvider_release(Credentials_t *pxCredentials)
+{
+    if (pxCredentials != NULL)
+    {
+        /* The snapshot is freed by a later rotation, never here, so readers don't race with the free. */
+        __atomic_sub_fetch(&(pxCredentials->uRefs), 1, __ATOMIC_ACQ_REL);
+    }
+}
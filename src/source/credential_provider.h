@@ -0,0 +1,57 @@
+#ifndef CREDENTIAL_PROVIDER_H
+#define CREDENTIAL_PROVIDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "polly/polly.h"
+
+/* A snapshot of credentials. It's immutable once published, so readers use it without locks. */
+typedef struct Credentials
+{
+    const char *pAccessKey;
+    const char *pSecretKey;
+    const char *pToken; // NULL for long-term credentials
+    time_t xExpiration; // 0 if the credentials don't expire
+
+    uint32_t uRefs;
+    struct Credentials *pxNext;
+} Credentials_t;
+
+/**
+ * @brief Get the current credentials. It doesn't take any lock.
+ *
+ * @param[in] xCredentialProvider The credential provider handle
+ * @return The credentials, or NULL if none has been fetched yet. It must be released by CredentialProvider_release().
+ */
+Credentials_t *CredentialProvider_acquire(PollyCredentialProviderHandle xCredentialProvider);
+
+/**
+ * @brief Release credentials returned by CredentialProvider_acquire()
+ *
+ * @param[in] pxCredentials The credentials
+ */
+void CredentialProvider_release(Credentials_t *pxCredentials);
+
+/**
+ * @brief Get a string field of the JSON document returned by a credential endpoint
+ *
+ * @param[in] pJson The JSON document
+ * @param[in] pName The name of the field
+ * @param[out] pValue The value of the field
+ * @param[in] uValueSize The size of pValue, including the terminating null
+ * @return true if the field is found and its value fits in pValue
+ */
+bool CredentialProvider_getJsonString(const char *pJson, const char *pName, char *pValue, size_t uValueSize);
+
+/**
+ * @brief Parse a UTC date time in ISO 8601 format, ex: "2021-01-01T00:00:00Z"
+ *
+ * @param[in] pDateTime The date time
+ * @return The seconds since the epoch, or 0 if it's malformed
+ */
+time_t CredentialProvider_parseIso8601(const char *pDateTime);
+
+#endif /* CREDENTIAL_PROVIDER_H */
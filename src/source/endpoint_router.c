@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "endpoint_router.h"
+#include "netio.h"
+#include "port.h"
+#include "trust_store.h"
+
+#define DEFAULT_SAMPLE_WEIGHT_PERCENT   (20)
+#define DEFAULT_EXPLORE_PERCENT         (5)
+#define DEFAULT_FAILURE_THRESHOLD       (5)
+#define DEFAULT_MAX_ERROR_PERCENT       (50)
+#define DEFAULT_OPEN_MS                 (10 * 1000)
+
+/* The error rate opens a circuit only after this many requests, so one early failure doesn't count as 100%. */
+#define MIN_ERROR_RATE_SAMPLES          (20)
+
+/* The longest time the probe thread sleeps if nothing wakes it up */
+#define PROBE_INTERVAL_MS               (1000)
+
+#define NO_ENDPOINT                     ((unsigned int)-1)
+
+typedef struct
+{
+    PollyEndpoint_t xEndpoint; // Immutable after creation
+    PollyEndpointState_t eState;
+    double fLatencyMs; // 0 until a request succeeds
+    double fErrorRate;
+    unsigned int uSamples; // Requests since the circuit closed
+    unsigned int uConsecutiveFailures;
+    uint64_t uRequests;
+    uint64_t uProbeAtMs; // When an open circuit is probed
+    bool bTrialInFlight; // A half-open circuit lets one request through at a time
+} RoutedEndpoint_t;
+
+typedef struct PollyEndpointRouter
+{
+    PollyEndpointRouterConfig_t xConfig;
+    double fSampleWeight;
+    RoutedEndpoint_t *pxEndpoints;
+    char *pStrings; // The strings of all endpoints share one allocation
+
+    /* Probes connect like requests do */
+    unsigned int uRecvTimeoutMs;
+    unsigned int uConnectTimeoutMs;
+    unsigned int uTlsMaxFragmentLen;
+    PollySocketOptions_t xSocketOptions;
+    PollyTrustStoreHandle xTrustStore;
+    PollyTransportHandle xTransport;
+
+    pthread_mutex_t xLock;
+    pthread_cond_t xCond;
+    pthread_t xThread;
+    bool bThreadStarted;
+    bool bStop;
+
+    uint64_t uSelections;
+    unsigned int uExploreCursor;
+} PollyEndpointRouter_t;
+
+static char *prvCopyString(char **ppDest, const char *pSrc)
+{
+    char *pCopy = *ppDest;
+    size_t uLen = strlen(pSrc);
+
+    memcpy(pCopy, pSrc, uLen + 1);
+    *ppDest += uLen + 1;
+
+    return pCopy;
+}
+
+static bool prvIsFaster(const RoutedEndpoint_t *pxA, const RoutedEndpoint_t *pxB)
+{
+    /* An endpoint whose latency is unknown is never preferred over one which is measured. */
+    return pxA->fLatencyMs > 0 && (pxB->fLatencyMs == 0 || pxA->fLatencyMs < pxB->fLatencyMs);
+}
+
+/* A probe is a TCP and TLS handshake. Polly has no health check, and a front-end which completes a handshake takes requests. */
+static bool prvProbe(PollyEndpointRouter_t *pxRouter, const PollyEndpoint_t *pxEndpoint)
+{
+    bool bReachable = false;
+    NetIoHandle xNetIo = NULL;
+
+    if ((xNetIo = NetIo_create()) != NULL)
+    {
+        bReachable = (NetIo_setRecvTimeout(xNetIo, pxRouter->uRecvTimeoutMs) == NETIO_ERRNO_NONE &&
+                      NetIo_setConnectTimeout(xNetIo, pxRouter->uConnectTimeoutMs) == NETIO_ERRNO_NONE &&
+                      NetIo_setMaxFragmentLength(xNetIo, pxRouter->uTlsMaxFragmentLen) == NETIO_ERRNO_NONE &&
+                      NetIo_setSocketOptions(xNetIo, &(pxRouter->xSocketOptions)) == NETIO_ERRNO_NONE &&
+                      NetIo_setTrustStore(xNetIo, pxRouter->xTrustStore) == NETIO_ERRNO_NONE &&
+                      NetIo_setTransport(xNetIo, pxRouter->xTransport) == NETIO_ERRNO_NONE &&
+                      NetIo_connect(xNetIo, pxEndpoint->pHost, pxEndpoint->pPort) == NETIO_ERRNO_NONE);
+        NetIo_terminate(xNetIo);
+    }
+
+    return bReachable;
+}
+
+static void prvOpenCircuit(PollyEndpointRouter_t *pxRouter, RoutedEndpoint_t *pxEndpoint)
+{
+    pxEndpoint->eState = POLLY_ENDPOINT_OPEN;
+    pxEndpoint->bTrialInFlight = false;
+    pxEndpoint->uProbeAtMs = Port_getTimeMs() + pxRouter->xConfig.uOpenMs;
+    pthread_cond_signal(&(pxRouter->xCond));
+}
+
+/* Wait for a wakeup or a timeout. It has to be called with the lock held. */
+static void prvTimedWait(PollyEndpointRouter_t *pxRouter, uint64_t uWaitMs)
+{
+    struct timespec xDeadline = {0};
+
+    clock_gettime(CLOCK_REALTIME, &xDeadline);
+    xDeadline.tv_sec += uWaitMs / 1000;
+    xDeadline.tv_nsec += (long)(uWaitMs % 1000) * 1000000;
+    if (xDeadline.tv_nsec >= 1000000000)
+    {
+        xDeadline.tv_sec++;
+        xDeadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&(pxRouter->xCond), &(pxRouter->xLock), &xDeadline);
+}
+
+static void *prvProbeThread(void *pArg)
+{
+    PollyEndpointRouter_t *pxRouter = (PollyEndpointRouter_t *)pArg;
+    RoutedEndpoint_t *pxEndpoint = NULL;
+    uint64_t uNowMs = 0;
+    uint64_t uNextProbeMs = 0;
+    bool bReachable = false;
+    unsigned int i = 0;
+
+    pthread_mutex_lock(&(pxRouter->xLock));
+    while (!pxRouter->bStop)
+    {
+        uNowMs = Port_getTimeMs();
+        uNextProbeMs = uNowMs + PROBE_INTERVAL_MS;
+        pxEndpoint = NULL;
+
+        for (i = 0; i < pxRouter->xConfig.uEndpointCount && pxEndpoint == NULL; i++)
+        {
+            if (pxRouter->pxEndpoints[i].eState != POLLY_ENDPOINT_OPEN)
+            {
+                /* Only open circuits are probed */
+            }
+            else if (pxRouter->pxEndpoints[i].uProbeAtMs <= uNowMs)
+            {
+                pxEndpoint = &(pxRouter->pxEndpoints[i]);
+            }
+            else if (pxRouter->pxEndpoints[i].uProbeAtMs < uNextProbeMs)
+            {
+                uNextProbeMs = pxRouter->pxEndpoints[i].uProbeAtMs;
+            }
+        }
+
+        if (pxEndpoint != NULL)
+        {
+            pthread_mutex_unlock(&(pxRouter->xLock));
+            bReachable = prvProbe(pxRouter, &(pxEndpoint->xEndpoint));
+            pthread_mutex_lock(&(pxRouter->xLock));
+
+            if (pxEndpoint->eState != POLLY_ENDPOINT_OPEN)
+            {
+                /* Nothing to do */
+            }
+            else if (bReachable)
+            {
+                pxEndpoint->eState = POLLY_ENDPOINT_HALF_OPEN;
+            }
+            else
+            {
+                pxEndpoint->uProbeAtMs = Port_getTimeMs() + pxRouter->xConfig.uOpenMs;
+            }
+        }
+        else
+        {
+            prvTimedWait(pxRouter, uNextProbeMs - uNowMs);
+        }
+    }
+    pthread_mutex_unlock(&(pxRouter->xLock));
+
+    return NULL;
+}
+
+PollyEndpointRouterHandle PollyEndpointRouter_create(PollyServiceParameter_t *pServPara, const PollyEndpointRouterConfig_t *pConfig)
+{
+    PollyEndpointRouter_t *pxRouter = NULL;
+    const PollyEndpoint_t *pxEndpoint = NULL;
+    size_t uStringsLen = 0;
+    char *p = NULL;
+    bool bValid = (pServPara != NULL && pConfig != NULL && pConfig->pxEndpoints != NULL && pConfig->uEndpointCount > 0);
+    bool bLockInited = false;
+    bool bCondInited = false;
+    unsigned int i = 0;
+
+    for (i = 0; bValid && i < pConfig->uEndpointCount; i++)
+    {
+        pxEndpoint = &(pConfig->pxEndpoints[i]);
+        bValid = (pxEndpoint->pRegion != NULL && pxEndpoint->pHost != NULL);
+        if (bValid)
+        {
+            uStringsLen += strlen(pxEndpoint->pRegion) + 1 + strlen(pxEndpoint->pHost) + 1 +
+                           strlen((pxEndpoint->pPort != NULL) ? pxEndpoint->pPort : POLLY_DEFAULT_PORT) + 1;
+        }
+    }
+
+    if (bValid && (pxRouter = (PollyEndpointRouter_t *)Allocator_malloc(sizeof(PollyEndpointRouter_t))) != NULL)
+    {
+        memset(pxRouter, 0, sizeof(PollyEndpointRouter_t));
+        memcpy(&(pxRouter->xConfig), pConfig, sizeof(PollyEndpointRouterConfig_t));
+
+        if (pxRouter->xConfig.uSampleWeightPercent == 0 || pxRouter->xConfig.uSampleWeightPercent > 100)
+        {
+            pxRouter->xConfig.uSampleWeightPercent = DEFAULT_SAMPLE_WEIGHT_PERCENT;
+        }
+        if (pxRouter->xConfig.uExplorePercent == 0)
+        {
+            pxRouter->xConfig.uExplorePercent = DEFAULT_EXPLORE_PERCENT;
+        }
+        if (pxRouter->xConfig.uFailureThreshold == 0)
+        {
+            pxRouter->xConfig.uFailureThreshold = DEFAULT_FAILURE_THRESHOLD;
+        }
+        if (pxRouter->xConfig.uMaxErrorPercent == 0)
+        {
+            pxRouter->xConfig.uMaxErrorPercent = DEFAULT_MAX_ERROR_PERCENT;
+        }
+        if (pxRouter->xConfig.uOpenMs == 0)
+        {
+            pxRouter->xConfig.uOpenMs = DEFAULT_OPEN_MS;
+        }
+        pxRouter->fSampleWeight = pxRouter->xConfig.uSampleWeightPercent / 100.0;
+        pxRouter->uRecvTimeoutMs = pServPara->uRecvTimeoutMs;
+        pxRouter->uConnectTimeoutMs = pServPara->uConnectTimeoutMs;
+        pxRouter->uTlsMaxFragmentLen = pServPara->uTlsMaxFragmentLen;
+        memcpy(&(pxRouter->xSocketOptions), &(pServPara->xSocketOptions), sizeof(PollySocketOptions_t));
+        pxRouter->xTrustStore = TrustStore_acquire(pServPara->xTrustStore);
+        pxRouter->xTransport = pServPara->xTransport;
+
+        if ((pxRouter->pxEndpoints = (RoutedEndpoint_t *)Allocator_calloc(pConfig->uEndpointCount, sizeof(RoutedEndpoint_t))) == NULL ||
+            (pxRouter->pStrings = (char *)Allocator_malloc(uStringsLen)) == NULL)
+        {
+            /* Cleaned up below */
+        }
+        else
+        {
+            p = pxRouter->pStrings;
+            for (i = 0; i < pConfig->uEndpointCount; i++)
+            {
+                pxEndpoint = &(pConfig->pxEndpoints[i]);
+                pxRouter->pxEndpoints[i].eState = POLLY_ENDPOINT_HEALTHY;
+                pxRouter->pxEndpoints[i].xEndpoint.pRegion = prvCopyString(&p, pxEndpoint->pRegion);
+                pxRouter->pxEndpoints[i].xEndpoint.pHost = prvCopyString(&p, pxEndpoint->pHost);
+                pxRouter->pxEndpoints[i].xEndpoint.pPort = prvCopyString(&p, (pxEndpoint->pPort != NULL) ? pxEndpoint->pPort : POLLY_DEFAULT_PORT);
+                pxRouter->pxEndpoints[i].xEndpoint.xConnPool = pxEndpoint->xConnPool;
+            }
+            pxRouter->xConfig.pxEndpoints = NULL;
+        }
+
+        if (pxRouter->pStrings == NULL ||
+            !(bLockInited = (pthread_mutex_init(&(pxRouter->xLock), NULL) == 0)) ||
+            !(bCondInited = (pthread_cond_init(&(pxRouter->xCond), NULL) == 0)) ||
+            pthread_create(&(pxRouter->xThread), NULL, prvProbeThread, pxRouter) != 0)
+        {
+            if (bCondInited)
+            {
+                pthread_cond_destroy(&(pxRouter->xCond));
+            }
+            if (bLockInited)
+            {
+                pthread_mutex_destroy(&(pxRouter->xLock));
+            }
+            TrustStore_release(pxRouter->xTrustStore);
+            Allocator_free(pxRouter->pStrings);
+            Allocator_free(pxRouter->pxEndpoints);
+            Allocator_free(pxRouter);
+            pxRouter = NULL;
+        }
+        else
+        {
+            pxRouter->bThreadStarted = true;
+        }
+    }
+
+    return pxRouter;
+}
+
+int PollyEndpointRouter_getStats(PollyEndpointRouterHandle xEndpointRouter, unsigned int uIndex, PollyEndpointStats_t *pxStats)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollyEndpointRouter_t *pxRouter = (PollyEndpointRouter_t *)xEndpointRouter;
+    RoutedEndpoint_t *pxEndpoint = NULL;
+
+    if (pxRouter == NULL || uIndex >= pxRouter->xConfig.uEndpointCount || pxStats == NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pthread_mutex_lock(&(pxRouter->xLock));
+        pxEndpoint = &(pxRouter->pxEndpoints[uIndex]);
+        pxStats->eState = pxEndpoint->eState;
+        pxStats->uLatencyMs = (unsigned int)(pxEndpoint->fLatencyMs + 0.5);
+        pxStats->uErrorPercent = (unsigned int)(pxEndpoint->fErrorRate * 100 + 0.5);
+        pxStats->uRequests = pxEndpoint->uRequests;
+        pthread_mutex_unlock(&(pxRouter->xLock));
+    }
+
+    return res;
+}
+
+void PollyEndpointRouter_terminate(PollyEndpointRouterHandle xEndpointRouter)
+{
+    PollyEndpointRouter_t *pxRouter = (PollyEndpointRouter_t *)xEndpointRouter;
+
+    if (pxRouter != NULL)
+    {
+        if (pxRouter->bThreadStarted)
+        {
+            pthread_mutex_lock(&(pxRouter->xLock));
+            pxRouter->bStop = true;
+            pthread_cond_signal(&(pxRouter->xCond));
+            pthread_mutex_unlock(&(pxRouter->xLock));
+            pthread_join(pxRouter->xThread, NULL);
+        }
+
+        pthread_cond_destroy(&(pxRouter->xCond));
+        pthread_mutex_destroy(&(pxRouter->xLock));
+        TrustStore_release(pxRouter->xTrustStore);
+        Allocator_free(pxRouter->pStrings);
+        Allocator_free(pxRouter->pxEndpoints);
+        Allocator_free(pxRouter);
+    }
+}
+
+unsigned int EndpointRouter_select(PollyEndpointRouterHandle xEndpointRouter)
+{
+    PollyEndpointRouter_t *pxRouter = (PollyEndpointRouter_t *)xEndpointRouter;
+    RoutedEndpoint_t *pxEndpoints = pxRouter->pxEndpoints;
+    unsigned int uCount = pxRouter->xConfig.uEndpointCount;
+    unsigned int uSelected = NO_ENDPOINT;
+    unsigned int uFastest = NO_ENDPOINT;
+    unsigned int uHealthy = 0;
+    unsigned int i = 0;
+
+    pthread_mutex_lock(&(pxRouter->xLock));
+    pxRouter->uSelections++;
+
+    for (i = 0; i < uCount && uSelected == NO_ENDPOINT; i++)
+    {
+        if (pxEndpoints[i].eState == POLLY_ENDPOINT_HALF_OPEN && !pxEndpoints[i].bTrialInFlight)
+        {
+            /* A recovering endpoint is tried right away, so it takes its share of traffic again as soon as it's healthy. */
+            pxEndpoints[i].bTrialInFlight = true;
+            uSelected = i;
+        }
+        else if (pxEndpoints[i].eState == POLLY_ENDPOINT_HEALTHY)
+        {
+            uHealthy++;
+            if (uFastest == NO_ENDPOINT || prvIsFaster(&(pxEndpoints[i]), &(pxEndpoints[uFastest])))
+            {
+                uFastest = i;
+            }
+        }
+    }
+
+    if (uSelected != NO_ENDPOINT)
+    {
+        /* Propagate the selection */
+    }
+    else if (uHealthy > 1 && (pxRouter->uSelections * pxRouter->xConfig.uExplorePercent) % 100 < pxRouter->xConfig.uExplorePercent)
+    {
+        /* The others are measured now and then, or a slow endpoint which recovers would never be chosen again. */
+        for (i = 0; i < uCount && uSelected == NO_ENDPOINT; i++)
+        {
+            pxRouter->uExploreCursor = (pxRouter->uExploreCursor + 1) % uCount;
+            if (pxEndpoints[pxRouter->uExploreCursor].eState == POLLY_ENDPOINT_HEALTHY && pxRouter->uExploreCursor != uFastest)
+            {
+                uSelected = pxRouter->uExploreCursor;
+            }
+        }
+    }
+    else if (uFastest != NO_ENDPOINT)
+    {
+        uSelected = uFastest;
+    }
+    else
+    {
+        /* Every circuit is open, so the request goes where a probe is due first rather than failing without a try. */
+        for (i = 0, uSelected = 0; i < uCount; i++)
+        {
+            if (pxEndpoints[i].uProbeAtMs < pxEndpoints[uSelected].uProbeAtMs)
+            {
+                uSelected = i;
+            }
+        }
+    }
+
+    pxEndpoints[uSelected].uRequests++;
+    pthread_mutex_unlock(&(pxRouter->xLock));
+
+    return uSelected;
+}
+
+const PollyEndpoint_t *EndpointRouter_getEndpoint(PollyEndpointRouterHandle xEndpointRouter, unsigned int uIndex)
+{
+    return &(((PollyEndpointRouter_t *)xEndpointRouter)->pxEndpoints[uIndex].xEndpoint);
+}
+
+void EndpointRouter_report(PollyEndpointRouterHandle xEndpointRouter, unsigned int uIndex, bool bFailure, uint32_t uLatencyMs)
+{
+    PollyEndpointRouter_t *pxRouter = (PollyEndpointRouter_t *)xEndpointRouter;
+    RoutedEndpoint_t *pxEndpoint = NULL;
+    double fWeight = 0;
+
+    if (pxRouter != NULL && uIndex < pxRouter->xConfig.uEndpointCount)
+    {
+        pthread_mutex_lock(&(pxRouter->xLock));
+        pxEndpoint = &(pxRouter->pxEndpoints[uIndex]);
+        fWeight = pxRouter->fSampleWeight;
+
+        pxEndpoint->uSamples++;
+        pxEndpoint->fErrorRate += ((bFailure ? 1.0 : 0.0) - pxEndpoint->fErrorRate) * fWeight;
+        if (bFailure)
+        {
+            pxEndpoint->uConsecutiveFailures++;
+        }
+        else
+        {
+            pxEndpoint->uConsecutiveFailures = 0;
+            if (uLatencyMs == 0)
+            {
+                /* Only the health is known */
+            }
+            else if (pxEndpoint->fLatencyMs == 0)
+            {
+                pxEndpoint->fLatencyMs = uLatencyMs;
+            }
+            else
+            {
+                pxEndpoint->fLatencyMs += (uLatencyMs - pxEndpoint->fLatencyMs) * fWeight;
+            }
+        }
+
+        if (pxEndpoint->eState == POLLY_ENDPOINT_HALF_OPEN)
+        {
+            if (bFailure)
+            {
+                prvOpenCircuit(pxRouter, pxEndpoint);
+            }
+            else
+            {
+                /* The error history from before the outage doesn't count against it any more. */
+                pxEndpoint->eState = POLLY_ENDPOINT_HEALTHY;
+                pxEndpoint->bTrialInFlight = false;
+                pxEndpoint->fErrorRate = 0;
+                pxEndpoint->uSamples = 0;
+            }
+        }
+        else if (pxEndpoint->eState == POLLY_ENDPOINT_HEALTHY &&
+                 (pxEndpoint->uConsecutiveFailures >= pxRouter->xConfig.uFailureThreshold ||
+                  (pxEndpoint->uSamples >= MIN_ERROR_RATE_SAMPLES && pxEndpoint->fErrorRate * 100 >= pxRouter->xConfig.uMaxErrorPercent)))
+        {
+            prvOpenCircuit(pxRouter, pxEndpoint);
+        }
+        pthread_mutex_unlock(&(pxRouter->xLock));
+    }
+}
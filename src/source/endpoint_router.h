@@ -0,0 +1,38 @@
+#ifndef ENDPOINT_ROUTER_H
+#define ENDPOINT_ROUTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "polly/polly.h"
+
+/**
+ * @brief Pick the endpoint of the next attempt: the healthy one with the lowest latency, another healthy one for a share of
+ * the requests to keep its latency current, or an endpoint which recovers to try it. If every circuit is open, the endpoint
+ * which will be probed first is used.
+ *
+ * @param[in] xEndpointRouter The endpoint router handle
+ * @return The index of the endpoint
+ */
+unsigned int EndpointRouter_select(PollyEndpointRouterHandle xEndpointRouter);
+
+/**
+ * @brief Get an endpoint picked by EndpointRouter_select()
+ *
+ * @param[in] xEndpointRouter The endpoint router handle
+ * @param[in] uIndex The index of the endpoint
+ * @return The endpoint. Its strings live as long as the router.
+ */
+const PollyEndpoint_t *EndpointRouter_getEndpoint(PollyEndpointRouterHandle xEndpointRouter, unsigned int uIndex);
+
+/**
+ * @brief Report the result of an attempt. It updates the moving averages of the endpoint, and opens or closes its circuit.
+ *
+ * @param[in] xEndpointRouter The endpoint router handle, or NULL if requests are not routed
+ * @param[in] uIndex The index of the endpoint
+ * @param[in] bFailure true if the endpoint failed to serve the request, not if the request itself was rejected
+ * @param[in] uLatencyMs Time to first byte of the request, or 0 if it's unknown
+ */
+void EndpointRouter_report(PollyEndpointRouterHandle xEndpointRouter, unsigned int uIndex, bool bFailure, uint32_t uLatencyMs);
+
+#endif /* ENDPOINT_ROUTER_H */
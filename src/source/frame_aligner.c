@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "frame_aligner.h"
+
+/* Frames delivered by one callback at most. A read of a TLS record holds a few dozens of MP3 frames at most. */
+#define FRAME_ALIGNER_MAX_FRAMES    (32)
+
+#define ID3V2_HEADER_LEN            (10)
+#define ID3V2_FOOTER_LEN            (10)
+#define ID3V1_TAG_LEN               (128)
+#define MP3_HEADER_LEN              (4)
+#define OGG_PAGE_HEADER_LEN         (27)
+
+typedef enum
+{
+    FRAME_SCAN_FOUND,       // A frame of the returned length starts here
+    FRAME_SCAN_SKIP,        // A tag of the returned length starts here, and it's dropped
+    FRAME_SCAN_WANT_MORE,   // The header is incomplete, and the returned length is needed to tell
+    FRAME_SCAN_INVALID      // No frame starts here
+} FrameScan_t;
+
+typedef struct FrameAligner
+{
+    FrameFormat_t eFormat;
+
+    /* The head of a frame which is split across two pushes */
+    uint8_t *pCarry;
+    size_t uCarryLen;
+    size_t uCarrySize;
+    bool bCarryPending; // The carried frame is complete, and it's referred by the batch until it's delivered
+
+    size_t uSkipLen; // The rest of a tag which is dropped
+
+    const uint8_t *ppFrames[FRAME_ALIGNER_MAX_FRAMES];
+    size_t puFrameLens[FRAME_ALIGNER_MAX_FRAMES];
+    size_t uFrameCount;
+} FrameAligner_t;
+
+/* Bitrates in kbps of MPEG-1 layer I, II, III and MPEG-2/2.5 layer I, and II and III. Index 0 is free format, which has no frame length. */
+static const uint16_t gpMp3Bitrates[5][16] =
+{
+    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+};
+
+/* Sample rates by the version bits: MPEG-2.5, reserved, MPEG-2 and MPEG-1 */
+static const uint32_t gpMp3SampleRates[4][3] =
+{
+    { 11025, 12000, 8000 },
+    { 0, 0, 0 },
+    { 22050, 24000, 16000 },
+    { 44100, 48000, 32000 },
+};
+
+static bool prvMatchPrefix(const uint8_t *p, size_t uAvail, const char *pPrefix, size_t uPrefixLen)
+{
+    return memcmp(p, pPrefix, (uAvail < uPrefixLen) ? uAvail : uPrefixLen) == 0;
+}
+
+/* Parse the 4-byte header of an MP3 frame. Free format frames are rejected, because their length isn't in the header. */
+static bool prvParseMp3Header(const uint8_t *p, size_t *puLen, uint32_t *puSamples, uint32_t *puSampleRate)
+{
+    bool bValid = false;
+    uint8_t uVersion = (p[1] >> 3) & 0x03;
+    uint8_t uLayer = (p[1] >> 1) & 0x03;
+    uint8_t uBitrateIndex = (p[2] >> 4) & 0x0F;
+    uint8_t uSampleRateIndex = (p[2] >> 2) & 0x03;
+    uint32_t uPadding = (p[2] >> 1) & 0x01;
+    uint32_t uBitrate = 0;
+    uint32_t uSampleRate = 0;
+
+    if (p[0] == 0xFF && (p[1] & 0xE0) == 0xE0 && uVersion != 1 && uLayer != 0 && uSampleRateIndex != 3)
+    {
+        if (uVersion == 3)
+        {
+            uBitrate = gpMp3Bitrates[3 - uLayer][uBitrateIndex] * 1000;
+        }
+        else
+        {
+            uBitrate = gpMp3Bitrates[(uLayer == 3) ? 3 : 4][uBitrateIndex] * 1000;
+        }
+        uSampleRate = gpMp3SampleRates[uVersion][uSampleRateIndex];
+    }
+
+    if (uBitrate > 0)
+    {
+        if (uLayer == 3)
+        {
+            *puLen = (12 * uBitrate / uSampleRate + uPadding) * 4;
+            *puSamples = 384;
+        }
+        else if (uLayer == 2 || uVersion == 3)
+        {
+            *puLen = 144 * uBitrate / uSampleRate + uPadding;
+            *puSamples = 1152;
+        }
+        else
+        {
+            /* Layer III of MPEG-2 and 2.5 has half the samples per frame */
+            *puLen = 72 * uBitrate / uSampleRate + uPadding;
+            *puSamples = 576;
+        }
+        *puSampleRate = uSampleRate;
+        bValid = true;
+    }
+
+    return bValid;
+}
+
+static FrameScan_t prvScanMp3(const uint8_t *p, size_t uAvail, size_t *puLen)
+{
+    FrameScan_t eScan = FRAME_SCAN_INVALID;
+    uint32_t uSamples = 0;
+    uint32_t uSampleRate = 0;
+
+    if (prvMatchPrefix(p, uAvail, "ID3", 3))
+    {
+        /* The size of an ID3v2 tag is a 28-bit integer, 7 bits per byte */
+        if (uAvail < ID3V2_HEADER_LEN)
+        {
+            *puLen = ID3V2_HEADER_LEN;
+            eScan = FRAME_SCAN_WANT_MORE;
+        }
+        else if (((p[6] | p[7] | p[8] | p[9]) & 0x80) == 0)
+        {
+            *puLen = ID3V2_HEADER_LEN + (((size_t)p[6] << 21) | ((size_t)p[7] << 14) | ((size_t)p[8] << 7) | (size_t)p[9]) +
+                     (((p[5] & 0x10) != 0) ? ID3V2_FOOTER_LEN : 0);
+            eScan = FRAME_SCAN_SKIP;
+        }
+    }
+    else if (prvMatchPrefix(p, uAvail, "TAG", 3))
+    {
+        *puLen = (uAvail < 3) ? 3 : ID3V1_TAG_LEN;
+        eScan = (uAvail < 3) ? FRAME_SCAN_WANT_MORE : FRAME_SCAN_SKIP;
+    }
+    else if (p[0] != 0xFF || (uAvail > 1 && (p[1] & 0xE0) != 0xE0))
+    {
+        /* Not a frame sync */
+    }
+    else if (uAvail < MP3_HEADER_LEN)
+    {
+        *puLen = MP3_HEADER_LEN;
+        eScan = FRAME_SCAN_WANT_MORE;
+    }
+    else if (prvParseMp3Header(p, puLen, &uSamples, &uSampleRate))
+    {
+        eScan = FRAME_SCAN_FOUND;
+    }
+
+    return eScan;
+}
+
+static FrameScan_t prvScanOgg(const uint8_t *p, size_t uAvail, size_t *puLen)
+{
+    FrameScan_t eScan = FRAME_SCAN_INVALID;
+    size_t uSegments = 0;
+    size_t uBodyLen = 0;
+    size_t i = 0;
+
+    if (!prvMatchPrefix(p, uAvail, "OggS", 4))
+    {
+        /* Not a capture pattern */
+    }
+    else if (uAvail < OGG_PAGE_HEADER_LEN)
+    {
+        *puLen = OGG_PAGE_HEADER_LEN;
+        eScan = FRAME_SCAN_WANT_MORE;
+    }
+    else if (p[4] != 0)
+    {
+        /* Unknown version */
+    }
+    else if (uAvail < OGG_PAGE_HEADER_LEN + (uSegments = p[26]))
+    {
+        /* The page length is the sum of the lacing values of the segment table */
+        *puLen = OGG_PAGE_HEADER_LEN + uSegments;
+        eScan = FRAME_SCAN_WANT_MORE;
+    }
+    else
+    {
+        for (i = 0; i < uSegments; i++)
+        {
+            uBodyLen += p[OGG_PAGE_HEADER_LEN + i];
+        }
+        *puLen = OGG_PAGE_HEADER_LEN + uSegments + uBodyLen;
+        eScan = FRAME_SCAN_FOUND;
+    }
+
+    return eScan;
+}
+
+static FrameScan_t prvScan(FrameAligner_t *pxFrameAligner, const uint8_t *p, size_t uAvail, size_t *puLen)
+{
+    return (pxFrameAligner->eFormat == FRAME_FORMAT_MP3) ? prvScanMp3(p, uAvail, puLen) : prvScanOgg(p, uAvail, puLen);
+}
+
+static int prvReserveCarry(FrameAligner_t *pxFrameAligner, size_t uSize)
+{
+    int res = FRAME_ALIGNER_ERRNO_NONE;
+    uint8_t *pTemp = NULL;
+
+    if (uSize > pxFrameAligner->uCarrySize)
+    {
+        if ((pTemp = (uint8_t *)Allocator_realloc(pxFrameAligner->pCarry, uSize)) == NULL)
+        {
+            res = FRAME_ALIGNER_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            pxFrameAligner->pCarry = pTemp;
+            pxFrameAligner->uCarrySize = uSize;
+        }
+    }
+
+    return res;
+}
+
+static void prvFlush(FrameAligner_t *pxFrameAligner, int (*onFramesCallback)(const uint8_t **, const size_t *, size_t, void *), void *pUserData,
+                     size_t *puBytesDelivered)
+{
+    size_t i = 0;
+
+    if (pxFrameAligner->uFrameCount > 0)
+    {
+        onFramesCallback(pxFrameAligner->ppFrames, pxFrameAligner->puFrameLens, pxFrameAligner->uFrameCount, pUserData);
+        for (i = 0; i < pxFrameAligner->uFrameCount; i++)
+        {
+            *puBytesDelivered += pxFrameAligner->puFrameLens[i];
+        }
+        pxFrameAligner->uFrameCount = 0;
+    }
+
+    if (pxFrameAligner->bCarryPending)
+    {
+        pxFrameAligner->uCarryLen = 0;
+        pxFrameAligner->bCarryPending = false;
+    }
+}
+
+static void prvAddFrame(FrameAligner_t *pxFrameAligner, const uint8_t *pFrame, size_t uFrameLen,
+                        int (*onFramesCallback)(const uint8_t **, const size_t *, size_t, void *), void *pUserData, size_t *puBytesDelivered)
+{
+    if (pxFrameAligner->uFrameCount == FRAME_ALIGNER_MAX_FRAMES)
+    {
+        prvFlush(pxFrameAligner, onFramesCallback, pUserData, puBytesDelivered);
+    }
+    pxFrameAligner->ppFrames[pxFrameAligner->uFrameCount] = pFrame;
+    pxFrameAligner->puFrameLens[pxFrameAligner->uFrameCount] = uFrameLen;
+    pxFrameAligner->uFrameCount++;
+}
+
+int FrameAligner_getMp3Duration(const uint8_t *pFrame, size_t uFrameLen, uint32_t *puSamples, uint32_t *puSampleRate)
+{
+    int res = FRAME_ALIGNER_ERRNO_NONE;
+    size_t uLen = 0;
+
+    if (pFrame == NULL || uFrameLen < MP3_HEADER_LEN || puSamples == NULL || puSampleRate == NULL ||
+        !prvParseMp3Header(pFrame, &uLen, puSamples, puSampleRate))
+    {
+        res = FRAME_ALIGNER_ERRNO_INVALID_PARAMETER;
+    }
+
+    return res;
+}
+
+FrameAlignerHandle FrameAligner_create(FrameFormat_t eFormat)
+{
+    FrameAligner_t *pxFrameAligner = NULL;
+
+    if ((pxFrameAligner = (FrameAligner_t *)Allocator_malloc(sizeof(FrameAligner_t))) != NULL)
+    {
+        memset(pxFrameAligner, 0, sizeof(FrameAligner_t));
+        pxFrameAligner->eFormat = eFormat;
+    }
+
+    return pxFrameAligner;
+}
+
+void FrameAligner_terminate(FrameAlignerHandle xFrameAligner)
+{
+    FrameAligner_t *pxFrameAligner = (FrameAligner_t *)xFrameAligner;
+
+    if (pxFrameAligner != NULL)
+    {
+        if (pxFrameAligner->pCarry != NULL)
+        {
+            Allocator_free(pxFrameAligner->pCarry);
+        }
+        Allocator_free(pxFrameAligner);
+    }
+}
+
+int FrameAligner_push(FrameAlignerHandle xFrameAligner, const uint8_t *pData, size_t uLen,
+                      int (*onFramesCallback)(const uint8_t **ppFrames, const size_t *puFrameLens, size_t uFrameCount, void *pUserData), void *pUserData,
+                      size_t *puBytesDelivered)
+{
+    int res = FRAME_ALIGNER_ERRNO_NONE;
+    FrameAligner_t *pxFrameAligner = (FrameAligner_t *)xFrameAligner;
+    FrameScan_t eScan = FRAME_SCAN_INVALID;
+    size_t uPos = 0;
+    size_t uFrameLen = 0;
+    size_t uCopyLen = 0;
+
+    if (pxFrameAligner == NULL || (pData == NULL && uLen > 0) || onFramesCallback == NULL || puBytesDelivered == NULL)
+    {
+        res = FRAME_ALIGNER_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        *puBytesDelivered = 0;
+
+        while (uPos < uLen && res == FRAME_ALIGNER_ERRNO_NONE)
+        {
+            if (pxFrameAligner->uSkipLen > 0)
+            {
+                uCopyLen = (uLen - uPos < pxFrameAligner->uSkipLen) ? uLen - uPos : pxFrameAligner->uSkipLen;
+                pxFrameAligner->uSkipLen -= uCopyLen;
+                uPos += uCopyLen;
+            }
+            else if (pxFrameAligner->uCarryLen > 0 && !pxFrameAligner->bCarryPending)
+            {
+                /* Complete the carried frame. Only the bytes it needs are copied, so it never holds the start of the next frame. */
+                eScan = prvScan(pxFrameAligner, pxFrameAligner->pCarry, pxFrameAligner->uCarryLen, &uFrameLen);
+                if (eScan == FRAME_SCAN_INVALID)
+                {
+                    /* The header turned out to be corrupted. Like in a stream which isn't split, only its first byte is dropped, and the
+                     * scan resumes at the next one, which may start a frame. Every frame or tag is longer than a carried header, so the
+                     * rest of the carry never holds a whole one. */
+                    pxFrameAligner->uCarryLen--;
+                    memmove(pxFrameAligner->pCarry, pxFrameAligner->pCarry + 1, pxFrameAligner->uCarryLen);
+                }
+                else if (eScan == FRAME_SCAN_SKIP)
+                {
+                    pxFrameAligner->uSkipLen = uFrameLen - pxFrameAligner->uCarryLen;
+                    pxFrameAligner->uCarryLen = 0;
+                }
+                else if ((res = prvReserveCarry(pxFrameAligner, uFrameLen)) == FRAME_ALIGNER_ERRNO_NONE)
+                {
+                    uCopyLen = (uLen - uPos < uFrameLen - pxFrameAligner->uCarryLen) ? uLen - uPos : uFrameLen - pxFrameAligner->uCarryLen;
+                    memcpy(pxFrameAligner->pCarry + pxFrameAligner->uCarryLen, pData + uPos, uCopyLen);
+                    pxFrameAligner->uCarryLen += uCopyLen;
+                    uPos += uCopyLen;
+
+                    if (eScan == FRAME_SCAN_FOUND && pxFrameAligner->uCarryLen == uFrameLen)
+                    {
+                        prvAddFrame(pxFrameAligner, pxFrameAligner->pCarry, uFrameLen, onFramesCallback, pUserData, puBytesDelivered);
+                        pxFrameAligner->bCarryPending = true;
+                    }
+                }
+            }
+            else
+            {
+                eScan = prvScan(pxFrameAligner, pData + uPos, uLen - uPos, &uFrameLen);
+                if (eScan == FRAME_SCAN_INVALID)
+                {
+                    uPos++;
+                }
+                else if (eScan == FRAME_SCAN_SKIP)
+                {
+                    pxFrameAligner->uSkipLen = uFrameLen;
+                }
+                else if (eScan == FRAME_SCAN_FOUND && uFrameLen <= uLen - uPos)
+                {
+                    /* A whole frame is delivered in place */
+                    prvAddFrame(pxFrameAligner, pData + uPos, uFrameLen, onFramesCallback, pUserData, puBytesDelivered);
+                    uPos += uFrameLen;
+                }
+                else
+                {
+                    /* The frame continues in the next push. The carry buffer may still be referred by the batch, so the batch goes first. */
+                    prvFlush(pxFrameAligner, onFramesCallback, pUserData, puBytesDelivered);
+                    if ((res = prvReserveCarry(pxFrameAligner, uLen - uPos)) == FRAME_ALIGNER_ERRNO_NONE)
+                    {
+                        memcpy(pxFrameAligner->pCarry, pData + uPos, uLen - uPos);
+                        pxFrameAligner->uCarryLen = uLen - uPos;
+                        uPos = uLen;
+                    }
+                }
+            }
+        }
+
+        prvFlush(pxFrameAligner, onFramesCallback, pUserData, puBytesDelivered);
+    }
+
+    return res;
+}
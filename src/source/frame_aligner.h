@@ -0,0 +1,62 @@
+#ifndef FRAME_ALIGNER_H
+#define FRAME_ALIGNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_ALIGNER_ERRNO_NONE                (0)
+#define FRAME_ALIGNER_ERRNO_INVALID_PARAMETER   (-1)
+#define FRAME_ALIGNER_ERRNO_OUT_OF_MEMORY       (-2)
+
+typedef enum
+{
+    FRAME_FORMAT_MP3,
+    FRAME_FORMAT_OGG
+} FrameFormat_t;
+
+typedef struct FrameAligner *FrameAlignerHandle;
+
+/**
+ * @brief Create a framing stage which cuts an audio stream into whole MP3 frames or Ogg pages
+ *
+ * @param[in] eFormat The container of the stream
+ * @return The frame aligner handle
+ */
+FrameAlignerHandle FrameAligner_create(FrameFormat_t eFormat);
+
+/**
+ * @brief Terminate a frame aligner. An incomplete frame carried over is dropped.
+ *
+ * @param[in] xFrameAligner The frame aligner handle
+ */
+void FrameAligner_terminate(FrameAlignerHandle xFrameAligner);
+
+/**
+ * @brief Feed the next bytes of the stream. Every complete frame is delivered by the callback, in batches of consecutive frames, and
+ * the tail of an incomplete frame is kept until the next call. Frames which are whole in pData are not copied.
+ * ID3 tags of MP3 streams and bytes which don't belong to any frame are dropped.
+ *
+ * @param[in] xFrameAligner The frame aligner handle
+ * @param[in] pData The next bytes of the stream
+ * @param[in] uLen The length of pData
+ * @param[in] onFramesCallback The callback which receives the frames. They are only valid during the call.
+ * @param[in] pUserData The user data of the callback
+ * @param[out] puBytesDelivered The bytes delivered by this call
+ * @return FRAME_ALIGNER_ERRNO_NONE on success, non-zero value otherwise
+ */
+int FrameAligner_push(FrameAlignerHandle xFrameAligner, const uint8_t *pData, size_t uLen,
+                      int (*onFramesCallback)(const uint8_t **ppFrames, const size_t *puFrameLens, size_t uFrameCount, void *pUserData), void *pUserData,
+                      size_t *puBytesDelivered);
+
+/**
+ * @brief Get the duration of an MP3 frame delivered by FrameAligner_push()
+ *
+ * @param[in] pFrame The frame
+ * @param[in] uFrameLen The length of the frame
+ * @param[out] puSamples The samples per channel in the frame
+ * @param[out] puSampleRate The sample rate of the frame
+ * @return FRAME_ALIGNER_ERRNO_NONE on success, non-zero value otherwise
+ */
+int FrameAligner_getMp3Duration(const uint8_t *pFrame, size_t uFrameLen, uint32_t *puSamples, uint32_t *puSampleRate);
+
+#endif /* FRAME_ALIGNER_H */
@@ -0,0 +1,906 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "hpack.h"
+
+/* Every entry of the dynamic table costs its name, its value and this overhead (RFC 7541 section 4.1). */
+#define HPACK_ENTRY_OVERHEAD        (32)
+
+/* The longest codes, EOS among them, are 30 bits */
+#define HPACK_HUFFMAN_MAX_CODE_LEN  (30)
+#define HPACK_HUFFMAN_EOS           (256)
+
+typedef struct
+{
+    const char *pName;
+    const char *pValue;
+} HpackStaticEntry_t;
+
+typedef struct
+{
+    char *pName; // The name and the value share one allocation
+    size_t uNameLen;
+    size_t uValueLen;
+} HpackDynamicEntry_t;
+
+typedef struct HpackDecoder
+{
+    HpackDynamicEntry_t *pxEntries; // The newest entry comes first
+    size_t uEntryCount;
+    size_t uEntryCapacity;
+    size_t uTableSize;
+    size_t uMaxTableSize;
+    size_t uProtocolMaxTableSize;
+} HpackDecoder_t;
+
+typedef struct
+{
+    uint32_t uCode;
+    uint8_t uLen;
+    uint16_t uSymbol;
+} HpackHuffmanCode_t;
+
+/* The codes of one length are consecutive, and follow the last code of the shorter length shifted left. */
+typedef struct
+{
+    uint32_t uFirstCode;
+    uint16_t uFirstIndex; // In gxHuffmanTable
+    uint16_t uCount;
+} HpackHuffmanLength_t;
+
+static const HpackStaticEntry_t gxStaticTable[] =
+{
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+#define HPACK_STATIC_TABLE_COUNT    (sizeof(gxStaticTable) / sizeof(gxStaticTable[0]))
+
+/* The Huffman code of every symbol and EOS (RFC 7541 Appendix B). The code is canonical, so sorted by length and symbol the codes are in
+ * ascending order, and a code decodes to its symbol by its offset from the first code of its length. */
+static const HpackHuffmanCode_t gxHuffmanTable[] =
+{
+    { 0x0, 5, 48 }, /* '0' */
+    { 0x1, 5, 49 }, /* '1' */
+    { 0x2, 5, 50 }, /* '2' */
+    { 0x3, 5, 97 }, /* 'a' */
+    { 0x4, 5, 99 }, /* 'c' */
+    { 0x5, 5, 101 }, /* 'e' */
+    { 0x6, 5, 105 }, /* 'i' */
+    { 0x7, 5, 111 }, /* 'o' */
+    { 0x8, 5, 115 }, /* 's' */
+    { 0x9, 5, 116 }, /* 't' */
+    { 0x14, 6, 32 }, /* ' ' */
+    { 0x15, 6, 37 }, /* '%' */
+    { 0x16, 6, 45 }, /* '-' */
+    { 0x17, 6, 46 }, /* '.' */
+    { 0x18, 6, 47 }, /* '/' */
+    { 0x19, 6, 51 }, /* '3' */
+    { 0x1a, 6, 52 }, /* '4' */
+    { 0x1b, 6, 53 }, /* '5' */
+    { 0x1c, 6, 54 }, /* '6' */
+    { 0x1d, 6, 55 }, /* '7' */
+    { 0x1e, 6, 56 }, /* '8' */
+    { 0x1f, 6, 57 }, /* '9' */
+    { 0x20, 6, 61 }, /* '=' */
+    { 0x21, 6, 65 }, /* 'A' */
+    { 0x22, 6, 95 }, /* '_' */
+    { 0x23, 6, 98 }, /* 'b' */
+    { 0x24, 6, 100 }, /* 'd' */
+    { 0x25, 6, 102 }, /* 'f' */
+    { 0x26, 6, 103 }, /* 'g' */
+    { 0x27, 6, 104 }, /* 'h' */
+    { 0x28, 6, 108 }, /* 'l' */
+    { 0x29, 6, 109 }, /* 'm' */
+    { 0x2a, 6, 110 }, /* 'n' */
+    { 0x2b, 6, 112 }, /* 'p' */
+    { 0x2c, 6, 114 }, /* 'r' */
+    { 0x2d, 6, 117 }, /* 'u' */
+    { 0x5c, 7, 58 }, /* ':' */
+    { 0x5d, 7, 66 }, /* 'B' */
+    { 0x5e, 7, 67 }, /* 'C' */
+    { 0x5f, 7, 68 }, /* 'D' */
+    { 0x60, 7, 69 }, /* 'E' */
+    { 0x61, 7, 70 }, /* 'F' */
+    { 0x62, 7, 71 }, /* 'G' */
+    { 0x63, 7, 72 }, /* 'H' */
+    { 0x64, 7, 73 }, /* 'I' */
+    { 0x65, 7, 74 }, /* 'J' */
+    { 0x66, 7, 75 }, /* 'K' */
+    { 0x67, 7, 76 }, /* 'L' */
+    { 0x68, 7, 77 }, /* 'M' */
+    { 0x69, 7, 78 }, /* 'N' */
+    { 0x6a, 7, 79 }, /* 'O' */
+    { 0x6b, 7, 80 }, /* 'P' */
+    { 0x6c, 7, 81 }, /* 'Q' */
+    { 0x6d, 7, 82 }, /* 'R' */
+    { 0x6e, 7, 83 }, /* 'S' */
+    { 0x6f, 7, 84 }, /* 'T' */
+    { 0x70, 7, 85 }, /* 'U' */
+    { 0x71, 7, 86 }, /* 'V' */
+    { 0x72, 7, 87 }, /* 'W' */
+    { 0x73, 7, 89 }, /* 'Y' */
+    { 0x74, 7, 106 }, /* 'j' */
+    { 0x75, 7, 107 }, /* 'k' */
+    { 0x76, 7, 113 }, /* 'q' */
+    { 0x77, 7, 118 }, /* 'v' */
+    { 0x78, 7, 119 }, /* 'w' */
+    { 0x79, 7, 120 }, /* 'x' */
+    { 0x7a, 7, 121 }, /* 'y' */
+    { 0x7b, 7, 122 }, /* 'z' */
+    { 0xf8, 8, 38 }, /* '&' */
+    { 0xf9, 8, 42 }, /* '*' */
+    { 0xfa, 8, 44 }, /* ',' */
+    { 0xfb, 8, 59 }, /* ';' */
+    { 0xfc, 8, 88 }, /* 'X' */
+    { 0xfd, 8, 90 }, /* 'Z' */
+    { 0x3f8, 10, 33 }, /* '!' */
+    { 0x3f9, 10, 34 }, /* '"' */
+    { 0x3fa, 10, 40 }, /* '(' */
+    { 0x3fb, 10, 41 }, /* ')' */
+    { 0x3fc, 10, 63 }, /* '?' */
+    { 0x7fa, 11, 39 }, /* '\'' */
+    { 0x7fb, 11, 43 }, /* '+' */
+    { 0x7fc, 11, 124 }, /* '|' */
+    { 0xffa, 12, 35 }, /* '#' */
+    { 0xffb, 12, 62 }, /* '>' */
+    { 0x1ff8, 13, 0 }, /* 0 */
+    { 0x1ff9, 13, 36 }, /* '$' */
+    { 0x1ffa, 13, 64 }, /* '@' */
+    { 0x1ffb, 13, 91 }, /* '[' */
+    { 0x1ffc, 13, 93 }, /* ']' */
+    { 0x1ffd, 13, 126 }, /* '~' */
+    { 0x3ffc, 14, 94 }, /* '^' */
+    { 0x3ffd, 14, 125 }, /* '}' */
+    { 0x7ffc, 15, 60 }, /* '<' */
+    { 0x7ffd, 15, 96 }, /* '`' */
+    { 0x7ffe, 15, 123 }, /* '{' */
+    { 0x7fff0, 19, 92 }, /* '\\' */
+    { 0x7fff1, 19, 195 }, /* 195 */
+    { 0x7fff2, 19, 208 }, /* 208 */
+    { 0xfffe6, 20, 128 }, /* 128 */
+    { 0xfffe7, 20, 130 }, /* 130 */
+    { 0xfffe8, 20, 131 }, /* 131 */
+    { 0xfffe9, 20, 162 }, /* 162 */
+    { 0xfffea, 20, 184 }, /* 184 */
+    { 0xfffeb, 20, 194 }, /* 194 */
+    { 0xfffec, 20, 224 }, /* 224 */
+    { 0xfffed, 20, 226 }, /* 226 */
+    { 0x1fffdc, 21, 153 }, /* 153 */
+    { 0x1fffdd, 21, 161 }, /* 161 */
+    { 0x1fffde, 21, 167 }, /* 167 */
+    { 0x1fffdf, 21, 172 }, /* 172 */
+    { 0x1fffe0, 21, 176 }, /* 176 */
+    { 0x1fffe1, 21, 177 }, /* 177 */
+    { 0x1fffe2, 21, 179 }, /* 179 */
+    { 0x1fffe3, 21, 209 }, /* 209 */
+    { 0x1fffe4, 21, 216 }, /* 216 */
+    { 0x1fffe5, 21, 217 }, /* 217 */
+    { 0x1fffe6, 21, 227 }, /* 227 */
+    { 0x1fffe7, 21, 229 }, /* 229 */
+    { 0x1fffe8, 21, 230 }, /* 230 */
+    { 0x3fffd2, 22, 129 }, /* 129 */
+    { 0x3fffd3, 22, 132 }, /* 132 */
+    { 0x3fffd4, 22, 133 }, /* 133 */
+    { 0x3fffd5, 22, 134 }, /* 134 */
+    { 0x3fffd6, 22, 136 }, /* 136 */
+    { 0x3fffd7, 22, 146 }, /* 146 */
+    { 0x3fffd8, 22, 154 }, /* 154 */
+    { 0x3fffd9, 22, 156 }, /* 156 */
+    { 0x3fffda, 22, 160 }, /* 160 */
+    { 0x3fffdb, 22, 163 }, /* 163 */
+    { 0x3fffdc, 22, 164 }, /* 164 */
+    { 0x3fffdd, 22, 169 }, /* 169 */
+    { 0x3fffde, 22, 170 }, /* 170 */
+    { 0x3fffdf, 22, 173 }, /* 173 */
+    { 0x3fffe0, 22, 178 }, /* 178 */
+    { 0x3fffe1, 22, 181 }, /* 181 */
+    { 0x3fffe2, 22, 185 }, /* 185 */
+    { 0x3fffe3, 22, 186 }, /* 186 */
+    { 0x3fffe4, 22, 187 }, /* 187 */
+    { 0x3fffe5, 22, 189 }, /* 189 */
+    { 0x3fffe6, 22, 190 }, /* 190 */
+    { 0x3fffe7, 22, 196 }, /* 196 */
+    { 0x3fffe8, 22, 198 }, /* 198 */
+    { 0x3fffe9, 22, 228 }, /* 228 */
+    { 0x3fffea, 22, 232 }, /* 232 */
+    { 0x3fffeb, 22, 233 }, /* 233 */
+    { 0x7fffd8, 23, 1 }, /* 1 */
+    { 0x7fffd9, 23, 135 }, /* 135 */
+    { 0x7fffda, 23, 137 }, /* 137 */
+    { 0x7fffdb, 23, 138 }, /* 138 */
+    { 0x7fffdc, 23, 139 }, /* 139 */
+    { 0x7fffdd, 23, 140 }, /* 140 */
+    { 0x7fffde, 23, 141 }, /* 141 */
+    { 0x7fffdf, 23, 143 }, /* 143 */
+    { 0x7fffe0, 23, 147 }, /* 147 */
+    { 0x7fffe1, 23, 149 }, /* 149 */
+    { 0x7fffe2, 23, 150 }, /* 150 */
+    { 0x7fffe3, 23, 151 }, /* 151 */
+    { 0x7fffe4, 23, 152 }, /* 152 */
+    { 0x7fffe5, 23, 155 }, /* 155 */
+    { 0x7fffe6, 23, 157 }, /* 157 */
+    { 0x7fffe7, 23, 158 }, /* 158 */
+    { 0x7fffe8, 23, 165 }, /* 165 */
+    { 0x7fffe9, 23, 166 }, /* 166 */
+    { 0x7fffea, 23, 168 }, /* 168 */
+    { 0x7fffeb, 23, 174 }, /* 174 */
+    { 0x7fffec, 23, 175 }, /* 175 */
+    { 0x7fffed, 23, 180 }, /* 180 */
+    { 0x7fffee, 23, 182 }, /* 182 */
+    { 0x7fffef, 23, 183 }, /* 183 */
+    { 0x7ffff0, 23, 188 }, /* 188 */
+    { 0x7ffff1, 23, 191 }, /* 191 */
+    { 0x7ffff2, 23, 197 }, /* 197 */
+    { 0x7ffff3, 23, 231 }, /* 231 */
+    { 0x7ffff4, 23, 239 }, /* 239 */
+    { 0xffffea, 24, 9 }, /* 9 */
+    { 0xffffeb, 24, 142 }, /* 142 */
+    { 0xffffec, 24, 144 }, /* 144 */
+    { 0xffffed, 24, 145 }, /* 145 */
+    { 0xffffee, 24, 148 }, /* 148 */
+    { 0xffffef, 24, 159 }, /* 159 */
+    { 0xfffff0, 24, 171 }, /* 171 */
+    { 0xfffff1, 24, 206 }, /* 206 */
+    { 0xfffff2, 24, 215 }, /* 215 */
+    { 0xfffff3, 24, 225 }, /* 225 */
+    { 0xfffff4, 24, 236 }, /* 236 */
+    { 0xfffff5, 24, 237 }, /* 237 */
+    { 0x1ffffec, 25, 199 }, /* 199 */
+    { 0x1ffffed, 25, 207 }, /* 207 */
+    { 0x1ffffee, 25, 234 }, /* 234 */
+    { 0x1ffffef, 25, 235 }, /* 235 */
+    { 0x3ffffe0, 26, 192 }, /* 192 */
+    { 0x3ffffe1, 26, 193 }, /* 193 */
+    { 0x3ffffe2, 26, 200 }, /* 200 */
+    { 0x3ffffe3, 26, 201 }, /* 201 */
+    { 0x3ffffe4, 26, 202 }, /* 202 */
+    { 0x3ffffe5, 26, 205 }, /* 205 */
+    { 0x3ffffe6, 26, 210 }, /* 210 */
+    { 0x3ffffe7, 26, 213 }, /* 213 */
+    { 0x3ffffe8, 26, 218 }, /* 218 */
+    { 0x3ffffe9, 26, 219 }, /* 219 */
+    { 0x3ffffea, 26, 238 }, /* 238 */
+    { 0x3ffffeb, 26, 240 }, /* 240 */
+    { 0x3ffffec, 26, 242 }, /* 242 */
+    { 0x3ffffed, 26, 243 }, /* 243 */
+    { 0x3ffffee, 26, 255 }, /* 255 */
+    { 0x7ffffde, 27, 203 }, /* 203 */
+    { 0x7ffffdf, 27, 204 }, /* 204 */
+    { 0x7ffffe0, 27, 211 }, /* 211 */
+    { 0x7ffffe1, 27, 212 }, /* 212 */
+    { 0x7ffffe2, 27, 214 }, /* 214 */
+    { 0x7ffffe3, 27, 221 }, /* 221 */
+    { 0x7ffffe4, 27, 222 }, /* 222 */
+    { 0x7ffffe5, 27, 223 }, /* 223 */
+    { 0x7ffffe6, 27, 241 }, /* 241 */
+    { 0x7ffffe7, 27, 244 }, /* 244 */
+    { 0x7ffffe8, 27, 245 }, /* 245 */
+    { 0x7ffffe9, 27, 246 }, /* 246 */
+    { 0x7ffffea, 27, 247 }, /* 247 */
+    { 0x7ffffeb, 27, 248 }, /* 248 */
+    { 0x7ffffec, 27, 250 }, /* 250 */
+    { 0x7ffffed, 27, 251 }, /* 251 */
+    { 0x7ffffee, 27, 252 }, /* 252 */
+    { 0x7ffffef, 27, 253 }, /* 253 */
+    { 0x7fffff0, 27, 254 }, /* 254 */
+    { 0xfffffe2, 28, 2 }, /* 2 */
+    { 0xfffffe3, 28, 3 }, /* 3 */
+    { 0xfffffe4, 28, 4 }, /* 4 */
+    { 0xfffffe5, 28, 5 }, /* 5 */
+    { 0xfffffe6, 28, 6 }, /* 6 */
+    { 0xfffffe7, 28, 7 }, /* 7 */
+    { 0xfffffe8, 28, 8 }, /* 8 */
+    { 0xfffffe9, 28, 11 }, /* 11 */
+    { 0xfffffea, 28, 12 }, /* 12 */
+    { 0xfffffeb, 28, 14 }, /* 14 */
+    { 0xfffffec, 28, 15 }, /* 15 */
+    { 0xfffffed, 28, 16 }, /* 16 */
+    { 0xfffffee, 28, 17 }, /* 17 */
+    { 0xfffffef, 28, 18 }, /* 18 */
+    { 0xffffff0, 28, 19 }, /* 19 */
+    { 0xffffff1, 28, 20 }, /* 20 */
+    { 0xffffff2, 28, 21 }, /* 21 */
+    { 0xffffff3, 28, 23 }, /* 23 */
+    { 0xffffff4, 28, 24 }, /* 24 */
+    { 0xffffff5, 28, 25 }, /* 25 */
+    { 0xffffff6, 28, 26 }, /* 26 */
+    { 0xffffff7, 28, 27 }, /* 27 */
+    { 0xffffff8, 28, 28 }, /* 28 */
+    { 0xffffff9, 28, 29 }, /* 29 */
+    { 0xffffffa, 28, 30 }, /* 30 */
+    { 0xffffffb, 28, 31 }, /* 31 */
+    { 0xffffffc, 28, 127 }, /* 127 */
+    { 0xffffffd, 28, 220 }, /* 220 */
+    { 0xffffffe, 28, 249 }, /* 249 */
+    { 0x3ffffffc, 30, 10 }, /* 10 */
+    { 0x3ffffffd, 30, 13 }, /* 13 */
+    { 0x3ffffffe, 30, 22 }, /* 22 */
+    { 0x3fffffff, 30, 256 }, /* EOS */
+};
+
+/* Where the codes of every length start in gxHuffmanTable, indexed by the length */
+static const HpackHuffmanLength_t gxHuffmanLengths[HPACK_HUFFMAN_MAX_CODE_LEN + 1] =
+{
+    { 0x0, 0, 0 }, /* 0 bits */
+    { 0x0, 0, 0 }, /* 1 bits */
+    { 0x0, 0, 0 }, /* 2 bits */
+    { 0x0, 0, 0 }, /* 3 bits */
+    { 0x0, 0, 0 }, /* 4 bits */
+    { 0x0, 0, 10 }, /* 5 bits */
+    { 0x14, 10, 26 }, /* 6 bits */
+    { 0x5c, 36, 32 }, /* 7 bits */
+    { 0xf8, 68, 6 }, /* 8 bits */
+    { 0x0, 0, 0 }, /* 9 bits */
+    { 0x3f8, 74, 5 }, /* 10 bits */
+    { 0x7fa, 79, 3 }, /* 11 bits */
+    { 0xffa, 82, 2 }, /* 12 bits */
+    { 0x1ff8, 84, 6 }, /* 13 bits */
+    { 0x3ffc, 90, 2 }, /* 14 bits */
+    { 0x7ffc, 92, 3 }, /* 15 bits */
+    { 0x0, 0, 0 }, /* 16 bits */
+    { 0x0, 0, 0 }, /* 17 bits */
+    { 0x0, 0, 0 }, /* 18 bits */
+    { 0x7fff0, 95, 3 }, /* 19 bits */
+    { 0xfffe6, 98, 8 }, /* 20 bits */
+    { 0x1fffdc, 106, 13 }, /* 21 bits */
+    { 0x3fffd2, 119, 26 }, /* 22 bits */
+    { 0x7fffd8, 145, 29 }, /* 23 bits */
+    { 0xffffea, 174, 12 }, /* 24 bits */
+    { 0x1ffffec, 186, 4 }, /* 25 bits */
+    { 0x3ffffe0, 190, 15 }, /* 26 bits */
+    { 0x7ffffde, 205, 19 }, /* 27 bits */
+    { 0xfffffe2, 224, 29 }, /* 28 bits */
+    { 0x0, 0, 0 }, /* 29 bits */
+    { 0x3ffffffc, 253, 4 }, /* 30 bits */
+};
+
+static int prvDecodeInteger(const uint8_t **ppCur, const uint8_t *pEnd, uint8_t uPrefixBits, size_t *puValue)
+{
+    int res = HPACK_ERRNO_NONE;
+    const uint8_t *p = *ppCur;
+    size_t uMax = (1 << uPrefixBits) - 1;
+    size_t uValue = 0;
+    unsigned int uShift = 0;
+
+    if (p >= pEnd)
+    {
+        res = HPACK_ERRNO_COMPRESSION_ERROR;
+    }
+    else if ((uValue = (*p++ & uMax)) == uMax)
+    {
+        do
+        {
+            if (p >= pEnd || uShift > 28)
+            {
+                res = HPACK_ERRNO_COMPRESSION_ERROR;
+                break;
+            }
+            uValue += (size_t)(*p & 0x7F) << uShift;
+            uShift += 7;
+        } while ((*p++ & 0x80) != 0);
+    }
+
+    if (res == HPACK_ERRNO_NONE)
+    {
+        *ppCur = p;
+        *puValue = uValue;
+    }
+
+    return res;
+}
+
+static int prvHuffmanDecode(const uint8_t *pSrc, size_t uSrcLen, char *pDst, size_t *puDstLen)
+{
+    int res = HPACK_ERRNO_NONE;
+    uint32_t uCode = 0;
+    uint8_t uCodeLen = 0;
+    size_t uDstLen = 0;
+    size_t i = 0;
+    uint32_t uOffset = 0;
+    const HpackHuffmanCode_t *pxCode = NULL;
+    int iBit = 0;
+
+    for (i = 0; i < uSrcLen && res == HPACK_ERRNO_NONE; i++)
+    {
+        for (iBit = 7; iBit >= 0 && res == HPACK_ERRNO_NONE; iBit--)
+        {
+            uCode = (uCode << 1) | ((pSrc[i] >> iBit) & 0x1);
+            uCodeLen++;
+
+            /* A code below the first one of its length wraps around, so it's past the count too. */
+            uOffset = uCode - gxHuffmanLengths[uCodeLen].uFirstCode;
+            if (uOffset < gxHuffmanLengths[uCodeLen].uCount)
+            {
+                pxCode = &(gxHuffmanTable[gxHuffmanLengths[uCodeLen].uFirstIndex + uOffset]);
+                if (pxCode->uSymbol == HPACK_HUFFMAN_EOS)
+                {
+                    /* EOS in a string is an error (RFC 7541 section 5.2) */
+                    res = HPACK_ERRNO_COMPRESSION_ERROR;
+                }
+                else
+                {
+                    pDst[uDstLen++] = (char)pxCode->uSymbol;
+                    uCode = 0;
+                    uCodeLen = 0;
+                }
+            }
+            else if (uCodeLen >= HPACK_HUFFMAN_MAX_CODE_LEN)
+            {
+                res = HPACK_ERRNO_COMPRESSION_ERROR;
+            }
+        }
+    }
+
+    /* The padding is the most significant bits of EOS, which are all 1, and it's shorter than 8 bits. */
+    if (res == HPACK_ERRNO_NONE && (uCodeLen > 7 || uCode != ((1u << uCodeLen) - 1)))
+    {
+        res = HPACK_ERRNO_COMPRESSION_ERROR;
+    }
+
+    if (res == HPACK_ERRNO_NONE)
+    {
+        *puDstLen = uDstLen;
+    }
+
+    return res;
+}
+
+static int prvDecodeString(const uint8_t **ppCur, const uint8_t *pEnd, char **ppScratch, const char **ppStr, size_t *puStrLen)
+{
+    int res = HPACK_ERRNO_NONE;
+    const uint8_t *p = *ppCur;
+    bool bHuffman = false;
+    size_t uLen = 0;
+
+    if (p < pEnd)
+    {
+        bHuffman = (*p & 0x80) != 0;
+    }
+
+    if ((res = prvDecodeInteger(&p, pEnd, 7, &uLen)) != HPACK_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if (uLen > (size_t)(pEnd - p))
+    {
+        res = HPACK_ERRNO_COMPRESSION_ERROR;
+    }
+    else if (!bHuffman)
+    {
+        /* Literal strings are referenced in place */
+        *ppStr = (const char *)p;
+        *puStrLen = uLen;
+        *ppCur = p + uLen;
+    }
+    else if ((res = prvHuffmanDecode(p, uLen, *ppScratch, puStrLen)) != HPACK_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else
+    {
+        *ppStr = *ppScratch;
+        *ppScratch += *puStrLen;
+        *ppCur = p + uLen;
+    }
+
+    return res;
+}
+
+static void prvEvict(HpackDecoder_t *pxDecoder, size_t uMaxTableSize)
+{
+    HpackDynamicEntry_t *pxEntry = NULL;
+
+    while (pxDecoder->uTableSize > uMaxTableSize && pxDecoder->uEntryCount > 0)
+    {
+        pxEntry = &(pxDecoder->pxEntries[pxDecoder->uEntryCount - 1]);
+        pxDecoder->uTableSize -= pxEntry->uNameLen + pxEntry->uValueLen + HPACK_ENTRY_OVERHEAD;
+        Allocator_free(pxEntry->pName);
+        pxDecoder->uEntryCount--;
+    }
+}
+
+static int prvAddEntry(HpackDecoder_t *pxDecoder, const char *pName, size_t uNameLen, const char *pValue, size_t uValueLen)
+{
+    int res = HPACK_ERRNO_NONE;
+    size_t uEntrySize = uNameLen + uValueLen + HPACK_ENTRY_OVERHEAD;
+    HpackDynamicEntry_t *pxEntries = NULL;
+    size_t uCapacity = 0;
+    char *pEntryName = NULL;
+
+    if (uEntrySize > pxDecoder->uMaxTableSize)
+    {
+        /* An entry larger than the table empties the table, and is not added (RFC 7541 section 4.4). */
+        prvEvict(pxDecoder, 0);
+    }
+    else if ((pEntryName = (char *)Allocator_malloc(uNameLen + uValueLen + 1)) == NULL)
+    {
+        res = HPACK_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        /* The name and the value may refer to an entry which is about to be evicted, so they are copied first. */
+        memcpy(pEntryName, pName, uNameLen);
+        memcpy(pEntryName + uNameLen, pValue, uValueLen);
+        prvEvict(pxDecoder, pxDecoder->uMaxTableSize - uEntrySize);
+
+        if (pxDecoder->uEntryCount == pxDecoder->uEntryCapacity)
+        {
+            uCapacity = (pxDecoder->uEntryCapacity == 0) ? 16 : pxDecoder->uEntryCapacity * 2;
+            if ((pxEntries = (HpackDynamicEntry_t *)Allocator_realloc(pxDecoder->pxEntries, uCapacity * sizeof(HpackDynamicEntry_t))) == NULL)
+            {
+                res = HPACK_ERRNO_OUT_OF_MEMORY;
+            }
+            else
+            {
+                pxDecoder->pxEntries = pxEntries;
+                pxDecoder->uEntryCapacity = uCapacity;
+            }
+        }
+
+        if (res == HPACK_ERRNO_NONE)
+        {
+            memmove(&(pxDecoder->pxEntries[1]), &(pxDecoder->pxEntries[0]), pxDecoder->uEntryCount * sizeof(HpackDynamicEntry_t));
+            pxDecoder->pxEntries[0].pName = pEntryName;
+            pxDecoder->pxEntries[0].uNameLen = uNameLen;
+            pxDecoder->pxEntries[0].uValueLen = uValueLen;
+            pxDecoder->uEntryCount++;
+            pxDecoder->uTableSize += uEntrySize;
+            pEntryName = NULL;
+        }
+    }
+
+    if (pEntryName != NULL)
+    {
+        Allocator_free(pEntryName);
+    }
+
+    return res;
+}
+
+static int prvGetEntry(HpackDecoder_t *pxDecoder, size_t uIndex, const char **ppName, size_t *puNameLen, const char **ppValue, size_t *puValueLen)
+{
+    int res = HPACK_ERRNO_NONE;
+    HpackDynamicEntry_t *pxEntry = NULL;
+
+    if (uIndex == 0)
+    {
+        res = HPACK_ERRNO_COMPRESSION_ERROR;
+    }
+    else if (uIndex <= HPACK_STATIC_TABLE_COUNT)
+    {
+        *ppName = gxStaticTable[uIndex - 1].pName;
+        *puNameLen = strlen(*ppName);
+        *ppValue = gxStaticTable[uIndex - 1].pValue;
+        *puValueLen = strlen(*ppValue);
+    }
+    else if (uIndex - HPACK_STATIC_TABLE_COUNT <= pxDecoder->uEntryCount)
+    {
+        pxEntry = &(pxDecoder->pxEntries[uIndex - HPACK_STATIC_TABLE_COUNT - 1]);
+        *ppName = pxEntry->pName;
+        *puNameLen = pxEntry->uNameLen;
+        *ppValue = pxEntry->pName + pxEntry->uNameLen;
+        *puValueLen = pxEntry->uValueLen;
+    }
+    else
+    {
+        res = HPACK_ERRNO_COMPRESSION_ERROR;
+    }
+
+    return res;
+}
+
+HpackDecoderHandle Hpack_createDecoder(size_t uMaxTableSize)
+{
+    HpackDecoder_t *pxDecoder = NULL;
+
+    if ((pxDecoder = (HpackDecoder_t *)Allocator_malloc(sizeof(HpackDecoder_t))) != NULL)
+    {
+        memset(pxDecoder, 0, sizeof(HpackDecoder_t));
+        pxDecoder->uMaxTableSize = uMaxTableSize;
+        pxDecoder->uProtocolMaxTableSize = uMaxTableSize;
+    }
+
+    return pxDecoder;
+}
+
+void Hpack_terminateDecoder(HpackDecoderHandle xDecoder)
+{
+    HpackDecoder_t *pxDecoder = (HpackDecoder_t *)xDecoder;
+
+    if (pxDecoder != NULL)
+    {
+        prvEvict(pxDecoder, 0);
+        if (pxDecoder->pxEntries != NULL)
+        {
+            Allocator_free(pxDecoder->pxEntries);
+        }
+        Allocator_free(pxDecoder);
+    }
+}
+
+int Hpack_decode(HpackDecoderHandle xDecoder, const uint8_t *pBlock, size_t uLen, HpackHeaderCb_t onHeader, void *pUserData)
+{
+    int res = HPACK_ERRNO_NONE;
+    HpackDecoder_t *pxDecoder = (HpackDecoder_t *)xDecoder;
+    const uint8_t *p = pBlock;
+    const uint8_t *pEnd = pBlock + uLen;
+    char *pScratch = NULL;
+    char *pScratchCur = NULL;
+    size_t uIndex = 0;
+    const char *pName = NULL;
+    size_t uNameLen = 0;
+    const char *pValue = NULL;
+    size_t uValueLen = 0;
+    const char *pUnused = NULL;
+    size_t uUnusedLen = 0;
+    bool bIndexing = false;
+
+    if (pxDecoder == NULL || (pBlock == NULL && uLen > 0) || onHeader == NULL)
+    {
+        res = HPACK_ERRNO_INVALID_PARAMETER;
+    }
+    /* Huffman codes are at least 5 bits, so decoded strings of a field never exceed 8/5 of the block. */
+    else if ((pScratch = (char *)Allocator_malloc(uLen * 8 / 5 + 1)) == NULL)
+    {
+        res = HPACK_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        while (p < pEnd && res == HPACK_ERRNO_NONE)
+        {
+            pScratchCur = pScratch;
+            bIndexing = false;
+
+            if ((*p & 0x80) != 0)
+            {
+                /* Indexed header field */
+                if ((res = prvDecodeInteger(&p, pEnd, 7, &uIndex)) == HPACK_ERRNO_NONE &&
+                    (res = prvGetEntry(pxDecoder, uIndex, &pName, &uNameLen, &pValue, &uValueLen)) == HPACK_ERRNO_NONE &&
+                    onHeader(pName, uNameLen, pValue, uValueLen, pUserData) != 0)
+                {
+                    res = HPACK_ERRNO_ABORTED;
+                }
+                continue;
+            }
+            else if ((*p & 0xE0) == 0x20)
+            {
+                /* Dynamic table size update */
+                if ((res = prvDecodeInteger(&p, pEnd, 5, &uIndex)) != HPACK_ERRNO_NONE)
+                {
+                    /* Propagate the error code */
+                }
+                else if (uIndex > pxDecoder->uProtocolMaxTableSize)
+                {
+                    res = HPACK_ERRNO_COMPRESSION_ERROR;
+                }
+                else
+                {
+                    pxDecoder->uMaxTableSize = uIndex;
+                    prvEvict(pxDecoder, uIndex);
+                }
+                continue;
+            }
+            else if ((*p & 0xC0) == 0x40)
+            {
+                /* Literal header field with incremental indexing */
+                bIndexing = true;
+                res = prvDecodeInteger(&p, pEnd, 6, &uIndex);
+            }
+            else
+            {
+                /* Literal header field without indexing, or never indexed */
+                res = prvDecodeInteger(&p, pEnd, 4, &uIndex);
+            }
+
+            if (res != HPACK_ERRNO_NONE)
+            {
+                /* Propagate the error code */
+            }
+            else if (uIndex > 0 && (res = prvGetEntry(pxDecoder, uIndex, &pName, &uNameLen, &pUnused, &uUnusedLen)) != HPACK_ERRNO_NONE)
+            {
+                /* Propagate the error code */
+            }
+            else if (uIndex == 0 && (res = prvDecodeString(&p, pEnd, &pScratchCur, &pName, &uNameLen)) != HPACK_ERRNO_NONE)
+            {
+                /* Propagate the error code */
+            }
+            else if ((res = prvDecodeString(&p, pEnd, &pScratchCur, &pValue, &uValueLen)) != HPACK_ERRNO_NONE)
+            {
+                /* Propagate the error code */
+            }
+            else if (onHeader(pName, uNameLen, pValue, uValueLen, pUserData) != 0)
+            {
+                res = HPACK_ERRNO_ABORTED;
+            }
+            else if (bIndexing)
+            {
+                res = prvAddEntry(pxDecoder, pName, uNameLen, pValue, uValueLen);
+            }
+        }
+    }
+
+    if (pScratch != NULL)
+    {
+        Allocator_free(pScratch);
+    }
+
+    return res;
+}
+
+static int prvEncodeInteger(uint8_t *pBuf, size_t uBufSize, size_t *puLen, uint8_t uFirstByte, uint8_t uPrefixBits, size_t uValue)
+{
+    int res = HPACK_ERRNO_NONE;
+    size_t uMax = (1 << uPrefixBits) - 1;
+    size_t uLen = *puLen;
+
+    if (uLen >= uBufSize)
+    {
+        res = HPACK_ERRNO_BUFFER_TOO_SMALL;
+    }
+    else if (uValue < uMax)
+    {
+        pBuf[uLen++] = uFirstByte | (uint8_t)uValue;
+    }
+    else
+    {
+        pBuf[uLen++] = uFirstByte | (uint8_t)uMax;
+        uValue -= uMax;
+        while (res == HPACK_ERRNO_NONE)
+        {
+            if (uLen >= uBufSize)
+            {
+                res = HPACK_ERRNO_BUFFER_TOO_SMALL;
+            }
+            else if (uValue >= 0x80)
+            {
+                pBuf[uLen++] = (uint8_t)(0x80 | (uValue & 0x7F));
+                uValue >>= 7;
+            }
+            else
+            {
+                pBuf[uLen++] = (uint8_t)uValue;
+                break;
+            }
+        }
+    }
+
+    if (res == HPACK_ERRNO_NONE)
+    {
+        *puLen = uLen;
+    }
+
+    return res;
+}
+
+static int prvEncodeString(uint8_t *pBuf, size_t uBufSize, size_t *puLen, const char *pStr, size_t uStrLen)
+{
+    int res = HPACK_ERRNO_NONE;
+
+    if ((res = prvEncodeInteger(pBuf, uBufSize, puLen, 0x00, 7, uStrLen)) != HPACK_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if (uBufSize - *puLen < uStrLen)
+    {
+        res = HPACK_ERRNO_BUFFER_TOO_SMALL;
+    }
+    else
+    {
+        memcpy(pBuf + *puLen, pStr, uStrLen);
+        *puLen += uStrLen;
+    }
+
+    return res;
+}
+
+int Hpack_encodeIndexed(uint8_t *pBuf, size_t uBufSize, size_t *puLen, size_t uIndex)
+{
+    int res = HPACK_ERRNO_NONE;
+
+    if (pBuf == NULL || puLen == NULL || uIndex == 0 || uIndex > HPACK_STATIC_TABLE_COUNT)
+    {
+        res = HPACK_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        res = prvEncodeInteger(pBuf, uBufSize, puLen, 0x80, 7, uIndex);
+    }
+
+    return res;
+}
+
+int Hpack_encodeLiteral(uint8_t *pBuf, size_t uBufSize, size_t *puLen, size_t uNameIndex, const char *pName, const char *pValue, size_t uValueLen)
+{
+    int res = HPACK_ERRNO_NONE;
+    size_t uLen = 0;
+
+    if (pBuf == NULL || puLen == NULL || uNameIndex > HPACK_STATIC_TABLE_COUNT || (uNameIndex == 0 && pName == NULL) || (pValue == NULL && uValueLen > 0))
+    {
+        res = HPACK_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* The request headers differ on every request (date and signature), so indexing them would only cost the server memory. */
+        uLen = *puLen;
+        if ((res = prvEncodeInteger(pBuf, uBufSize, &uLen, 0x00, 4, uNameIndex)) != HPACK_ERRNO_NONE)
+        {
+            /* Propagate the error code */
+        }
+        else if (uNameIndex == 0 && (res = prvEncodeString(pBuf, uBufSize, &uLen, pName, strlen(pName))) != HPACK_ERRNO_NONE)
+        {
+            /* Propagate the error code */
+        }
+        else if ((res = prvEncodeString(pBuf, uBufSize, &uLen, pValue, uValueLen)) != HPACK_ERRNO_NONE)
+        {
+            /* Propagate the error code */
+        }
+        else
+        {
+            *puLen = uLen;
+        }
+    }
+
+    return res;
+}
@@ -0,0 +1,87 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HPACK_ERRNO_NONE                    (0)
+#define HPACK_ERRNO_INVALID_PARAMETER       (-1)
+#define HPACK_ERRNO_OUT_OF_MEMORY           (-2)
+#define HPACK_ERRNO_BUFFER_TOO_SMALL        (-3)
+#define HPACK_ERRNO_COMPRESSION_ERROR       (-4)
+#define HPACK_ERRNO_ABORTED                 (-5)
+
+/* The default maximum size of the dynamic table defined by HTTP/2 */
+#define HPACK_DEFAULT_TABLE_SIZE            (4096)
+
+/* Indexes of the static table (RFC 7541 Appendix A) used by the encoder */
+#define HPACK_STATIC_AUTHORITY              (1)
+#define HPACK_STATIC_METHOD_POST            (3)
+#define HPACK_STATIC_PATH                   (4)
+#define HPACK_STATIC_SCHEME_HTTPS           (7)
+#define HPACK_STATIC_AUTHORIZATION          (23)
+#define HPACK_STATIC_CONTENT_LENGTH         (28)
+#define HPACK_STATIC_CONTENT_TYPE           (31)
+
+/**
+ * @brief Callback of a decoded header field. Strings are not NUL-terminated, and only valid during the call.
+ *
+ * @return 0 to continue, non-zero value to abort the decoding
+ */
+typedef int (*HpackHeaderCb_t)(const char *pName, size_t uNameLen, const char *pValue, size_t uValueLen, void *pUserData);
+
+typedef struct HpackDecoder *HpackDecoderHandle;
+
+/**
+ * @brief Create a HPACK decoder. It keeps the dynamic table across header blocks of a connection.
+ *
+ * @param[in] uMaxTableSize The maximum size of the dynamic table
+ * @return The decoder handle
+ */
+HpackDecoderHandle Hpack_createDecoder(size_t uMaxTableSize);
+
+/**
+ * @brief Terminate a HPACK decoder
+ *
+ * @param[in] xDecoder The decoder handle
+ */
+void Hpack_terminateDecoder(HpackDecoderHandle xDecoder);
+
+/**
+ * @brief Decode a complete header block
+ *
+ * @param[in] xDecoder The decoder handle
+ * @param[in] pBlock The header block
+ * @param[in] uLen The length of the header block
+ * @param[in] onHeader The callback of decoded header fields
+ * @param[in] pUserData The user data of the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int Hpack_decode(HpackDecoderHandle xDecoder, const uint8_t *pBlock, size_t uLen, HpackHeaderCb_t onHeader, void *pUserData);
+
+/**
+ * @brief Encode a header field which is fully indexed in the static table
+ *
+ * @param[out] pBuf The output buffer
+ * @param[in] uBufSize The size of the output buffer
+ * @param[in,out] puLen The length of data in the buffer. It's advanced by the encoded length.
+ * @param[in] uIndex The index in the static table
+ * @return 0 on success, non-zero value otherwise
+ */
+int Hpack_encodeIndexed(uint8_t *pBuf, size_t uBufSize, size_t *puLen, size_t uIndex);
+
+/**
+ * @brief Encode a header field as a literal without indexing. Strings are not Huffman encoded.
+ *
+ * @param[out] pBuf The output buffer
+ * @param[in] uBufSize The size of the output buffer
+ * @param[in,out] puLen The length of data in the buffer. It's advanced by the encoded length.
+ * @param[in] uNameIndex The index of the name in the static table, or 0 to encode pName as a literal
+ * @param[in] pName The lowercase header name. It's ignored if uNameIndex is not 0.
+ * @param[in] pValue The header value
+ * @param[in] uValueLen The length of the header value
+ * @return 0 on success, non-zero value otherwise
+ */
+int Hpack_encodeLiteral(uint8_t *pBuf, size_t uBufSize, size_t *puLen, size_t uNameIndex, const char *pName, const char *pValue, size_t uValueLen);
+
+#endif /* HPACK_H */
@@ -0,0 +1,926 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "hpack.h"
+#include "http2.h"
+
+#define HTTP2_CONNECTION_PREFACE            "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+#define HTTP2_FRAME_HEADER_LEN              (9)
+
+/* We never advertise a larger SETTINGS_MAX_FRAME_SIZE, so a frame always fits in this size. */
+#define HTTP2_DEFAULT_MAX_FRAME_SIZE        (16384)
+#define HTTP2_MAX_MAX_FRAME_SIZE            (16777215)
+#define HTTP2_DEFAULT_WINDOW_SIZE           (65535)
+#define HTTP2_MAX_WINDOW_SIZE               (0x7FFFFFFF)
+
+/* Large receive windows let the server stream audio without waiting for our WINDOW_UPDATE. */
+#define HTTP2_LOCAL_STREAM_WINDOW_SIZE      (1 << 20)
+#define HTTP2_LOCAL_CONNECTION_WINDOW_SIZE  (1 << 24)
+
+/* The response headers of Polly are small, so a larger header block is treated as an error. */
+#define HTTP2_MAX_HEADER_BLOCK_SIZE         (64 * 1024)
+
+#define HTTP2_FRAME_TYPE_DATA               (0x0)
+#define HTTP2_FRAME_TYPE_HEADERS            (0x1)
+#define HTTP2_FRAME_TYPE_PRIORITY           (0x2)
+#define HTTP2_FRAME_TYPE_RST_STREAM         (0x3)
+#define HTTP2_FRAME_TYPE_SETTINGS           (0x4)
+#define HTTP2_FRAME_TYPE_PUSH_PROMISE       (0x5)
+#define HTTP2_FRAME_TYPE_PING               (0x6)
+#define HTTP2_FRAME_TYPE_GOAWAY             (0x7)
+#define HTTP2_FRAME_TYPE_WINDOW_UPDATE      (0x8)
+#define HTTP2_FRAME_TYPE_CONTINUATION       (0x9)
+
+#define HTTP2_FLAG_ACK                      (0x1)
+#define HTTP2_FLAG_END_STREAM               (0x1)
+#define HTTP2_FLAG_END_HEADERS              (0x4)
+#define HTTP2_FLAG_PADDED                   (0x8)
+#define HTTP2_FLAG_PRIORITY                 (0x20)
+
+#define HTTP2_SETTINGS_ENABLE_PUSH          (0x2)
+#define HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS   (0x3)
+#define HTTP2_SETTINGS_INITIAL_WINDOW_SIZE  (0x4)
+#define HTTP2_SETTINGS_MAX_FRAME_SIZE       (0x5)
+
+#define HTTP2_ERROR_CODE_NO_ERROR           (0x0)
+#define HTTP2_ERROR_CODE_PROTOCOL_ERROR     (0x1)
+#define HTTP2_ERROR_CODE_COMPRESSION_ERROR  (0x9)
+#define HTTP2_ERROR_CODE_REFUSED_STREAM     (0x7)
+
+#define HTTP2_HEADER_STATUS                 ":status"
+#define HTTP2_HEADER_AMZN_ERROR_TYPE        "x-amzn-errortype"
+
+typedef enum
+{
+    HTTP2_STREAM_IDLE = 0,
+    HTTP2_STREAM_OPEN = 1,
+    HTTP2_STREAM_HALF_CLOSED_LOCAL = 2,
+    HTTP2_STREAM_CLOSED = 3,
+} Http2StreamState_t;
+
+typedef struct
+{
+    Http2Request_t *pxReq;
+    uint32_t uStreamId;
+    Http2StreamState_t eState;
+    size_t uBodySent;
+    int64_t iSendWindow;
+    uint32_t uRecvUnacked;
+} Http2Stream_t;
+
+typedef struct Http2
+{
+    NetIoHandle xNetIo;
+    HpackDecoderHandle xDecoder;
+    bool bPrefaceSent;
+
+    uint8_t *pRecvBuf;
+    size_t uRecvLen;
+    uint8_t *pSendBuf;
+
+    /* A header block may be split into a HEADERS frame and CONTINUATION frames. */
+    uint8_t *pHeaderBlock;
+    size_t uHeaderBlockLen;
+    size_t uHeaderBlockSize;
+    uint32_t uHeaderStreamId;
+    bool bHeaderEndStream;
+    bool bInHeaderBlock;
+
+    /* Settings and flow control of the peer */
+    uint32_t uPeerMaxConcurrentStreams;
+    uint32_t uPeerInitialWindowSize;
+    uint32_t uPeerMaxFrameSize;
+    int64_t iConnSendWindow;
+    uint32_t uConnRecvUnacked;
+
+    uint32_t uNextStreamId;
+    bool bGoAway;
+    uint32_t uGoAwayLastStreamId;
+
+    /* Streams of the running Http2_execute() */
+    Http2Stream_t *pxStreams;
+    size_t uStreamCount;
+    size_t uStreamsOpened;
+    size_t uStreamsClosed;
+    uint32_t uFirstStreamId;
+} Http2_t;
+
+static uint32_t prvGetUint32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void prvPutUint32(uint8_t *p, uint32_t uValue)
+{
+    p[0] = (uint8_t)(uValue >> 24);
+    p[1] = (uint8_t)(uValue >> 16);
+    p[2] = (uint8_t)(uValue >> 8);
+    p[3] = (uint8_t)uValue;
+}
+
+static void prvPutFrameHeader(uint8_t *p, size_t uLen, uint8_t uType, uint8_t uFlags, uint32_t uStreamId)
+{
+    p[0] = (uint8_t)(uLen >> 16);
+    p[1] = (uint8_t)(uLen >> 8);
+    p[2] = (uint8_t)uLen;
+    p[3] = uType;
+    p[4] = uFlags;
+    prvPutUint32(p + 5, uStreamId & HTTP2_MAX_WINDOW_SIZE);
+}
+
+static int prvSendFrame(Http2_t *pxHttp2, uint8_t uType, uint8_t uFlags, uint32_t uStreamId, const uint8_t *pPayload, size_t uLen)
+{
+    int res = HTTP2_ERRNO_NONE;
+
+    /* The header and the payload are sent in one TLS record. */
+    prvPutFrameHeader(pxHttp2->pSendBuf, uLen, uType, uFlags, uStreamId);
+    if (uLen > 0)
+    {
+        memcpy(pxHttp2->pSendBuf + HTTP2_FRAME_HEADER_LEN, pPayload, uLen);
+    }
+
+    if (NetIo_send(pxHttp2->xNetIo, pxHttp2->pSendBuf, HTTP2_FRAME_HEADER_LEN + uLen) != NETIO_ERRNO_NONE)
+    {
+        res = HTTP2_ERRNO_SEND_FAILED;
+    }
+
+    return res;
+}
+
+static int prvSendWindowUpdate(Http2_t *pxHttp2, uint32_t uStreamId, uint32_t uIncrement)
+{
+    uint8_t pPayload[4];
+
+    prvPutUint32(pPayload, uIncrement);
+    return prvSendFrame(pxHttp2, HTTP2_FRAME_TYPE_WINDOW_UPDATE, 0, uStreamId, pPayload, sizeof(pPayload));
+}
+
+static int prvSendRstStream(Http2_t *pxHttp2, uint32_t uStreamId, uint32_t uErrorCode)
+{
+    uint8_t pPayload[4];
+
+    prvPutUint32(pPayload, uErrorCode);
+    return prvSendFrame(pxHttp2, HTTP2_FRAME_TYPE_RST_STREAM, 0, uStreamId, pPayload, sizeof(pPayload));
+}
+
+static void prvSendGoAway(Http2_t *pxHttp2, uint32_t uErrorCode)
+{
+    uint8_t pPayload[8];
+
+    /* We never accept streams from the server, so the last stream ID is 0. It's sent on a failing connection, so the result is ignored. */
+    prvPutUint32(pPayload, 0);
+    prvPutUint32(pPayload + 4, uErrorCode);
+    prvSendFrame(pxHttp2, HTTP2_FRAME_TYPE_GOAWAY, 0, 0, pPayload, sizeof(pPayload));
+}
+
+static int prvSendPreface(Http2_t *pxHttp2)
+{
+    int res = HTTP2_ERRNO_NONE;
+    uint8_t *p = pxHttp2->pSendBuf;
+
+    /* The preface, our SETTINGS and the enlarged connection window are sent together. */
+    memcpy(p, HTTP2_CONNECTION_PREFACE, sizeof(HTTP2_CONNECTION_PREFACE) - 1);
+    p += sizeof(HTTP2_CONNECTION_PREFACE) - 1;
+
+    prvPutFrameHeader(p, 12, HTTP2_FRAME_TYPE_SETTINGS, 0, 0);
+    p += HTTP2_FRAME_HEADER_LEN;
+    p[0] = 0;
+    p[1] = HTTP2_SETTINGS_ENABLE_PUSH;
+    prvPutUint32(p + 2, 0);
+    p[6] = 0;
+    p[7] = HTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    prvPutUint32(p + 8, HTTP2_LOCAL_STREAM_WINDOW_SIZE);
+    p += 12;
+
+    prvPutFrameHeader(p, 4, HTTP2_FRAME_TYPE_WINDOW_UPDATE, 0, 0);
+    p += HTTP2_FRAME_HEADER_LEN;
+    prvPutUint32(p, HTTP2_LOCAL_CONNECTION_WINDOW_SIZE - HTTP2_DEFAULT_WINDOW_SIZE);
+    p += 4;
+
+    if (NetIo_send(pxHttp2->xNetIo, pxHttp2->pSendBuf, p - pxHttp2->pSendBuf) != NETIO_ERRNO_NONE)
+    {
+        res = HTTP2_ERRNO_SEND_FAILED;
+    }
+    else
+    {
+        pxHttp2->bPrefaceSent = true;
+    }
+
+    return res;
+}
+
+static size_t prvGetMaxSendFrameSize(Http2_t *pxHttp2)
+{
+    return (pxHttp2->uPeerMaxFrameSize < HTTP2_DEFAULT_MAX_FRAME_SIZE) ? pxHttp2->uPeerMaxFrameSize : HTTP2_DEFAULT_MAX_FRAME_SIZE;
+}
+
+static Http2Stream_t *prvGetStream(Http2_t *pxHttp2, uint32_t uStreamId)
+{
+    Http2Stream_t *pxStream = NULL;
+    size_t uIndex = 0;
+
+    /* Client streams are odd numbers, so the streams of a batch map to consecutive indexes. */
+    if (pxHttp2->pxStreams != NULL && uStreamId >= pxHttp2->uFirstStreamId && (uStreamId - pxHttp2->uFirstStreamId) % 2 == 0)
+    {
+        uIndex = (uStreamId - pxHttp2->uFirstStreamId) / 2;
+        if (uIndex < pxHttp2->uStreamsOpened && pxHttp2->pxStreams[uIndex].eState != HTTP2_STREAM_CLOSED)
+        {
+            pxStream = &(pxHttp2->pxStreams[uIndex]);
+        }
+    }
+
+    return pxStream;
+}
+
+static void prvCloseStream(Http2_t *pxHttp2, Http2Stream_t *pxStream, int res)
+{
+    if (pxStream->eState != HTTP2_STREAM_CLOSED)
+    {
+        pxStream->eState = HTTP2_STREAM_CLOSED;
+        pxStream->pxReq->res = res;
+        pxHttp2->uStreamsClosed++;
+    }
+}
+
+static int prvEndStream(Http2_t *pxHttp2, Http2Stream_t *pxStream)
+{
+    int res = HTTP2_ERRNO_NONE;
+
+    if (pxStream->eState == HTTP2_STREAM_OPEN)
+    {
+        /* The server answered before the whole body is sent, so the rest of the body is not needed. */
+        res = prvSendRstStream(pxHttp2, pxStream->uStreamId, HTTP2_ERROR_CODE_NO_ERROR);
+    }
+    prvCloseStream(pxHttp2, pxStream, HTTP2_ERRNO_NONE);
+
+    return res;
+}
+
+static int prvSendData(Http2_t *pxHttp2, Http2Stream_t *pxStream)
+{
+    int res = HTTP2_ERRNO_NONE;
+    Http2Request_t *pxReq = pxStream->pxReq;
+    size_t uLen = 0;
+    uint8_t uFlags = 0;
+
+    /* Send as much of the body as the flow control windows allow. */
+    while (res == HTTP2_ERRNO_NONE && pxStream->eState == HTTP2_STREAM_OPEN && pxStream->iSendWindow > 0 && pxHttp2->iConnSendWindow > 0)
+    {
+        uLen = pxReq->uBodyLen - pxStream->uBodySent;
+        uLen = (uLen < prvGetMaxSendFrameSize(pxHttp2)) ? uLen : prvGetMaxSendFrameSize(pxHttp2);
+        uLen = ((int64_t)uLen < pxStream->iSendWindow) ? uLen : (size_t)pxStream->iSendWindow;
+        uLen = ((int64_t)uLen < pxHttp2->iConnSendWindow) ? uLen : (size_t)pxHttp2->iConnSendWindow;
+        uFlags = (pxStream->uBodySent + uLen == pxReq->uBodyLen) ? HTTP2_FLAG_END_STREAM : 0;
+
+        if (uLen == 0)
+        {
+            /* The body would never advance */
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else if ((res = prvSendFrame(pxHttp2, HTTP2_FRAME_TYPE_DATA, uFlags, pxStream->uStreamId, pxReq->pBody + pxStream->uBodySent, uLen)) == HTTP2_ERRNO_NONE)
+        {
+            pxStream->uBodySent += uLen;
+            pxStream->iSendWindow -= uLen;
+            pxHttp2->iConnSendWindow -= uLen;
+            if (uFlags & HTTP2_FLAG_END_STREAM)
+            {
+                pxStream->eState = HTTP2_STREAM_HALF_CLOSED_LOCAL;
+            }
+        }
+    }
+
+    return res;
+}
+
+static int prvOpenStream(Http2_t *pxHttp2, Http2Stream_t *pxStream)
+{
+    int res = HTTP2_ERRNO_NONE;
+    Http2Request_t *pxReq = pxStream->pxReq;
+    size_t uMaxFrameSize = prvGetMaxSendFrameSize(pxHttp2);
+    size_t uSent = 0;
+    size_t uLen = 0;
+    uint8_t uType = HTTP2_FRAME_TYPE_HEADERS;
+    uint8_t uFlags = 0;
+
+    pxStream->uStreamId = pxHttp2->uNextStreamId;
+    pxStream->iSendWindow = pxHttp2->uPeerInitialWindowSize;
+    pxStream->eState = HTTP2_STREAM_OPEN;
+    pxHttp2->uNextStreamId += 2;
+    pxHttp2->uStreamsOpened++;
+
+    /* A header block larger than a frame continues in CONTINUATION frames. */
+    do
+    {
+        uLen = pxReq->uHeaderBlockLen - uSent;
+        uLen = (uLen < uMaxFrameSize) ? uLen : uMaxFrameSize;
+        uFlags = (uSent + uLen == pxReq->uHeaderBlockLen) ? HTTP2_FLAG_END_HEADERS : 0;
+        if (uType == HTTP2_FRAME_TYPE_HEADERS && pxReq->uBodyLen == 0)
+        {
+            uFlags |= HTTP2_FLAG_END_STREAM;
+        }
+
+        if (uLen == 0 && uSent < pxReq->uHeaderBlockLen)
+        {
+            /* The header block would never advance */
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else if ((res = prvSendFrame(pxHttp2, uType, uFlags, pxStream->uStreamId, pxReq->pHeaderBlock + uSent, uLen)) == HTTP2_ERRNO_NONE)
+        {
+            uSent += uLen;
+            uType = HTTP2_FRAME_TYPE_CONTINUATION;
+        }
+    } while (res == HTTP2_ERRNO_NONE && uSent < pxReq->uHeaderBlockLen);
+
+    if (res == HTTP2_ERRNO_NONE)
+    {
+        if (pxReq->uBodyLen == 0)
+        {
+            pxStream->eState = HTTP2_STREAM_HALF_CLOSED_LOCAL;
+        }
+        else
+        {
+            res = prvSendData(pxHttp2, pxStream);
+        }
+    }
+
+    return res;
+}
+
+static int prvOnHeader(const char *pName, size_t uNameLen, const char *pValue, size_t uValueLen, void *pUserData)
+{
+    Http2Stream_t *pxStream = (Http2Stream_t *)pUserData;
+    Http2Request_t *pxReq = NULL;
+    unsigned int uStatusCode = 0;
+    size_t i = 0;
+
+    if (pxStream != NULL)
+    {
+        pxReq = pxStream->pxReq;
+
+        if (uNameLen == sizeof(HTTP2_HEADER_STATUS) - 1 && memcmp(pName, HTTP2_HEADER_STATUS, uNameLen) == 0)
+        {
+            for (i = 0; i < uValueLen && pValue[i] >= '0' && pValue[i] <= '9'; i++)
+            {
+                uStatusCode = uStatusCode * 10 + (pValue[i] - '0');
+            }
+            pxReq->uStatusCode = uStatusCode;
+        }
+        else if (uNameLen == sizeof(HTTP2_HEADER_AMZN_ERROR_TYPE) - 1 && memcmp(pName, HTTP2_HEADER_AMZN_ERROR_TYPE, uNameLen) == 0)
+        {
+            /* The value looks like "ThrottlingException:http://internal.amazon.com/coral/", and only the type is kept. */
+            for (i = 0; i < uValueLen && i < HTTP2_ERROR_TYPE_MAX_LEN - 1 && pValue[i] != ':'; i++)
+            {
+                pxReq->pErrorType[i] = pValue[i];
+            }
+            pxReq->pErrorType[i] = '\0';
+        }
+    }
+
+    return 0;
+}
+
+static int prvOnHeaderBlock(Http2_t *pxHttp2)
+{
+    int res = HTTP2_ERRNO_NONE;
+    Http2Stream_t *pxStream = prvGetStream(pxHttp2, pxHttp2->uHeaderStreamId);
+
+    pxHttp2->bInHeaderBlock = false;
+
+    /* The block is decoded even if the stream is gone, because it may update the dynamic table. */
+    if (Hpack_decode(pxHttp2->xDecoder, pxHttp2->pHeaderBlock, pxHttp2->uHeaderBlockLen, prvOnHeader, pxStream) != HPACK_ERRNO_NONE)
+    {
+        res = HTTP2_ERRNO_COMPRESSION_ERROR;
+    }
+    else if (pxStream != NULL)
+    {
+        if (pxStream->pxReq->uStatusCode / 100 == 1)
+        {
+            /* An informational response is followed by the final one. */
+            pxStream->pxReq->uStatusCode = 0;
+        }
+
+        if (pxHttp2->bHeaderEndStream)
+        {
+            res = prvEndStream(pxHttp2, pxStream);
+        }
+    }
+
+    pxHttp2->uHeaderBlockLen = 0;
+
+    return res;
+}
+
+static int prvAppendHeaderBlock(Http2_t *pxHttp2, const uint8_t *pFragment, size_t uLen)
+{
+    int res = HTTP2_ERRNO_NONE;
+    uint8_t *pTemp = NULL;
+    size_t uSize = 0;
+
+    if (pxHttp2->uHeaderBlockLen + uLen > HTTP2_MAX_HEADER_BLOCK_SIZE)
+    {
+        res = HTTP2_ERRNO_PROTOCOL_ERROR;
+    }
+    else
+    {
+        if (pxHttp2->uHeaderBlockLen + uLen > pxHttp2->uHeaderBlockSize)
+        {
+            uSize = (pxHttp2->uHeaderBlockSize == 0) ? HTTP2_DEFAULT_MAX_FRAME_SIZE : pxHttp2->uHeaderBlockSize;
+            while (uSize < pxHttp2->uHeaderBlockLen + uLen)
+            {
+                uSize *= 2;
+            }
+
+            if ((pTemp = (uint8_t *)Allocator_realloc(pxHttp2->pHeaderBlock, uSize)) == NULL)
+            {
+                res = HTTP2_ERRNO_OUT_OF_MEMORY;
+            }
+            else
+            {
+                pxHttp2->pHeaderBlock = pTemp;
+                pxHttp2->uHeaderBlockSize = uSize;
+            }
+        }
+
+        if (res == HTTP2_ERRNO_NONE)
+        {
+            memcpy(pxHttp2->pHeaderBlock + pxHttp2->uHeaderBlockLen, pFragment, uLen);
+            pxHttp2->uHeaderBlockLen += uLen;
+        }
+    }
+
+    return res;
+}
+
+static int prvRemovePadding(uint8_t uFlags, const uint8_t **ppPayload, size_t *puLen)
+{
+    int res = HTTP2_ERRNO_NONE;
+    size_t uPadLen = 0;
+
+    if (uFlags & HTTP2_FLAG_PADDED)
+    {
+        if (*puLen < 1 || (uPadLen = (*ppPayload)[0]) > *puLen - 1)
+        {
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else
+        {
+            *ppPayload += 1;
+            *puLen -= 1 + uPadLen;
+        }
+    }
+
+    return res;
+}
+
+static int prvOnDataFrame(Http2_t *pxHttp2, uint8_t uFlags, uint32_t uStreamId, const uint8_t *pPayload, size_t uLen)
+{
+    int res = HTTP2_ERRNO_NONE;
+    Http2Stream_t *pxStream = prvGetStream(pxHttp2, uStreamId);
+    uint32_t uFrameLen = (uint32_t)uLen;
+
+    /* Flow control counts the whole frame including the padding. */
+    pxHttp2->uConnRecvUnacked += uFrameLen;
+    if (pxHttp2->uConnRecvUnacked >= HTTP2_LOCAL_CONNECTION_WINDOW_SIZE / 2)
+    {
+        res = prvSendWindowUpdate(pxHttp2, 0, pxHttp2->uConnRecvUnacked);
+        pxHttp2->uConnRecvUnacked = 0;
+    }
+
+    if (res != HTTP2_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if ((res = prvRemovePadding(uFlags, &pPayload, &uLen)) != HTTP2_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if (pxStream != NULL)
+    {
+        if (uLen > 0 && pxStream->pxReq->onDataCallback != NULL)
+        {
+            pxStream->pxReq->onDataCallback((uint8_t *)pPayload, uLen, pxStream->pxReq->pUserData);
+        }
+
+        if (uFlags & HTTP2_FLAG_END_STREAM)
+        {
+            res = prvEndStream(pxHttp2, pxStream);
+        }
+        else
+        {
+            pxStream->uRecvUnacked += uFrameLen;
+            if (pxStream->uRecvUnacked >= HTTP2_LOCAL_STREAM_WINDOW_SIZE / 2)
+            {
+                res = prvSendWindowUpdate(pxHttp2, uStreamId, pxStream->uRecvUnacked);
+                pxStream->uRecvUnacked = 0;
+            }
+        }
+    }
+
+    return res;
+}
+
+static int prvOnHeadersFrame(Http2_t *pxHttp2, uint8_t uFlags, uint32_t uStreamId, const uint8_t *pPayload, size_t uLen)
+{
+    int res = HTTP2_ERRNO_NONE;
+
+    if (uStreamId == 0 || (res = prvRemovePadding(uFlags, &pPayload, &uLen)) != HTTP2_ERRNO_NONE)
+    {
+        res = HTTP2_ERRNO_PROTOCOL_ERROR;
+    }
+    else if ((uFlags & HTTP2_FLAG_PRIORITY) && uLen < 5)
+    {
+        res = HTTP2_ERRNO_PROTOCOL_ERROR;
+    }
+    else
+    {
+        if (uFlags & HTTP2_FLAG_PRIORITY)
+        {
+            /* Priority of a response stream is meaningless to a client. */
+            pPayload += 5;
+            uLen -= 5;
+        }
+
+        pxHttp2->uHeaderStreamId = uStreamId;
+        pxHttp2->bHeaderEndStream = (uFlags & HTTP2_FLAG_END_STREAM) != 0;
+        pxHttp2->uHeaderBlockLen = 0;
+
+        if ((res = prvAppendHeaderBlock(pxHttp2, pPayload, uLen)) != HTTP2_ERRNO_NONE)
+        {
+            /* Propagate the error code */
+        }
+        else if (uFlags & HTTP2_FLAG_END_HEADERS)
+        {
+            res = prvOnHeaderBlock(pxHttp2);
+        }
+        else
+        {
+            pxHttp2->bInHeaderBlock = true;
+        }
+    }
+
+    return res;
+}
+
+static int prvOnSettingsFrame(Http2_t *pxHttp2, uint8_t uFlags, const uint8_t *pPayload, size_t uLen)
+{
+    int res = HTTP2_ERRNO_NONE;
+    uint16_t uId = 0;
+    uint32_t uValue = 0;
+    int64_t iDelta = 0;
+    size_t i = 0;
+    size_t k = 0;
+
+    if (uFlags & HTTP2_FLAG_ACK)
+    {
+        /* Our settings are acknowledged */
+    }
+    else if (uLen % 6 != 0)
+    {
+        res = HTTP2_ERRNO_PROTOCOL_ERROR;
+    }
+    else
+    {
+        for (i = 0; i < uLen && res == HTTP2_ERRNO_NONE; i += 6)
+        {
+            uId = (uint16_t)((pPayload[i] << 8) | pPayload[i + 1]);
+            uValue = prvGetUint32(pPayload + i + 2);
+
+            if (uId == HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS)
+            {
+                pxHttp2->uPeerMaxConcurrentStreams = uValue;
+            }
+            else if (uId == HTTP2_SETTINGS_INITIAL_WINDOW_SIZE)
+            {
+                if (uValue > HTTP2_MAX_WINDOW_SIZE)
+                {
+                    res = HTTP2_ERRNO_PROTOCOL_ERROR;
+                }
+                else
+                {
+                    /* The change applies to the windows of open streams as well. */
+                    iDelta = (int64_t)uValue - (int64_t)pxHttp2->uPeerInitialWindowSize;
+                    pxHttp2->uPeerInitialWindowSize = uValue;
+                    for (k = 0; k < pxHttp2->uStreamsOpened; k++)
+                    {
+                        pxHttp2->pxStreams[k].iSendWindow += iDelta;
+                    }
+                }
+            }
+            else if (uId == HTTP2_SETTINGS_MAX_FRAME_SIZE)
+            {
+                /* RFC 9113 6.5.2: the value must be between the initial size and the largest frame the length field holds. */
+                if (uValue < HTTP2_DEFAULT_MAX_FRAME_SIZE || uValue > HTTP2_MAX_MAX_FRAME_SIZE)
+                {
+                    res = HTTP2_ERRNO_PROTOCOL_ERROR;
+                }
+                else
+                {
+                    pxHttp2->uPeerMaxFrameSize = uValue;
+                }
+            }
+        }
+
+        if (res == HTTP2_ERRNO_NONE)
+        {
+            res = prvSendFrame(pxHttp2, HTTP2_FRAME_TYPE_SETTINGS, HTTP2_FLAG_ACK, 0, NULL, 0);
+        }
+    }
+
+    return res;
+}
+
+static int prvOnFrame(Http2_t *pxHttp2, uint8_t uType, uint8_t uFlags, uint32_t uStreamId, const uint8_t *pPayload, size_t uLen)
+{
+    int res = HTTP2_ERRNO_NONE;
+    Http2Stream_t *pxStream = NULL;
+    uint32_t uValue = 0;
+    size_t i = 0;
+
+    if (pxHttp2->bInHeaderBlock && (uType != HTTP2_FRAME_TYPE_CONTINUATION || uStreamId != pxHttp2->uHeaderStreamId))
+    {
+        /* Nothing can interleave a header block. */
+        res = HTTP2_ERRNO_PROTOCOL_ERROR;
+    }
+    else if (uType == HTTP2_FRAME_TYPE_DATA)
+    {
+        res = prvOnDataFrame(pxHttp2, uFlags, uStreamId, pPayload, uLen);
+    }
+    else if (uType == HTTP2_FRAME_TYPE_HEADERS)
+    {
+        res = prvOnHeadersFrame(pxHttp2, uFlags, uStreamId, pPayload, uLen);
+    }
+    else if (uType == HTTP2_FRAME_TYPE_CONTINUATION)
+    {
+        if (!pxHttp2->bInHeaderBlock)
+        {
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else if ((res = prvAppendHeaderBlock(pxHttp2, pPayload, uLen)) == HTTP2_ERRNO_NONE && (uFlags & HTTP2_FLAG_END_HEADERS))
+        {
+            res = prvOnHeaderBlock(pxHttp2);
+        }
+    }
+    else if (uType == HTTP2_FRAME_TYPE_RST_STREAM)
+    {
+        if (uLen != 4)
+        {
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else if ((pxStream = prvGetStream(pxHttp2, uStreamId)) != NULL)
+        {
+            prvCloseStream(pxHttp2, pxStream, (prvGetUint32(pPayload) == HTTP2_ERROR_CODE_REFUSED_STREAM) ? HTTP2_ERRNO_STREAM_REFUSED : HTTP2_ERRNO_STREAM_RESET);
+        }
+    }
+    else if (uType == HTTP2_FRAME_TYPE_SETTINGS)
+    {
+        res = prvOnSettingsFrame(pxHttp2, uFlags, pPayload, uLen);
+    }
+    else if (uType == HTTP2_FRAME_TYPE_PUSH_PROMISE)
+    {
+        /* We have disabled server push. */
+        res = HTTP2_ERRNO_PROTOCOL_ERROR;
+    }
+    else if (uType == HTTP2_FRAME_TYPE_PING)
+    {
+        if (uLen != 8)
+        {
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else if (!(uFlags & HTTP2_FLAG_ACK))
+        {
+            res = prvSendFrame(pxHttp2, HTTP2_FRAME_TYPE_PING, HTTP2_FLAG_ACK, 0, pPayload, uLen);
+        }
+    }
+    else if (uType == HTTP2_FRAME_TYPE_GOAWAY)
+    {
+        if (uLen < 8)
+        {
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else
+        {
+            /* Streams after the last one were not processed, so they can be sent again on another connection. */
+            pxHttp2->bGoAway = true;
+            pxHttp2->uGoAwayLastStreamId = prvGetUint32(pPayload) & HTTP2_MAX_WINDOW_SIZE;
+            for (i = 0; i < pxHttp2->uStreamsOpened; i++)
+            {
+                pxStream = &(pxHttp2->pxStreams[i]);
+                if (pxStream->uStreamId > pxHttp2->uGoAwayLastStreamId)
+                {
+                    prvCloseStream(pxHttp2, pxStream, HTTP2_ERRNO_STREAM_REFUSED);
+                }
+            }
+        }
+    }
+    else if (uType == HTTP2_FRAME_TYPE_WINDOW_UPDATE)
+    {
+        if (uLen != 4)
+        {
+            res = HTTP2_ERRNO_PROTOCOL_ERROR;
+        }
+        else
+        {
+            uValue = prvGetUint32(pPayload) & HTTP2_MAX_WINDOW_SIZE;
+            if (uStreamId == 0)
+            {
+                pxHttp2->iConnSendWindow += uValue;
+            }
+            else if ((pxStream = prvGetStream(pxHttp2, uStreamId)) != NULL)
+            {
+                pxStream->iSendWindow += uValue;
+            }
+        }
+    }
+    else
+    {
+        /* PRIORITY and unknown frames are ignored. */
+    }
+
+    return res;
+}
+
+static int prvRecvFrames(Http2_t *pxHttp2)
+{
+    int res = HTTP2_ERRNO_NONE;
+    size_t uBytesReceived = 0;
+    size_t uFrameLen = 0;
+    uint8_t *p = pxHttp2->pRecvBuf;
+
+    if (NetIo_recv(pxHttp2->xNetIo, pxHttp2->pRecvBuf + pxHttp2->uRecvLen, HTTP2_FRAME_HEADER_LEN + HTTP2_DEFAULT_MAX_FRAME_SIZE - pxHttp2->uRecvLen, &uBytesReceived) != NETIO_ERRNO_NONE ||
+        uBytesReceived == 0)
+    {
+        res = HTTP2_ERRNO_RECV_FAILED;
+    }
+    else
+    {
+        pxHttp2->uRecvLen += uBytesReceived;
+
+        /* One read may carry several frames. A partial frame is kept for the next read. */
+        while (res == HTTP2_ERRNO_NONE && pxHttp2->uRecvLen >= HTTP2_FRAME_HEADER_LEN)
+        {
+            uFrameLen = ((size_t)p[0] << 16) | ((size_t)p[1] << 8) | (size_t)p[2];
+            if (uFrameLen > HTTP2_DEFAULT_MAX_FRAME_SIZE)
+            {
+                res = HTTP2_ERRNO_PROTOCOL_ERROR;
+            }
+            else if (pxHttp2->uRecvLen < HTTP2_FRAME_HEADER_LEN + uFrameLen)
+            {
+                break;
+            }
+            else
+            {
+                res = prvOnFrame(pxHttp2, p[3], p[4], prvGetUint32(p + 5) & HTTP2_MAX_WINDOW_SIZE, p + HTTP2_FRAME_HEADER_LEN, uFrameLen);
+                p += HTTP2_FRAME_HEADER_LEN + uFrameLen;
+                pxHttp2->uRecvLen -= HTTP2_FRAME_HEADER_LEN + uFrameLen;
+            }
+        }
+
+        memmove(pxHttp2->pRecvBuf, p, pxHttp2->uRecvLen);
+    }
+
+    return res;
+}
+
+Http2Handle Http2_create(NetIoHandle xNetIo)
+{
+    Http2_t *pxHttp2 = NULL;
+
+    if (xNetIo != NULL && (pxHttp2 = (Http2_t *)Allocator_malloc(sizeof(Http2_t))) != NULL)
+    {
+        memset(pxHttp2, 0, sizeof(Http2_t));
+        pxHttp2->xNetIo = xNetIo;
+        pxHttp2->uPeerMaxConcurrentStreams = UINT32_MAX;
+        pxHttp2->uPeerInitialWindowSize = HTTP2_DEFAULT_WINDOW_SIZE;
+        pxHttp2->uPeerMaxFrameSize = HTTP2_DEFAULT_MAX_FRAME_SIZE;
+        pxHttp2->iConnSendWindow = HTTP2_DEFAULT_WINDOW_SIZE;
+        pxHttp2->uNextStreamId = 1;
+
+        if ((pxHttp2->xDecoder = Hpack_createDecoder(HPACK_DEFAULT_TABLE_SIZE)) == NULL ||
+            (pxHttp2->pRecvBuf = (uint8_t *)Allocator_malloc(HTTP2_FRAME_HEADER_LEN + HTTP2_DEFAULT_MAX_FRAME_SIZE)) == NULL ||
+            (pxHttp2->pSendBuf = (uint8_t *)Allocator_malloc(HTTP2_FRAME_HEADER_LEN + HTTP2_DEFAULT_MAX_FRAME_SIZE)) == NULL)
+        {
+            Http2_terminate(pxHttp2);
+            pxHttp2 = NULL;
+        }
+    }
+
+    return pxHttp2;
+}
+
+void Http2_terminate(Http2Handle xHttp2)
+{
+    Http2_t *pxHttp2 = (Http2_t *)xHttp2;
+
+    if (pxHttp2 != NULL)
+    {
+        Hpack_terminateDecoder(pxHttp2->xDecoder);
+        if (pxHttp2->pRecvBuf != NULL)
+        {
+            Allocator_free(pxHttp2->pRecvBuf);
+        }
+        if (pxHttp2->pSendBuf != NULL)
+        {
+            Allocator_free(pxHttp2->pSendBuf);
+        }
+        if (pxHttp2->pHeaderBlock != NULL)
+        {
+            Allocator_free(pxHttp2->pHeaderBlock);
+        }
+        Allocator_free(pxHttp2);
+    }
+}
+
+int Http2_execute(Http2Handle xHttp2, Http2Request_t *pxRequests, size_t uCount)
+{
+    int res = HTTP2_ERRNO_NONE;
+    Http2_t *pxHttp2 = (Http2_t *)xHttp2;
+    Http2Stream_t *pxStream = NULL;
+    size_t i = 0;
+
+    if (pxHttp2 == NULL || pxRequests == NULL || uCount == 0)
+    {
+        res = HTTP2_ERRNO_INVALID_PARAMETER;
+    }
+    else if ((pxHttp2->pxStreams = (Http2Stream_t *)Allocator_calloc(uCount, sizeof(Http2Stream_t))) == NULL)
+    {
+        res = HTTP2_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        pxHttp2->uStreamCount = uCount;
+        pxHttp2->uStreamsOpened = 0;
+        pxHttp2->uStreamsClosed = 0;
+        pxHttp2->uFirstStreamId = pxHttp2->uNextStreamId;
+        for (i = 0; i < uCount; i++)
+        {
+            pxRequests[i].res = HTTP2_ERRNO_STREAM_REFUSED;
+            pxRequests[i].uStatusCode = 0;
+            pxRequests[i].pErrorType[0] = '\0';
+            pxHttp2->pxStreams[i].pxReq = &(pxRequests[i]);
+        }
+
+        if (!pxHttp2->bPrefaceSent)
+        {
+            res = prvSendPreface(pxHttp2);
+        }
+
+        while (res == HTTP2_ERRNO_NONE && pxHttp2->uStreamsClosed < uCount)
+        {
+            /* Open more streams as the concurrency limit of the server allows. */
+            while (res == HTTP2_ERRNO_NONE && !pxHttp2->bGoAway && pxHttp2->uStreamsOpened < uCount &&
+                   pxHttp2->uStreamsOpened - pxHttp2->uStreamsClosed < pxHttp2->uPeerMaxConcurrentStreams)
+            {
+                res = prvOpenStream(pxHttp2, &(pxHttp2->pxStreams[pxHttp2->uStreamsOpened]));
+            }
+
+            /* Continue the bodies blocked by flow control */
+            for (i = 0; i < pxHttp2->uStreamsOpened && res == HTTP2_ERRNO_NONE; i++)
+            {
+                res = prvSendData(pxHttp2, &(pxHttp2->pxStreams[i]));
+            }
+
+            if (res != HTTP2_ERRNO_NONE)
+            {
+                /* Propagate the error code */
+            }
+            else if (pxHttp2->uStreamsOpened == pxHttp2->uStreamsClosed && (pxHttp2->bGoAway || pxHttp2->uPeerMaxConcurrentStreams == 0))
+            {
+                /* Nothing is in flight, and no more streams can be opened on this connection. */
+                break;
+            }
+            else
+            {
+                res = prvRecvFrames(pxHttp2);
+            }
+        }
+
+        if (res == HTTP2_ERRNO_PROTOCOL_ERROR)
+        {
+            prvSendGoAway(pxHttp2, HTTP2_ERROR_CODE_PROTOCOL_ERROR);
+        }
+        else if (res == HTTP2_ERRNO_COMPRESSION_ERROR)
+        {
+            prvSendGoAway(pxHttp2, HTTP2_ERROR_CODE_COMPRESSION_ERROR);
+        }
+
+        /* Streams which are still open failed with the connection. The ones never opened keep HTTP2_ERRNO_STREAM_REFUSED. */
+        for (i = 0; i < pxHttp2->uStreamsOpened; i++)
+        {
+            pxStream = &(pxHttp2->pxStreams[i]);
+            prvCloseStream(pxHttp2, pxStream, res);
+        }
+
+        Allocator_free(pxHttp2->pxStreams);
+        pxHttp2->pxStreams = NULL;
+        pxHttp2->uStreamsOpened = 0;
+
+        if (res == HTTP2_ERRNO_NONE && pxHttp2->bGoAway)
+        {
+            res = HTTP2_ERRNO_STREAM_REFUSED;
+        }
+    }
+
+    return res;
+}
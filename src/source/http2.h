@@ -0,0 +1,70 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "netio.h"
+
+#define HTTP2_ERRNO_NONE                    (0)
+#define HTTP2_ERRNO_INVALID_PARAMETER       (-1)
+#define HTTP2_ERRNO_OUT_OF_MEMORY           (-2)
+#define HTTP2_ERRNO_SEND_FAILED             (-3)
+#define HTTP2_ERRNO_RECV_FAILED             (-4)
+#define HTTP2_ERRNO_PROTOCOL_ERROR          (-5)
+#define HTTP2_ERRNO_COMPRESSION_ERROR       (-6)
+#define HTTP2_ERRNO_STREAM_REFUSED          (-7) // The server didn't process the request, so it's safe to send it again
+#define HTTP2_ERRNO_STREAM_RESET            (-8)
+
+#define HTTP2_ERROR_TYPE_MAX_LEN            (64)
+
+typedef struct
+{
+    /* Request */
+    const uint8_t *pHeaderBlock; // HPACK encoded request headers
+    size_t uHeaderBlockLen;
+    const uint8_t *pBody;
+    size_t uBodyLen;
+
+    /* The status code and the error type are already set when the first data of the response is delivered. */
+    int (*onDataCallback)(uint8_t *pData, size_t uLen, void *pUserData);
+    void *pUserData;
+
+    /* Response */
+    int res;
+    unsigned int uStatusCode;
+    char pErrorType[HTTP2_ERROR_TYPE_MAX_LEN]; // The x-amzn-errortype header without the part after ':'
+} Http2Request_t;
+
+typedef struct Http2 *Http2Handle;
+
+/**
+ * @brief Create a HTTP/2 client on a connection which has negotiated "h2" by ALPN
+ *
+ * @param[in] xNetIo The connected network I/O handle. It's still owned by the caller.
+ * @return The HTTP/2 client handle
+ */
+Http2Handle Http2_create(NetIoHandle xNetIo);
+
+/**
+ * @brief Terminate a HTTP/2 client
+ *
+ * @param[in] xHttp2 The HTTP/2 client handle
+ */
+void Http2_terminate(Http2Handle xHttp2);
+
+/**
+ * @brief Send requests as concurrent streams of the connection, and receive all the responses.
+ *
+ * Streams are opened up to the concurrency limit of the server, and the rest are opened when earlier ones complete.
+ * The result of every request is set in its res field, even if the connection fails.
+ *
+ * @param[in] xHttp2 The HTTP/2 client handle
+ * @param[in,out] pxRequests The requests
+ * @param[in] uCount The number of requests
+ * @return 0 if the connection is still usable, non-zero value otherwise
+ */
+int Http2_execute(Http2Handle xHttp2, Http2Request_t *pxRequests, size_t uCount);
+
+#endif /* HTTP2_H */
@@ -1,7 +1,10 @@
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "llhttp.h"
+
+#include "allocator.h"
 #include "http_parser.h"
 
 typedef enum
@@ -9,8 +12,14 @@ typedef enum
     LLHTTP_PAUSE_ON_UNKNOWN_REASON = 0,
     LLHTTP_PAUSE_ON_HEADERS_COMPLETE = 1,
     LLHTTP_PAUSE_ON_CHUNK_COMPLETE = 2,
+    LLHTTP_PAUSE_ON_MESSAGE_COMPLETE = 3,
+    LLHTTP_PAUSE_ON_BODY = 4,
 } LlhttpPauseReason_t;
 
+/* The header which carries the error type of a failed AWS request, ex: "ThrottlingException:http://internal.amazon.com/coral/" */
+#define HTTP_HEADER_AMZN_ERROR_TYPE     "x-amzn-ErrorType"
+#define HTTP_ERROR_TYPE_MAX_LEN         64
+
 typedef struct
 {
     llhttp_settings_t xSettings;
@@ -18,6 +27,11 @@ typedef struct
     LlhttpPauseReason_t ePauseReason;
     const char *pChuckLoc;
     size_t uChunkLen;
+
+    bool bMessageComplete;
+    bool bKeepAlive;
+    bool bHeaderIsErrorType;
+    char pErrorType[HTTP_ERROR_TYPE_MAX_LEN];
 } llhttp_settings_ex_t;
 
 typedef struct HttpParser
@@ -26,6 +40,41 @@ typedef struct HttpParser
     llhttp_settings_ex_t xSettingsEx;
 } HttpParser_t;
 
+static int prvOnMessageBeginCb(llhttp_t *pLlhttp)
+{
+    llhttp_settings_ex_t *pxSettingsEx = (llhttp_settings_ex_t *)(pLlhttp->settings);
+    pxSettingsEx->bMessageComplete = false;
+    pxSettingsEx->bKeepAlive = false;
+    pxSettingsEx->bHeaderIsErrorType = false;
+    pxSettingsEx->pErrorType[0] = '\0';
+    return 0;
+}
+
+static int prvOnHeaderFieldCb(llhttp_t *pLlhttp, const char *at, size_t length)
+{
+    llhttp_settings_ex_t *pxSettingsEx = (llhttp_settings_ex_t *)(pLlhttp->settings);
+    pxSettingsEx->bHeaderIsErrorType = (length == sizeof(HTTP_HEADER_AMZN_ERROR_TYPE) - 1 && strncasecmp(at, HTTP_HEADER_AMZN_ERROR_TYPE, length) == 0);
+    return 0;
+}
+
+static int prvOnHeaderValueCb(llhttp_t *pLlhttp, const char *at, size_t length)
+{
+    llhttp_settings_ex_t *pxSettingsEx = (llhttp_settings_ex_t *)(pLlhttp->settings);
+    size_t uLen = 0;
+
+    if (pxSettingsEx->bHeaderIsErrorType)
+    {
+        /* Only keep the exception name, and drop the namespace after the colon. */
+        while (uLen < length && uLen < HTTP_ERROR_TYPE_MAX_LEN - 1 && at[uLen] != ':')
+        {
+            uLen++;
+        }
+        memcpy(pxSettingsEx->pErrorType, at, uLen);
+        pxSettingsEx->pErrorType[uLen] = '\0';
+    }
+    return 0;
+}
+
 static int prvOnHeadersCompleteCb(llhttp_t *pLlhttp)
 {
     llhttp_settings_ex_t *pxSettingsEx = (llhttp_settings_ex_t *)(pLlhttp->settings);
@@ -40,11 +89,30 @@ static int prvOnChunkCompleteCb(llhttp_t *pLlhttp)
     return HPE_PAUSED;
 }
 
+static int prvOnMessageCompleteCb(llhttp_t *pLlhttp)
+{
+    llhttp_settings_ex_t *pxSettingsEx = (llhttp_settings_ex_t *)(pLlhttp->settings);
+    pxSettingsEx->ePauseReason = LLHTTP_PAUSE_ON_MESSAGE_COMPLETE;
+    pxSettingsEx->bMessageComplete = true;
+    /* llhttp resets the connection flags after this callback, so keep the result now. */
+    pxSettingsEx->bKeepAlive = (llhttp_should_keep_alive(pLlhttp) != 0);
+    return HPE_PAUSED;
+}
+
 static int prvOnBodyCb(llhttp_t *pLlhttp, const char *at, size_t length)
 {
     llhttp_settings_ex_t *pxSettingsEx = (llhttp_settings_ex_t *)(pLlhttp->settings);
     pxSettingsEx->pChuckLoc = at;
     pxSettingsEx->uChunkLen = length;
+
+    /* llhttp has already counted the span down, so a body or chunk which isn't over ends with the received data. It's reported now, rather
+     * than rolled back until the rest arrives. A span which ends the body is reported by the completion which follows it. llhttp also
+     * flushes an empty span at the end of the data, which has nothing to report. */
+    if (length > 0 && pLlhttp->content_length > 0)
+    {
+        pxSettingsEx->ePauseReason = LLHTTP_PAUSE_ON_BODY;
+        return HPE_PAUSED;
+    }
     return 0;
 }
 
@@ -54,7 +122,7 @@ HttpParserHandle Hp_create()
     llhttp_t *pLlhttp = NULL;
     llhttp_settings_t *pSettings = NULL;
 
-    if ((pHttpParser = (HttpParser_t *)malloc(sizeof(HttpParser_t))) != NULL)
+    if ((pHttpParser = (HttpParser_t *)Allocator_malloc(sizeof(HttpParser_t))) != NULL)
     {
         memset(pHttpParser, 0, sizeof(HttpParser_t));
 
@@ -62,9 +130,13 @@ HttpParserHandle Hp_create()
         pLlhttp = &(pHttpParser->xLlhttp);
 
         llhttp_settings_init(pSettings);
+        pSettings->on_message_begin = prvOnMessageBeginCb;
+        pSettings->on_header_field = prvOnHeaderFieldCb;
+        pSettings->on_header_value = prvOnHeaderValueCb;
         pSettings->on_headers_complete = prvOnHeadersCompleteCb;
         pSettings->on_chunk_complete = prvOnChunkCompleteCb;
         pSettings->on_body = prvOnBodyCb;
+        pSettings->on_message_complete = prvOnMessageCompleteCb;
 
         llhttp_init(pLlhttp, HTTP_RESPONSE, pSettings);
     }
@@ -86,7 +158,8 @@ int Hp_parse(HttpParserHandle xHttpParserandle, char *pBuf, size_t uLen, size_t
     const char *pChunkLoc = NULL;
     size_t uChunkLen = 0;
 
-    if (pHttpParser == NULL || pBuf == NULL || uLen == 0 || puByteParsed == NULL)
+    /* No data is parsed too, as a pause can leave callbacks which need none, ex: the completion of a message after its last chunk. */
+    if (pHttpParser == NULL || pBuf == NULL || puByteParsed == NULL)
     {
         res = HTTP_PARSER_ERRNO_INVALID_PARAMETER;
     }
@@ -96,7 +169,9 @@ int Hp_parse(HttpParserHandle xHttpParserandle, char *pBuf, size_t uLen, size_t
         pLlhttp = &(pHttpParser->xLlhttp);
 
         memcpy(&xLlhttpBak, pLlhttp, sizeof(llhttp_t));
-        pHttpParser->xSettingsEx.ePauseReason = LLHTTP_PAUSE_ON_UNKNOWN_REASON;
+        pxSettingsEx->ePauseReason = LLHTTP_PAUSE_ON_UNKNOWN_REASON;
+        pxSettingsEx->pChuckLoc = NULL;
+        pxSettingsEx->uChunkLen = 0;
         xHttpErrno = llhttp_execute(pLlhttp, pBuf, uLen);
         if (xHttpErrno == HPE_OK)
         {
@@ -113,8 +188,11 @@ int Hp_parse(HttpParserHandle xHttpParserandle, char *pBuf, size_t uLen, size_t
             {
                 uStatusCode = pLlhttp->status_code;
             }
-            else if (pHttpParser->xSettingsEx.ePauseReason == LLHTTP_PAUSE_ON_CHUNK_COMPLETE)
+            else if (pHttpParser->xSettingsEx.ePauseReason == LLHTTP_PAUSE_ON_BODY ||
+                     pHttpParser->xSettingsEx.ePauseReason == LLHTTP_PAUSE_ON_CHUNK_COMPLETE ||
+                     pHttpParser->xSettingsEx.ePauseReason == LLHTTP_PAUSE_ON_MESSAGE_COMPLETE)
             {
+                /* The body is reported as it arrives, so the parsed bytes never have to be kept for a whole chunk or message. */
                 if (ppChunkLoc != NULL && puChunkLen != NULL)
                 {
                     if (pxSettingsEx->pChuckLoc != NULL && pxSettingsEx->uChunkLen > 0)
@@ -150,12 +228,89 @@ int Hp_parse(HttpParserHandle xHttpParserandle, char *pBuf, size_t uLen, size_t
     return res;
 }
 
+void Hp_reset(HttpParserHandle xHttpParserandle)
+{
+    HttpParser_t *pHttpParser = (HttpParser_t *)xHttpParserandle;
+
+    if (pHttpParser != NULL)
+    {
+        /* llhttp itself starts over after a complete keep-alive message, so only the results of the previous message are cleared. */
+        pHttpParser->xSettingsEx.bMessageComplete = false;
+        pHttpParser->xSettingsEx.bKeepAlive = false;
+        pHttpParser->xSettingsEx.bHeaderIsErrorType = false;
+        pHttpParser->xSettingsEx.pErrorType[0] = '\0';
+    }
+}
+
+bool Hp_isMessageComplete(HttpParserHandle xHttpParserandle)
+{
+    HttpParser_t *pHttpParser = (HttpParser_t *)xHttpParserandle;
+
+    return (pHttpParser != NULL) ? pHttpParser->xSettingsEx.bMessageComplete : false;
+}
+
+bool Hp_shouldKeepAlive(HttpParserHandle xHttpParserandle)
+{
+    HttpParser_t *pHttpParser = (HttpParser_t *)xHttpParserandle;
+
+    return (pHttpParser != NULL) ? pHttpParser->xSettingsEx.bKeepAlive : false;
+}
+
+int Hp_getBodyFraming(HttpParserHandle xHttpParserandle, bool *pbChunked, uint64_t *puContentLength)
+{
+    int res = HTTP_PARSER_ERRNO_NONE;
+    HttpParser_t *pHttpParser = (HttpParser_t *)xHttpParserandle;
+
+    if (pHttpParser == NULL || pbChunked == NULL || puContentLength == NULL)
+    {
+        res = HTTP_PARSER_ERRNO_INVALID_PARAMETER;
+    }
+    else if ((pHttpParser->xLlhttp.flags & F_CHUNKED) != 0)
+    {
+        *pbChunked = true;
+        *puContentLength = 0;
+    }
+    else if ((pHttpParser->xLlhttp.flags & F_CONTENT_LENGTH) != 0)
+    {
+        /* llhttp counts it down as the body is parsed, so it's the whole body right after the headers. */
+        *pbChunked = false;
+        *puContentLength = pHttpParser->xLlhttp.content_length;
+    }
+    else
+    {
+        res = HTTP_PARSER_ERRNO_PARSE_FAILURE;
+    }
+
+    return res;
+}
+
+void Hp_skipBody(HttpParserHandle xHttpParserandle)
+{
+    HttpParser_t *pHttpParser = (HttpParser_t *)xHttpParserandle;
+
+    if (pHttpParser != NULL)
+    {
+        pHttpParser->xSettingsEx.bMessageComplete = true;
+        pHttpParser->xSettingsEx.bKeepAlive = (llhttp_should_keep_alive(&(pHttpParser->xLlhttp)) != 0);
+
+        /* llhttp still waits for the body, so it starts over. The settings and the results above are kept. */
+        llhttp_init(&(pHttpParser->xLlhttp), HTTP_RESPONSE, &(pHttpParser->xSettingsEx.xSettings));
+    }
+}
+
+const char *Hp_getErrorType(HttpParserHandle xHttpParserandle)
+{
+    HttpParser_t *pHttpParser = (HttpParser_t *)xHttpParserandle;
+
+    return (pHttpParser != NULL && pHttpParser->xSettingsEx.pErrorType[0] != '\0') ? pHttpParser->xSettingsEx.pErrorType : NULL;
+}
+
 void Hp_terminate(HttpParserHandle xHttpParserandle)
 {
     HttpParser_t *pHttpParser = (HttpParser_t *)xHttpParserandle;
 
     if (pHttpParser != NULL)
     {
-        free(pHttpParser);
+        Allocator_free(pHttpParser);
     }
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #ifndef HTTP_PARSER_H
 #define HTTP_PARSER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #define HTTP_PARSER_ERRNO_NONE                      (0)
 #define HTTP_PARSER_ERRNO_INVALID_PARAMETER         (-1)
 #define HTTP_PARSER_ERRNO_WANT_MORE_DATA            (-2)
@@ -12,6 +16,21 @@ HttpParserHandle Hp_create();
 
 int Hp_parse(HttpParserHandle xHttpParserandle, char *pBuf, size_t uLen, size_t *puByteParsed, unsigned int *puStatusCode, const char **ppChunkLoc, size_t *puChunkLen);
 
+/* Get ready for the next response on a persistent connection. The data after the previous response is parsed as a new message. */
+void Hp_reset(HttpParserHandle xHttpParserandle);
+
+bool Hp_isMessageComplete(HttpParserHandle xHttpParserandle);
+
+bool Hp_shouldKeepAlive(HttpParserHandle xHttpParserandle);
+
+/* How the body of the response is delimited, once the headers are parsed. It fails for a body which lasts until the connection closes. */
+int Hp_getBodyFraming(HttpParserHandle xHttpParserandle, bool *pbChunked, uint64_t *puContentLength);
+
+/* The body after the headers was consumed without the parser, so complete the message. The next data is parsed as a new message. */
+void Hp_skipBody(HttpParserHandle xHttpParserandle);
+
+const char *Hp_getErrorType(HttpParserHandle xHttpParserandle);
+
 void Hp_terminate(HttpParserHandle xHttpParserandle);
 
 #endif /* HTTP_PARSER_H */
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "mem_pool.h"
+
+/* The block counts are build options. The sizes fit, from the smallest: handles and short strings, parsers and HTTP/2 streams,
+ * receive buffers and signing strings, TLS record buffers and request arenas, and the arenas of long SSML texts. */
+#ifndef MEM_POOL_BLOCKS_64
+#define MEM_POOL_BLOCKS_64      (256)
+#endif
+#ifndef MEM_POOL_BLOCKS_512
+#define MEM_POOL_BLOCKS_512     (128)
+#endif
+#ifndef MEM_POOL_BLOCKS_4K
+#define MEM_POOL_BLOCKS_4K      (32)
+#endif
+#ifndef MEM_POOL_BLOCKS_20K
+#define MEM_POOL_BLOCKS_20K     (16)
+#endif
+#ifndef MEM_POOL_BLOCKS_64K
+#define MEM_POOL_BLOCKS_64K     (4)
+#endif
+
+#define MEM_POOL_COUNT          (5)
+
+/* Blocks are aligned for any type, like malloc() */
+#define MEM_POOL_ALIGN          (16)
+
+/* A pool with no blocks still declares one, because C doesn't allow empty arrays. */
+#define MEM_POOL_STORAGE(uBlockSize, uBlockCount)   ((uBlockSize) * (((uBlockCount) > 0) ? (uBlockCount) : 1))
+
+typedef struct FreeBlock
+{
+    struct FreeBlock *pxNext;
+} FreeBlock_t;
+
+typedef struct
+{
+    size_t uBlockSize;
+    size_t uBlockCount;
+    uint8_t *pStorage;
+    FreeBlock_t *pxFree;
+
+    size_t uBlocksInUse;
+    size_t uPeakBlocksInUse;
+    size_t uFailures;
+} MemPool_t;
+
+static uint8_t gpStorage64[MEM_POOL_STORAGE(64, MEM_POOL_BLOCKS_64)] __attribute__((aligned(MEM_POOL_ALIGN)));
+static uint8_t gpStorage512[MEM_POOL_STORAGE(512, MEM_POOL_BLOCKS_512)] __attribute__((aligned(MEM_POOL_ALIGN)));
+static uint8_t gpStorage4K[MEM_POOL_STORAGE(4096, MEM_POOL_BLOCKS_4K)] __attribute__((aligned(MEM_POOL_ALIGN)));
+static uint8_t gpStorage20K[MEM_POOL_STORAGE(20480, MEM_POOL_BLOCKS_20K)] __attribute__((aligned(MEM_POOL_ALIGN)));
+static uint8_t gpStorage64K[MEM_POOL_STORAGE(MEM_POOL_MAX_BLOCK_SIZE, MEM_POOL_BLOCKS_64K)] __attribute__((aligned(MEM_POOL_ALIGN)));
+
+static MemPool_t gxPools[MEM_POOL_COUNT] =
+{
+    { 64, MEM_POOL_BLOCKS_64, gpStorage64, NULL, 0, 0, 0 },
+    { 512, MEM_POOL_BLOCKS_512, gpStorage512, NULL, 0, 0, 0 },
+    { 4096, MEM_POOL_BLOCKS_4K, gpStorage4K, NULL, 0, 0, 0 },
+    { 20480, MEM_POOL_BLOCKS_20K, gpStorage20K, NULL, 0, 0, 0 },
+    { MEM_POOL_MAX_BLOCK_SIZE, MEM_POOL_BLOCKS_64K, gpStorage64K, NULL, 0, 0, 0 },
+};
+
+static pthread_mutex_t gxLock = PTHREAD_MUTEX_INITIALIZER;
+static bool gbInited = false;
+
+/* Chain all blocks into the free lists. It has to be called with the lock held. */
+static void prvInit(void)
+{
+    MemPool_t *pxPool = NULL;
+    FreeBlock_t *pxBlock = NULL;
+    size_t i = 0;
+    size_t j = 0;
+
+    for (i = 0; i < MEM_POOL_COUNT; i++)
+    {
+        pxPool = &(gxPools[i]);
+        for (j = pxPool->uBlockCount; j > 0; j--)
+        {
+            pxBlock = (FreeBlock_t *)(pxPool->pStorage + (j - 1) * pxPool->uBlockSize);
+            pxBlock->pxNext = pxPool->pxFree;
+            pxPool->pxFree = pxBlock;
+        }
+    }
+    gbInited = true;
+}
+
+static MemPool_t *prvGetPoolOf(void *ptr)
+{
+    MemPool_t *pxPool = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < MEM_POOL_COUNT && pxPool == NULL; i++)
+    {
+        if ((uint8_t *)ptr >= gxPools[i].pStorage && (uint8_t *)ptr < gxPools[i].pStorage + gxPools[i].uBlockSize * gxPools[i].uBlockCount)
+        {
+            pxPool = &(gxPools[i]);
+        }
+    }
+
+    return pxPool;
+}
+
+void *MemPool_malloc(size_t uSize)
+{
+    FreeBlock_t *pxBlock = NULL;
+    MemPool_t *pxPool = NULL;
+    size_t i = 0;
+
+    pthread_mutex_lock(&gxLock);
+    if (!gbInited)
+    {
+        prvInit();
+    }
+
+    /* A larger block is used when the fitting pool is exhausted, but the heap never is. */
+    for (i = 0; i < MEM_POOL_COUNT && pxBlock == NULL; i++)
+    {
+        pxPool = &(gxPools[i]);
+        if (uSize <= pxPool->uBlockSize)
+        {
+            if ((pxBlock = pxPool->pxFree) != NULL)
+            {
+                pxPool->pxFree = pxBlock->pxNext;
+                pxPool->uBlocksInUse++;
+                if (pxPool->uBlocksInUse > pxPool->uPeakBlocksInUse)
+                {
+                    pxPool->uPeakBlocksInUse = pxPool->uBlocksInUse;
+                }
+            }
+            else
+            {
+                pxPool->uFailures++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&gxLock);
+
+    return pxBlock;
+}
+
+void *MemPool_realloc(void *ptr, size_t uSize)
+{
+    void *p = NULL;
+    MemPool_t *pxPool = NULL;
+
+    if (ptr == NULL)
+    {
+        p = MemPool_malloc(uSize);
+    }
+    else if ((pxPool = prvGetPoolOf(ptr)) != NULL)
+    {
+        if (uSize <= pxPool->uBlockSize)
+        {
+            /* It still fits the block */
+            p = ptr;
+        }
+        else if ((p = MemPool_malloc(uSize)) != NULL)
+        {
+            memcpy(p, ptr, pxPool->uBlockSize);
+            MemPool_free(ptr);
+        }
+    }
+
+    return p;
+}
+
+void MemPool_free(void *ptr)
+{
+    FreeBlock_t *pxBlock = (FreeBlock_t *)ptr;
+    MemPool_t *pxPool = NULL;
+
+    if (ptr != NULL && (pxPool = prvGetPoolOf(ptr)) != NULL)
+    {
+        pthread_mutex_lock(&gxLock);
+        pxBlock->pxNext = pxPool->pxFree;
+        pxPool->pxFree = pxBlock;
+        pxPool->uBlocksInUse--;
+        pthread_mutex_unlock(&gxLock);
+    }
+}
+
+size_t MemPool_getStats(PollyMemoryPoolStats_t *pxStats, size_t uMaxCount)
+{
+    size_t i = 0;
+
+    pthread_mutex_lock(&gxLock);
+    for (i = 0; i < MEM_POOL_COUNT && i < uMaxCount && pxStats != NULL; i++)
+    {
+        pxStats[i].uBlockSize = gxPools[i].uBlockSize;
+        pxStats[i].uBlockCount = gxPools[i].uBlockCount;
+        pxStats[i].uBlocksInUse = gxPools[i].uBlocksInUse;
+        pxStats[i].uPeakBlocksInUse = gxPools[i].uPeakBlocksInUse;
+        pxStats[i].uFailures = gxPools[i].uFailures;
+    }
+    pthread_mutex_unlock(&gxLock);
+
+    return MEM_POOL_COUNT;
+}
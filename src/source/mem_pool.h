@@ -0,0 +1,29 @@
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+#include <stddef.h>
+
+#include "polly/polly.h"
+
+/* Fixed-size block pools in static memory. They back the allocator when the library is built with POLLY_STATIC_MEMORY, so nothing comes
+ * from the heap. A request is served by the smallest block which fits it, and it fails when all such blocks are in use. */
+
+/* The size of the largest blocks, so no allocation can be larger */
+#define MEM_POOL_MAX_BLOCK_SIZE (65536)
+
+void *MemPool_malloc(size_t uSize);
+
+void *MemPool_realloc(void *ptr, size_t uSize);
+
+void MemPool_free(void *ptr);
+
+/**
+ * @brief Get the usage of the pools
+ *
+ * @param[out] pxStats The usage of every pool, from the smallest block size
+ * @param[in] uMaxCount The number of elements of pxStats
+ * @return The number of pools
+ */
+size_t MemPool_getStats(PollyMemoryPoolStats_t *pxStats, size_t uMaxCount);
+
+#endif /* MEM_POOL_H */
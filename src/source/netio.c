@@ -13,22 +13,88 @@
  * permissions and limitations under the License.
  */
 
+/* The TCP tuning options, splice() and kTLS are not part of POSIX */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 /* Third party headers */
+#include "mbedtls/aesni.h"
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/net.h"
 #include "mbedtls/net_sockets.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/ssl_internal.h"
 
+/* kTLS takes the keys of the session, which mbedtls only hands out with MBEDTLS_SSL_EXPORT_KEYS. */
+#if defined(__linux__) && defined(MBEDTLS_SSL_EXPORT_KEYS)
+#include <linux/tls.h>
+#if defined(TLS_RX) && defined(TCP_ULP)
+#define NETIO_KTLS
+#if !defined(SOL_TLS)
+#define SOL_TLS                             (282)
+#endif
+#endif
+#endif
+
+#include "allocator.h"
+#include "cancel_token.h"
 #include "netio.h"
+#include "port.h"
+#include "transport.h"
+#include "trust_store.h"
 
 #define DEFAULT_CONNECTION_TIMEOUT_MS       (10 * 1000)
 
+/* The maximum number of connections which can be waited at the same time */
+#define NETIO_WAIT_MAX_HANDLES              (8)
+
+/* The AES-GCM keys which kTLS takes: the key, and the implicit part of the nonce */
+#define NETIO_KTLS_MAX_KEY_LEN              (32)
+#define NETIO_KTLS_SALT_LEN                 (4)
+
+/* The suites offered to the server, in preference order. AES-GCM is the fastest where mbedtls runs AES on AES-NI, and ChaCha20-Poly1305
+ * is the fastest where AES runs in software. The AWS endpoints take all of them. */
+static const int gpCiphersuitesAesFirst[] =
+{
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+    0
+};
+
+static const int gpCiphersuitesChaChaFirst[] =
+{
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    0
+};
+
 typedef struct NetIo
 {
     /* Basic ssl connection parameters */
@@ -45,8 +111,46 @@ typedef struct NetIo
 
     /* Options */
     uint32_t uRecvTimeoutMs;
+    uint32_t uConnectTimeoutMs;
+    const char **ppAlpnProtocols;
+    unsigned char uMaxFragLenCode;
+    PollyTrustStoreHandle xTrustStore;
+    PollySocketOptions_t xSocketOptions;
+
+    /* The request being served */
+    uint64_t uDeadlineMs; // 0 means none
+    PollyCancelTokenHandle xCancelToken;
+
+    /* While connecting, the waits on the socket share the connect timeout, which ends at uConnectEndMs. */
+    bool bConnecting;
+    uint64_t uConnectEndMs;
+
+    /* The transport carries the bytes, and keeps its own state of the connection in pConn. */
+    PollyTransport_t *pxTransport;
+    void *pConn;
+
+    /* The kernel decrypts the received records, while mbedtls keeps encrypting the sent ones. The keys are only kept until then. */
+    bool bKernelTlsRx;
+    unsigned char pServerKey[NETIO_KTLS_MAX_KEY_LEN];
+    size_t uServerKeyLen;
+    unsigned char pServerSalt[NETIO_KTLS_SALT_LEN];
+
+    int xSplicePipe[2]; // Between the socket and the file descriptor of NetIo_splice(), -1 until it's used
 } NetIo_t;
 
+/* getaddrinfo() can't be interrupted, so a resolve with a deadline runs in a thread which the caller can walk away from.
+ * The caller and the thread share the resolver, and the last one to let go frees it. */
+typedef struct Resolver
+{
+    uint32_t uRefs;
+    int xPipe[2]; // The thread writes a byte when it's done
+    int retVal;
+    struct addrinfo *pxAddrList;
+    const char *pcHost;
+    const char *pcPort;
+    char pNames[]; // The host and the port, copied as the caller may be gone
+} Resolver_t;
+
 static int prvCreateX509Cert(NetIo_t *pxNet)
 {
     int res = NETIO_ERRNO_NONE;
@@ -55,9 +159,9 @@ static int prvCreateX509Cert(NetIo_t *pxNet)
     {
         res = NETIO_ERRNO_INVALID_PARAMETER;
     }
-    else if ((pxNet->pRootCA = (mbedtls_x509_crt *)malloc(sizeof(mbedtls_x509_crt))) == NULL ||
-        (pxNet->pCert = (mbedtls_x509_crt *)malloc(sizeof(mbedtls_x509_crt))) == NULL ||
-        (pxNet->pPrivKey = (mbedtls_pk_context *)malloc(sizeof(mbedtls_pk_context))) == NULL)
+    else if ((pxNet->pRootCA = (mbedtls_x509_crt *)Allocator_malloc(sizeof(mbedtls_x509_crt))) == NULL ||
+        (pxNet->pCert = (mbedtls_x509_crt *)Allocator_malloc(sizeof(mbedtls_x509_crt))) == NULL ||
+        (pxNet->pPrivKey = (mbedtls_pk_context *)Allocator_malloc(sizeof(mbedtls_pk_context))) == NULL)
     {
         res = NETIO_ERRNO_OUT_OF_MEMORY;
     }
@@ -71,271 +175,1426 @@ static int prvCreateX509Cert(NetIo_t *pxNet)
     return res;
 }
 
-static int prvInitConfig(NetIo_t *pxNet, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+static void prvSetSocketOption(int fd, int level, int name, int value)
 {
-    int res = NETIO_ERRNO_NONE;
-    int retVal = 0;
-
-    if (pxNet == NULL)
-    {
-        res = NETIO_ERRNO_INVALID_PARAMETER;
-    }
-    else
-    {
-        mbedtls_ssl_set_bio(&(pxNet->xSsl), &(pxNet->xFd), mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
-
-        if ((retVal = mbedtls_ssl_config_defaults(&(pxNet->xConf), MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
-        {
-            res = NETIO_ERRNO_OUT_OF_MEMORY;
-        }
-        else
-        {
-            mbedtls_ssl_conf_rng(&(pxNet->xConf), mbedtls_ctr_drbg_random, &(pxNet->xCtrDrbg));
-            mbedtls_ssl_conf_read_timeout(&(pxNet->xConf), pxNet->uRecvTimeoutMs);
-
-            if (pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL)
-            {
-                if ((retVal = mbedtls_x509_crt_parse(pxNet->pRootCA, (void *)pcRootCA, strlen(pcRootCA) + 1)) != 0 ||
-                    (retVal = mbedtls_x509_crt_parse(pxNet->pCert, (void *)pcCert, strlen(pcCert) + 1)) != 0 ||
-                    (retVal = mbedtls_pk_parse_key(pxNet->pPrivKey, (void *)pcPrivKey, strlen(pcPrivKey) + 1, NULL, 0)) != 0)
-                {
-                    res = NETIO_ERRNO_UNABLE_TO_PARSE_CERT;
-                }
-                else
-                {
-                    mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_REQUIRED);
-                    mbedtls_ssl_conf_ca_chain(&(pxNet->xConf), pxNet->pRootCA, NULL);
-
-                    if ((retVal = mbedtls_ssl_conf_own_cert(&(pxNet->xConf), pxNet->pCert, pxNet->pPrivKey)) != 0)
-                    {
-                        res = NETIO_ERRNO_OUT_OF_MEMORY;
-                    }
-                }
-            }
-            else
-            {
-                mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_NONE);
-            }
-        }
-    }
-
-    if (res == NETIO_ERRNO_NONE)
-    {
-        if ((retVal = mbedtls_ssl_setup(&(pxNet->xSsl), &(pxNet->xConf))) != 0)
-        {
-            res = NETIO_ERRNO_OUT_OF_MEMORY;
-        }
-    }
-
-    return res;
+    /* A value which the OS rejects, ex: a busy poll time beyond the system limit without CAP_NET_ADMIN, keeps its default. */
+    (void)setsockopt(fd, level, name, &value, sizeof(value));
 }
 
-static int prvConnect(NetIo_t *pxNet, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+static void prvApplySocketOptions(NetIo_t *pxNet)
 {
-    int res = NETIO_ERRNO_NONE;
-    int retVal = 0;
+    PollySocketOptions_t *pxOpts = &(pxNet->xSocketOptions);
+    int fd = pxNet->xFd.fd;
 
-    if (pxNet == NULL || pcHost == NULL || pcPort == NULL)
+    if (pxOpts->bTcpNoDelay)
     {
-        res = NETIO_ERRNO_INVALID_PARAMETER;
+        prvSetSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 1);
     }
-    else if ((pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL) && (res = prvCreateX509Cert(pxNet)) != NETIO_ERRNO_NONE)
+    if (pxOpts->uRecvBufferSize > 0)
     {
-        /* Propagate the res error */
+        prvSetSocketOption(fd, SOL_SOCKET, SO_RCVBUF, (int)pxOpts->uRecvBufferSize);
     }
-    else if ((retVal = mbedtls_net_connect(&(pxNet->xFd), pcHost, pcPort, MBEDTLS_NET_PROTO_TCP)) != 0)
+    if (pxOpts->uSendBufferSize > 0)
     {
-        switch (retVal)
+        prvSetSocketOption(fd, SOL_SOCKET, SO_SNDBUF, (int)pxOpts->uSendBufferSize);
+    }
+    if (pxOpts->uKeepAliveIdleSec > 0)
+    {
+        prvSetSocketOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1);
+#if defined(TCP_KEEPIDLE)
+        prvSetSocketOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, (int)pxOpts->uKeepAliveIdleSec);
+#endif
+#if defined(TCP_KEEPINTVL)
+        if (pxOpts->uKeepAliveIntervalSec > 0)
         {
-            case MBEDTLS_ERR_NET_SOCKET_FAILED:
-                res = NETIO_ERRNO_NET_SOCKET_FAILED;
-                break;
-            case MBEDTLS_ERR_NET_UNKNOWN_HOST:
-                res = NETIO_ERRNO_NET_UNKNOWN_HOST;
-                break;
-            case MBEDTLS_ERR_NET_CONNECT_FAILED:
-            default:
-                res = NETIO_ERRNO_NET_CONNECT_FAILED;
-                break;
+            prvSetSocketOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, (int)pxOpts->uKeepAliveIntervalSec);
+        }
+#endif
+#if defined(TCP_KEEPCNT)
+        if (pxOpts->uKeepAliveCount > 0)
+        {
+            prvSetSocketOption(fd, IPPROTO_TCP, TCP_KEEPCNT, (int)pxOpts->uKeepAliveCount);
         }
+#endif
     }
-    else if ((res = prvInitConfig(pxNet, pcRootCA, pcCert, pcPrivKey)) != NETIO_ERRNO_NONE)
+#if defined(TCP_QUICKACK)
+    if (pxOpts->bTcpQuickAck)
     {
-        /* Propagate the res error */
+        prvSetSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
     }
-    else if ((retVal = mbedtls_ssl_handshake(&(pxNet->xSsl))) != 0)
+#endif
+#if defined(SO_BUSY_POLL)
+    if (pxOpts->uBusyPollUs > 0)
     {
-        res = NETIO_ERRNO_SSL_HANDSHAKE_ERROR;
+        prvSetSocketOption(fd, SOL_SOCKET, SO_BUSY_POLL, (int)pxOpts->uBusyPollUs);
     }
-    else
+#endif
+#if defined(TCP_USER_TIMEOUT)
+    if (pxOpts->uUserTimeoutMs > 0)
     {
-        /* nop */
+        prvSetSocketOption(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, (int)pxOpts->uUserTimeoutMs);
     }
-
-    return res;
+#endif
 }
 
-NetIoHandle NetIo_create(void)
+static const int *prvGetCiphersuites(void)
 {
-    NetIo_t *pxNet = NULL;
+#if defined(MBEDTLS_AESNI_C) && defined(MBEDTLS_HAVE_X86_64)
+    /* mbedtls checks the CPU once and caches the answer. */
+    return mbedtls_aesni_has_support(MBEDTLS_AESNI_AES) ? gpCiphersuitesAesFirst : gpCiphersuitesChaChaFirst;
+#else
+    /* mbedtls has no other AES acceleration, so AES is done in software. */
+    return gpCiphersuitesChaChaFirst;
+#endif
+}
 
-    if ((pxNet = (NetIo_t *)malloc(sizeof(NetIo_t))) != NULL)
-    {
-        memset(pxNet, 0, sizeof(NetIo_t));
+static int prvSetNonBlocking(int fd)
+{
+    int xFlags = fcntl(fd, F_GETFL, 0);
 
-        mbedtls_net_init(&(pxNet->xFd));
-        mbedtls_ssl_init(&(pxNet->xSsl));
-        mbedtls_ssl_config_init(&(pxNet->xConf));
-        mbedtls_ctr_drbg_init(&(pxNet->xCtrDrbg));
-        mbedtls_entropy_init(&(pxNet->xEntropy));
+    return (xFlags < 0) ? -1 : fcntl(fd, F_SETFL, xFlags | O_NONBLOCK);
+}
 
-        pxNet->uRecvTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
+/* Milliseconds to wait until the earlier of two ends, -1 if neither is set */
+static int prvGetWaitMs(uint64_t uNowMs, uint64_t uEndMs, uint64_t uDeadlineMs)
+{
+    uint64_t uWaitMs = UINT64_MAX;
+    uint64_t uLeftMs = 0;
 
-        if (mbedtls_ctr_drbg_seed(&(pxNet->xCtrDrbg), mbedtls_entropy_func, &(pxNet->xEntropy), NULL, 0) != 0)
-        {
-            NetIo_terminate(pxNet);
-            pxNet = NULL;
-        }
+    if (uEndMs != 0)
+    {
+        uWaitMs = (uEndMs > uNowMs) ? uEndMs - uNowMs : 0;
+    }
+    if (uDeadlineMs != 0)
+    {
+        uLeftMs = (uDeadlineMs > uNowMs) ? uDeadlineMs - uNowMs : 0;
+        uWaitMs = (uLeftMs < uWaitMs) ? uLeftMs : uWaitMs;
     }
 
-    return pxNet;
+    return (uWaitMs == UINT64_MAX) ? -1 : (int)((uWaitMs > INT32_MAX) ? INT32_MAX : uWaitMs);
 }
 
-void NetIo_terminate(NetIoHandle xNetIoHandle)
+static int prvWait(NetIo_t *pxNet, int fd, short events, uint32_t uTimeoutMs)
 {
-    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    int res = NETIO_ERRNO_NONE;
+    struct pollfd pxPollFds[2];
+    uint64_t uNowMs = Port_getTimeMs();
+    uint64_t uEndMs = (uTimeoutMs == 0) ? 0 : uNowMs + uTimeoutMs;
+    bool bReady = false;
+    int retVal = 0;
 
-    if (pxNet != NULL)
-    {
-        mbedtls_ctr_drbg_free(&(pxNet->xCtrDrbg));
-        mbedtls_entropy_free(&(pxNet->xEntropy));
-        mbedtls_net_free(&(pxNet->xFd));
-        mbedtls_ssl_free(&(pxNet->xSsl));
-        mbedtls_ssl_config_free(&(pxNet->xConf));
+    pxPollFds[0].fd = fd;
+    pxPollFds[0].events = events;
+    pxPollFds[1].fd = CancelToken_getFd(pxNet->xCancelToken); // poll() skips it if it's -1
+    pxPollFds[1].events = POLLIN;
 
-        if (pxNet->pRootCA != NULL)
+    while (res == NETIO_ERRNO_NONE && !bReady)
+    {
+        if (CancelToken_isCancelled(pxNet->xCancelToken))
         {
-            mbedtls_x509_crt_free(pxNet->pRootCA);
-            free(pxNet->pRootCA);
-            pxNet->pRootCA = NULL;
+            res = NETIO_ERRNO_CANCELLED;
         }
-
-        if (pxNet->pCert != NULL)
+        else if (pxNet->uDeadlineMs != 0 && uNowMs >= pxNet->uDeadlineMs)
         {
-            mbedtls_x509_crt_free(pxNet->pCert);
-            free(pxNet->pCert);
-            pxNet->pCert = NULL;
+            res = NETIO_ERRNO_DEADLINE_EXCEEDED;
         }
-
-        if (pxNet->pPrivKey != NULL)
+        else if (uEndMs != 0 && uNowMs >= uEndMs)
         {
-            mbedtls_pk_free(pxNet->pPrivKey);
-            free(pxNet->pPrivKey);
-            pxNet->pPrivKey = NULL;
+            res = NETIO_ERRNO_TIMEOUT;
+        }
+        else
+        {
+            pxPollFds[0].revents = 0;
+            pxPollFds[1].revents = 0;
+            if ((retVal = poll(pxPollFds, 2, prvGetWaitMs(uNowMs, uEndMs, pxNet->uDeadlineMs))) < 0 && errno != EINTR)
+            {
+                res = NETIO_ERRNO_POLL_FAILED;
+            }
+            else
+            {
+                bReady = (retVal > 0 && pxPollFds[0].revents != 0);
+                uNowMs = Port_getTimeMs();
+            }
         }
-        free(pxNet);
     }
-}
 
-int NetIo_connect(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort)
-{
-    return prvConnect(xNetIoHandle, pcHost, pcPort, NULL, NULL, NULL);
+    return res;
 }
 
-int NetIo_connectWithX509(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+/* The timeout of a wait on the socket: what is left of the connect timeout while connecting, the receive timeout otherwise */
+static uint32_t prvGetSocketTimeoutMs(NetIo_t *pxNet)
 {
-    return prvConnect(xNetIoHandle, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey);
+    uint32_t uTimeoutMs = pxNet->uRecvTimeoutMs;
+    uint64_t uNowMs = 0;
+
+    if (pxNet->bConnecting)
+    {
+        /* A timeout of 0 would wait forever, so a connect which has no time left waits the shortest time. */
+        uNowMs = Port_getTimeMs();
+        uTimeoutMs = (pxNet->uConnectEndMs > uNowMs) ? (uint32_t)(pxNet->uConnectEndMs - uNowMs) : 1;
+    }
+
+    return uTimeoutMs;
 }
 
-void NetIo_disconnect(NetIoHandle xNetIoHandle)
+/* An SSL call on the non-blocking socket which would block asks to be called again once the socket is ready. Other errors stay errors. */
+static int prvWaitForSsl(NetIo_t *pxNet, int retVal, int xError)
 {
-    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    int res = xError;
 
-    if (pxNet != NULL)
+    if (retVal == MBEDTLS_ERR_SSL_WANT_READ)
     {
-        mbedtls_ssl_close_notify(&(pxNet->xSsl));
+        res = prvWait(pxNet, pxNet->xFd.fd, POLLIN, prvGetSocketTimeoutMs(pxNet));
     }
+    else if (retVal == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        res = prvWait(pxNet, pxNet->xFd.fd, POLLOUT, prvGetSocketTimeoutMs(pxNet));
+    }
+
+    return res;
 }
 
-int NetIo_send(NetIoHandle xNetIoHandle, const unsigned char *pBuffer, size_t uBytesToSend)
+/* Move received bytes to xFd through a pipe, as splice() needs one on either side. The pipe is drained before returning, so it's empty
+ * whenever the socket is spliced into it. */
+static int prvSplice(NetIo_t *pxNet, int xFd, size_t uLen, size_t *puBytesSpliced)
 {
-    int n = 0;
     int res = NETIO_ERRNO_NONE;
-    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
-    size_t uBytesRemaining = uBytesToSend;
-    char *pIndex = (char *)pBuffer;
+#if defined(__linux__)
+    int xFlags = fcntl(xFd, F_GETFL, 0);
+    ssize_t n = 0;
+    ssize_t m = 0;
 
-    if (pxNet == NULL || pBuffer == NULL)
+    if (xFlags < 0 || (xFlags & O_APPEND) != 0)
     {
-        res = NETIO_ERRNO_INVALID_PARAMETER;
+        /* splice() can't write to a file opened for appending */
+        res = NETIO_ERRNO_NOT_SUPPORTED;
+    }
+    else if (pxNet->xSplicePipe[0] < 0 && pipe(pxNet->xSplicePipe) != 0)
+    {
+        pxNet->xSplicePipe[0] = -1;
+        pxNet->xSplicePipe[1] = -1;
+        res = NETIO_ERRNO_OUT_OF_MEMORY;
     }
     else
     {
-        do
+        while (res == NETIO_ERRNO_NONE && (n = splice(pxNet->xFd.fd, NULL, pxNet->xSplicePipe[1], NULL, uLen, SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) < 0)
         {
-            n = mbedtls_ssl_write(&(pxNet->xSsl), (const unsigned char *)pIndex, uBytesRemaining);
-            if (n < 0)
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
             {
-                res = NETIO_ERRNO_SSL_WRITE_ERROR;
-                break;
+                res = prvWait(pxNet, pxNet->xFd.fd, POLLIN, pxNet->uRecvTimeoutMs);
             }
-            else if (n > uBytesRemaining)
+            else if (errno != EINTR)
             {
-                res = NETIO_ERRNO_SEND_MORE_THAN_REMAINING_DATA;
-                break;
+                /* Ex: kTLS refuses to splice a record which is not application data, such as an alert. */
+                res = NETIO_ERRNO_SSL_READ_ERROR;
             }
-            uBytesRemaining -= n;
-            pIndex += n;
-        } while (uBytesRemaining > 0);
+        }
+
+        *puBytesSpliced = (res == NETIO_ERRNO_NONE) ? (size_t)n : 0;
+        while (res == NETIO_ERRNO_NONE && n > 0)
+        {
+            if ((m = splice(pxNet->xSplicePipe[0], NULL, xFd, NULL, (size_t)n, SPLICE_F_MOVE)) > 0)
+            {
+                n -= m;
+            }
+            else if (m < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                res = prvWait(pxNet, xFd, POLLOUT, pxNet->uRecvTimeoutMs);
+            }
+            else if (m == 0 || errno != EINTR)
+            {
+                res = NETIO_ERRNO_WRITE_FAILED;
+            }
+        }
+
+        if (n > 0)
+        {
+            /* The bytes left in the pipe are lost, and the next splice needs an empty pipe. */
+            close(pxNet->xSplicePipe[0]);
+            close(pxNet->xSplicePipe[1]);
+            pxNet->xSplicePipe[0] = -1;
+            pxNet->xSplicePipe[1] = -1;
+        }
     }
+#else
+    res = NETIO_ERRNO_NOT_SUPPORTED;
+#endif
 
     return res;
 }
 
-int NetIo_recv(NetIoHandle xNetIoHandle, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+static void prvReleaseResolver(Resolver_t *pxResolver)
+{
+    if (__atomic_sub_fetch(&(pxResolver->uRefs), 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (pxResolver->pxAddrList != NULL)
+        {
+            freeaddrinfo(pxResolver->pxAddrList);
+        }
+        close(pxResolver->xPipe[0]);
+        close(pxResolver->xPipe[1]);
+        Allocator_free(pxResolver);
+    }
+}
+
+static void *prvResolverThread(void *pArg)
+{
+    Resolver_t *pxResolver = (Resolver_t *)pArg;
+    struct addrinfo xHints = {0};
+    uint8_t uByte = 1;
+
+    xHints.ai_family = AF_UNSPEC;
+    xHints.ai_socktype = SOCK_STREAM;
+    xHints.ai_protocol = IPPROTO_TCP;
+    pxResolver->retVal = getaddrinfo(pxResolver->pcHost, pxResolver->pcPort, &xHints, &(pxResolver->pxAddrList));
+
+    /* The write publishes the result to the caller, which reads it only after poll() sees the byte. */
+    while (write(pxResolver->xPipe[1], &uByte, 1) < 0 && errno == EINTR)
+    {
+    }
+    prvReleaseResolver(pxResolver);
+
+    return NULL;
+}
+
+static int prvResolve(NetIo_t *pxNet, const char *pcHost, const char *pcPort, struct addrinfo **ppxAddrList)
 {
-    int n;
     int res = NETIO_ERRNO_NONE;
-    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    struct addrinfo xHints = {0};
+    Resolver_t *pxResolver = NULL;
+    size_t uHostLen = strlen(pcHost);
+    size_t uPortLen = strlen(pcPort);
+    pthread_attr_t xAttr;
+    pthread_t xThread;
 
-    if (pxNet == NULL || pBuffer == NULL || puBytesReceived == NULL)
+    if (pxNet->uDeadlineMs == 0 && pxNet->xCancelToken == NULL)
     {
-        res = NETIO_ERRNO_INVALID_PARAMETER;
+        xHints.ai_family = AF_UNSPEC;
+        xHints.ai_socktype = SOCK_STREAM;
+        xHints.ai_protocol = IPPROTO_TCP;
+        if (getaddrinfo(pcHost, pcPort, &xHints, ppxAddrList) != 0)
+        {
+            res = NETIO_ERRNO_NET_UNKNOWN_HOST;
+        }
+    }
+    else if ((pxResolver = (Resolver_t *)Allocator_calloc(1, sizeof(Resolver_t) + uHostLen + uPortLen + 2)) == NULL)
+    {
+        res = NETIO_ERRNO_OUT_OF_MEMORY;
+    }
+    else if (pipe(pxResolver->xPipe) != 0)
+    {
+        Allocator_free(pxResolver);
+        res = NETIO_ERRNO_NET_SOCKET_FAILED;
     }
     else
     {
-        n = mbedtls_ssl_read(&(pxNet->xSsl), pBuffer, uBufferSize);
-        if (n < 0)
+        memcpy(pxResolver->pNames, pcHost, uHostLen + 1);
+        memcpy(pxResolver->pNames + uHostLen + 1, pcPort, uPortLen + 1);
+        pxResolver->pcHost = pxResolver->pNames;
+        pxResolver->pcPort = pxResolver->pNames + uHostLen + 1;
+        pxResolver->uRefs = 2;
+
+        pthread_attr_init(&xAttr);
+        pthread_attr_setdetachstate(&xAttr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&xThread, &xAttr, prvResolverThread, pxResolver) != 0)
         {
-            res = NETIO_ERRNO_SSL_READ_ERROR;
+            pxResolver->uRefs = 1;
+            res = NETIO_ERRNO_OUT_OF_MEMORY;
+        }
+        else if ((res = prvWait(pxNet, pxResolver->xPipe[0], POLLIN, 0)) != NETIO_ERRNO_NONE)
+        {
+            /* Leave the thread behind, it frees the resolver when it's done. */
         }
-        else if (n > uBufferSize)
+        else if (pxResolver->retVal != 0)
         {
-            res = NETIO_ERRNO_RECV_MORE_THAN_AVAILABLE_SPACE;
+            res = NETIO_ERRNO_NET_UNKNOWN_HOST;
         }
         else
         {
-            *puBytesReceived = n;
+            *ppxAddrList = pxResolver->pxAddrList;
+            pxResolver->pxAddrList = NULL;
         }
+        pthread_attr_destroy(&xAttr);
+
+        prvReleaseResolver(pxResolver);
     }
 
     return res;
 }
 
-int NetIo_setRecvTimeout(NetIoHandle xNetIoHandle, unsigned int uRecvTimeoutMs)
+static int prvConnectAddress(NetIo_t *pxNet, const struct addrinfo *pxAddr)
 {
     int res = NETIO_ERRNO_NONE;
-    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    int fd = -1;
+    int xError = 0;
+    socklen_t uErrorLen = sizeof(xError);
 
-    if (pxNet == NULL)
+    if ((fd = (int)socket(pxAddr->ai_family, pxAddr->ai_socktype, pxAddr->ai_protocol)) < 0 || prvSetNonBlocking(fd) != 0)
     {
-        res = NETIO_ERRNO_INVALID_PARAMETER;
+        res = NETIO_ERRNO_NET_SOCKET_FAILED;
+    }
+    else if (connect(fd, pxAddr->ai_addr, pxAddr->ai_addrlen) == 0)
+    {
+        /* Connected right away, ex: to the loopback */
+    }
+    else if (errno != EINPROGRESS)
+    {
+        res = NETIO_ERRNO_NET_CONNECT_FAILED;
+    }
+    else if ((res = prvWait(pxNet, fd, POLLOUT, prvGetSocketTimeoutMs(pxNet))) != NETIO_ERRNO_NONE)
+    {
+        /* An address which doesn't answer in time is skipped like one which refuses. The next one gets what is left of the timeout. */
+        res = (res == NETIO_ERRNO_TIMEOUT) ? NETIO_ERRNO_NET_CONNECT_FAILED : res;
+    }
+    else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &xError, &uErrorLen) != 0 || xError != 0)
+    {
+        res = NETIO_ERRNO_NET_CONNECT_FAILED;
+    }
+
+    if (res == NETIO_ERRNO_NONE)
+    {
+        pxNet->xFd.fd = fd;
+    }
+    else if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return res;
+}
+
+/* Like mbedtls_net_connect(), but the socket is non-blocking, so every step can be bounded by the deadline and cancelled. */
+static int prvConnectSocket(NetIo_t *pxNet, const char *pcHost, const char *pcPort)
+{
+    int res = NETIO_ERRNO_NONE;
+    struct addrinfo *pxAddrList = NULL;
+    struct addrinfo *pxAddr = NULL;
+
+    if ((res = prvResolve(pxNet, pcHost, pcPort, &pxAddrList)) != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error */
     }
     else
     {
-        pxNet->uRecvTimeoutMs = (uint32_t)uRecvTimeoutMs;
-        mbedtls_ssl_conf_read_timeout(&(pxNet->xConf), pxNet->uRecvTimeoutMs);
+        res = NETIO_ERRNO_NET_UNKNOWN_HOST;
+        for (pxAddr = pxAddrList; pxAddr != NULL; pxAddr = pxAddr->ai_next)
+        {
+            res = prvConnectAddress(pxNet, pxAddr);
+            if (res != NETIO_ERRNO_NET_SOCKET_FAILED && res != NETIO_ERRNO_NET_CONNECT_FAILED)
+            {
+                break;
+            }
+        }
+        freeaddrinfo(pxAddrList);
+    }
+
+    if (res == NETIO_ERRNO_NONE)
+    {
+        /* The socket is tuned before the handshake, so the handshake benefits too. */
+        prvApplySocketOptions(pxNet);
     }
 
     return res;
-}
\ No newline at end of file
+}
+
+#if defined(NETIO_KTLS)
+/* The key block of an AEAD suite is the client key, the server key, the client salt and the server salt, without MAC keys. */
+static int prvOnExportKeys(void *pArg, const unsigned char *pMasterSecret, const unsigned char *pKeyBlock, size_t uMacLen, size_t uKeyLen, size_t uIvLen)
+{
+    NetIo_t *pxNet = (NetIo_t *)pArg;
+
+    if (uMacLen == 0 && uKeyLen <= NETIO_KTLS_MAX_KEY_LEN && uIvLen == NETIO_KTLS_SALT_LEN)
+    {
+        memcpy(pxNet->pServerKey, pKeyBlock + uKeyLen, uKeyLen);
+        memcpy(pxNet->pServerSalt, pKeyBlock + 2 * uKeyLen + uIvLen, uIvLen);
+        pxNet->uServerKeyLen = uKeyLen;
+    }
+
+    return 0;
+}
+
+/* Hand the decryption of the received records to the kernel. It's only done for TLS 1.2 with AES-GCM, and before anything is received
+ * after the handshake, so the kernel starts at the record which mbedtls would read next. */
+static bool prvEnableKernelTlsRx(NetIo_t *pxNet)
+{
+    bool bEnabled = false;
+    const mbedtls_ssl_ciphersuite_t *pxSuite = mbedtls_ssl_ciphersuite_from_string(mbedtls_ssl_get_ciphersuite(&(pxNet->xSsl)));
+    struct tls12_crypto_info_aes_gcm_128 xInfo128;
+    struct tls12_crypto_info_aes_gcm_256 xInfo256;
+
+    memset(&xInfo128, 0, sizeof(xInfo128));
+    memset(&xInfo256, 0, sizeof(xInfo256));
+
+    if (pxSuite == NULL || pxNet->xSsl.minor_ver != MBEDTLS_SSL_MINOR_VERSION_3 || pxNet->uServerKeyLen == 0 ||
+        mbedtls_ssl_get_bytes_avail(&(pxNet->xSsl)) > 0 || mbedtls_ssl_check_pending(&(pxNet->xSsl)))
+    {
+        /* Stay with mbedtls */
+    }
+    else if (setsockopt(pxNet->xFd.fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+    {
+        /* The tls module isn't loaded, or the kernel has no kTLS. The socket is unchanged. */
+    }
+    else if (pxSuite->cipher == MBEDTLS_CIPHER_AES_128_GCM && pxNet->uServerKeyLen == TLS_CIPHER_AES_GCM_128_KEY_SIZE)
+    {
+        xInfo128.info.version = TLS_1_2_VERSION;
+        xInfo128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        memcpy(xInfo128.key, pxNet->pServerKey, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+        memcpy(xInfo128.salt, pxNet->pServerSalt, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+        memcpy(xInfo128.iv, pxNet->xSsl.in_ctr, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+        memcpy(xInfo128.rec_seq, pxNet->xSsl.in_ctr, TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+        bEnabled = (setsockopt(pxNet->xFd.fd, SOL_TLS, TLS_RX, &xInfo128, sizeof(xInfo128)) == 0);
+    }
+    else if (pxSuite->cipher == MBEDTLS_CIPHER_AES_256_GCM && pxNet->uServerKeyLen == TLS_CIPHER_AES_GCM_256_KEY_SIZE)
+    {
+        xInfo256.info.version = TLS_1_2_VERSION;
+        xInfo256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        memcpy(xInfo256.key, pxNet->pServerKey, TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+        memcpy(xInfo256.salt, pxNet->pServerSalt, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+        memcpy(xInfo256.iv, pxNet->xSsl.in_ctr, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+        memcpy(xInfo256.rec_seq, pxNet->xSsl.in_ctr, TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+        bEnabled = (setsockopt(pxNet->xFd.fd, SOL_TLS, TLS_RX, &xInfo256, sizeof(xInfo256)) == 0);
+    }
+
+    /* Without a TLS_RX the ULP passes the records through, so mbedtls goes on as before. */
+    mbedtls_platform_zeroize(&xInfo128, sizeof(xInfo128));
+    mbedtls_platform_zeroize(&xInfo256, sizeof(xInfo256));
+    mbedtls_platform_zeroize(pxNet->pServerKey, sizeof(pxNet->pServerKey));
+    pxNet->uServerKeyLen = 0;
+
+    return bEnabled;
+}
+#endif
+
+static int prvInitConfig(NetIo_t *pxNet, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = NETIO_ERRNO_NONE;
+    int retVal = 0;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        mbedtls_ssl_set_bio(&(pxNet->xSsl), &(pxNet->xFd), mbedtls_net_send, mbedtls_net_recv, NULL);
+
+        if ((retVal = mbedtls_ssl_config_defaults(&(pxNet->xConf), MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
+        {
+            res = NETIO_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            mbedtls_ssl_conf_rng(&(pxNet->xConf), mbedtls_ctr_drbg_random, &(pxNet->xCtrDrbg));
+            mbedtls_ssl_conf_ciphersuites(&(pxNet->xConf), prvGetCiphersuites());
+#if defined(NETIO_KTLS)
+            if (pxNet->xSocketOptions.bKernelTls)
+            {
+                mbedtls_ssl_conf_export_keys_cb(&(pxNet->xConf), prvOnExportKeys, pxNet);
+            }
+#endif
+
+            if (pxNet->ppAlpnProtocols != NULL && (retVal = mbedtls_ssl_conf_alpn_protocols(&(pxNet->xConf), pxNet->ppAlpnProtocols)) != 0)
+            {
+                res = NETIO_ERRNO_INVALID_PARAMETER;
+            }
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+            else if (pxNet->uMaxFragLenCode != MBEDTLS_SSL_MAX_FRAG_LEN_NONE && (retVal = mbedtls_ssl_conf_max_frag_len(&(pxNet->xConf), pxNet->uMaxFragLenCode)) != 0)
+            {
+                res = NETIO_ERRNO_INVALID_PARAMETER;
+            }
+#endif
+            else if (pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL)
+            {
+                if ((retVal = mbedtls_x509_crt_parse(pxNet->pRootCA, (void *)pcRootCA, strlen(pcRootCA) + 1)) != 0 ||
+                    (retVal = mbedtls_x509_crt_parse(pxNet->pCert, (void *)pcCert, strlen(pcCert) + 1)) != 0 ||
+                    (retVal = mbedtls_pk_parse_key(pxNet->pPrivKey, (void *)pcPrivKey, strlen(pcPrivKey) + 1, NULL, 0)) != 0)
+                {
+                    res = NETIO_ERRNO_UNABLE_TO_PARSE_CERT;
+                }
+                else
+                {
+                    mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_REQUIRED);
+                    mbedtls_ssl_conf_ca_chain(&(pxNet->xConf), pxNet->pRootCA, NULL);
+
+                    if ((retVal = mbedtls_ssl_conf_own_cert(&(pxNet->xConf), pxNet->pCert, pxNet->pPrivKey)) != 0)
+                    {
+                        res = NETIO_ERRNO_OUT_OF_MEMORY;
+                    }
+                }
+            }
+            else
+            {
+                /* With a trust store, the chain is verified by the store right after the handshake, so a cached verification can skip the
+                 * validation. The handshake still proves the server owns the key of the leaf certificate. */
+                mbedtls_ssl_conf_authmode(&(pxNet->xConf), MBEDTLS_SSL_VERIFY_NONE);
+            }
+        }
+    }
+
+    if (res == NETIO_ERRNO_NONE)
+    {
+        if ((retVal = mbedtls_ssl_setup(&(pxNet->xSsl), &(pxNet->xConf))) != 0)
+        {
+            res = NETIO_ERRNO_OUT_OF_MEMORY;
+        }
+    }
+
+    return res;
+}
+
+static int prvHandshake(NetIo_t *pxNet)
+{
+    int res = NETIO_ERRNO_NONE;
+    int retVal = 0;
+
+    while (res == NETIO_ERRNO_NONE && (retVal = mbedtls_ssl_handshake(&(pxNet->xSsl))) != 0)
+    {
+        res = prvWaitForSsl(pxNet, retVal, NETIO_ERRNO_SSL_HANDSHAKE_ERROR);
+    }
+
+    return res;
+}
+
+static int prvConnect(NetIo_t *pxNet, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = NETIO_ERRNO_NONE;
+
+    if (pxNet == NULL || pcHost == NULL || pcPort == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else if ((pcRootCA != NULL && pcCert != NULL && pcPrivKey != NULL) && (res = prvCreateX509Cert(pxNet)) != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (mbedtls_ctr_drbg_seed(&(pxNet->xCtrDrbg), mbedtls_entropy_func, &(pxNet->xEntropy), NULL, 0) != 0)
+    {
+        /* It's seeded here rather than at create, so the handles of other transports don't gather entropy. */
+        res = NETIO_ERRNO_OUT_OF_MEMORY;
+    }
+    else if ((res = prvConnectSocket(pxNet, pcHost, pcPort)) != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if ((res = prvInitConfig(pxNet, pcRootCA, pcCert, pcPrivKey)) != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if ((res = prvHandshake(pxNet)) != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (pxNet->xTrustStore != NULL && pcRootCA == NULL &&
+             TrustStore_verifyPeer(pxNet->xTrustStore, mbedtls_ssl_get_peer_cert(&(pxNet->xSsl)), pcHost) != TRUST_STORE_ERRNO_NONE)
+    {
+        res = NETIO_ERRNO_SSL_VERIFY_FAILED;
+    }
+#if defined(NETIO_KTLS)
+    else if (pxNet->xSocketOptions.bKernelTls)
+    {
+        /* A connection which the kernel doesn't take stays with mbedtls. */
+        pxNet->bKernelTlsRx = prvEnableKernelTlsRx(pxNet);
+    }
+#endif
+    else
+    {
+        /* nop */
+    }
+
+    return res;
+}
+
+static int prvTlsConnect(PollyTransportHandle xTransport, NetIoHandle xNetIo, const char *pcHost, const char *pcPort, void **ppConn)
+{
+    return prvConnect((NetIo_t *)xNetIo, pcHost, pcPort, NULL, NULL, NULL);
+}
+
+static void prvTlsDisconnect(NetIoHandle xNetIo, void *pConn)
+{
+    mbedtls_ssl_close_notify(&(((NetIo_t *)xNetIo)->xSsl));
+}
+
+static int prvTlsSend(NetIoHandle xNetIo, void *pConn, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    int n = 0;
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+    size_t uBytesRemaining = uBytesToSend;
+    char *pIndex = (char *)pBuffer;
+
+    do
+    {
+        n = mbedtls_ssl_write(&(pxNet->xSsl), (const unsigned char *)pIndex, uBytesRemaining);
+        if (n < 0)
+        {
+            /* The same data is written again once the socket takes more. */
+            if ((res = prvWaitForSsl(pxNet, n, NETIO_ERRNO_SSL_WRITE_ERROR)) != NETIO_ERRNO_NONE)
+            {
+                break;
+            }
+            continue;
+        }
+        else if (n > uBytesRemaining)
+        {
+            res = NETIO_ERRNO_SEND_MORE_THAN_REMAINING_DATA;
+            break;
+        }
+        uBytesRemaining -= n;
+        pIndex += n;
+    } while (uBytesRemaining > 0);
+
+    return res;
+}
+
+#if defined(NETIO_KTLS)
+/* A read returns the data of the records which the kernel decrypted. Any other record, ex: an alert, is returned on its own with its type,
+ * and it breaks the connection like it does in mbedtls_ssl_read(). */
+static int prvKernelTlsRecv(NetIo_t *pxNet, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    int res = NETIO_ERRNO_NONE;
+    struct msghdr xMsg;
+    struct iovec xIov;
+    union
+    {
+        struct cmsghdr xAlign;
+        char pBuf[CMSG_SPACE(sizeof(unsigned char))];
+    } xControl;
+    struct cmsghdr *pxCmsg = NULL;
+    ssize_t n = 0;
+
+    memset(&xMsg, 0, sizeof(xMsg));
+    xIov.iov_base = pBuffer;
+    xIov.iov_len = uBufferSize;
+    xMsg.msg_iov = &xIov;
+    xMsg.msg_iovlen = 1;
+    xMsg.msg_control = xControl.pBuf;
+    xMsg.msg_controllen = sizeof(xControl.pBuf);
+
+    while (res == NETIO_ERRNO_NONE && (n = recvmsg(pxNet->xFd.fd, &xMsg, 0)) < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            res = prvWait(pxNet, pxNet->xFd.fd, POLLIN, pxNet->uRecvTimeoutMs);
+        }
+        else if (errno != EINTR)
+        {
+            res = NETIO_ERRNO_SSL_READ_ERROR;
+        }
+    }
+
+    if (res != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if ((pxCmsg = CMSG_FIRSTHDR(&xMsg)) != NULL && pxCmsg->cmsg_level == SOL_TLS && pxCmsg->cmsg_type == TLS_GET_RECORD_TYPE &&
+             *CMSG_DATA(pxCmsg) != MBEDTLS_SSL_MSG_APPLICATION_DATA)
+    {
+        res = NETIO_ERRNO_SSL_READ_ERROR;
+    }
+    else
+    {
+        *puBytesReceived = (size_t)n;
+    }
+
+    return res;
+}
+#endif
+
+static int prvSslRecv(NetIo_t *pxNet, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    int n;
+    int res = NETIO_ERRNO_NONE;
+
+    while ((n = mbedtls_ssl_read(&(pxNet->xSsl), pBuffer, uBufferSize)) < 0 &&
+           (res = prvWaitForSsl(pxNet, n, NETIO_ERRNO_SSL_READ_ERROR)) == NETIO_ERRNO_NONE)
+    {
+    }
+
+    if (res != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error */
+    }
+    else if (n > uBufferSize)
+    {
+        res = NETIO_ERRNO_RECV_MORE_THAN_AVAILABLE_SPACE;
+    }
+    else
+    {
+        *puBytesReceived = n;
+    }
+
+    return res;
+}
+
+static int prvTlsRecv(NetIoHandle xNetIo, void *pConn, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+
+#if defined(NETIO_KTLS)
+    return pxNet->bKernelTlsRx ? prvKernelTlsRecv(pxNet, pBuffer, uBufferSize, puBytesReceived) : prvSslRecv(pxNet, pBuffer, uBufferSize, puBytesReceived);
+#else
+    return prvSslRecv(pxNet, pBuffer, uBufferSize, puBytesReceived);
+#endif
+}
+
+static int prvTlsSplice(NetIoHandle xNetIo, void *pConn, int xFd, size_t uLen, size_t *puBytesSpliced)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+
+    /* The records which mbedtls decrypts have to go through its buffers. */
+    return pxNet->bKernelTlsRx ? prvSplice(pxNet, xFd, uLen, puBytesSpliced) : NETIO_ERRNO_NOT_SUPPORTED;
+}
+
+static bool prvTlsHasPendingData(NetIoHandle xNetIo, void *pConn)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+
+    return mbedtls_ssl_get_bytes_avail(&(pxNet->xSsl)) > 0 || mbedtls_ssl_check_pending(&(pxNet->xSsl));
+}
+
+/* An idle connection has nothing to read, so a readable socket means EOF, an alert or an error. */
+static bool prvIsIdleSocketAlive(NetIo_t *pxNet)
+{
+    struct pollfd xPollFd = {0};
+
+    xPollFd.fd = pxNet->xFd.fd;
+    xPollFd.events = POLLIN;
+
+    return xPollFd.fd >= 0 && poll(&xPollFd, 1, 0) == 0;
+}
+
+static bool prvTlsIsIdleConnectionAlive(NetIoHandle xNetIo, void *pConn)
+{
+    return !prvTlsHasPendingData(xNetIo, pConn) && prvIsIdleSocketAlive((NetIo_t *)xNetIo);
+}
+
+static const char *prvTlsGetAlpnProtocol(NetIoHandle xNetIo, void *pConn)
+{
+    return mbedtls_ssl_get_alpn_protocol(&(((NetIo_t *)xNetIo)->xSsl));
+}
+
+static const char *prvTlsGetCiphersuite(NetIoHandle xNetIo, void *pConn)
+{
+    return mbedtls_ssl_get_ciphersuite(&(((NetIo_t *)xNetIo)->xSsl));
+}
+
+static size_t prvTlsGetMemoryUsage(NetIoHandle xNetIo, void *pConn)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+    size_t uBytes = 0;
+
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    /* The buffers are resized to the negotiated fragment length after the handshake. */
+    uBytes += (pxNet->xSsl.in_buf != NULL) ? pxNet->xSsl.in_buf_len : 0;
+    uBytes += (pxNet->xSsl.out_buf != NULL) ? pxNet->xSsl.out_buf_len : 0;
+#else
+    uBytes += (pxNet->xSsl.in_buf != NULL) ? MBEDTLS_SSL_IN_BUFFER_LEN : 0;
+    uBytes += (pxNet->xSsl.out_buf != NULL) ? MBEDTLS_SSL_OUT_BUFFER_LEN : 0;
+#endif
+
+    return uBytes;
+}
+
+static PollyTransport_t gxTlsTransport =
+{
+    prvTlsConnect,
+    prvTlsDisconnect,
+    NULL,
+    prvTlsSend,
+    prvTlsRecv,
+    prvTlsSplice,
+    prvTlsHasPendingData,
+    prvTlsIsIdleConnectionAlive,
+    prvTlsGetAlpnProtocol,
+    prvTlsGetCiphersuite,
+    prvTlsGetMemoryUsage,
+    NULL
+};
+
+static int prvPlainConnect(PollyTransportHandle xTransport, NetIoHandle xNetIo, const char *pcHost, const char *pcPort, void **ppConn)
+{
+    return (pcHost == NULL || pcPort == NULL) ? NETIO_ERRNO_INVALID_PARAMETER : prvConnectSocket((NetIo_t *)xNetIo, pcHost, pcPort);
+}
+
+static void prvPlainDisconnect(NetIoHandle xNetIo, void *pConn)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+
+    if (pxNet->xFd.fd >= 0)
+    {
+        (void)shutdown(pxNet->xFd.fd, SHUT_WR);
+    }
+}
+
+/* mbedtls_net_send() and mbedtls_net_recv() report a socket which would block like SSL does, so the waits are the same as for TLS. */
+static int prvPlainSend(NetIoHandle xNetIo, void *pConn, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    int n = 0;
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+    size_t uBytesRemaining = uBytesToSend;
+
+    while (res == NETIO_ERRNO_NONE && uBytesRemaining > 0)
+    {
+        if ((n = mbedtls_net_send(&(pxNet->xFd), pBuffer, uBytesRemaining)) < 0)
+        {
+            res = prvWaitForSsl(pxNet, n, NETIO_ERRNO_SSL_WRITE_ERROR);
+        }
+        else
+        {
+            uBytesRemaining -= n;
+            pBuffer += n;
+        }
+    }
+
+    return res;
+}
+
+static int prvPlainRecv(NetIoHandle xNetIo, void *pConn, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    int n;
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIo;
+
+    while ((n = mbedtls_net_recv(&(pxNet->xFd), pBuffer, uBufferSize)) < 0 &&
+           (res = prvWaitForSsl(pxNet, n, NETIO_ERRNO_SSL_READ_ERROR)) == NETIO_ERRNO_NONE)
+    {
+    }
+
+    if (res == NETIO_ERRNO_NONE)
+    {
+        *puBytesReceived = n;
+    }
+
+    return res;
+}
+
+static int prvPlainSplice(NetIoHandle xNetIo, void *pConn, int xFd, size_t uLen, size_t *puBytesSpliced)
+{
+    return prvSplice((NetIo_t *)xNetIo, xFd, uLen, puBytesSpliced);
+}
+
+static bool prvPlainHasPendingData(NetIoHandle xNetIo, void *pConn)
+{
+    return false;
+}
+
+static bool prvPlainIsIdleConnectionAlive(NetIoHandle xNetIo, void *pConn)
+{
+    return prvIsIdleSocketAlive((NetIo_t *)xNetIo);
+}
+
+static const char *prvPlainGetProtocolInfo(NetIoHandle xNetIo, void *pConn)
+{
+    /* Nothing is negotiated, so a plain connection speaks HTTP/1.1. */
+    return NULL;
+}
+
+static size_t prvPlainGetMemoryUsage(NetIoHandle xNetIo, void *pConn)
+{
+    return 0;
+}
+
+static PollyTransport_t gxPlainTransport =
+{
+    prvPlainConnect,
+    prvPlainDisconnect,
+    NULL,
+    prvPlainSend,
+    prvPlainRecv,
+    prvPlainSplice,
+    prvPlainHasPendingData,
+    prvPlainIsIdleConnectionAlive,
+    prvPlainGetProtocolInfo,
+    prvPlainGetProtocolInfo,
+    prvPlainGetMemoryUsage,
+    NULL
+};
+
+NetIoHandle NetIo_create(void)
+{
+    NetIo_t *pxNet = NULL;
+
+    if ((pxNet = (NetIo_t *)Allocator_malloc(sizeof(NetIo_t))) != NULL)
+    {
+        memset(pxNet, 0, sizeof(NetIo_t));
+
+        mbedtls_net_init(&(pxNet->xFd));
+        mbedtls_ssl_init(&(pxNet->xSsl));
+        mbedtls_ssl_config_init(&(pxNet->xConf));
+        mbedtls_ctr_drbg_init(&(pxNet->xCtrDrbg));
+        mbedtls_entropy_init(&(pxNet->xEntropy));
+
+        pxNet->uRecvTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
+        pxNet->uConnectTimeoutMs = DEFAULT_CONNECTION_TIMEOUT_MS;
+        pxNet->pxTransport = &gxTlsTransport;
+        pxNet->xSplicePipe[0] = -1;
+        pxNet->xSplicePipe[1] = -1;
+    }
+
+    return pxNet;
+}
+
+void NetIo_terminate(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet != NULL)
+    {
+        if (pxNet->pConn != NULL)
+        {
+            pxNet->pxTransport->close(pxNet, pxNet->pConn);
+        }
+
+        mbedtls_ctr_drbg_free(&(pxNet->xCtrDrbg));
+        mbedtls_entropy_free(&(pxNet->xEntropy));
+        mbedtls_net_free(&(pxNet->xFd));
+        mbedtls_ssl_free(&(pxNet->xSsl));
+        mbedtls_ssl_config_free(&(pxNet->xConf));
+
+        if (pxNet->pRootCA != NULL)
+        {
+            mbedtls_x509_crt_free(pxNet->pRootCA);
+            Allocator_free(pxNet->pRootCA);
+            pxNet->pRootCA = NULL;
+        }
+
+        if (pxNet->pCert != NULL)
+        {
+            mbedtls_x509_crt_free(pxNet->pCert);
+            Allocator_free(pxNet->pCert);
+            pxNet->pCert = NULL;
+        }
+
+        if (pxNet->pPrivKey != NULL)
+        {
+            mbedtls_pk_free(pxNet->pPrivKey);
+            Allocator_free(pxNet->pPrivKey);
+            pxNet->pPrivKey = NULL;
+        }
+
+        if (pxNet->xSplicePipe[0] >= 0)
+        {
+            close(pxNet->xSplicePipe[0]);
+            close(pxNet->xSplicePipe[1]);
+        }
+
+        TrustStore_release(pxNet->xTrustStore);
+        Allocator_free(pxNet);
+    }
+}
+
+int NetIo_setTransport(NetIoHandle xNetIoHandle, PollyTransportHandle xTransport)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL || pxNet->pConn != NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pxNet->pxTransport = (xTransport != NULL) ? (PollyTransport_t *)xTransport : &gxTlsTransport;
+    }
+
+    return res;
+}
+
+PollyTransportHandle NetIo_getTlsTransport(void)
+{
+    return &gxTlsTransport;
+}
+
+PollyTransportHandle NetIo_getPlainTransport(void)
+{
+    return &gxPlainTransport;
+}
+
+/* The connect timeout starts with the connect, and bounds the TCP connect and the TLS handshake together. The deadline still bounds both. */
+static void prvBeginConnect(NetIo_t *pxNet)
+{
+    pxNet->bConnecting = true;
+    pxNet->uConnectEndMs = Port_getTimeMs() + pxNet->uConnectTimeoutMs;
+}
+
+int NetIo_connect(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        prvBeginConnect(pxNet);
+        res = pxNet->pxTransport->connect(pxNet->pxTransport, pxNet, pcHost, pcPort, &(pxNet->pConn));
+        pxNet->bConnecting = false;
+    }
+
+    return res;
+}
+
+int NetIo_connectWithX509(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort, const char *pcRootCA, const char *pcCert, const char *pcPrivKey)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL || pxNet->pxTransport != &gxTlsTransport)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        prvBeginConnect(pxNet);
+        res = prvConnect(pxNet, pcHost, pcPort, pcRootCA, pcCert, pcPrivKey);
+        pxNet->bConnecting = false;
+    }
+
+    return res;
+}
+
+void NetIo_disconnect(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet != NULL)
+    {
+        pxNet->pxTransport->disconnect(pxNet, pxNet->pConn);
+    }
+}
+
+int NetIo_send(NetIoHandle xNetIoHandle, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL || pBuffer == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        res = pxNet->pxTransport->send(pxNet, pxNet->pConn, pBuffer, uBytesToSend);
+    }
+
+    return res;
+}
+
+int NetIo_recv(NetIoHandle xNetIoHandle, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL || pBuffer == NULL || puBytesReceived == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+#if defined(TCP_QUICKACK)
+        /* Linux clears quick ACK mode by itself, so it's armed again before every read. */
+        if (pxNet->xSocketOptions.bTcpQuickAck && pxNet->xFd.fd >= 0)
+        {
+            prvSetSocketOption(pxNet->xFd.fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+        }
+#endif
+        res = pxNet->pxTransport->recv(pxNet, pxNet->pConn, pBuffer, uBufferSize, puBytesReceived);
+    }
+
+    return res;
+}
+
+int NetIo_splice(NetIoHandle xNetIoHandle, int xFd, size_t uLen, size_t *puBytesSpliced)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL || xFd < 0 || uLen == 0 || puBytesSpliced == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else if (pxNet->pxTransport->splice == NULL)
+    {
+        res = NETIO_ERRNO_NOT_SUPPORTED;
+    }
+    else
+    {
+        res = pxNet->pxTransport->splice(pxNet, pxNet->pConn, xFd, uLen, puBytesSpliced);
+    }
+
+    return res;
+}
+int NetIo_setRecvTimeout(NetIoHandle xNetIoHandle, unsigned int uRecvTimeoutMs)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pxNet->uRecvTimeoutMs = (uint32_t)uRecvTimeoutMs;
+    }
+
+    return res;
+}
+
+int NetIo_setConnectTimeout(NetIoHandle xNetIoHandle, unsigned int uConnectTimeoutMs)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pxNet->uConnectTimeoutMs = (uConnectTimeoutMs == 0) ? DEFAULT_CONNECTION_TIMEOUT_MS : (uint32_t)uConnectTimeoutMs;
+    }
+
+    return res;
+}
+
+int NetIo_setDeadline(NetIoHandle xNetIoHandle, uint64_t uDeadlineMs, PollyCancelTokenHandle xCancelToken)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pxNet->uDeadlineMs = uDeadlineMs;
+        pxNet->xCancelToken = xCancelToken;
+    }
+
+    return res;
+}
+
+int NetIo_setAlpnProtocols(NetIoHandle xNetIoHandle, const char **ppProtocols)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pxNet->ppAlpnProtocols = ppProtocols;
+    }
+
+    return res;
+}
+
+int NetIo_setTrustStore(NetIoHandle xNetIoHandle, PollyTrustStoreHandle xTrustStore)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        TrustStore_release(pxNet->xTrustStore);
+        pxNet->xTrustStore = TrustStore_acquire(xTrustStore);
+    }
+
+    return res;
+}
+
+int NetIo_setSocketOptions(NetIoHandle xNetIoHandle, const PollySocketOptions_t *pxSocketOptions)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL || pxSocketOptions == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        memcpy(&(pxNet->xSocketOptions), pxSocketOptions, sizeof(PollySocketOptions_t));
+    }
+
+    return res;
+}
+
+int NetIo_setMaxFragmentLength(NetIoHandle xNetIoHandle, unsigned int uMaxFragmentLen)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    if (pxNet == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    else if (uMaxFragmentLen == 0)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+    }
+    else if (uMaxFragmentLen == 512)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_512;
+    }
+    else if (uMaxFragmentLen == 1024)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+    }
+    else if (uMaxFragmentLen == 2048)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+    }
+    else if (uMaxFragmentLen == 4096)
+    {
+        pxNet->uMaxFragLenCode = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+    }
+#endif
+    else if (uMaxFragmentLen != 0)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+
+    return res;
+}
+
+size_t NetIo_getMemoryUsage(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    size_t uBytes = 0;
+
+    if (pxNet != NULL)
+    {
+        uBytes = sizeof(NetIo_t) + pxNet->pxTransport->getMemoryUsage(pxNet, pxNet->pConn);
+    }
+
+    return uBytes;
+}
+
+const char *NetIo_getAlpnProtocol(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    const char *pProtocol = NULL;
+
+    if (pxNet != NULL)
+    {
+        pProtocol = pxNet->pxTransport->getAlpnProtocol(pxNet, pxNet->pConn);
+    }
+
+    return pProtocol;
+}
+
+const char *NetIo_getCiphersuite(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+    const char *pCiphersuite = NULL;
+
+    if (pxNet != NULL)
+    {
+        pCiphersuite = pxNet->pxTransport->getCiphersuite(pxNet, pxNet->pConn);
+    }
+
+    return pCiphersuite;
+}
+
+bool NetIo_isIdleConnectionAlive(NetIoHandle xNetIoHandle)
+{
+    NetIo_t *pxNet = (NetIo_t *)xNetIoHandle;
+
+    return pxNet != NULL && pxNet->pxTransport->isIdleConnectionAlive(pxNet, pxNet->pConn);
+}
+int NetIo_waitReadable(NetIoHandle *pxNetIoHandles, size_t uCount, unsigned int uTimeoutMs, size_t *puReadyIndex)
+{
+    int res = NETIO_ERRNO_NONE;
+    NetIo_t *pxNet = NULL;
+    NetIo_t *pxFirst = NULL;
+    struct pollfd pxPollFds[NETIO_WAIT_MAX_HANDLES + 1]; // The last one is the cancellation token
+    uint64_t uNowMs = 0;
+    bool bReady = false;
+    int retVal = 0;
+    size_t i = 0;
+
+    if (pxNetIoHandles == NULL || uCount == 0 || uCount > NETIO_WAIT_MAX_HANDLES || puReadyIndex == NULL)
+    {
+        res = NETIO_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Data which is already buffered in the transport, ex: in the SSL context, won't wake up poll(), so check it first. */
+        for (i = 0; i < uCount && !bReady; i++)
+        {
+            pxNet = (NetIo_t *)pxNetIoHandles[i];
+            if (pxNet == NULL)
+            {
+                res = NETIO_ERRNO_INVALID_PARAMETER;
+                break;
+            }
+            else if (pxNet->pxTransport->hasPendingData(pxNet, pxNet->pConn))
+            {
+                *puReadyIndex = i;
+                bReady = true;
+            }
+            else
+            {
+                pxPollFds[i].fd = pxNet->xFd.fd;
+                pxPollFds[i].events = POLLIN;
+                pxPollFds[i].revents = 0;
+            }
+        }
+
+        if (res == NETIO_ERRNO_NONE && !bReady)
+        {
+            pxFirst = (NetIo_t *)pxNetIoHandles[0];
+            pxPollFds[uCount].fd = CancelToken_getFd(pxFirst->xCancelToken);
+            pxPollFds[uCount].events = POLLIN;
+            pxPollFds[uCount].revents = 0;
+            uNowMs = Port_getTimeMs();
+
+            if (CancelToken_isCancelled(pxFirst->xCancelToken))
+            {
+                res = NETIO_ERRNO_CANCELLED;
+            }
+            else if (pxFirst->uDeadlineMs != 0 && uNowMs >= pxFirst->uDeadlineMs)
+            {
+                res = NETIO_ERRNO_DEADLINE_EXCEEDED;
+            }
+            else if ((retVal = poll(pxPollFds, uCount + 1, prvGetWaitMs(uNowMs, (uTimeoutMs == 0) ? 0 : uNowMs + uTimeoutMs, pxFirst->uDeadlineMs))) < 0)
+            {
+                res = NETIO_ERRNO_POLL_FAILED;
+            }
+            else if (CancelToken_isCancelled(pxFirst->xCancelToken))
+            {
+                res = NETIO_ERRNO_CANCELLED;
+            }
+            else if (retVal == 0)
+            {
+                res = (pxFirst->uDeadlineMs != 0 && Port_getTimeMs() >= pxFirst->uDeadlineMs) ? NETIO_ERRNO_DEADLINE_EXCEEDED : NETIO_ERRNO_TIMEOUT;
+            }
+            else
+            {
+                for (i = 0; i < uCount; i++)
+                {
+                    if (pxPollFds[i].revents != 0)
+                    {
+                        *puReadyIndex = i;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return res;
+}
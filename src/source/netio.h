@@ -2,6 +2,10 @@
 #define NETIO_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "polly/polly.h"
 
 #define NETIO_ERRNO_NONE                            (0)
 #define NETIO_ERRNO_INVALID_PARAMETER               (-1)
@@ -16,6 +20,13 @@
 #define NETIO_ERRNO_SSL_HANDSHAKE_ERROR             (-9)
 #define NETIO_ERRNO_SSL_WRITE_ERROR                 (-10)
 #define NETIO_ERRNO_SSL_READ_ERROR                  (-11)
+#define NETIO_ERRNO_TIMEOUT                         (-12)
+#define NETIO_ERRNO_POLL_FAILED                     (-13)
+#define NETIO_ERRNO_SSL_VERIFY_FAILED               (-14)
+#define NETIO_ERRNO_DEADLINE_EXCEEDED               (-15)
+#define NETIO_ERRNO_CANCELLED                       (-16)
+#define NETIO_ERRNO_NOT_SUPPORTED                   (-17)
+#define NETIO_ERRNO_WRITE_FAILED                    (-18)
 
 typedef struct NetIo *NetIoHandle;
 
@@ -33,6 +44,29 @@ NetIoHandle NetIo_create(void);
  */
 void NetIo_terminate(NetIoHandle xNetIoHandle);
 
+/**
+ * @brief Carry the connection over another transport than TLS. It must be called before connecting.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] xTransport The transport, or NULL for TLS. It must outlive the handle.
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setTransport(NetIoHandle xNetIoHandle, PollyTransportHandle xTransport);
+
+/**
+ * @brief Get the transport which NetIo uses by default, TLS over TCP by mbedtls
+ *
+ * @return The transport, which is built in and never terminated
+ */
+PollyTransportHandle NetIo_getTlsTransport(void);
+
+/**
+ * @brief Get the transport of plain TCP, without TLS
+ *
+ * @return The transport, which is built in and never terminated
+ */
+PollyTransportHandle NetIo_getPlainTransport(void);
+
 /**
  * @brief Connect to a host with port
  *
@@ -44,7 +78,7 @@ void NetIo_terminate(NetIoHandle xNetIoHandle);
 int NetIo_connect(NetIoHandle xNetIoHandle, const char *pcHost, const char *pcPort);
 
 /**
- * @brief Connect to a host with port and X509 certificates
+ * @brief Connect to a host with port and X509 certificates. It's only supported by the TLS transport.
  *
  * @param[in] xNetIoHandle The network I/O handle
  * @param[in] pcHost The hostname
@@ -85,7 +119,21 @@ int NetIo_send(NetIoHandle xNetIoHandle, const unsigned char *pBuffer, size_t uB
 int NetIo_recv(NetIoHandle xNetIoHandle, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived);
 
 /**
- * @brief Configure receive timeout.
+ * @brief Receive data into a file descriptor, ex: a file or a pipe, without copying it through user space. It's supported on Linux by
+ * the plain transport, and by TLS once the kernel decrypts the records (bKernelTls of the socket options).
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] xFd The file descriptor to write to. It can't be opened with O_APPEND.
+ * @param[in] uLen The most bytes to move
+ * @param[out] puBytesSpliced The actual bytes moved, 0 if the connection is closed
+ * @return 0 on success, NETIO_ERRNO_NOT_SUPPORTED if the data has to be received by NetIo_recv(), NETIO_ERRNO_WRITE_FAILED if xFd
+ * doesn't take the data, other non-zero value otherwise
+ */
+int NetIo_splice(NetIoHandle xNetIoHandle, int xFd, size_t uLen, size_t *puBytesSpliced);
+
+/**
+ * @brief Configure receive timeout. It bounds every wait on the socket of a connected handle, so it also bounds a send which makes no
+ * progress.
  *
  * @param xNetIoHandle The network I/O handle
  * @param uRecvTimeoutMs Receive timeout in milliseconds
@@ -93,4 +141,110 @@ int NetIo_recv(NetIoHandle xNetIoHandle, unsigned char *pBuffer, size_t uBufferS
  */
 int NetIo_setRecvTimeout(NetIoHandle xNetIoHandle, unsigned int uRecvTimeoutMs);
 
+/**
+ * @brief Configure connect timeout. It bounds the TCP connect to every address of the host and the TLS handshake together, and a
+ * connect which runs out of it fails. The deadline of NetIo_setDeadline() bounds the connect too, whichever ends first.
+ *
+ * @param xNetIoHandle The network I/O handle
+ * @param uConnectTimeoutMs Connect timeout in milliseconds, or 0 for the default of 10 seconds
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setConnectTimeout(NetIoHandle xNetIoHandle, unsigned int uConnectTimeoutMs);
+
+/**
+ * @brief Bound everything the handle does from now on, including the resolve and the handshake of a connect, by the deadline and the
+ * cancellation token of a request. A wait which reaches the deadline fails with NETIO_ERRNO_DEADLINE_EXCEEDED, and one which is woken
+ * up by the token fails with NETIO_ERRNO_CANCELLED. The connection is broken afterwards.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] uDeadlineMs The deadline on the clock of Port_getTimeMs(), or 0 for none
+ * @param[in] xCancelToken The cancellation token, or NULL for none. It must outlive the deadline, so clear it when the request is done.
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setDeadline(NetIoHandle xNetIoHandle, uint64_t uDeadlineMs, PollyCancelTokenHandle xCancelToken);
+
+/**
+ * @brief Offer application protocols in the TLS handshake (ALPN). It must be called before connecting.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] ppProtocols NULL-terminated list of protocols in preference order, ex: { "h2", "http/1.1", NULL }. It must outlive the handle.
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setAlpnProtocols(NetIoHandle xNetIoHandle, const char **ppProtocols);
+
+/**
+ * @brief Verify the server certificate against a trust store. It must be called before connecting.
+ * The handle takes a reference of the store, which is released when the handle is terminated.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] xTrustStore The trust store, or NULL to skip verification
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setTrustStore(NetIoHandle xNetIoHandle, PollyTrustStoreHandle xTrustStore);
+
+/**
+ * @brief Tune the TCP socket. It must be called before connecting, and the options are applied right after the TCP connection is made.
+ * Options which the OS doesn't have or rejects keep their defaults.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] pxSocketOptions The socket options, which are copied
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setSocketOptions(NetIoHandle xNetIoHandle, const PollySocketOptions_t *pxSocketOptions);
+
+/**
+ * @brief Ask the server for smaller TLS records (max_fragment_length). It must be called before connecting.
+ * If the server accepts it, the incoming record buffer can shrink to the fragment length.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @param[in] uMaxFragmentLen 512, 1024, 2048 or 4096, or 0 to keep the default of 16 KB
+ * @return 0 on success, non-zero value otherwise
+ */
+int NetIo_setMaxFragmentLength(NetIoHandle xNetIoHandle, unsigned int uMaxFragmentLen);
+
+/**
+ * @brief Get the memory held by a connection. It counts the handle and the TLS record buffers, which dominate it.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @return Bytes in use
+ */
+size_t NetIo_getMemoryUsage(NetIoHandle xNetIoHandle);
+
+/**
+ * @brief Get the application protocol negotiated in the TLS handshake
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @return The protocol, or NULL if the server didn't choose one
+ */
+const char *NetIo_getAlpnProtocol(NetIoHandle xNetIoHandle);
+
+/**
+ * @brief Get the ciphersuite negotiated in the TLS handshake
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @return The name of the suite, or NULL if the handle is not connected
+ */
+const char *NetIo_getCiphersuite(NetIoHandle xNetIoHandle);
+
+/**
+ * @brief Check if an idle connection is still usable. A connection which is closed by the peer, or has unexpected data, is not usable.
+ *
+ * @param[in] xNetIoHandle The network I/O handle
+ * @return true if the connection is usable, false otherwise
+ */
+bool NetIo_isIdleConnectionAlive(NetIoHandle xNetIoHandle);
+
+/**
+ * @brief Wait until any of the connections has data to read. The deadline and the cancellation token of the first handle cut the
+ * wait short.
+ *
+ * @param[in] pxNetIoHandles The network I/O handles
+ * @param[in] uCount The number of handles
+ * @param[in] uTimeoutMs Timeout in milliseconds, 0 means wait forever
+ * @param[out] puReadyIndex The index of the first handle which is readable
+ * @return 0 on success, NETIO_ERRNO_TIMEOUT on timeout, NETIO_ERRNO_DEADLINE_EXCEEDED or NETIO_ERRNO_CANCELLED if the request of
+ * the first handle is over, other non-zero value otherwise
+ */
+int NetIo_waitReadable(NetIoHandle *pxNetIoHandles, size_t uCount, unsigned int uTimeoutMs, size_t *puReadyIndex);
+
 #endif /* NETIO_H */
\ No newline at end of file
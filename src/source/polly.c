@@ -1,273 +1,1709 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
-#include <time.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "polly/polly.h"
 
+#include "allocator.h"
+#include "buffer_pool.h"
+#include "cancel_token.h"
+#include "endpoint_router.h"
+#include "arena.h"
+#include "conn_pool.h"
+#include "http2.h"
+#include "frame_aligner.h"
 #include "http_parser.h"
-#include "sigv4.h"
 #include "netio.h"
+#include "port.h"
+#include "rate_limiter.h"
+#include "request.h"
+#include "retry_policy.h"
+#if defined(POLLY_STATIC_MEMORY)
+#include "mem_pool.h"
+#endif
 
 #define DEFAULT_HTTP_RECV_BUFSIZE   2048
 
-static int prvGenDateTimeIso8601(char pDateISO8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE])
+/* A response head which doesn't end within this many bytes is malformed. */
+#define MAX_HTTP_HEAD_SIZE          16384
+
+/* After the head, the body is reported as it arrives, so the buffer only grows for what the parser holds back, ex: the framing of a chunk.
+ * A buffer from the static pools is a power of two behind a header in one block, so the largest which fits is half the largest block. */
+#if defined(POLLY_STATIC_MEMORY)
+#define MAX_HTTP_RECV_BUFSIZE       (MEM_POOL_MAX_BLOCK_SIZE / 2)
+#else
+#define MAX_HTTP_RECV_BUFSIZE       SIZE_MAX
+#endif
+
+/* The length of the error body we keep to classify a failed request */
+#define HTTP_ERROR_BODY_MAX_LEN     512
+
+/* 16 hex digits hold any chunk size, and the rest of a longer line is its extensions */
+#define HTTP_CHUNK_SIZE_MAX_DIGITS  16
+
+/* A chunked response doesn't tell its length, so the audio buffer starts from an estimate of the speech which the text makes. */
+#define SPEECH_CHARS_PER_SEC            15
+#define SPEECH_COMPRESSED_BYTES_PER_SEC 6000 // mp3 and ogg_vorbis at 48 kbps
+#define SPEECH_MARKS_BYTES_PER_CHAR     16
+#define SPEECH_PCM_DEFAULT_SAMPLE_RATE  16000
+
+/* The memory which Polly_synthesizeSpeechToBuffer() receives the audio into. It's kept across the attempts of a request. */
+typedef struct
+{
+    uint8_t *pBuf;
+    size_t uSize;
+    size_t uLen;
+    size_t uEstimatedLen; // The size a chunked body starts from
+    uint64_t uAnnouncedLen; // The Content-Length of the last response, 0 if it was chunked
+    bool bOwned; // Allocated by the library, so it grows as needed
+} OutputBuffer_t;
+
+typedef struct
+{
+    bool bReusedConnection;
+    bool bKeepAlive;
+    uint32_t uTtfbMs;
+    size_t uBytesDelivered;
+    char pErrorBody[HTTP_ERROR_BODY_MAX_LEN + 1];
+    size_t uErrorBodyLen;
+    FrameAlignerHandle xFrameAligner; // NULL if the audio is delivered as it's received
+    int resDelivery;
+    uint64_t uDeadlineMs; // 0 if the request has no deadline
+    PollyCancelTokenHandle xCancelToken;
+    PollyPriority_t ePriority;
+    int xOutputFd; // -1 unless the audio is written to a file descriptor
+    OutputBuffer_t *pxOutputBuf; // NULL unless the audio is received into memory
+    bool bBodyBypassed; // The body is moved to the file or the buffer past the HTTP parser
+} SynthesizeSpeechAttempt_t;
+
+/* A response reader lives as long as the connection, so the data received after a response is kept for the next one. */
+typedef struct
+{
+    HttpParserHandle xHttpParser;
+    PollyBufferHandle xRecvBuffer; // Audio is delivered as slices of it, so it's replaced rather than overwritten while a slice is kept
+    char *pRecvBuf;
+    size_t uRecvBufSize;
+    size_t uBytesTotalReceived;
+} HttpResponseReader_t;
+
+typedef struct
+{
+    PollySynthesizeSpeechOutput_t *pOut;
+    Http2Request_t *pxReq;
+    SynthesizeSpeechAttempt_t xAttempt;
+    bool bAnswered; // A request which is not answered on the shared connection is sent again on its own
+    int res;
+} SynthesizeSpeechStream_t;
+
+/* HTTP/1.1 is offered as well, so the same connection serves a server which doesn't support HTTP/2. */
+static const char *gpAlpnProtocols[] = { "h2", "http/1.1", NULL };
+
+static int prvConnectAndSend(PollyServiceParameter_t *pServPara, SynthesizeSpeechAttempt_t *pxAttempt, const char *pHttpReq, size_t uHttpReqLen, bool bFreshConnection,
+                             NetIoHandle *pxNetIo, bool *pbReused)
+{
+    int res = POLLY_ERRNO_NONE;
+    NetIoHandle xNetIo = NULL;
+
+    *pbReused = false;
+
+    if (!bFreshConnection && (xNetIo = ConnPool_acquire(pServPara->xConnPool, pxAttempt->ePriority)) != NULL)
+    {
+        /* A pre-warmed or kept-alive connection skips DNS, TCP and TLS handshakes. */
+        *pbReused = true;
+    }
+    else if ((xNetIo = NetIo_create()) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else if (NetIo_setConnectTimeout(xNetIo, pServPara->uConnectTimeoutMs) != NETIO_ERRNO_NONE ||
+             NetIo_setMaxFragmentLength(xNetIo, pServPara->uTlsMaxFragmentLen) != NETIO_ERRNO_NONE ||
+             NetIo_setSocketOptions(xNetIo, &(pServPara->xSocketOptions)) != NETIO_ERRNO_NONE ||
+             NetIo_setTrustStore(xNetIo, pServPara->xTrustStore) != NETIO_ERRNO_NONE ||
+             NetIo_setTransport(xNetIo, pServPara->xTransport) != NETIO_ERRNO_NONE ||
+             NetIo_setDeadline(xNetIo, pxAttempt->uDeadlineMs, pxAttempt->xCancelToken) != NETIO_ERRNO_NONE)
+    {
+        res = POLLY_ERRNO_NET_CONFIG_FAILED;
+    }
+    else if (NetIo_connect(xNetIo, pServPara->pHost, (pServPara->pPort != NULL) ? pServPara->pPort : POLLY_DEFAULT_PORT) != NETIO_ERRNO_NONE)
+    {
+        res = POLLY_ERRNO_NET_CONNECT_FAILED;
+    }
+
+    if (res != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if (NetIo_setRecvTimeout(xNetIo, pServPara->uRecvTimeoutMs) != NETIO_ERRNO_NONE ||
+             NetIo_setDeadline(xNetIo, pxAttempt->uDeadlineMs, pxAttempt->xCancelToken) != NETIO_ERRNO_NONE)
+    {
+        res = POLLY_ERRNO_NET_CONFIG_FAILED;
+    }
+    else if (NetIo_send(xNetIo, (const unsigned char *)pHttpReq, uHttpReqLen) != NETIO_ERRNO_NONE)
+    {
+        res = POLLY_ERRNO_NET_SEND_FAILED;
+    }
+    else
+    {
+        *pxNetIo = xNetIo;
+    }
+
+    if (res != POLLY_ERRNO_NONE)
+    {
+        NetIo_terminate(xNetIo);
+    }
+
+    return res;
+}
+
+static void prvReleaseConnection(PollyServiceParameter_t *pServPara, NetIoHandle xNetIo)
+{
+    if (pServPara->xConnPool != NULL)
+    {
+        /* The next request which takes it brings its own deadline. */
+        NetIo_setDeadline(xNetIo, 0, NULL);
+        ConnPool_release(pServPara->xConnPool, xNetIo);
+    }
+    else
+    {
+        NetIo_terminate(xNetIo);
+    }
+}
+
+static void prvGetErrorTypeFromBody(const char *pBody, char pErrorType[POLLY_ERROR_TYPE_MAX_LEN])
+{
+    const char *p = NULL;
+    const char *pHash = NULL;
+    size_t uLen = 0;
+
+    /* The error body looks like: {"__type":"com.amazonaws.polly#ThrottlingException","message":"Rate exceeded"} */
+    if ((p = strstr(pBody, "\"__type\"")) != NULL && (p = strchr(p + sizeof("\"__type\"") - 1, ':')) != NULL && (p = strchr(p, '"')) != NULL)
+    {
+        p++;
+        while (p[uLen] != '\0' && p[uLen] != '"')
+        {
+            if (p[uLen] == '#')
+            {
+                pHash = p + uLen;
+            }
+            uLen++;
+        }
+        if (pHash != NULL)
+        {
+            uLen -= (pHash + 1 - p);
+            p = pHash + 1;
+        }
+        if (uLen >= POLLY_ERROR_TYPE_MAX_LEN)
+        {
+            uLen = POLLY_ERROR_TYPE_MAX_LEN - 1;
+        }
+        memcpy(pErrorType, p, uLen);
+        pErrorType[uLen] = '\0';
+    }
+}
+
+static int prvInitAttempt(SynthesizeSpeechAttempt_t *pxAttempt, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut, uint64_t uDeadlineMs,
+                          int xOutputFd, OutputBuffer_t *pxOutputBuf)
+{
+    int res = POLLY_ERRNO_NONE;
+    FrameFormat_t eFormat = FRAME_FORMAT_MP3;
+
+    memset(pxAttempt, 0, sizeof(SynthesizeSpeechAttempt_t));
+    pxAttempt->uDeadlineMs = uDeadlineMs;
+    pxAttempt->xCancelToken = pPara->xCancelToken;
+    pxAttempt->ePriority = pPara->ePriority;
+    pxAttempt->xOutputFd = xOutputFd;
+    pxAttempt->pxOutputBuf = pxOutputBuf;
+
+    if (pxOutputBuf != NULL)
+    {
+        /* Every attempt receives the audio from the start, and the callbacks are not used */
+        pxOutputBuf->uLen = 0;
+        pxOutputBuf->uAnnouncedLen = 0;
+    }
+    else if (xOutputFd >= 0)
+    {
+        /* The audio is written to the file, and the callbacks are not used */
+    }
+    else if (pOut->onFramesCallback == NULL)
+    {
+        /* The audio is delivered as it's received */
+    }
+    else if (pOut->onBufferCallback != NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else if (pPara->pOutputFormat == NULL || (strcmp(pPara->pOutputFormat, "mp3") != 0 && strcmp(pPara->pOutputFormat, "ogg_vorbis") != 0))
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        eFormat = (strcmp(pPara->pOutputFormat, "mp3") == 0) ? FRAME_FORMAT_MP3 : FRAME_FORMAT_OGG;
+        if ((pxAttempt->xFrameAligner = FrameAligner_create(eFormat)) == NULL)
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+    }
+
+    return res;
+}
+
+static void prvDeinitAttempt(SynthesizeSpeechAttempt_t *pxAttempt)
+{
+    FrameAligner_terminate(pxAttempt->xFrameAligner);
+    pxAttempt->xFrameAligner = NULL;
+}
+
+static int prvDeliverSlice(PollySynthesizeSpeechOutput_t *pOut, PollyBufferHandle xBuffer, uint8_t *pData, size_t uLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollyBufferSlice_t xSlice = { 0 };
+    PollyBufferHandle xCopy = NULL;
+
+    if (xBuffer == NULL)
+    {
+        /* The data doesn't live in a buffer of the pool, so it's copied into one the consumer can keep. */
+        if ((xCopy = BufferPool_acquire(uLen)) == NULL)
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            memcpy(BufferPool_getData(xCopy), pData, uLen);
+            pData = BufferPool_getData(xCopy);
+            xBuffer = xCopy;
+        }
+    }
+
+    if (res == POLLY_ERRNO_NONE)
+    {
+        xSlice.pData = pData;
+        xSlice.uLen = uLen;
+        xSlice.xBuffer = xBuffer;
+        pOut->onBufferCallback(&xSlice, pOut->pUserData);
+        PollyBuffer_release(xCopy);
+    }
+
+    return res;
+}
+
+static int prvWriteToFd(int xFd, const uint8_t *pData, size_t uLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    struct pollfd xPollFd = { 0 };
+    ssize_t n = 0;
+
+    xPollFd.fd = xFd;
+    xPollFd.events = POLLOUT;
+    while (res == POLLY_ERRNO_NONE && uLen > 0)
+    {
+        if ((n = write(xFd, pData, uLen)) > 0)
+        {
+            pData += n;
+            uLen -= (size_t)n;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            /* A non-blocking pipe is full until its reader catches up. */
+            (void)poll(&xPollFd, 1, -1);
+        }
+        else if (n == 0 || errno != EINTR)
+        {
+            res = POLLY_ERRNO_WRITE_FAILED;
+        }
+    }
+
+    return res;
+}
+
+/* Make room for uNeeded more bytes. Unless bExact, a buffer of the library at least doubles, so a chunked body is reallocated a few times at most. */
+static int prvReserveOutput(OutputBuffer_t *pxOutputBuf, uint64_t uNeeded, bool bExact)
+{
+    int res = POLLY_ERRNO_NONE;
+    uint8_t *pTemp = NULL;
+    size_t uSize = 0;
+
+    if (uNeeded <= pxOutputBuf->uSize - pxOutputBuf->uLen)
+    {
+        /* It fits already */
+    }
+    else if (!pxOutputBuf->bOwned)
+    {
+        res = POLLY_ERRNO_BUFFER_TOO_SMALL;
+    }
+    else if (uNeeded > SIZE_MAX - pxOutputBuf->uLen)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        uSize = pxOutputBuf->uLen + (size_t)uNeeded;
+        if (!bExact && pxOutputBuf->uSize <= SIZE_MAX / 2 && uSize < pxOutputBuf->uSize * 2)
+        {
+            uSize = pxOutputBuf->uSize * 2;
+        }
+
+        if ((pTemp = (uint8_t *)Allocator_realloc(pxOutputBuf->pBuf, uSize)) == NULL)
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            pxOutputBuf->pBuf = pTemp;
+            pxOutputBuf->uSize = uSize;
+        }
+    }
+
+    return res;
+}
+
+/* Size the buffer once the headers are parsed: exactly to the Content-Length, or to the estimate if the body is chunked. */
+static int prvPresizeOutput(OutputBuffer_t *pxOutputBuf, HttpParserHandle xHttpParser)
+{
+    int res = POLLY_ERRNO_NONE;
+    bool bChunked = false;
+    uint64_t uContentLength = 0;
+
+    if (Hp_getBodyFraming(xHttpParser, &bChunked, &uContentLength) != HTTP_PARSER_ERRNO_NONE || bChunked)
+    {
+        /* A buffer of the caller is used as it is, and the audio may well fit it. */
+        res = pxOutputBuf->bOwned ? prvReserveOutput(pxOutputBuf, pxOutputBuf->uEstimatedLen, true) : POLLY_ERRNO_NONE;
+    }
+    else
+    {
+        pxOutputBuf->uAnnouncedLen = uContentLength;
+        res = prvReserveOutput(pxOutputBuf, uContentLength, true);
+    }
+
+    return res;
+}
+
+/* Write the audio to the file, or copy it to the buffer */
+static int prvWriteOutput(SynthesizeSpeechAttempt_t *pxAttempt, const uint8_t *pData, size_t uLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    OutputBuffer_t *pxOutputBuf = pxAttempt->pxOutputBuf;
+
+    if (pxOutputBuf == NULL)
+    {
+        res = prvWriteToFd(pxAttempt->xOutputFd, pData, uLen);
+    }
+    else if ((res = prvReserveOutput(pxOutputBuf, uLen, false)) == POLLY_ERRNO_NONE)
+    {
+        memcpy(pxOutputBuf->pBuf + pxOutputBuf->uLen, pData, uLen);
+        pxOutputBuf->uLen += uLen;
+    }
+
+    return res;
+}
+
+/* xBuffer is the pool buffer which holds pData, or NULL if it lives elsewhere. */
+static int prvOnResponseData(PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt, PollyBufferHandle xBuffer, uint8_t *pData, size_t uLen)
+{
+    size_t uCopyLen = 0;
+    size_t uBytesDelivered = 0;
+
+    if (pxAttempt->resDelivery != POLLY_ERRNO_NONE)
+    {
+        /* The rest of a response which failed to be delivered is dropped */
+    }
+    else if (pOut->uStatusCode / 100 == 2)
+    {
+        if (pxAttempt->xOutputFd >= 0 || pxAttempt->pxOutputBuf != NULL)
+        {
+            /* Only a body which lasts until the connection closes goes through the parser. */
+            pxAttempt->resDelivery = prvWriteOutput(pxAttempt, pData, uLen);
+            pxAttempt->uBytesDelivered += (pxAttempt->resDelivery == POLLY_ERRNO_NONE) ? uLen : 0;
+        }
+        else if (pxAttempt->xFrameAligner != NULL)
+        {
+            /* Records and chunks split frames anywhere, so a partial frame is kept until the rest of it arrives. */
+            if (FrameAligner_push(pxAttempt->xFrameAligner, pData, uLen, pOut->onFramesCallback, pOut->pUserData, &uBytesDelivered) != FRAME_ALIGNER_ERRNO_NONE)
+            {
+                pxAttempt->resDelivery = POLLY_ERRNO_OUT_OF_MEMORY;
+            }
+            pxAttempt->uBytesDelivered += uBytesDelivered;
+        }
+        else if (pOut->onBufferCallback != NULL)
+        {
+            pxAttempt->resDelivery = prvDeliverSlice(pOut, xBuffer, pData, uLen);
+            pxAttempt->uBytesDelivered += (pxAttempt->resDelivery == POLLY_ERRNO_NONE) ? uLen : 0;
+        }
+        else
+        {
+            if (pOut->onDataCallback != NULL)
+            {
+                pOut->onDataCallback(pData, uLen, pOut->pUserData);
+            }
+            pxAttempt->uBytesDelivered += uLen;
+        }
+    }
+    else
+    {
+        /* Keep the head of the error body to classify the failure. */
+        uCopyLen = HTTP_ERROR_BODY_MAX_LEN - pxAttempt->uErrorBodyLen;
+        uCopyLen = (uLen < uCopyLen) ? uLen : uCopyLen;
+        memcpy(pxAttempt->pErrorBody + pxAttempt->uErrorBodyLen, pData, uCopyLen);
+        pxAttempt->uErrorBodyLen += uCopyLen;
+    }
+
+    return pxAttempt->resDelivery;
+}
+
+/* Replace the receive buffer by a new one of uSize bytes, which starts with the unparsed bytes from uOffset. */
+static int prvReplaceRecvBuffer(HttpResponseReader_t *pxReader, size_t uSize, size_t uOffset)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollyBufferHandle xBuffer = NULL;
+
+    if ((xBuffer = BufferPool_acquire(uSize)) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        memcpy(BufferPool_getData(xBuffer), pxReader->pRecvBuf + uOffset, pxReader->uBytesTotalReceived);
+        PollyBuffer_release(pxReader->xRecvBuffer);
+        pxReader->xRecvBuffer = xBuffer;
+        pxReader->pRecvBuf = (char *)BufferPool_getData(xBuffer);
+        pxReader->uRecvBufSize = BufferPool_getSize(xBuffer);
+    }
+
+    return res;
+}
+
+/* Drop the uOffset bytes at the front, and keep the uBytesTotalReceived bytes after them. If a consumer kept a slice, they go to another buffer instead. */
+static int prvDropRecvBytes(HttpResponseReader_t *pxReader, size_t uOffset)
+{
+    int res = POLLY_ERRNO_NONE;
+
+    if (uOffset == 0)
+    {
+        /* Nothing to drop */
+    }
+    else if (!BufferPool_isShared(pxReader->xRecvBuffer))
+    {
+        memmove(pxReader->pRecvBuf, pxReader->pRecvBuf + uOffset, pxReader->uBytesTotalReceived);
+    }
+    else
+    {
+        res = prvReplaceRecvBuffer(pxReader, pxReader->uRecvBufSize, uOffset);
+    }
+
+    return res;
+}
+
+static int prvSynthesizeSpeechParse(HttpResponseReader_t *pxReader, unsigned int *puHttpStatusCode, PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt)
+{
+    int res = POLLY_ERRNO_HTTP_WANT_MORE;
+    int resHttpParser = HTTP_PARSER_ERRNO_NONE;
+    size_t uOffset = 0;
+    size_t uBytesParsed = 0;
+    const char *pChunkLoc = NULL;
+    size_t uChunkLen = 0;
+    bool bHeadersComplete = false;
+    bool bChunked = false;
+    uint64_t uContentLength = 0;
+
+    /* One read may carry several data blocks, so parse until the parser wants more data, even after the last byte is parsed. */
+    while (res == POLLY_ERRNO_HTTP_WANT_MORE)
+    {
+        resHttpParser = Hp_parse(pxReader->xHttpParser, pxReader->pRecvBuf + uOffset, pxReader->uBytesTotalReceived, &uBytesParsed, puHttpStatusCode, &pChunkLoc, &uChunkLen);
+        if (resHttpParser == HTTP_PARSER_ERRNO_WANT_MORE_DATA)
+        {
+            break;
+        }
+        else if (resHttpParser != HTTP_PARSER_ERRNO_NONE)
+        {
+            res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+        }
+        else
+        {
+            bHeadersComplete = (*puHttpStatusCode != 0 && pOut->uStatusCode == 0);
+            if (*puHttpStatusCode != 0)
+            {
+                pOut->uStatusCode = *puHttpStatusCode;
+            }
+
+            if (pChunkLoc != NULL && uChunkLen > 0 &&
+                prvOnResponseData(pOut, pxAttempt, pxReader->xRecvBuffer, (uint8_t *)pChunkLoc, uChunkLen) != POLLY_ERRNO_NONE)
+            {
+                res = pxAttempt->resDelivery;
+            }
+
+            /* Move the parsed data forward */
+            uOffset += uBytesParsed;
+            pxReader->uBytesTotalReceived -= uBytesParsed;
+
+            if (res != POLLY_ERRNO_HTTP_WANT_MORE)
+            {
+                /* Propagate the error code */
+            }
+            else if (bHeadersComplete && uOffset > MAX_HTTP_HEAD_SIZE)
+            {
+                /* The whole head may have arrived in one read, so it's measured once parsed too. */
+                res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+            }
+            else if (Hp_isMessageComplete(pxReader->xHttpParser))
+            {
+                res = (pOut->uStatusCode / 100 == 2) ? POLLY_ERRNO_NONE : POLLY_ERRNO_HTTP_REQ_FAILURE;
+            }
+            else if (bHeadersComplete && pxAttempt->pxOutputBuf != NULL && pOut->uStatusCode / 100 == 2 &&
+                     (pxAttempt->resDelivery = prvPresizeOutput(pxAttempt->pxOutputBuf, pxReader->xHttpParser)) != POLLY_ERRNO_NONE)
+            {
+                res = pxAttempt->resDelivery;
+            }
+            else if (bHeadersComplete && (pxAttempt->xOutputFd >= 0 || pxAttempt->pxOutputBuf != NULL) && pOut->uStatusCode / 100 == 2 &&
+                     Hp_getBodyFraming(pxReader->xHttpParser, &bChunked, &uContentLength) == HTTP_PARSER_ERRNO_NONE)
+            {
+                /* The caller moves the body to the file or the buffer, so it can be spliced or received in place rather than parsed. */
+                pxAttempt->bBodyBypassed = true;
+                res = POLLY_ERRNO_NONE;
+            }
+        }
+    }
+
+    /* The unparsed bytes are moved to the front once per read. */
+    if (prvDropRecvBytes(pxReader, uOffset) != POLLY_ERRNO_NONE)
+    {
+        /* The unparsed bytes can't be kept, so the connection can't serve another response. */
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+
+    return res;
+}
+
+static int prvInitResponseReader(HttpResponseReader_t *pxReader)
+{
+    int res = POLLY_ERRNO_NONE;
+
+    memset(pxReader, 0, sizeof(HttpResponseReader_t));
+
+    if ((pxReader->xRecvBuffer = BufferPool_acquire(DEFAULT_HTTP_RECV_BUFSIZE)) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else if ((pxReader->xHttpParser = Hp_create()) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        pxReader->pRecvBuf = (char *)BufferPool_getData(pxReader->xRecvBuffer);
+        pxReader->uRecvBufSize = BufferPool_getSize(pxReader->xRecvBuffer);
+    }
+
+    return res;
+}
+
+static void prvDeinitResponseReader(HttpResponseReader_t *pxReader)
+{
+    Hp_terminate(pxReader->xHttpParser);
+    pxReader->xHttpParser = NULL;
+    PollyBuffer_release(pxReader->xRecvBuffer);
+    pxReader->xRecvBuffer = NULL;
+    pxReader->pRecvBuf = NULL;
+}
+
+/* Receive more data after the bytes which are already in the reader */
+static int prvRecvMore(NetIoHandle xNetIo, HttpResponseReader_t *pxReader)
+{
+    int res = POLLY_ERRNO_NONE;
+    size_t uBytesReceived = 0;
+
+    if (pxReader->uBytesTotalReceived == pxReader->uRecvBufSize)
+    {
+        /* A chunk size line which doesn't fit the buffer is malformed. */
+        res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+    }
+    else if (NetIo_recv(xNetIo, (unsigned char *)(pxReader->pRecvBuf + pxReader->uBytesTotalReceived), pxReader->uRecvBufSize - pxReader->uBytesTotalReceived, &uBytesReceived) != NETIO_ERRNO_NONE ||
+             uBytesReceived == 0)
+    {
+        res = POLLY_ERRNO_NET_RECV_FAILED;
+    }
+    else
+    {
+        pxReader->uBytesTotalReceived += uBytesReceived;
+    }
+
+    return res;
+}
+
+/* Read a line of the chunked framing, and drop it with its CRLF. The line is copied to pLine, and cut if it's longer. */
+static int prvReadFramingLine(NetIoHandle xNetIo, HttpResponseReader_t *pxReader, char *pLine, size_t uLineSize, size_t *puLineLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    const char *pEnd = NULL;
+    size_t uLineLen = 0;
+
+    while (res == POLLY_ERRNO_NONE &&
+           (pxReader->uBytesTotalReceived < 2 || (pEnd = memchr(pxReader->pRecvBuf + 1, '\n', pxReader->uBytesTotalReceived - 1)) == NULL))
+    {
+        res = prvRecvMore(xNetIo, pxReader);
+    }
+
+    if (res == POLLY_ERRNO_NONE)
+    {
+        uLineLen = (size_t)(pEnd - pxReader->pRecvBuf);
+        if (pEnd[-1] != '\r')
+        {
+            res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+        }
+        else
+        {
+            *puLineLen = uLineLen - 1;
+            memcpy(pLine, pxReader->pRecvBuf, (*puLineLen < uLineSize) ? *puLineLen : uLineSize);
+            pxReader->uBytesTotalReceived -= uLineLen + 1;
+            res = prvDropRecvBytes(pxReader, uLineLen + 1);
+        }
+    }
+
+    return res;
+}
+
+static int prvReadChunkSize(NetIoHandle xNetIo, HttpResponseReader_t *pxReader, uint64_t *puChunkSize)
+{
+    int res = POLLY_ERRNO_NONE;
+    char pLine[HTTP_CHUNK_SIZE_MAX_DIGITS] = { 0 };
+    size_t uLineLen = 0;
+    size_t i = 0;
+    int xDigit = 0;
+
+    *puChunkSize = 0;
+    if ((res = prvReadFramingLine(xNetIo, pxReader, pLine, sizeof(pLine), &uLineLen)) == POLLY_ERRNO_NONE)
+    {
+        /* The extensions after ';' are ignored, as llhttp does. */
+        for (i = 0; i < uLineLen && i < sizeof(pLine) && pLine[i] != ';' && pLine[i] != ' ' && pLine[i] != '\t' && res == POLLY_ERRNO_NONE; i++)
+        {
+            xDigit = (pLine[i] >= '0' && pLine[i] <= '9') ? pLine[i] - '0' :
+                     (pLine[i] >= 'a' && pLine[i] <= 'f') ? pLine[i] - 'a' + 10 :
+                     (pLine[i] >= 'A' && pLine[i] <= 'F') ? pLine[i] - 'A' + 10 : -1;
+            if (xDigit < 0 || *puChunkSize > (UINT64_MAX >> 4))
+            {
+                res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+            }
+            else
+            {
+                *puChunkSize = (*puChunkSize << 4) | (uint64_t)xDigit;
+            }
+        }
+
+        if (i == 0 || (i == sizeof(pLine) && uLineLen > i))
+        {
+            res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+        }
+    }
+
+    return res;
+}
+
+/* Move uLen bytes of the body to the output. The bytes which the reader holds are copied, and the rest is received straight into the buffer,
+ * or spliced to the file if the connection allows it. */
+static int prvMoveBody(NetIoHandle xNetIo, HttpResponseReader_t *pxReader, PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt, uint64_t uLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    int resNetIo = NETIO_ERRNO_NONE;
+    bool bSplice = true;
+    size_t uMoved = 0;
+    size_t uSpace = 0;
+    OutputBuffer_t *pxOutputBuf = pxAttempt->pxOutputBuf;
+
+    while (res == POLLY_ERRNO_NONE && uLen > 0)
+    {
+        uMoved = 0;
+        if (pxReader->uBytesTotalReceived > 0)
+        {
+            uMoved = (uLen < pxReader->uBytesTotalReceived) ? (size_t)uLen : pxReader->uBytesTotalReceived;
+            if ((res = prvWriteOutput(pxAttempt, (uint8_t *)(pxReader->pRecvBuf), uMoved)) == POLLY_ERRNO_NONE)
+            {
+                pxReader->uBytesTotalReceived -= uMoved;
+                res = prvDropRecvBytes(pxReader, uMoved);
+            }
+            else
+            {
+                uMoved = 0;
+            }
+        }
+        else if (pxOutputBuf != NULL)
+        {
+            /* The chunk framing stays in the reader, and the data doesn't go through it. */
+            if ((res = prvReserveOutput(pxOutputBuf, uLen, false)) == POLLY_ERRNO_NONE)
+            {
+                uSpace = pxOutputBuf->uSize - pxOutputBuf->uLen;
+                if (NetIo_recv(xNetIo, pxOutputBuf->pBuf + pxOutputBuf->uLen, (uLen < uSpace) ? (size_t)uLen : uSpace, &uMoved) != NETIO_ERRNO_NONE || uMoved == 0)
+                {
+                    uMoved = 0;
+                    res = POLLY_ERRNO_NET_RECV_FAILED;
+                }
+                else
+                {
+                    pxOutputBuf->uLen += uMoved;
+                }
+            }
+        }
+        else if (bSplice &&
+                 (resNetIo = NetIo_splice(xNetIo, pxAttempt->xOutputFd, (uLen < SIZE_MAX) ? (size_t)uLen : SIZE_MAX, &uMoved)) != NETIO_ERRNO_NOT_SUPPORTED)
+        {
+            if (resNetIo == NETIO_ERRNO_WRITE_FAILED)
+            {
+                res = POLLY_ERRNO_WRITE_FAILED;
+            }
+            else if (resNetIo != NETIO_ERRNO_NONE || uMoved == 0)
+            {
+                res = POLLY_ERRNO_NET_RECV_FAILED;
+            }
+            else
+            {
+                pOut->uBytesSpliced += uMoved;
+            }
+        }
+        else
+        {
+            /* The connection can't splice, so the data is received and written. */
+            bSplice = false;
+            res = prvRecvMore(xNetIo, pxReader);
+        }
+
+        uLen -= uMoved;
+        pxAttempt->uBytesDelivered += uMoved;
+    }
+
+    return res;
+}
+
+static int prvRecvBodyBypassed(NetIoHandle xNetIo, HttpResponseReader_t *pxReader, PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt)
+{
+    int res = POLLY_ERRNO_NONE;
+    bool bChunked = false;
+    uint64_t uLen = 0;
+    char pLine[1] = { 0 };
+    size_t uLineLen = 0;
+
+    if (Hp_getBodyFraming(pxReader->xHttpParser, &bChunked, &uLen) != HTTP_PARSER_ERRNO_NONE)
+    {
+        res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+    }
+    else if (!bChunked)
+    {
+        res = prvMoveBody(xNetIo, pxReader, pOut, pxAttempt, uLen);
+    }
+    else
+    {
+        /* Each chunk is its size line, the data and a CRLF. The last one is empty, and the trailers after it end with an empty line. */
+        while (res == POLLY_ERRNO_NONE && (res = prvReadChunkSize(xNetIo, pxReader, &uLen)) == POLLY_ERRNO_NONE && uLen > 0)
+        {
+            if ((res = prvMoveBody(xNetIo, pxReader, pOut, pxAttempt, uLen)) != POLLY_ERRNO_NONE)
+            {
+                /* Propagate the res error */
+            }
+            else if ((res = prvReadFramingLine(xNetIo, pxReader, pLine, sizeof(pLine), &uLineLen)) == POLLY_ERRNO_NONE && uLineLen != 0)
+            {
+                res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+            }
+        }
+
+        uLineLen = 1;
+        while (res == POLLY_ERRNO_NONE && uLineLen != 0)
+        {
+            res = prvReadFramingLine(xNetIo, pxReader, pLine, sizeof(pLine), &uLineLen);
+        }
+    }
+
+    if (res == POLLY_ERRNO_NONE)
+    {
+        Hp_skipBody(pxReader->xHttpParser);
+    }
+
+    return res;
+}
+
+static int prvSynthesizeSpeechRecv(NetIoHandle xNetIo, HttpResponseReader_t *pxReader, PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt)
+{
+    int res = POLLY_ERRNO_HTTP_WANT_MORE;
+    size_t uBytesReceived = 0;
+    unsigned int uHttpStatusCode = 0;
+    const char *pErrorType = NULL;
+
+    Hp_reset(pxReader->xHttpParser);
+
+    /* In a pipeline, the head of this response may have arrived with the previous one. */
+    if (pxReader->uBytesTotalReceived > 0)
+    {
+        res = prvSynthesizeSpeechParse(pxReader, &uHttpStatusCode, pOut, pxAttempt);
+    }
+
+    while (res == POLLY_ERRNO_HTTP_WANT_MORE)
+    {
+        /* The status code is known once the head is parsed, and until then all the bytes held are the head, whatever the size of the buffer. */
+        if (uHttpStatusCode == 0 && pxReader->uBytesTotalReceived >= MAX_HTTP_HEAD_SIZE)
+        {
+            res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+            break;
+        }
+        else if (pxReader->uBytesTotalReceived == pxReader->uRecvBufSize)
+        {
+            if (pxReader->uRecvBufSize > MAX_HTTP_RECV_BUFSIZE / 2)
+            {
+                res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
+                break;
+            }
+            else if ((res = prvReplaceRecvBuffer(pxReader, pxReader->uRecvBufSize * 2, 0)) != POLLY_ERRNO_NONE)
+            {
+                break;
+            }
+            else
+            {
+                res = POLLY_ERRNO_HTTP_WANT_MORE;
+            }
+        }
+
+        if (NetIo_recv(xNetIo, (unsigned char *)(pxReader->pRecvBuf + pxReader->uBytesTotalReceived), pxReader->uRecvBufSize - pxReader->uBytesTotalReceived, &uBytesReceived) != NETIO_ERRNO_NONE ||
+            uBytesReceived == 0)
+        {
+            /* The status line may already tell the request failed even if the error body is incomplete. */
+            res = (uHttpStatusCode != 0 && uHttpStatusCode / 100 != 2) ? POLLY_ERRNO_HTTP_REQ_FAILURE : POLLY_ERRNO_NET_RECV_FAILED;
+        }
+        else
+        {
+            pxReader->uBytesTotalReceived += uBytesReceived;
+            res = prvSynthesizeSpeechParse(pxReader, &uHttpStatusCode, pOut, pxAttempt);
+        }
+    }
+
+    if (res == POLLY_ERRNO_NONE && pxAttempt->bBodyBypassed)
+    {
+        res = prvRecvBodyBypassed(xNetIo, pxReader, pOut, pxAttempt);
+    }
+
+    /* The connection can serve another request only if the response is complete and the server keeps it alive. */
+    pxAttempt->bKeepAlive = (res != POLLY_ERRNO_OUT_OF_MEMORY && Hp_isMessageComplete(pxReader->xHttpParser) && Hp_shouldKeepAlive(pxReader->xHttpParser));
+
+    if (res == POLLY_ERRNO_HTTP_REQ_FAILURE)
+    {
+        if ((pErrorType = Hp_getErrorType(pxReader->xHttpParser)) != NULL)
+        {
+            snprintf(pOut->pErrorType, POLLY_ERROR_TYPE_MAX_LEN, "%s", pErrorType);
+        }
+        else
+        {
+            pxAttempt->pErrorBody[pxAttempt->uErrorBodyLen] = '\0';
+            prvGetErrorTypeFromBody(pxAttempt->pErrorBody, pOut->pErrorType);
+        }
+    }
+
+    return res;
+}
+
+/* The network or the service failed, rather than the request itself */
+static bool prvIsServerFailure(int res, PollySynthesizeSpeechOutput_t *pOut)
+{
+    bool bServerFailure = false;
+
+    if (res == POLLY_ERRNO_NET_CONNECT_FAILED || res == POLLY_ERRNO_NET_SEND_FAILED || res == POLLY_ERRNO_NET_RECV_FAILED)
+    {
+        bServerFailure = true;
+    }
+    else if (res == POLLY_ERRNO_HTTP_REQ_FAILURE)
+    {
+        bServerFailure = (pOut->uStatusCode == 429 || pOut->uStatusCode / 100 == 5 ||
+                          strstr(pOut->pErrorType, "Throttl") != NULL ||
+                          strcmp(pOut->pErrorType, "ServiceFailureException") == 0 ||
+                          strcmp(pOut->pErrorType, "RequestTimeoutException") == 0);
+    }
+
+    return bServerFailure;
+}
+
+/* An endpoint which ran the request out of time was too slow for it, but one which served a cancelled request didn't fail. */
+static bool prvIsEndpointFailure(int res, PollySynthesizeSpeechOutput_t *pOut)
+{
+    return res == POLLY_ERRNO_DEADLINE_EXCEEDED || prvIsServerFailure(res, pOut);
+}
+
+static bool prvIsRetryable(int res, PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt)
+{
+    /* The caller may have consumed a part of the audio, and then the request can't be replayed transparently. A buffer is just refilled. */
+    return (pxAttempt->uBytesDelivered == 0 || pxAttempt->pxOutputBuf != NULL) && prvIsServerFailure(res, pOut);
+}
+
+static bool prvIsThrottled(int res, PollySynthesizeSpeechOutput_t *pOut)
+{
+    return res == POLLY_ERRNO_HTTP_REQ_FAILURE && (pOut->uStatusCode == 429 || strstr(pOut->pErrorType, "Throttl") != NULL);
+}
+
+static bool prvIsStaleConnection(int res, PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt)
+{
+    /* The server may close an idle connection right before we use it, and then nothing is received at all. */
+    return pxAttempt->bReusedConnection && (res == POLLY_ERRNO_NET_SEND_FAILED || res == POLLY_ERRNO_NET_RECV_FAILED) &&
+           pOut->uStatusCode == 0 && pxAttempt->uBytesDelivered == 0;
+}
+
+static uint64_t prvGetDeadlineMs(uint64_t uStartMs, PollySynthesizeSpeechParameter_t *pPara)
+{
+    return (pPara->uTimeoutMs == 0) ? 0 : uStartMs + pPara->uTimeoutMs;
+}
+
+static int prvCheckInterrupted(uint64_t uDeadlineMs, PollyCancelTokenHandle xCancelToken)
+{
+    int res = POLLY_ERRNO_NONE;
+
+    if (CancelToken_isCancelled(xCancelToken))
+    {
+        res = POLLY_ERRNO_CANCELLED;
+    }
+    else if (uDeadlineMs != 0 && Port_getTimeMs() >= uDeadlineMs)
+    {
+        res = POLLY_ERRNO_DEADLINE_EXCEEDED;
+    }
+
+    return res;
+}
+
+/* A request which broke off because it was cancelled or out of time reports that, rather than the error it broke off with.
+ * An answer of the service is kept, as it came before. */
+static int prvGetInterruptedResult(int res, uint64_t uDeadlineMs, PollyCancelTokenHandle xCancelToken)
+{
+    int resInterrupted = POLLY_ERRNO_NONE;
+
+    if (res != POLLY_ERRNO_NONE && res != POLLY_ERRNO_HTTP_REQ_FAILURE && (resInterrupted = prvCheckInterrupted(uDeadlineMs, xCancelToken)) != POLLY_ERRNO_NONE)
+    {
+        res = resInterrupted;
+    }
+
+    return res;
+}
+
+/* Wait before a retry. It's skipped if the request would be out of time by then, and cut short if the request is cancelled meanwhile. */
+static bool prvBackoff(PollyServiceParameter_t *pServPara, unsigned int uAttempt, uint64_t uDeadlineMs, PollyCancelTokenHandle xCancelToken)
+{
+    uint32_t uBackoffMs = RetryPolicy_getBackoffMs(pServPara->xRetryPolicy, uAttempt);
+
+    return (uDeadlineMs == 0 || Port_getTimeMs() + uBackoffMs < uDeadlineMs) && CancelToken_sleepMs(xCancelToken, uBackoffMs);
+}
+
+/* With an endpoint router, an attempt goes to the endpoint it picks, signed for the region of the endpoint and through its pool. */
+static PollyServiceParameter_t *prvRouteAttempt(PollyServiceParameter_t *pServPara, PollyServiceParameter_t *pxRoutedPara, unsigned int *puEndpoint)
+{
+    PollyServiceParameter_t *pAttemptPara = pServPara;
+    const PollyEndpoint_t *pxEndpoint = NULL;
+
+    if (pServPara->xEndpointRouter != NULL)
+    {
+        *puEndpoint = EndpointRouter_select(pServPara->xEndpointRouter);
+        pxEndpoint = EndpointRouter_getEndpoint(pServPara->xEndpointRouter, *puEndpoint);
+
+        memcpy(pxRoutedPara, pServPara, sizeof(PollyServiceParameter_t));
+        pxRoutedPara->pRegion = pxEndpoint->pRegion;
+        pxRoutedPara->pHost = pxEndpoint->pHost;
+        pxRoutedPara->pPort = pxEndpoint->pPort;
+        pxRoutedPara->xConnPool = pxEndpoint->xConnPool;
+        pAttemptPara = pxRoutedPara;
+    }
+
+    return pAttemptPara;
+}
+
+static int prvSynthesizeSpeechAttempt(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut, SynthesizeSpeechAttempt_t *pxAttempt, bool bFreshConnection)
+{
+    int res = POLLY_ERRNO_NONE;
+    int resNetIo = NETIO_ERRNO_NONE;
+    char *pHttpReq = NULL;
+    size_t uHttpReqLen = 0;
+    NetIoHandle pxNetIo[2] = { NULL, NULL };
+    bool pbReused[2] = { false, false };
+    uint64_t puSentMs[2] = { 0, 0 };
+    size_t uNetIoCount = 0;
+    size_t uReady = 0;
+    uint32_t uHedgeDelayMs = RetryPolicy_getHedgeDelayMs(pServPara->xRetryPolicy);
+    ArenaHandle xArena = NULL;
+    HttpResponseReader_t xReader = { 0 };
+
+    /* All short-lived strings of the request are allocated from an arena, and released at once. */
+    if ((xArena = Arena_create(REQUEST_ARENA_OVERHEAD + REQUEST_ARENA_TEXT_FACTOR * strlen(pPara->pText))) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else if ((res = Request_genHttpReq(xArena, pServPara, pPara, &pHttpReq, &uHttpReqLen)) != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if ((res = prvConnectAndSend(pServPara, pxAttempt, pHttpReq, uHttpReqLen, bFreshConnection, &(pxNetIo[0]), &(pbReused[0]))) != POLLY_ERRNO_NONE)
+    {
+        pxAttempt->bReusedConnection = pbReused[0];
+    }
+    else
+    {
+        puSentMs[0] = Port_getTimeMs();
+        uNetIoCount = 1;
+        pxAttempt->bReusedConnection = pbReused[0];
+
+        /* Hedge a slow attempt with a second one, and use whichever responds first. */
+        if (uHedgeDelayMs > 0 && (pServPara->uRecvTimeoutMs == 0 || uHedgeDelayMs < pServPara->uRecvTimeoutMs) &&
+            NetIo_waitReadable(pxNetIo, 1, uHedgeDelayMs, &uReady) == NETIO_ERRNO_TIMEOUT &&
+            RetryPolicy_acquire(pServPara->xRetryPolicy) &&
+            prvConnectAndSend(pServPara, pxAttempt, pHttpReq, uHttpReqLen, bFreshConnection, &(pxNetIo[1]), &(pbReused[1])) == POLLY_ERRNO_NONE)
+        {
+            puSentMs[1] = Port_getTimeMs();
+            uNetIoCount = 2;
+        }
+
+        /* Free resource early */
+        Arena_terminate(xArena);
+        xArena = NULL;
+
+        if ((resNetIo = NetIo_waitReadable(pxNetIo, uNetIoCount, pServPara->uRecvTimeoutMs, &uReady)) != NETIO_ERRNO_NONE)
+        {
+            res = POLLY_ERRNO_NET_RECV_FAILED;
+        }
+        else
+        {
+            pxAttempt->uTtfbMs = (uint32_t)(Port_getTimeMs() - puSentMs[uReady]);
+            RetryPolicy_recordTtfb(pServPara->xRetryPolicy, pxAttempt->uTtfbMs);
+
+            /* Drop the slower attempt */
+            NetIo_terminate(pxNetIo[1 - uReady]);
+            pxNetIo[1 - uReady] = NULL;
+            pxAttempt->bReusedConnection = pbReused[uReady];
+            pOut->uConnMemBytes = NetIo_getMemoryUsage(pxNetIo[uReady]);
+
+            if ((res = prvInitResponseReader(&xReader)) == POLLY_ERRNO_NONE)
+            {
+                res = prvSynthesizeSpeechRecv(pxNetIo[uReady], &xReader, pOut, pxAttempt);
+            }
+
+            /* Data after the response is unexpected without pipelining, so such a connection is not reused. */
+            if (pxAttempt->bKeepAlive && xReader.uBytesTotalReceived == 0)
+            {
+                prvReleaseConnection(pServPara, pxNetIo[uReady]);
+                pxNetIo[uReady] = NULL;
+            }
+        }
+    }
+
+    prvDeinitResponseReader(&xReader);
+    NetIo_terminate(pxNetIo[0]);
+    NetIo_terminate(pxNetIo[1]);
+    Arena_terminate(xArena);
+
+    return res;
+}
+
+static int prvSynthesizeSpeech(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut, uint64_t uDeadlineMs, int xOutputFd,
+                               OutputBuffer_t *pxOutputBuf)
+{
+    int res = POLLY_ERRNO_NONE;
+    SynthesizeSpeechAttempt_t xAttempt;
+    PollyServiceParameter_t xRoutedPara;
+    unsigned int uEndpoint = 0;
+    bool bStale = false;
+    unsigned int uMaxAttempts = 0;
+    unsigned int uAttempt = 0;
+    bool bFreshConnection = false;
+    bool bDone = false;
+    int64_t iMemBaseline = Allocator_getThreadUsage();
+
+    Allocator_resetThreadPeak();
+
+    if (pServPara == NULL || pPara == NULL || pPara->pText == NULL || pOut == NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        uMaxAttempts = RetryPolicy_getMaxAttempts(pServPara->xRetryPolicy);
+        RetryPolicy_onRequest(pServPara->xRetryPolicy);
+
+        while (!bDone)
+        {
+            pOut->uStatusCode = 0;
+            pOut->pErrorType[0] = '\0';
+            pOut->uBytesSpliced = 0;
+
+            if ((res = prvInitAttempt(&xAttempt, pPara, pOut, uDeadlineMs, xOutputFd, pxOutputBuf)) != POLLY_ERRNO_NONE)
+            {
+                bDone = true;
+            }
+            else if ((res = prvCheckInterrupted(uDeadlineMs, pPara->xCancelToken)) != POLLY_ERRNO_NONE)
+            {
+                bDone = true;
+            }
+            else if (RateLimiter_acquire(pServPara->xRateLimiter, 1, pPara->ePriority, uDeadlineMs) != RATE_LIMITER_ERRNO_NONE)
+            {
+                res = prvGetInterruptedResult(POLLY_ERRNO_RATE_LIMITED, uDeadlineMs, pPara->xCancelToken);
+                bDone = true;
+            }
+            else
+            {
+                res = prvSynthesizeSpeechAttempt(prvRouteAttempt(pServPara, &xRoutedPara, &uEndpoint), pPara, pOut, &xAttempt, bFreshConnection);
+                res = prvGetInterruptedResult(res, uDeadlineMs, pPara->xCancelToken);
+                RateLimiter_release(pServPara->xRateLimiter, 1, prvIsThrottled(res, pOut) ? 1 : 0, xAttempt.uTtfbMs);
+
+                /* A pooled connection which the server closed says nothing about the endpoint. */
+                bStale = (res != POLLY_ERRNO_NONE && !bFreshConnection && prvIsStaleConnection(res, pOut, &xAttempt));
+                EndpointRouter_report(pServPara->xEndpointRouter, uEndpoint, !bStale && prvIsEndpointFailure(res, pOut), xAttempt.uTtfbMs);
+            }
+            prvDeinitAttempt(&xAttempt);
+
+            if (bDone)
+            {
+                /* Propagate the error code */
+            }
+            else if (bStale)
+            {
+                /* Replay it on a new connection right away. It doesn't count as a retry. */
+                bFreshConnection = true;
+            }
+            else
+            {
+                pOut->uAttempts = ++uAttempt;
+                if (res == POLLY_ERRNO_NONE || uAttempt >= uMaxAttempts || !prvIsRetryable(res, pOut, &xAttempt) ||
+                    !RetryPolicy_acquire(pServPara->xRetryPolicy))
+                {
+                    bDone = true;
+                }
+                else if (!prvBackoff(pServPara, uAttempt, uDeadlineMs, pPara->xCancelToken))
+                {
+                    /* The error of the last attempt stands, unless the request was cancelled meanwhile. */
+                    res = prvGetInterruptedResult(res, 0, pPara->xCancelToken);
+                    bDone = true;
+                }
+            }
+        }
+
+        pOut->uPeakMemBytes = (size_t)(Allocator_getThreadPeak() - iMemBaseline);
+    }
+
+    return res;
+}
+
+int Polly_synthesizeSpeech(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut)
+{
+    /* The deadline starts now, and all attempts share it. */
+    return prvSynthesizeSpeech(pServPara, pPara, pOut, (pPara != NULL) ? prvGetDeadlineMs(Port_getTimeMs(), pPara) : 0, -1, NULL);
+}
+
+int Polly_synthesizeSpeechToFile(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut, int xFd)
+{
+    return (xFd < 0) ? POLLY_ERRNO_INVALID_PARAMETER : prvSynthesizeSpeech(pServPara, pPara, pOut, (pPara != NULL) ? prvGetDeadlineMs(Port_getTimeMs(), pPara) : 0, xFd, NULL);
+}
+
+/* Estimate the length of the audio from the length of the text, for a response which doesn't tell it */
+static size_t prvEstimateAudioLen(PollySynthesizeSpeechParameter_t *pPara)
+{
+    size_t uTextLen = strlen(pPara->pText);
+    size_t uBytesPerSec = SPEECH_COMPRESSED_BYTES_PER_SEC;
+    long lSampleRate = 0;
+
+    if (pPara->pOutputFormat != NULL && strcmp(pPara->pOutputFormat, "json") == 0)
+    {
+        /* Speech marks are a line of JSON per word or sentence */
+        uBytesPerSec = SPEECH_MARKS_BYTES_PER_CHAR * SPEECH_CHARS_PER_SEC;
+    }
+    else if (pPara->pOutputFormat != NULL && strcmp(pPara->pOutputFormat, "pcm") == 0)
+    {
+        /* 16-bit mono samples */
+        lSampleRate = (pPara->pSampleRate != NULL) ? strtol(pPara->pSampleRate, NULL, 10) : 0;
+        uBytesPerSec = 2 * ((lSampleRate > 0) ? (size_t)lSampleRate : SPEECH_PCM_DEFAULT_SAMPLE_RATE);
+    }
+
+    return (uTextLen / SPEECH_CHARS_PER_SEC + 1) * uBytesPerSec;
+}
+
+int Polly_synthesizeSpeechToBuffer(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut,
+                                   uint8_t *pBuf, size_t uBufSize, uint8_t **ppAudio, size_t *puAudioLen)
 {
     int res = POLLY_ERRNO_NONE;
-    time_t xTimeUtcNow = {0};
+    OutputBuffer_t xOutputBuf = { 0 };
+    uint8_t *pTemp = NULL;
+
+    if (pPara == NULL || pPara->pText == NULL || ppAudio == NULL || puAudioLen == NULL || (pBuf == NULL && uBufSize > 0))
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        xOutputBuf.pBuf = pBuf;
+        xOutputBuf.uSize = uBufSize;
+        xOutputBuf.bOwned = (pBuf == NULL);
+        xOutputBuf.uEstimatedLen = prvEstimateAudioLen(pPara);
+
+        res = prvSynthesizeSpeech(pServPara, pPara, pOut, prvGetDeadlineMs(Port_getTimeMs(), pPara), -1, &xOutputBuf);
+        if (res == POLLY_ERRNO_NONE)
+        {
+            /* An estimate which was well over the audio gives its rest back. */
+            if (xOutputBuf.bOwned && xOutputBuf.uLen > 0 && xOutputBuf.uLen < xOutputBuf.uSize - xOutputBuf.uSize / 4 &&
+                (pTemp = (uint8_t *)Allocator_realloc(xOutputBuf.pBuf, xOutputBuf.uLen)) != NULL)
+            {
+                xOutputBuf.pBuf = pTemp;
+            }
+            *ppAudio = (xOutputBuf.uLen > 0) ? xOutputBuf.pBuf : NULL;
+            *puAudioLen = xOutputBuf.uLen;
+        }
+        else
+        {
+            /* The caller can retry with a buffer of the announced length */
+            *ppAudio = NULL;
+            *puAudioLen = (res == POLLY_ERRNO_BUFFER_TOO_SMALL && xOutputBuf.uAnnouncedLen <= SIZE_MAX) ? (size_t)xOutputBuf.uAnnouncedLen : 0;
+        }
 
-    xTimeUtcNow = time(NULL);
-    strftime(pDateISO8601, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime(&xTimeUtcNow));
+        if (xOutputBuf.bOwned && *ppAudio == NULL)
+        {
+            Allocator_free(xOutputBuf.pBuf);
+        }
+    }
 
     return res;
 }
 
-static int prvGenSynthesizeSpeechHttpPayload(PollySynthesizeSpeechParameter_t *pPara, char **ppPayload, size_t *puPayloadLen)
+void Polly_freeAudio(uint8_t *pAudio)
+{
+    Allocator_free(pAudio);
+}
+
+static int prvOnHttp2Data(uint8_t *pData, size_t uLen, void *pUserData)
+{
+    SynthesizeSpeechStream_t *pxStream = (SynthesizeSpeechStream_t *)pUserData;
+
+    pxStream->pOut->uStatusCode = pxStream->pxReq->uStatusCode;
+
+    return prvOnResponseData(pxStream->pOut, &(pxStream->xAttempt), NULL, pData, uLen);
+}
+
+static int prvGetHttp2Result(SynthesizeSpeechStream_t *pxStream)
 {
     int res = POLLY_ERRNO_NONE;
-    char *pPayload = NULL;
-    size_t uPayloadLen = 0;
+    Http2Request_t *pxReq = pxStream->pxReq;
+    PollySynthesizeSpeechOutput_t *pOut = pxStream->pOut;
+    SynthesizeSpeechAttempt_t *pxAttempt = &(pxStream->xAttempt);
 
-    uPayloadLen = snprintf(NULL, 0, "{\"OutputFormat\": \"%s\",\"VoiceId\": \"%s\", \"Text\": \"%s\"}",
-        pPara->pOutputFormat,
-        pPara->pVoiceId,
-        pPara->pText
-    );
+    pOut->uStatusCode = pxReq->uStatusCode;
 
-    if ((pPayload = (char *)malloc(uPayloadLen + 1)) == NULL)
+    if (pxAttempt->resDelivery != POLLY_ERRNO_NONE)
+    {
+        res = pxAttempt->resDelivery;
+    }
+    else if (pxReq->res == HTTP2_ERRNO_NONE)
+    {
+        if (pOut->uStatusCode / 100 != 2)
+        {
+            res = POLLY_ERRNO_HTTP_REQ_FAILURE;
+            if (pxReq->pErrorType[0] != '\0')
+            {
+                snprintf(pOut->pErrorType, POLLY_ERROR_TYPE_MAX_LEN, "%s", pxReq->pErrorType);
+            }
+            else
+            {
+                pxAttempt->pErrorBody[pxAttempt->uErrorBodyLen] = '\0';
+                prvGetErrorTypeFromBody(pxAttempt->pErrorBody, pOut->pErrorType);
+            }
+        }
+    }
+    else if (pxReq->res == HTTP2_ERRNO_SEND_FAILED)
+    {
+        res = POLLY_ERRNO_NET_SEND_FAILED;
+    }
+    else if (pxReq->res == HTTP2_ERRNO_RECV_FAILED || pxReq->res == HTTP2_ERRNO_STREAM_RESET)
+    {
+        res = POLLY_ERRNO_NET_RECV_FAILED;
+    }
+    else if (pxReq->res == HTTP2_ERRNO_OUT_OF_MEMORY)
     {
         res = POLLY_ERRNO_OUT_OF_MEMORY;
     }
     else
     {
-        snprintf(pPayload, uPayloadLen + 1, "{\"OutputFormat\": \"%s\",\"VoiceId\": \"%s\", \"Text\": \"%s\"}",
-            pPara->pOutputFormat,
-            pPara->pVoiceId,
-            pPara->pText
-        );
-        *ppPayload = pPayload;
-        *puPayloadLen = uPayloadLen;
+        res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
     }
 
     return res;
 }
 
-static int prvSynthesizeSpeechRecv(NetIoHandle xNetIo, PollySynthesizeSpeechOutput_t *pOut)
+static int prvConnectWithAlpn(PollyServiceParameter_t *pServPara, uint64_t uDeadlineMs, PollyCancelTokenHandle xCancelToken, NetIoHandle *pxNetIo)
 {
     int res = POLLY_ERRNO_NONE;
-    int resHttpParser = HTTP_PARSER_ERRNO_NONE;
-
-    char *pRecvBuf = NULL;
-    size_t uRecvBufSize = DEFAULT_HTTP_RECV_BUFSIZE;
-    size_t uBytesReceived = 0;
-    size_t uBytesTotalReceived = 0;
-    HttpParserHandle xHttpParser = NULL;
-    unsigned int uHttpStatusCode = 0;
-    size_t uBytesParsed = 0;
-    const char *pChunkLoc = NULL;
-    size_t uChunkLen = 0;
-    char *pTemp = NULL;
+    NetIoHandle xNetIo = NULL;
 
-    if ((pRecvBuf = (char *)malloc(uRecvBufSize)) == NULL)
+    if ((xNetIo = NetIo_create()) == NULL)
     {
         res = POLLY_ERRNO_OUT_OF_MEMORY;
     }
-    else if ((xHttpParser = Hp_create()) == NULL)
+    else if (NetIo_setAlpnProtocols(xNetIo, gpAlpnProtocols) != NETIO_ERRNO_NONE ||
+             NetIo_setRecvTimeout(xNetIo, pServPara->uRecvTimeoutMs) != NETIO_ERRNO_NONE ||
+             NetIo_setConnectTimeout(xNetIo, pServPara->uConnectTimeoutMs) != NETIO_ERRNO_NONE ||
+             NetIo_setMaxFragmentLength(xNetIo, pServPara->uTlsMaxFragmentLen) != NETIO_ERRNO_NONE ||
+             NetIo_setSocketOptions(xNetIo, &(pServPara->xSocketOptions)) != NETIO_ERRNO_NONE ||
+             NetIo_setTrustStore(xNetIo, pServPara->xTrustStore) != NETIO_ERRNO_NONE ||
+             NetIo_setTransport(xNetIo, pServPara->xTransport) != NETIO_ERRNO_NONE ||
+             NetIo_setDeadline(xNetIo, uDeadlineMs, xCancelToken) != NETIO_ERRNO_NONE)
+    {
+        res = POLLY_ERRNO_NET_CONFIG_FAILED;
+    }
+    else if (NetIo_connect(xNetIo, pServPara->pHost, (pServPara->pPort != NULL) ? pServPara->pPort : POLLY_DEFAULT_PORT) != NETIO_ERRNO_NONE)
+    {
+        res = POLLY_ERRNO_NET_CONNECT_FAILED;
+    }
+    else
+    {
+        *pxNetIo = xNetIo;
+    }
+
+    if (res != POLLY_ERRNO_NONE)
+    {
+        NetIo_terminate(xNetIo);
+    }
+
+    return res;
+}
+
+static int prvSynthesizeSpeechHttp2(PollyServiceParameter_t *pServPara, NetIoHandle xNetIo, PollySynthesizeSpeechParameter_t *pParas, PollySynthesizeSpeechOutput_t *pOuts,
+                                    ArenaHandle *pxArenas, Http2Request_t *pxReqs, SynthesizeSpeechStream_t *pxStreams, size_t uCount)
+{
+    int res = POLLY_ERRNO_NONE;
+    Http2Handle xHttp2 = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < uCount && res == POLLY_ERRNO_NONE; i++)
+    {
+        RetryPolicy_onRequest(pServPara->xRetryPolicy);
+
+        pOuts[i].uStatusCode = 0;
+        pOuts[i].pErrorType[0] = '\0';
+        pOuts[i].uAttempts = 1;
+        pxStreams[i].pOut = &(pOuts[i]);
+        pxStreams[i].pxReq = &(pxReqs[i]);
+        pxReqs[i].onDataCallback = prvOnHttp2Data;
+        pxReqs[i].pUserData = &(pxStreams[i]);
+
+        if ((pxArenas[i] = Arena_create(REQUEST_ARENA_OVERHEAD + REQUEST_ARENA_TEXT_FACTOR * strlen(pParas[i].pText))) == NULL)
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            res = Request_genHttp2Req(pxArenas[i], pServPara, &(pParas[i]), &(pxReqs[i]));
+        }
+    }
+
+    if (res != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if ((xHttp2 = Http2_create(xNetIo)) == NULL)
     {
         res = POLLY_ERRNO_OUT_OF_MEMORY;
     }
     else
     {
-        do
-        {            
-            if (uBytesTotalReceived == uRecvBufSize)
+        /* Results are kept per request, so the result of the connection doesn't matter here. */
+        Http2_execute(xHttp2, pxReqs, uCount);
+
+        for (i = 0; i < uCount; i++)
+        {
+            pxStreams[i].bAnswered = (pxReqs[i].res != HTTP2_ERRNO_STREAM_REFUSED);
+            pxStreams[i].res = prvGetHttp2Result(&(pxStreams[i]));
+        }
+    }
+
+    Http2_terminate(xHttp2);
+
+    return res;
+}
+
+static int prvSynthesizeSpeechPipeline(PollyServiceParameter_t *pServPara, NetIoHandle xNetIo, PollySynthesizeSpeechParameter_t *pParas, PollySynthesizeSpeechOutput_t *pOuts,
+                                       SynthesizeSpeechStream_t *pxStreams, size_t uCount, bool *pbReusable)
+{
+    int res = POLLY_ERRNO_NONE;
+    HttpResponseReader_t xReader = { 0 };
+    ArenaHandle xArena = NULL;
+    char *pHttpReq = NULL;
+    size_t uHttpReqLen = 0;
+    size_t uSent = 0;
+    size_t uAnswered = 0;
+    bool bAlive = true;
+    SynthesizeSpeechStream_t *pxStream = NULL;
+    size_t uDepth = (pServPara->uPipelineDepth > 1) ? pServPara->uPipelineDepth : 1;
+
+    if ((res = prvInitResponseReader(&xReader)) == POLLY_ERRNO_NONE)
+    {
+        while (res == POLLY_ERRNO_NONE && bAlive && uAnswered < uCount)
+        {
+            /* Keep the pipeline full, so the server never waits a round trip for the next request. */
+            while (res == POLLY_ERRNO_NONE && bAlive && uSent < uCount && uSent - uAnswered < uDepth)
             {
-                if ((pTemp = (char *)realloc(pRecvBuf, uRecvBufSize*2)) == NULL)
+                RetryPolicy_onRequest(pServPara->xRetryPolicy);
+
+                if ((xArena = Arena_create(REQUEST_ARENA_OVERHEAD + REQUEST_ARENA_TEXT_FACTOR * strlen(pParas[uSent].pText))) == NULL)
                 {
                     res = POLLY_ERRNO_OUT_OF_MEMORY;
-                    break;
+                }
+                else if ((res = Request_genHttpReq(xArena, pServPara, &(pParas[uSent]), &pHttpReq, &uHttpReqLen)) != POLLY_ERRNO_NONE)
+                {
+                    /* Propagate the error code */
+                }
+                else if (NetIo_send(xNetIo, (const unsigned char *)pHttpReq, uHttpReqLen) != NETIO_ERRNO_NONE)
+                {
+                    bAlive = false;
                 }
                 else
                 {
-                    pRecvBuf = pTemp;
-                    uRecvBufSize *= 2;
+                    uSent++;
                 }
+
+                Arena_terminate(xArena);
+                xArena = NULL;
             }
 
-            if (NetIo_recv(xNetIo, (unsigned char *)(pRecvBuf + uBytesTotalReceived), uRecvBufSize - uBytesTotalReceived, &uBytesReceived) != NETIO_ERRNO_NONE)
+            if (res != POLLY_ERRNO_NONE || uSent == uAnswered)
             {
-                res = POLLY_ERRNO_NET_RECV_FAILED;
                 break;
             }
-            else if (uBytesReceived == 0)
+
+            /* Responses come back in the order of the requests. */
+            pxStream = &(pxStreams[uAnswered]);
+            pxStream->pOut = &(pOuts[uAnswered]);
+            pxStream->pOut->uStatusCode = 0;
+            pxStream->pOut->pErrorType[0] = '\0';
+            pxStream->pOut->uAttempts = 1;
+            pxStream->res = prvSynthesizeSpeechRecv(xNetIo, &xReader, pxStream->pOut, &(pxStream->xAttempt));
+
+            if (pxStream->res == POLLY_ERRNO_NET_RECV_FAILED && pxStream->pOut->uStatusCode == 0 && pxStream->xAttempt.uBytesDelivered == 0)
             {
-                res = POLLY_ERRNO_NET_RECV_FAILED;
-                break;
+                /* The server closed the connection before answering, so this request and the ones after it are sent again. */
+                bAlive = false;
             }
             else
             {
-                uBytesTotalReceived += uBytesReceived;
-                resHttpParser = Hp_parse(xHttpParser, pRecvBuf, uBytesTotalReceived, &uBytesParsed, &uHttpStatusCode, &pChunkLoc, &uChunkLen);
-                if (resHttpParser == HTTP_PARSER_ERRNO_NONE || resHttpParser == HTTP_PARSER_ERRNO_WANT_MORE_DATA)
-                {
-                    if (uHttpStatusCode != 0)
-                    {
-                        pOut->uStatusCode = uHttpStatusCode;
-                        if (pOut->uStatusCode / 100 != 2)
-                        {
-                            res = POLLY_ERRNO_HTTP_REQ_FAILURE;
-                            break;
-                        }
-                    }
-
-                    if (pOut->onDataCallback != NULL && pChunkLoc != NULL && uChunkLen > 0)
-                    {
-                        pOut->onDataCallback((uint8_t *)pChunkLoc, uChunkLen, pOut->pUserData);
-                    }
-
-                    /* Move the parsed data forward */
-                    uBytesTotalReceived -= uBytesParsed;
-                    memmove(pRecvBuf, pRecvBuf + uBytesParsed, uBytesTotalReceived);
-                    res = POLLY_ERRNO_HTTP_WANT_MORE;
-                }
-                else
-                {
-                    res = POLLY_ERRNO_HTTP_PARSE_FAILURE;
-                    break;
-                }
+                pxStream->bAnswered = true;
+                uAnswered++;
+                bAlive = pxStream->xAttempt.bKeepAlive;
             }
-        } while (res != POLLY_ERRNO_NONE);
+        }
     }
 
-    Hp_terminate(xHttpParser);
-    if (pRecvBuf != NULL)
+    /* The connection is reusable only if nothing is in flight and nothing unexpected was received. */
+    *pbReusable = (res == POLLY_ERRNO_NONE && bAlive && uSent == uAnswered && xReader.uBytesTotalReceived == 0);
+
+    prvDeinitResponseReader(&xReader);
+
+    return res;
+}
+
+static int prvInitStreamAttempts(SynthesizeSpeechStream_t *pxStreams, PollySynthesizeSpeechParameter_t *pParas, PollySynthesizeSpeechOutput_t *pOuts, size_t uCount,
+                                 uint64_t uDeadlineMs)
+{
+    int res = POLLY_ERRNO_NONE;
+    size_t i = 0;
+
+    for (i = 0; i < uCount && res == POLLY_ERRNO_NONE; i++)
     {
-        free(pRecvBuf);
+        res = prvInitAttempt(&(pxStreams[i].xAttempt), &(pParas[i]), &(pOuts[i]), uDeadlineMs, -1, NULL);
     }
 
     return res;
 }
 
-int Polly_synthesizeSpeech(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, PollySynthesizeSpeechOutput_t *pOut)
+/* The shared connection is bounded by one deadline and one token, and takes its permits in one class, so the requests must have the same
+ * timeout, token and priority. */
+static bool prvCanShareConnection(PollySynthesizeSpeechParameter_t *pParas, size_t uCount)
 {
-    int res = POLLY_ERRNO_NONE;
-    char *pPayload = NULL;
-    size_t uPayloadLen = 0;
-    SigV4Para_t xSigV4Para = { 0 };
-    char *pAuth = NULL;
-    size_t uAuthLen = 0;
-    
-    char pDateISO8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE];
-    char *pHttpReq = NULL;
-    size_t uHttpReqLen = 0;
-    char *p = NULL;
+    bool bShare = true;
+    size_t i = 0;
+
+    for (i = 1; i < uCount && bShare; i++)
+    {
+        bShare = (pParas[i].uTimeoutMs == pParas[0].uTimeoutMs && pParas[i].xCancelToken == pParas[0].xCancelToken &&
+                  pParas[i].ePriority == pParas[0].ePriority);
+    }
 
+    return bShare;
+}
+
+int Polly_synthesizeSpeechMulti(PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pParas, PollySynthesizeSpeechOutput_t *pOuts, size_t uCount, int *pResults)
+{
+    int res = POLLY_ERRNO_NONE;
+    int resReq = POLLY_ERRNO_NONE;
+    ArenaHandle *pxArenas = NULL;
+    Http2Request_t *pxReqs = NULL;
+    SynthesizeSpeechStream_t *pxStreams = NULL;
     NetIoHandle xNetIo = NULL;
+    const char *pAlpnProtocol = NULL;
+    bool bReusable = false;
+    bool bAcquired = false;
+    bool bConnected = false;
+    PollyServiceParameter_t xRoutedPara;
+    PollyServiceParameter_t *pBatchPara = NULL;
+    unsigned int uEndpoint = 0;
+    unsigned int uAnswered = 0;
+    unsigned int uThrottled = 0;
+    uint64_t uStartMs = Port_getTimeMs();
+    uint64_t uDeadlineMs = 0;
+    PollyCancelTokenHandle xCancelToken = NULL;
+    int resConnect = POLLY_ERRNO_NONE;
+    size_t uBatchPeakMemBytes = 0;
+    size_t uBatchConnMemBytes = 0;
+    int64_t iMemBaseline = Allocator_getThreadUsage();
+    size_t i = 0;
 
-    if ((res = prvGenDateTimeIso8601(pDateISO8601)) != POLLY_ERRNO_NONE)
+    Allocator_resetThreadPeak();
+
+    if (pServPara == NULL || pParas == NULL || pOuts == NULL || uCount == 0)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        for (i = 0; i < uCount; i++)
+        {
+            if (pParas[i].pText == NULL)
+            {
+                res = POLLY_ERRNO_INVALID_PARAMETER;
+            }
+        }
+
+        /* They apply to the shared connection, which serves only requests which have the same ones. */
+        uDeadlineMs = prvGetDeadlineMs(uStartMs, &(pParas[0]));
+        xCancelToken = pParas[0].xCancelToken;
+    }
+
+    if (res != POLLY_ERRNO_NONE)
     {
         /* Propagate the error code */
     }
-    else if ((res = prvGenSynthesizeSpeechHttpPayload(pPara, &pPayload, &uPayloadLen)) != POLLY_ERRNO_NONE)
+    else if ((pxArenas = (ArenaHandle *)Allocator_calloc(uCount, sizeof(ArenaHandle))) == NULL ||
+             (pxReqs = (Http2Request_t *)Allocator_calloc(uCount, sizeof(Http2Request_t))) == NULL ||
+             (pxStreams = (SynthesizeSpeechStream_t *)Allocator_calloc(uCount, sizeof(SynthesizeSpeechStream_t))) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else if (!prvCanShareConnection(pParas, uCount))
+    {
+        /* The requests are sent one by one, each with its own deadline and token. */
+    }
+    else if ((res = prvInitStreamAttempts(pxStreams, pParas, pOuts, uCount, uDeadlineMs)) != POLLY_ERRNO_NONE)
     {
         /* Propagate the error code */
     }
+    else if (!(bAcquired = (RateLimiter_acquire(pServPara->xRateLimiter, (unsigned int)uCount, pParas[0].ePriority, uDeadlineMs) == RATE_LIMITER_ERRNO_NONE)))
+    {
+        res = prvGetInterruptedResult(POLLY_ERRNO_RATE_LIMITED, uDeadlineMs, xCancelToken);
+    }
+    else if (!(bConnected = ((resConnect = prvConnectWithAlpn((pBatchPara = prvRouteAttempt(pServPara, &xRoutedPara, &uEndpoint)), uDeadlineMs, xCancelToken,
+                                                              &xNetIo)) == POLLY_ERRNO_NONE)))
+    {
+        /* The requests are sent one by one, and each of them retries the connection. */
+        resConnect = prvGetInterruptedResult(resConnect, uDeadlineMs, xCancelToken);
+        EndpointRouter_report(pServPara->xEndpointRouter, uEndpoint, prvIsEndpointFailure(resConnect, &(pOuts[0])), 0);
+    }
+    else if ((pAlpnProtocol = NetIo_getAlpnProtocol(xNetIo)) != NULL && strcmp(pAlpnProtocol, "h2") == 0)
+    {
+        /* All requests are multiplexed on one connection, so they share a single handshake and congestion window. */
+        res = prvSynthesizeSpeechHttp2(pBatchPara, xNetIo, pParas, pOuts, pxArenas, pxReqs, pxStreams, uCount);
+    }
     else
     {
-        xSigV4Para.pAccessKey = pServPara->pAccessKey;
-        xSigV4Para.pAccessKey = pServPara->pAccessKey;
-        xSigV4Para.pSecretKey = pServPara->pSecretKey;
-        xSigV4Para.pRegion = pServPara->pRegion;
-        xSigV4Para.pService = pServPara->pService;
-        xSigV4Para.pDateIso8601 = pDateISO8601;
-        xSigV4Para.pHttpMethod = "POST";
-        xSigV4Para.pPath = "/v1/speech";
-        xSigV4Para.pQuery = NULL;
-        xSigV4Para.pHost = pServPara->pHost;
-        xSigV4Para.pPayload = pPayload;
-        xSigV4Para.uPayloadLen = uPayloadLen;
+        /* The server speaks HTTP/1.1 only, so requests are pipelined on the connection, or sent one after another on it with a depth of 1.
+         * Either way the handshake which negotiated the protocol serves them. */
+        res = prvSynthesizeSpeechPipeline(pBatchPara, xNetIo, pParas, pOuts, pxStreams, uCount, &bReusable);
+    }
+    uBatchPeakMemBytes = (size_t)(Allocator_getThreadPeak() - iMemBaseline);
+    uBatchConnMemBytes = NetIo_getMemoryUsage(xNetIo);
+
+    if (xNetIo != NULL && bReusable)
+    {
+        prvReleaseConnection(pBatchPara, xNetIo);
+        xNetIo = NULL;
+    }
+    NetIo_terminate(xNetIo);
 
-        if (SigV4_Sign(&xSigV4Para, &pAuth, &uAuthLen) != SIGV4_ERRNO_NONE)
+    /* Every answer counts for the endpoint. A connection which served none still tells the endpoint is reachable. */
+    for (i = 0; bConnected && i < uCount; i++)
+    {
+        if (pxStreams[i].bAnswered)
         {
-            res = POLLY_ERRNO_SIGN_FAILURE;
+            pxStreams[i].res = prvGetInterruptedResult(pxStreams[i].res, uDeadlineMs, xCancelToken);
+            EndpointRouter_report(pServPara->xEndpointRouter, uEndpoint, prvIsEndpointFailure(pxStreams[i].res, &(pOuts[i])), 0);
+            uAnswered++;
         }
-        else
+    }
+    if (bConnected && uAnswered == 0)
+    {
+        EndpointRouter_report(pServPara->xEndpointRouter, uEndpoint, false, 0);
+    }
+
+    if (bAcquired)
+    {
+        /* The permits are given back before the requests left over are sent one by one, which take their own. */
+        for (i = 0; i < uCount; i++)
         {
-            /* Calculate needed length */
-            uHttpReqLen = 0;
-            uHttpReqLen += snprintf(NULL, 0, "POST /v1/speech HTTP/1.1\r\n");
-            uHttpReqLen += snprintf(NULL, 0, "host: %s\r\n", pServPara->pHost);
-            uHttpReqLen += snprintf(NULL, 0, "content-type: application/json\r\n");
-            uHttpReqLen += snprintf(NULL, 0, "content-length: %zu\r\n", uPayloadLen);
-            uHttpReqLen += snprintf(NULL, 0, "authorization: %s\r\n", pAuth);
-            uHttpReqLen += snprintf(NULL, 0, "x-amz-Date: %s\r\n", pDateISO8601);
-            uHttpReqLen += snprintf(NULL, 0, "\r\n");
-            uHttpReqLen += snprintf(NULL, 0, "%.*s", (int)uPayloadLen, pPayload);
+            if (pxStreams[i].bAnswered && prvIsThrottled(pxStreams[i].res, &(pOuts[i])))
+            {
+                uThrottled++;
+            }
+        }
+        RateLimiter_release(pServPara->xRateLimiter, (unsigned int)uCount, uThrottled, 0);
+    }
 
-            if ((pHttpReq = (char *)malloc(uHttpReqLen + 1)) == NULL)
+    if (res == POLLY_ERRNO_NONE)
+    {
+        for (i = 0; i < uCount; i++)
+        {
+            if (!pxStreams[i].bAnswered)
             {
-                res = POLLY_ERRNO_OUT_OF_MEMORY;
+                /* The server didn't process the request, so it's sent again like a new request, in the time it has left. */
+                resReq = prvSynthesizeSpeech(pServPara, &(pParas[i]), &(pOuts[i]), prvGetDeadlineMs(uStartMs, &(pParas[i])), -1, NULL);
             }
             else
             {
-                p = pHttpReq;
-                p += sprintf(p, "POST /v1/speech HTTP/1.1\r\n");
-                p += sprintf(p, "host: %s\r\n", pServPara->pHost);
-                p += sprintf(p, "content-type: application/json\r\n");
-                p += sprintf(p, "content-length: %zu\r\n", uPayloadLen);
-                p += sprintf(p, "authorization: %s\r\n", pAuth);
-                p += sprintf(p, "x-amz-Date: %s\r\n", pDateISO8601);
-                p += sprintf(p, "\r\n");
-                p += sprintf(p, "%.*s", (int)uPayloadLen, pPayload);
-
-                /* Free resource early */
-                free(pPayload);
-                pPayload = NULL;
-                free(pAuth);
-                pAuth = NULL;
-
-                if ((xNetIo = NetIo_create()) == NULL)
-                {
-                    res = POLLY_ERRNO_OUT_OF_MEMORY;
-                }
-                else if (NetIo_connect(xNetIo, pServPara->pHost, "443") != NETIO_ERRNO_NONE)
-                {
-                    res = POLLY_ERRNO_NET_CONNECT_FAILED;
-                }
-                else if (NetIo_setRecvTimeout(xNetIo, pServPara->uRecvTimeoutMs) != NETIO_ERRNO_NONE)
-                {
-                    res = POLLY_ERRNO_NET_CONFIG_FAILED;
-                }
-                else if (NetIo_send(xNetIo, (const unsigned char *)pHttpReq, uHttpReqLen) != NETIO_ERRNO_NONE)
+                pOuts[i].uPeakMemBytes = uBatchPeakMemBytes;
+                pOuts[i].uConnMemBytes = uBatchConnMemBytes;
+                resReq = pxStreams[i].res;
+
+                if (resReq != POLLY_ERRNO_NONE && RetryPolicy_getMaxAttempts(pServPara->xRetryPolicy) > 1 &&
+                    prvIsRetryable(resReq, &(pOuts[i]), &(pxStreams[i].xAttempt)) && RetryPolicy_acquire(pServPara->xRetryPolicy) &&
+                    prvBackoff(pServPara, 1, uDeadlineMs, xCancelToken))
                 {
-                    res = POLLY_ERRNO_NET_SEND_FAILED;
+                    resReq = prvSynthesizeSpeech(pServPara, &(pParas[i]), &(pOuts[i]), uDeadlineMs, -1, NULL);
+                    pOuts[i].uAttempts++;
                 }
-                else
-                {
-                    /* Free resource early */
-                    free(pHttpReq);
-                    pHttpReq = NULL;
+            }
 
-                    res = prvSynthesizeSpeechRecv(xNetIo, pOut);
-                }
+            if (pResults != NULL)
+            {
+                pResults[i] = resReq;
+            }
+
+            /* The batch fails with the first failed request */
+            if (res == POLLY_ERRNO_NONE)
+            {
+                res = resReq;
             }
         }
     }
 
-    NetIo_terminate(xNetIo);
-    if (pHttpReq != NULL)
+    if (pxArenas != NULL)
     {
-        free(pHttpReq);
+        for (i = 0; i < uCount; i++)
+        {
+            Arena_terminate(pxArenas[i]);
+        }
+        Allocator_free(pxArenas);
     }
-    if (pAuth != NULL)
+    if (pxReqs != NULL)
     {
-        free(pAuth);
+        Allocator_free(pxReqs);
     }
-    if (pPayload != NULL)
+    if (pxStreams != NULL)
     {
-        free(pPayload);
+        for (i = 0; i < uCount; i++)
+        {
+            prvDeinitAttempt(&(pxStreams[i].xAttempt));
+        }
+        Allocator_free(pxStreams);
     }
 
     return res;
-}
\ No newline at end of file
+}
@@ -0,0 +1,48 @@
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "port.h"
+
+uint64_t Port_getTimeMs(void)
+{
+    struct timespec xTs = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &xTs);
+
+    return (uint64_t)xTs.tv_sec * 1000 + (uint64_t)xTs.tv_nsec / 1000000;
+}
+
+void Port_sleepMs(uint32_t uMs)
+{
+    struct timespec xTs = {0};
+
+    xTs.tv_sec = uMs / 1000;
+    xTs.tv_nsec = (long)(uMs % 1000) * 1000000;
+    while (nanosleep(&xTs, &xTs) != 0 && errno == EINTR)
+    {
+        /* Interrupted by a signal, sleep for the remaining time. */
+    }
+}
+
+uint32_t Port_random(uint32_t *puState)
+{
+    uint32_t x = *puState;
+
+    if (x == 0)
+    {
+        x = (uint32_t)Port_getTimeMs() ^ (uint32_t)(uintptr_t)puState ^ 0x9E3779B9u;
+        if (x == 0)
+        {
+            x = 1;
+        }
+    }
+
+    /* xorshift32 */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *puState = x;
+
+    return x;
+}
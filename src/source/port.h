@@ -0,0 +1,28 @@
+#ifndef PORT_H
+#define PORT_H
+
+#include <stdint.h>
+
+/**
+ * @brief Get the time of a monotonic clock
+ *
+ * @return Milliseconds elapsed since an unspecified starting point
+ */
+uint64_t Port_getTimeMs(void);
+
+/**
+ * @brief Suspend the calling thread
+ *
+ * @param[in] uMs Milliseconds to sleep
+ */
+void Port_sleepMs(uint32_t uMs);
+
+/**
+ * @brief Generate a pseudo random number. It's fast but not cryptographically secure.
+ *
+ * @param[in,out] puState The generator state. A zero state is seeded automatically.
+ * @return A pseudo random number
+ */
+uint32_t Port_random(uint32_t *puState);
+
+#endif /* PORT_H */
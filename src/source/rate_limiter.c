@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "port.h"
+#include "rate_limiter.h"
+
+#define DEFAULT_INITIAL_CONCURRENCY     (8)
+#define DEFAULT_MIN_CONCURRENCY         (1)
+#define DEFAULT_MAX_CONCURRENCY         (64)
+#define DEFAULT_MAX_QUEUED              (256)
+#define DEFAULT_MAX_QUEUE_WAIT_MS       (5 * 1000)
+
+/* A throttle halves the concurrency and cuts the rate, and the rate recovers by this percentage of the configured rate every second. */
+#define THROTTLE_CONCURRENCY_DECREASE   (0.5)
+#define THROTTLE_RATE_DECREASE          (0.7)
+#define RATE_INCREASE_PERCENT_PER_SEC   (5)
+
+/* The rate never drops below this percentage of the configured rate, so it can recover from a burst of throttles. */
+#define MIN_RATE_PERCENT                (10)
+
+/* Latency beyond this factor of the lowest latency seen means requests queue up in the service, and the concurrency is reduced. */
+#define LATENCY_TOLERANCE               (2.0)
+#define LATENCY_CONCURRENCY_DECREASE    (0.9)
+
+/* The lowest latency creeps toward recent samples, so a lasting change of the network path is learned again. */
+#define MIN_LATENCY_DRIFT               (0.01)
+
+typedef struct PollyRateLimiter
+{
+    PollyRateLimiterConfig_t xConfig;
+
+    /* Callers waiting for permits sleep on the condition, and every release wakes them up. */
+    pthread_mutex_t xLock;
+    pthread_cond_t xCond;
+    unsigned int uQueued;
+
+    /* Priority classes. A bulk request waits while interactive ones are queued, unless it has a turn by uInteractiveWeight. */
+    unsigned int uInteractiveQueued;
+    unsigned int uBulkQueued;
+    unsigned int uInteractiveStreak; // Interactive requests let through since a bulk one, while bulk ones were queued
+
+    /* Token bucket. The refill rate adapts between MIN_RATE_PERCENT and the configured rate. */
+    double fTokens;
+    double fRate;
+    uint64_t uLastRefillMs;
+    uint64_t uLastRateIncreaseMs;
+
+    /* AIMD concurrency limit */
+    double fLimit;
+    unsigned int uInFlight;
+    double fMinLatencyMs; // 0 until the first sample
+} PollyRateLimiter_t;
+
+/* Wait for a wakeup or a timeout. It has to be called with the lock held. */
+static void prvTimedWait(PollyRateLimiter_t *pxRateLimiter, uint64_t uWaitMs)
+{
+    struct timespec xDeadline = {0};
+
+    clock_gettime(CLOCK_REALTIME, &xDeadline);
+    xDeadline.tv_sec += uWaitMs / 1000;
+    xDeadline.tv_nsec += (long)(uWaitMs % 1000) * 1000000;
+    if (xDeadline.tv_nsec >= 1000000000)
+    {
+        xDeadline.tv_sec++;
+        xDeadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&(pxRateLimiter->xCond), &(pxRateLimiter->xLock), &xDeadline);
+}
+
+/* It has to be called with the lock held. */
+static void prvRefill(PollyRateLimiter_t *pxRateLimiter, uint64_t uNowMs)
+{
+    pxRateLimiter->fTokens += (double)(uNowMs - pxRateLimiter->uLastRefillMs) * pxRateLimiter->fRate / 1000;
+    if (pxRateLimiter->fTokens > pxRateLimiter->xConfig.uBurst)
+    {
+        pxRateLimiter->fTokens = pxRateLimiter->xConfig.uBurst;
+    }
+    pxRateLimiter->uLastRefillMs = uNowMs;
+}
+
+PollyRateLimiterHandle PollyRateLimiter_create(const PollyRateLimiterConfig_t *pConfig)
+{
+    PollyRateLimiter_t *pxRateLimiter = NULL;
+    bool bLockInited = false;
+
+    if (pConfig != NULL && (pxRateLimiter = (PollyRateLimiter_t *)Allocator_malloc(sizeof(PollyRateLimiter_t))) != NULL)
+    {
+        memset(pxRateLimiter, 0, sizeof(PollyRateLimiter_t));
+        memcpy(&(pxRateLimiter->xConfig), pConfig, sizeof(PollyRateLimiterConfig_t));
+
+        if (pxRateLimiter->xConfig.uBurst == 0)
+        {
+            pxRateLimiter->xConfig.uBurst = pxRateLimiter->xConfig.uRequestsPerSecond;
+        }
+        if (pxRateLimiter->xConfig.uMinConcurrency == 0)
+        {
+            pxRateLimiter->xConfig.uMinConcurrency = DEFAULT_MIN_CONCURRENCY;
+        }
+        if (pxRateLimiter->xConfig.uMaxConcurrency == 0)
+        {
+            pxRateLimiter->xConfig.uMaxConcurrency = DEFAULT_MAX_CONCURRENCY;
+        }
+        if (pxRateLimiter->xConfig.uInitialConcurrency == 0)
+        {
+            pxRateLimiter->xConfig.uInitialConcurrency = DEFAULT_INITIAL_CONCURRENCY;
+        }
+        if (pxRateLimiter->xConfig.uMaxQueued == 0)
+        {
+            pxRateLimiter->xConfig.uMaxQueued = DEFAULT_MAX_QUEUED;
+        }
+        if (pxRateLimiter->xConfig.uMaxQueueWaitMs == 0)
+        {
+            pxRateLimiter->xConfig.uMaxQueueWaitMs = DEFAULT_MAX_QUEUE_WAIT_MS;
+        }
+
+        pxRateLimiter->fLimit = pxRateLimiter->xConfig.uInitialConcurrency;
+        if (pxRateLimiter->fLimit < pxRateLimiter->xConfig.uMinConcurrency)
+        {
+            pxRateLimiter->fLimit = pxRateLimiter->xConfig.uMinConcurrency;
+        }
+        if (pxRateLimiter->fLimit > pxRateLimiter->xConfig.uMaxConcurrency)
+        {
+            pxRateLimiter->fLimit = pxRateLimiter->xConfig.uMaxConcurrency;
+        }
+        pxRateLimiter->fRate = pxRateLimiter->xConfig.uRequestsPerSecond;
+        pxRateLimiter->fTokens = pxRateLimiter->xConfig.uBurst;
+        pxRateLimiter->uLastRefillMs = Port_getTimeMs();
+        pxRateLimiter->uLastRateIncreaseMs = pxRateLimiter->uLastRefillMs;
+
+        if (!(bLockInited = (pthread_mutex_init(&(pxRateLimiter->xLock), NULL) == 0)) ||
+            pthread_cond_init(&(pxRateLimiter->xCond), NULL) != 0)
+        {
+            if (bLockInited)
+            {
+                pthread_mutex_destroy(&(pxRateLimiter->xLock));
+            }
+            Allocator_free(pxRateLimiter);
+            pxRateLimiter = NULL;
+        }
+    }
+
+    return pxRateLimiter;
+}
+
+void PollyRateLimiter_terminate(PollyRateLimiterHandle xRateLimiter)
+{
+    PollyRateLimiter_t *pxRateLimiter = (PollyRateLimiter_t *)xRateLimiter;
+
+    if (pxRateLimiter != NULL)
+    {
+        pthread_cond_destroy(&(pxRateLimiter->xCond));
+        pthread_mutex_destroy(&(pxRateLimiter->xLock));
+        Allocator_free(pxRateLimiter);
+    }
+}
+
+int PollyRateLimiter_getLimits(PollyRateLimiterHandle xRateLimiter, unsigned int *puConcurrency, unsigned int *puRequestsPerSecond)
+{
+    int res = POLLY_ERRNO_NONE;
+    PollyRateLimiter_t *pxRateLimiter = (PollyRateLimiter_t *)xRateLimiter;
+
+    if (pxRateLimiter == NULL || puConcurrency == NULL || puRequestsPerSecond == NULL)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        pthread_mutex_lock(&(pxRateLimiter->xLock));
+        *puConcurrency = (unsigned int)pxRateLimiter->fLimit;
+        *puRequestsPerSecond = (unsigned int)pxRateLimiter->fRate;
+        pthread_mutex_unlock(&(pxRateLimiter->xLock));
+    }
+
+    return res;
+}
+
+/* Whether a request of the class may take the capacity which is free. It has to be called with the lock held. */
+static bool prvIsAdmitted(PollyRateLimiter_t *pxRateLimiter, PollyPriority_t ePriority, unsigned int uPermits, double fTokensNeeded)
+{
+    bool bConcurrencyOk = false;
+    bool bTokensOk = false;
+    bool bTurn = true;
+    unsigned int uReservedConcurrency = 0;
+    double fReservedTokens = 0;
+
+    if (ePriority == POLLY_PRIORITY_BULK)
+    {
+        /* The reserve never exceeds the bucket, so a bulk request still goes once the bucket is full. */
+        uReservedConcurrency = pxRateLimiter->xConfig.uReservedConcurrency;
+        fReservedTokens = pxRateLimiter->xConfig.uReservedBurst;
+        if (fReservedTokens > pxRateLimiter->xConfig.uBurst - fTokensNeeded)
+        {
+            fReservedTokens = pxRateLimiter->xConfig.uBurst - fTokensNeeded;
+        }
+        bTurn = pxRateLimiter->uInteractiveQueued == 0 ||
+                (pxRateLimiter->xConfig.uInteractiveWeight > 0 && pxRateLimiter->uInteractiveStreak >= pxRateLimiter->xConfig.uInteractiveWeight);
+    }
+
+    bConcurrencyOk = pxRateLimiter->uInFlight == 0 ||
+                     pxRateLimiter->uInFlight + uPermits + uReservedConcurrency <= (unsigned int)pxRateLimiter->fLimit;
+    bTokensOk = pxRateLimiter->xConfig.uRequestsPerSecond == 0 || pxRateLimiter->fTokens >= fTokensNeeded + fReservedTokens;
+
+    return bTurn && bConcurrencyOk && bTokensOk;
+}
+
+int RateLimiter_acquire(PollyRateLimiterHandle xRateLimiter, unsigned int uPermits, PollyPriority_t ePriority, uint64_t uRequestDeadlineMs)
+{
+    int res = RATE_LIMITER_ERRNO_NONE;
+    PollyRateLimiter_t *pxRateLimiter = (PollyRateLimiter_t *)xRateLimiter;
+    uint64_t uNowMs = 0;
+    uint64_t uDeadlineMs = 0;
+    uint64_t uWaitMs = 0;
+    double fTokensNeeded = 0;
+    unsigned int *puClassQueued = NULL;
+
+    if (pxRateLimiter != NULL)
+    {
+        pthread_mutex_lock(&(pxRateLimiter->xLock));
+        if (pxRateLimiter->uQueued >= pxRateLimiter->xConfig.uMaxQueued)
+        {
+            /* Shed the load right away rather than queueing without bound */
+            res = RATE_LIMITER_ERRNO_REJECTED;
+        }
+        else
+        {
+            pxRateLimiter->uQueued++;
+            puClassQueued = (ePriority == POLLY_PRIORITY_BULK) ? &(pxRateLimiter->uBulkQueued) : &(pxRateLimiter->uInteractiveQueued);
+            (*puClassQueued)++;
+            uDeadlineMs = Port_getTimeMs() + pxRateLimiter->xConfig.uMaxQueueWaitMs;
+            if (uRequestDeadlineMs != 0 && uRequestDeadlineMs < uDeadlineMs)
+            {
+                uDeadlineMs = uRequestDeadlineMs;
+            }
+            fTokensNeeded = (uPermits < pxRateLimiter->xConfig.uBurst) ? uPermits : pxRateLimiter->xConfig.uBurst;
+
+            while (true)
+            {
+                uNowMs = Port_getTimeMs();
+                prvRefill(pxRateLimiter, uNowMs);
+
+                if (prvIsAdmitted(pxRateLimiter, ePriority, uPermits, fTokensNeeded))
+                {
+                    /* A batch larger than the bucket leaves it in debt, which the next requests wait out. */
+                    if (pxRateLimiter->xConfig.uRequestsPerSecond > 0)
+                    {
+                        pxRateLimiter->fTokens -= uPermits;
+                    }
+                    pxRateLimiter->uInFlight += uPermits;
+                    if (ePriority == POLLY_PRIORITY_BULK)
+                    {
+                        pxRateLimiter->uInteractiveStreak = 0;
+                    }
+                    else if (pxRateLimiter->uBulkQueued > 0)
+                    {
+                        pxRateLimiter->uInteractiveStreak++;
+                    }
+                    break;
+                }
+                else if (uNowMs >= uDeadlineMs)
+                {
+                    res = RATE_LIMITER_ERRNO_REJECTED;
+                    break;
+                }
+                else
+                {
+                    uWaitMs = uDeadlineMs - uNowMs;
+                    if (pxRateLimiter->xConfig.uRequestsPerSecond > 0 && pxRateLimiter->fTokens < fTokensNeeded && pxRateLimiter->fRate > 0)
+                    {
+                        /* Sleep until enough tokens are refilled, unless a release wakes us up first */
+                        if ((fTokensNeeded - pxRateLimiter->fTokens) * 1000 / pxRateLimiter->fRate + 1 < (double)uWaitMs)
+                        {
+                            uWaitMs = (uint64_t)((fTokensNeeded - pxRateLimiter->fTokens) * 1000 / pxRateLimiter->fRate) + 1;
+                        }
+                    }
+                    else if (ePriority == POLLY_PRIORITY_BULK && pxRateLimiter->xConfig.uRequestsPerSecond > 0 && pxRateLimiter->fRate > 0 &&
+                             pxRateLimiter->uInteractiveQueued == 0)
+                    {
+                        /* The reserved tokens refill without a release, so poll the bucket at the rate it refills. */
+                        if (1000 / pxRateLimiter->fRate + 1 < (double)uWaitMs)
+                        {
+                            uWaitMs = (uint64_t)(1000 / pxRateLimiter->fRate) + 1;
+                        }
+                    }
+                    prvTimedWait(pxRateLimiter, uWaitMs);
+                }
+            }
+            pxRateLimiter->uQueued--;
+            (*puClassQueued)--;
+            if (ePriority == POLLY_PRIORITY_INTERACTIVE && pxRateLimiter->uInteractiveQueued == 0 && pxRateLimiter->uBulkQueued > 0)
+            {
+                /* The bulk requests held back by this one may go now. */
+                pthread_cond_broadcast(&(pxRateLimiter->xCond));
+            }
+        }
+        pthread_mutex_unlock(&(pxRateLimiter->xLock));
+    }
+
+    return res;
+}
+
+void RateLimiter_release(PollyRateLimiterHandle xRateLimiter, unsigned int uPermits, unsigned int uThrottled, uint32_t uLatencyMs)
+{
+    PollyRateLimiter_t *pxRateLimiter = (PollyRateLimiter_t *)xRateLimiter;
+    double fMinRate = 0;
+    uint64_t uNowMs = 0;
+
+    if (pxRateLimiter != NULL)
+    {
+        pthread_mutex_lock(&(pxRateLimiter->xLock));
+        uNowMs = Port_getTimeMs();
+        pxRateLimiter->uInFlight -= (uPermits < pxRateLimiter->uInFlight) ? uPermits : pxRateLimiter->uInFlight;
+
+        if (uThrottled > 0)
+        {
+            /* Multiplicative decrease. The tokens saved up are dropped too, so no burst follows the throttle. */
+            pxRateLimiter->fLimit *= THROTTLE_CONCURRENCY_DECREASE;
+            fMinRate = (double)pxRateLimiter->xConfig.uRequestsPerSecond * MIN_RATE_PERCENT / 100;
+            pxRateLimiter->fRate *= THROTTLE_RATE_DECREASE;
+            if (pxRateLimiter->fRate < fMinRate)
+            {
+                pxRateLimiter->fRate = fMinRate;
+            }
+            if (pxRateLimiter->fTokens > 0)
+            {
+                pxRateLimiter->fTokens = 0;
+            }
+            pxRateLimiter->uLastRateIncreaseMs = uNowMs;
+        }
+        else
+        {
+            /* Additive increase of the rate, by the time which passed without a throttle */
+            pxRateLimiter->fRate += (double)(uNowMs - pxRateLimiter->uLastRateIncreaseMs) / 1000 *
+                                    pxRateLimiter->xConfig.uRequestsPerSecond * RATE_INCREASE_PERCENT_PER_SEC / 100;
+            if (pxRateLimiter->fRate > pxRateLimiter->xConfig.uRequestsPerSecond)
+            {
+                pxRateLimiter->fRate = pxRateLimiter->xConfig.uRequestsPerSecond;
+            }
+            pxRateLimiter->uLastRateIncreaseMs = uNowMs;
+
+            if (uLatencyMs > 0)
+            {
+                if (pxRateLimiter->fMinLatencyMs == 0 || uLatencyMs < pxRateLimiter->fMinLatencyMs)
+                {
+                    pxRateLimiter->fMinLatencyMs = uLatencyMs;
+                }
+                else
+                {
+                    pxRateLimiter->fMinLatencyMs += (uLatencyMs - pxRateLimiter->fMinLatencyMs) * MIN_LATENCY_DRIFT;
+                }
+            }
+
+            if (uLatencyMs > 0 && uLatencyMs > pxRateLimiter->fMinLatencyMs * LATENCY_TOLERANCE)
+            {
+                pxRateLimiter->fLimit *= LATENCY_CONCURRENCY_DECREASE;
+            }
+            else
+            {
+                /* The limit grows by about one per round of requests at the limit */
+                pxRateLimiter->fLimit += (double)uPermits / pxRateLimiter->fLimit;
+            }
+        }
+
+        if (pxRateLimiter->fLimit < pxRateLimiter->xConfig.uMinConcurrency)
+        {
+            pxRateLimiter->fLimit = pxRateLimiter->xConfig.uMinConcurrency;
+        }
+        if (pxRateLimiter->fLimit > pxRateLimiter->xConfig.uMaxConcurrency)
+        {
+            pxRateLimiter->fLimit = pxRateLimiter->xConfig.uMaxConcurrency;
+        }
+
+        pthread_cond_broadcast(&(pxRateLimiter->xCond));
+        pthread_mutex_unlock(&(pxRateLimiter->xLock));
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "polly/polly.h"
+
+#define RATE_LIMITER_ERRNO_NONE         (0)
+#define RATE_LIMITER_ERRNO_REJECTED     (-1)
+
+/**
+ * @brief Wait for the permits to send requests. A request needs a token of the bucket and a slot of the concurrency limit.
+ * A batch larger than the limits is let through alone, so it can't wait forever. A bulk request leaves the reserved capacity to
+ * interactive requests, and waits while they are queued.
+ *
+ * @param[in] xRateLimiter The rate limiter handle, or NULL to not limit
+ * @param[in] uPermits The number of requests
+ * @param[in] ePriority The class of the requests
+ * @param[in] uRequestDeadlineMs The deadline of the requests on the clock of Port_getTimeMs(), which cuts the wait short, or 0 for none
+ * @return RATE_LIMITER_ERRNO_NONE if the requests can be sent, RATE_LIMITER_ERRNO_REJECTED if the queue is full or the wait timed out
+ */
+int RateLimiter_acquire(PollyRateLimiterHandle xRateLimiter, unsigned int uPermits, PollyPriority_t ePriority, uint64_t uRequestDeadlineMs);
+
+/**
+ * @brief Return the permits of finished requests, and adapt the limits to how the service handled them
+ *
+ * @param[in] xRateLimiter The rate limiter handle, or NULL to not limit
+ * @param[in] uPermits The number of requests
+ * @param[in] uThrottled How many of them were throttled by the service
+ * @param[in] uLatencyMs Time to first byte of the requests, or 0 if it's unknown
+ */
+void RateLimiter_release(PollyRateLimiterHandle xRateLimiter, unsigned int uPermits, unsigned int uThrottled, uint32_t uLatencyMs);
+
+#endif /* RATE_LIMITER_H */
@@ -0,0 +1,345 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+
+#include "polly/polly.h"
+
+#include "credential_provider.h"
+#include "hpack.h"
+#include "request.h"
+#include "sigv4.h"
+
+/* The HTTP/2 header block holds the host, the authorization, the session token and this much for the rest of the headers. */
+#define HTTP2_HEADER_BLOCK_OVERHEAD 256
+
+static int prvGenDateTimeIso8601(char pDateISO8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE])
+{
+    int res = POLLY_ERRNO_NONE;
+    time_t xTimeUtcNow = {0};
+
+    xTimeUtcNow = time(NULL);
+    strftime(pDateISO8601, DATE_TIME_ISO_8601_FORMAT_STRING_SIZE, "%Y%m%dT%H%M%SZ", gmtime(&xTimeUtcNow));
+
+    return res;
+}
+
+/* Print at the end of a buffer which may be NULL, so the same code measures and writes the payload. */
+static size_t prvPrintAt(char *pBuf, size_t uBufSize, size_t uOffset, const char *pFormat, ...)
+{
+    va_list xArgs;
+    int iLen = 0;
+
+    va_start(xArgs, pFormat);
+    iLen = vsnprintf((pBuf != NULL) ? pBuf + uOffset : NULL, (pBuf != NULL) ? uBufSize - uOffset : 0, pFormat, xArgs);
+    va_end(xArgs);
+
+    return (iLen > 0) ? (size_t)iLen : 0;
+}
+
+/* A comma separated list, ex: "sentence,word", is sent as a JSON array of strings. */
+static size_t prvPrintList(char *pBuf, size_t uBufSize, size_t uOffset, const char *pName, const char *pList)
+{
+    size_t uLen = 0;
+    const char *pItem = pList;
+    size_t uItemLen = 0;
+
+    uLen += prvPrintAt(pBuf, uBufSize, uOffset + uLen, ",\"%s\": [", pName);
+    while (*pItem != '\0')
+    {
+        uItemLen = strcspn(pItem, ",");
+        uLen += prvPrintAt(pBuf, uBufSize, uOffset + uLen, "%s\"%.*s\"", (pItem == pList) ? "" : ",", (int)uItemLen, pItem);
+        pItem += uItemLen;
+        pItem += (*pItem == ',') ? 1 : 0;
+    }
+    uLen += prvPrintAt(pBuf, uBufSize, uOffset + uLen, "]");
+
+    return uLen;
+}
+
+static size_t prvPrintPayload(char *pBuf, size_t uBufSize, PollySynthesizeSpeechParameter_t *pPara)
+{
+    size_t uLen = 0;
+
+    uLen += prvPrintAt(pBuf, uBufSize, uLen, "{\"OutputFormat\": \"%s\",\"VoiceId\": \"%s\", \"Text\": \"%s\"", pPara->pOutputFormat, pPara->pVoiceId, pPara->pText);
+    if (pPara->pEngine != NULL)
+    {
+        uLen += prvPrintAt(pBuf, uBufSize, uLen, ",\"Engine\": \"%s\"", pPara->pEngine);
+    }
+    if (pPara->pLanguageCode != NULL)
+    {
+        uLen += prvPrintAt(pBuf, uBufSize, uLen, ",\"LanguageCode\": \"%s\"", pPara->pLanguageCode);
+    }
+    if (pPara->pSampleRate != NULL)
+    {
+        uLen += prvPrintAt(pBuf, uBufSize, uLen, ",\"SampleRate\": \"%s\"", pPara->pSampleRate);
+    }
+    if (pPara->pTextType != NULL)
+    {
+        uLen += prvPrintAt(pBuf, uBufSize, uLen, ",\"TextType\": \"%s\"", pPara->pTextType);
+    }
+    if (pPara->pLexiconNames != NULL)
+    {
+        uLen += prvPrintList(pBuf, uBufSize, uLen, "LexiconNames", pPara->pLexiconNames);
+    }
+    if (pPara->pSpeechMarkTypes != NULL)
+    {
+        uLen += prvPrintList(pBuf, uBufSize, uLen, "SpeechMarkTypes", pPara->pSpeechMarkTypes);
+    }
+    uLen += prvPrintAt(pBuf, uBufSize, uLen, "}");
+
+    return uLen;
+}
+
+int Request_genPayload(ArenaHandle xArena, PollySynthesizeSpeechParameter_t *pPara, char **ppPayload, size_t *puPayloadLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    char *pPayload = NULL;
+    size_t uPayloadLen = 0;
+
+    uPayloadLen = prvPrintPayload(NULL, 0, pPara);
+
+    if ((pPayload = (char *)Arena_alloc(xArena, uPayloadLen + 1)) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        prvPrintPayload(pPayload, uPayloadLen + 1, pPara);
+        *ppPayload = pPayload;
+        *puPayloadLen = uPayloadLen;
+    }
+
+    return res;
+}
+
+/* Take the credentials of a request. With a provider it's the current snapshot, which can't change while the request is being signed. */
+static Credentials_t *prvAcquireCredentials(PollyServiceParameter_t *pServPara, Credentials_t *pxStaticCredentials)
+{
+    Credentials_t *pxCredentials = NULL;
+
+    if (pServPara->xCredentialProvider != NULL)
+    {
+        pxCredentials = CredentialProvider_acquire(pServPara->xCredentialProvider);
+    }
+    else if (pServPara->pAccessKey != NULL && pServPara->pSecretKey != NULL)
+    {
+        memset(pxStaticCredentials, 0, sizeof(Credentials_t));
+        pxStaticCredentials->pAccessKey = pServPara->pAccessKey;
+        pxStaticCredentials->pSecretKey = pServPara->pSecretKey;
+        pxStaticCredentials->pToken = (pServPara->pToken != NULL && pServPara->pToken[0] != '\0') ? pServPara->pToken : NULL;
+        pxCredentials = pxStaticCredentials;
+    }
+
+    return pxCredentials;
+}
+
+static void prvReleaseCredentials(PollyServiceParameter_t *pServPara, Credentials_t *pxCredentials)
+{
+    if (pServPara->xCredentialProvider != NULL && pxCredentials != NULL)
+    {
+        CredentialProvider_release(pxCredentials);
+    }
+}
+
+static int prvSignSynthesizeSpeechReq(ArenaHandle xArena, PollyServiceParameter_t *pServPara, Credentials_t *pxCredentials, PollySynthesizeSpeechParameter_t *pPara, const char *pDateISO8601, char **ppPayload, size_t *puPayloadLen, char **ppAuth)
+{
+    int res = POLLY_ERRNO_NONE;
+    char *pPayload = NULL;
+    size_t uPayloadLen = 0;
+    SigV4Para_t xSigV4Para = { 0 };
+    char *pAuth = NULL;
+    size_t uAuthLen = 0;
+
+    if ((res = Request_genPayload(xArena, pPara, &pPayload, &uPayloadLen)) != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else
+    {
+        xSigV4Para.pAccessKey = pxCredentials->pAccessKey;
+        xSigV4Para.pSecretKey = pxCredentials->pSecretKey;
+        xSigV4Para.pToken = pxCredentials->pToken;
+        xSigV4Para.pRegion = pServPara->pRegion;
+        xSigV4Para.pService = pServPara->pService;
+        xSigV4Para.pDateIso8601 = pDateISO8601;
+        xSigV4Para.pHttpMethod = "POST";
+        xSigV4Para.pPath = "/v1/speech";
+        xSigV4Para.pQuery = NULL;
+        xSigV4Para.pHost = pServPara->pHost;
+        xSigV4Para.pPayload = pPayload;
+        xSigV4Para.uPayloadLen = uPayloadLen;
+        xSigV4Para.xArena = xArena;
+
+        if (SigV4_Sign(&xSigV4Para, &pAuth, &uAuthLen) != SIGV4_ERRNO_NONE)
+        {
+            res = POLLY_ERRNO_SIGN_FAILURE;
+        }
+        else
+        {
+            *ppPayload = pPayload;
+            *puPayloadLen = uPayloadLen;
+            *ppAuth = pAuth;
+        }
+    }
+
+    if (res != POLLY_ERRNO_NONE && pPayload != NULL)
+    {
+        Arena_free(xArena, pPayload);
+    }
+
+    return res;
+}
+
+int Request_genHttpReq(ArenaHandle xArena, PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, char **ppHttpReq, size_t *puHttpReqLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    char *pPayload = NULL;
+    size_t uPayloadLen = 0;
+    char *pAuth = NULL;
+    Credentials_t xStaticCredentials;
+    Credentials_t *pxCredentials = NULL;
+
+    char pDateISO8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE];
+    char *pHttpReq = NULL;
+    size_t uHttpReqLen = 0;
+    char *p = NULL;
+
+    if ((pxCredentials = prvAcquireCredentials(pServPara, &xStaticCredentials)) == NULL)
+    {
+        res = POLLY_ERRNO_NO_CREDENTIALS;
+    }
+    else if ((res = prvGenDateTimeIso8601(pDateISO8601)) != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if ((res = prvSignSynthesizeSpeechReq(xArena, pServPara, pxCredentials, pPara, pDateISO8601, &pPayload, &uPayloadLen, &pAuth)) != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else
+    {
+        /* Calculate needed length */
+        uHttpReqLen = 0;
+        uHttpReqLen += snprintf(NULL, 0, "POST /v1/speech HTTP/1.1\r\n");
+        uHttpReqLen += snprintf(NULL, 0, "host: %s\r\n", pServPara->pHost);
+        uHttpReqLen += snprintf(NULL, 0, "content-type: application/json\r\n");
+        uHttpReqLen += snprintf(NULL, 0, "content-length: %zu\r\n", uPayloadLen);
+        uHttpReqLen += snprintf(NULL, 0, "authorization: %s\r\n", pAuth);
+        uHttpReqLen += snprintf(NULL, 0, "x-amz-Date: %s\r\n", pDateISO8601);
+        if (pxCredentials->pToken != NULL)
+        {
+            uHttpReqLen += snprintf(NULL, 0, "x-amz-security-token: %s\r\n", pxCredentials->pToken);
+        }
+        uHttpReqLen += snprintf(NULL, 0, "\r\n");
+        uHttpReqLen += snprintf(NULL, 0, "%.*s", (int)uPayloadLen, pPayload);
+
+        if ((pHttpReq = (char *)Arena_alloc(xArena, uHttpReqLen + 1)) == NULL)
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            p = pHttpReq;
+            p += sprintf(p, "POST /v1/speech HTTP/1.1\r\n");
+            p += sprintf(p, "host: %s\r\n", pServPara->pHost);
+            p += sprintf(p, "content-type: application/json\r\n");
+            p += sprintf(p, "content-length: %zu\r\n", uPayloadLen);
+            p += sprintf(p, "authorization: %s\r\n", pAuth);
+            p += sprintf(p, "x-amz-Date: %s\r\n", pDateISO8601);
+            if (pxCredentials->pToken != NULL)
+            {
+                p += sprintf(p, "x-amz-security-token: %s\r\n", pxCredentials->pToken);
+            }
+            p += sprintf(p, "\r\n");
+            p += sprintf(p, "%.*s", (int)uPayloadLen, pPayload);
+
+            *ppHttpReq = pHttpReq;
+            *puHttpReqLen = uHttpReqLen;
+        }
+    }
+
+    prvReleaseCredentials(pServPara, pxCredentials);
+    if (pAuth != NULL)
+    {
+        Arena_free(xArena, pAuth);
+    }
+    if (pPayload != NULL)
+    {
+        Arena_free(xArena, pPayload);
+    }
+
+    return res;
+}
+
+int Request_genHttp2Req(ArenaHandle xArena, PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, Http2Request_t *pxReq)
+{
+    int res = POLLY_ERRNO_NONE;
+    char *pPayload = NULL;
+    size_t uPayloadLen = 0;
+    char *pAuth = NULL;
+    char pDateISO8601[DATE_TIME_ISO_8601_FORMAT_STRING_SIZE];
+    char pContentLength[24];
+    uint8_t *pHeaderBlock = NULL;
+    size_t uHeaderBlockSize = 0;
+    size_t uHeaderBlockLen = 0;
+    Credentials_t xStaticCredentials;
+    Credentials_t *pxCredentials = NULL;
+
+    if ((pxCredentials = prvAcquireCredentials(pServPara, &xStaticCredentials)) == NULL)
+    {
+        res = POLLY_ERRNO_NO_CREDENTIALS;
+    }
+    else if ((res = prvGenDateTimeIso8601(pDateISO8601)) != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if ((res = prvSignSynthesizeSpeechReq(xArena, pServPara, pxCredentials, pPara, pDateISO8601, &pPayload, &uPayloadLen, &pAuth)) != POLLY_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else
+    {
+        snprintf(pContentLength, sizeof(pContentLength), "%zu", uPayloadLen);
+
+        /* Literal strings cost their length plus a few bytes of prefix, so this is always enough. */
+        uHeaderBlockSize = HTTP2_HEADER_BLOCK_OVERHEAD + strlen(pServPara->pHost) + strlen(pAuth) + ((pxCredentials->pToken != NULL) ? strlen(pxCredentials->pToken) : 0);
+
+        if ((pHeaderBlock = (uint8_t *)Arena_alloc(xArena, uHeaderBlockSize)) == NULL)
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+        else if (Hpack_encodeIndexed(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, HPACK_STATIC_METHOD_POST) != HPACK_ERRNO_NONE ||
+                 Hpack_encodeIndexed(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, HPACK_STATIC_SCHEME_HTTPS) != HPACK_ERRNO_NONE ||
+                 Hpack_encodeLiteral(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, HPACK_STATIC_PATH, NULL, "/v1/speech", sizeof("/v1/speech") - 1) != HPACK_ERRNO_NONE ||
+                 Hpack_encodeLiteral(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, HPACK_STATIC_AUTHORITY, NULL, pServPara->pHost, strlen(pServPara->pHost)) != HPACK_ERRNO_NONE ||
+                 Hpack_encodeLiteral(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, HPACK_STATIC_CONTENT_TYPE, NULL, "application/json", sizeof("application/json") - 1) != HPACK_ERRNO_NONE ||
+                 Hpack_encodeLiteral(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, HPACK_STATIC_CONTENT_LENGTH, NULL, pContentLength, strlen(pContentLength)) != HPACK_ERRNO_NONE ||
+                 Hpack_encodeLiteral(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, HPACK_STATIC_AUTHORIZATION, NULL, pAuth, strlen(pAuth)) != HPACK_ERRNO_NONE ||
+                 Hpack_encodeLiteral(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, 0, "x-amz-date", pDateISO8601, strlen(pDateISO8601)) != HPACK_ERRNO_NONE ||
+                 (pxCredentials->pToken != NULL &&
+                  Hpack_encodeLiteral(pHeaderBlock, uHeaderBlockSize, &uHeaderBlockLen, 0, "x-amz-security-token", pxCredentials->pToken, strlen(pxCredentials->pToken)) != HPACK_ERRNO_NONE))
+        {
+            res = POLLY_ERRNO_OUT_OF_MEMORY;
+        }
+        else
+        {
+            /* The header block and the payload stay in the arena until the response is received. */
+            pxReq->pHeaderBlock = pHeaderBlock;
+            pxReq->uHeaderBlockLen = uHeaderBlockLen;
+            pxReq->pBody = (const uint8_t *)pPayload;
+            pxReq->uBodyLen = uPayloadLen;
+        }
+    }
+
+    prvReleaseCredentials(pServPara, pxCredentials);
+    if (pAuth != NULL)
+    {
+        Arena_free(xArena, pAuth);
+    }
+
+    return res;
+}
+
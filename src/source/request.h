@@ -0,0 +1,49 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include <stddef.h>
+
+#include "polly/polly.h"
+
+#include "arena.h"
+#include "http2.h"
+
+/* The arena of a request holds the payload, the signing strings and the HTTP request. They all grow with the text, and the rest fits in this overhead. */
+#define REQUEST_ARENA_OVERHEAD      2048
+#define REQUEST_ARENA_TEXT_FACTOR   2
+
+/**
+ * @brief Generate the JSON payload of a SynthesizeSpeech request
+ *
+ * @param[in] xArena The arena which the payload is allocated from
+ * @param[in] pPara The parameters of the request
+ * @param[out] ppPayload The payload, NUL-terminated
+ * @param[out] puPayloadLen The length of the payload
+ * @return POLLY_ERRNO_NONE on success, non-zero value otherwise
+ */
+int Request_genPayload(ArenaHandle xArena, PollySynthesizeSpeechParameter_t *pPara, char **ppPayload, size_t *puPayloadLen);
+
+/**
+ * @brief Generate a signed HTTP/1.1 SynthesizeSpeech request, with the headers and the payload in one buffer
+ *
+ * @param[in] xArena The arena which the request is allocated from
+ * @param[in] pServPara The service parameters, which have the credentials
+ * @param[in] pPara The parameters of the request
+ * @param[out] ppHttpReq The request
+ * @param[out] puHttpReqLen The length of the request
+ * @return POLLY_ERRNO_NONE on success, non-zero value otherwise
+ */
+int Request_genHttpReq(ArenaHandle xArena, PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, char **ppHttpReq, size_t *puHttpReqLen);
+
+/**
+ * @brief Generate a signed HTTP/2 SynthesizeSpeech request, with an HPACK header block and the payload as the body
+ *
+ * @param[in] xArena The arena which the request is allocated from. The header block and the body stay in it until the response is received.
+ * @param[in] pServPara The service parameters, which have the credentials
+ * @param[in] pPara The parameters of the request
+ * @param[out] pxReq The request
+ * @return POLLY_ERRNO_NONE on success, non-zero value otherwise
+ */
+int Request_genHttp2Req(ArenaHandle xArena, PollyServiceParameter_t *pServPara, PollySynthesizeSpeechParameter_t *pPara, Http2Request_t *pxReq);
+
+#endif /* REQUEST_H */
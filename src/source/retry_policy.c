@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "port.h"
+#include "retry_policy.h"
+
+#define DEFAULT_BASE_BACKOFF_MS         (50)
+#define DEFAULT_MAX_BACKOFF_MS          (5 * 1000)
+#define DEFAULT_BUDGET_PERCENT          (10)
+#define DEFAULT_BUDGET_BURST            (10)
+#define DEFAULT_HEDGE_MIN_DELAY_MS      (20)
+
+/* The hedge delay before we have enough samples to estimate the percentile */
+#define HEDGE_COLD_DELAY_MS             (1000)
+#define HEDGE_PERCENTILE                (95)
+#define HEDGE_MIN_SAMPLES               (20)
+
+/* The TTFB histogram has 4 buckets per power of 2, and the samples decay by half once it's full. */
+#define TTFB_HISTOGRAM_BUCKETS          (64)
+#define TTFB_HISTOGRAM_SUB_BUCKET_BITS  (2)
+#define TTFB_HISTOGRAM_MAX_SAMPLES      (2048)
+
+/* The retry budget is accounted in 1/1000 of a retry */
+#define BUDGET_UNIT                     (1000)
+
+typedef struct PollyRetryPolicy
+{
+    PollyRetryPolicyConfig_t xConfig;
+
+    pthread_mutex_t xLock;
+    uint32_t uBudgetBalance;
+    uint32_t uBudgetMax;
+    uint32_t uRandomState;
+
+    uint32_t puTtfbHistogram[TTFB_HISTOGRAM_BUCKETS];
+    uint32_t uTtfbSamples;
+} PollyRetryPolicy_t;
+
+static unsigned int prvTtfbToBucket(uint32_t uTtfbMs)
+{
+    unsigned int uExp = 0;
+    unsigned int uBucket = 0;
+
+    if (uTtfbMs < (1 << TTFB_HISTOGRAM_SUB_BUCKET_BITS))
+    {
+        uBucket = uTtfbMs;
+    }
+    else
+    {
+        while ((uTtfbMs >> (uExp + 1)) != 0)
+        {
+            uExp++;
+        }
+        uBucket = ((uExp - 1) << TTFB_HISTOGRAM_SUB_BUCKET_BITS) +
+                  ((uTtfbMs >> (uExp - TTFB_HISTOGRAM_SUB_BUCKET_BITS)) & ((1 << TTFB_HISTOGRAM_SUB_BUCKET_BITS) - 1));
+        if (uBucket >= TTFB_HISTOGRAM_BUCKETS)
+        {
+            uBucket = TTFB_HISTOGRAM_BUCKETS - 1;
+        }
+    }
+
+    return uBucket;
+}
+
+static uint32_t prvBucketUpperBound(unsigned int uBucket)
+{
+    unsigned int uExp = 0;
+    unsigned int uSub = 0;
+    uint32_t uUpper = 0;
+
+    if (uBucket < (1 << TTFB_HISTOGRAM_SUB_BUCKET_BITS))
+    {
+        uUpper = uBucket;
+    }
+    else
+    {
+        uExp = (uBucket >> TTFB_HISTOGRAM_SUB_BUCKET_BITS) + 1;
+        uSub = uBucket & ((1 << TTFB_HISTOGRAM_SUB_BUCKET_BITS) - 1);
+        uUpper = (((1 << TTFB_HISTOGRAM_SUB_BUCKET_BITS) + uSub + 1) << (uExp - TTFB_HISTOGRAM_SUB_BUCKET_BITS)) - 1;
+    }
+
+    return uUpper;
+}
+
+PollyRetryPolicyHandle PollyRetryPolicy_create(const PollyRetryPolicyConfig_t *pConfig)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = NULL;
+
+    if (pConfig != NULL && (pxRetryPolicy = (PollyRetryPolicy_t *)Allocator_malloc(sizeof(PollyRetryPolicy_t))) != NULL)
+    {
+        memset(pxRetryPolicy, 0, sizeof(PollyRetryPolicy_t));
+        memcpy(&(pxRetryPolicy->xConfig), pConfig, sizeof(PollyRetryPolicyConfig_t));
+
+        if (pxRetryPolicy->xConfig.uMaxAttempts == 0)
+        {
+            pxRetryPolicy->xConfig.uMaxAttempts = 1;
+        }
+        if (pxRetryPolicy->xConfig.uBaseBackoffMs == 0)
+        {
+            pxRetryPolicy->xConfig.uBaseBackoffMs = DEFAULT_BASE_BACKOFF_MS;
+        }
+        if (pxRetryPolicy->xConfig.uMaxBackoffMs == 0)
+        {
+            pxRetryPolicy->xConfig.uMaxBackoffMs = DEFAULT_MAX_BACKOFF_MS;
+        }
+        if (pxRetryPolicy->xConfig.uBudgetPercent == 0)
+        {
+            pxRetryPolicy->xConfig.uBudgetPercent = DEFAULT_BUDGET_PERCENT;
+        }
+        if (pxRetryPolicy->xConfig.uBudgetBurst == 0)
+        {
+            pxRetryPolicy->xConfig.uBudgetBurst = DEFAULT_BUDGET_BURST;
+        }
+        if (pxRetryPolicy->xConfig.uHedgeMinDelayMs == 0)
+        {
+            pxRetryPolicy->xConfig.uHedgeMinDelayMs = DEFAULT_HEDGE_MIN_DELAY_MS;
+        }
+
+        pxRetryPolicy->uBudgetMax = pxRetryPolicy->xConfig.uBudgetBurst * BUDGET_UNIT;
+        pxRetryPolicy->uBudgetBalance = pxRetryPolicy->uBudgetMax;
+
+        if (pthread_mutex_init(&(pxRetryPolicy->xLock), NULL) != 0)
+        {
+            Allocator_free(pxRetryPolicy);
+            pxRetryPolicy = NULL;
+        }
+    }
+
+    return pxRetryPolicy;
+}
+
+void PollyRetryPolicy_terminate(PollyRetryPolicyHandle xRetryPolicy)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = (PollyRetryPolicy_t *)xRetryPolicy;
+
+    if (pxRetryPolicy != NULL)
+    {
+        pthread_mutex_destroy(&(pxRetryPolicy->xLock));
+        Allocator_free(pxRetryPolicy);
+    }
+}
+
+unsigned int RetryPolicy_getMaxAttempts(PollyRetryPolicyHandle xRetryPolicy)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = (PollyRetryPolicy_t *)xRetryPolicy;
+
+    return (pxRetryPolicy == NULL) ? 1 : pxRetryPolicy->xConfig.uMaxAttempts;
+}
+
+void RetryPolicy_onRequest(PollyRetryPolicyHandle xRetryPolicy)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = (PollyRetryPolicy_t *)xRetryPolicy;
+
+    if (pxRetryPolicy != NULL)
+    {
+        pthread_mutex_lock(&(pxRetryPolicy->xLock));
+        pxRetryPolicy->uBudgetBalance += pxRetryPolicy->xConfig.uBudgetPercent * BUDGET_UNIT / 100;
+        if (pxRetryPolicy->uBudgetBalance > pxRetryPolicy->uBudgetMax)
+        {
+            pxRetryPolicy->uBudgetBalance = pxRetryPolicy->uBudgetMax;
+        }
+        pthread_mutex_unlock(&(pxRetryPolicy->xLock));
+    }
+}
+
+bool RetryPolicy_acquire(PollyRetryPolicyHandle xRetryPolicy)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = (PollyRetryPolicy_t *)xRetryPolicy;
+    bool bAcquired = false;
+
+    if (pxRetryPolicy != NULL)
+    {
+        pthread_mutex_lock(&(pxRetryPolicy->xLock));
+        if (pxRetryPolicy->uBudgetBalance >= BUDGET_UNIT)
+        {
+            pxRetryPolicy->uBudgetBalance -= BUDGET_UNIT;
+            bAcquired = true;
+        }
+        pthread_mutex_unlock(&(pxRetryPolicy->xLock));
+    }
+
+    return bAcquired;
+}
+
+uint32_t RetryPolicy_getBackoffMs(PollyRetryPolicyHandle xRetryPolicy, unsigned int uRetry)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = (PollyRetryPolicy_t *)xRetryPolicy;
+    uint32_t uCeilingMs = 0;
+    uint32_t uBackoffMs = 0;
+
+    if (pxRetryPolicy != NULL && uRetry > 0)
+    {
+        uCeilingMs = pxRetryPolicy->xConfig.uBaseBackoffMs;
+        while (--uRetry > 0 && uCeilingMs < pxRetryPolicy->xConfig.uMaxBackoffMs)
+        {
+            uCeilingMs *= 2;
+        }
+        if (uCeilingMs > pxRetryPolicy->xConfig.uMaxBackoffMs)
+        {
+            uCeilingMs = pxRetryPolicy->xConfig.uMaxBackoffMs;
+        }
+
+        /* Full jitter: spread the retries of many clients uniformly so they don't arrive in waves. */
+        pthread_mutex_lock(&(pxRetryPolicy->xLock));
+        uBackoffMs = Port_random(&(pxRetryPolicy->uRandomState)) % (uCeilingMs + 1);
+        pthread_mutex_unlock(&(pxRetryPolicy->xLock));
+    }
+
+    return uBackoffMs;
+}
+
+void RetryPolicy_recordTtfb(PollyRetryPolicyHandle xRetryPolicy, uint32_t uTtfbMs)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = (PollyRetryPolicy_t *)xRetryPolicy;
+    size_t i = 0;
+
+    if (pxRetryPolicy != NULL)
+    {
+        pthread_mutex_lock(&(pxRetryPolicy->xLock));
+        if (pxRetryPolicy->uTtfbSamples >= TTFB_HISTOGRAM_MAX_SAMPLES)
+        {
+            /* Decay old samples so the percentile follows the recent latency. */
+            pxRetryPolicy->uTtfbSamples = 0;
+            for (i = 0; i < TTFB_HISTOGRAM_BUCKETS; i++)
+            {
+                pxRetryPolicy->puTtfbHistogram[i] /= 2;
+                pxRetryPolicy->uTtfbSamples += pxRetryPolicy->puTtfbHistogram[i];
+            }
+        }
+        pxRetryPolicy->puTtfbHistogram[prvTtfbToBucket(uTtfbMs)]++;
+        pxRetryPolicy->uTtfbSamples++;
+        pthread_mutex_unlock(&(pxRetryPolicy->xLock));
+    }
+}
+
+uint32_t RetryPolicy_getHedgeDelayMs(PollyRetryPolicyHandle xRetryPolicy)
+{
+    PollyRetryPolicy_t *pxRetryPolicy = (PollyRetryPolicy_t *)xRetryPolicy;
+    uint32_t uDelayMs = 0;
+    uint32_t uRank = 0;
+    uint32_t uCount = 0;
+    size_t i = 0;
+
+    if (pxRetryPolicy != NULL && pxRetryPolicy->xConfig.bHedge)
+    {
+        pthread_mutex_lock(&(pxRetryPolicy->xLock));
+        if (pxRetryPolicy->uTtfbSamples < HEDGE_MIN_SAMPLES)
+        {
+            uDelayMs = HEDGE_COLD_DELAY_MS;
+        }
+        else
+        {
+            uRank = (pxRetryPolicy->uTtfbSamples * HEDGE_PERCENTILE + 99) / 100;
+            for (i = 0; i < TTFB_HISTOGRAM_BUCKETS; i++)
+            {
+                uCount += pxRetryPolicy->puTtfbHistogram[i];
+                if (uCount >= uRank)
+                {
+                    break;
+                }
+            }
+            uDelayMs = prvBucketUpperBound((i < TTFB_HISTOGRAM_BUCKETS) ? i : TTFB_HISTOGRAM_BUCKETS - 1);
+        }
+        pthread_mutex_unlock(&(pxRetryPolicy->xLock));
+
+        if (uDelayMs < pxRetryPolicy->xConfig.uHedgeMinDelayMs)
+        {
+            uDelayMs = pxRetryPolicy->xConfig.uHedgeMinDelayMs;
+        }
+    }
+
+    return uDelayMs;
+}
@@ -0,0 +1,57 @@
+#ifndef RETRY_POLICY_H
+#define RETRY_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "polly/polly.h"
+
+/**
+ * @brief Get the maximum number of attempts of a request
+ *
+ * @param[in] xRetryPolicy The retry policy handle
+ * @return The maximum attempts, it's at least 1
+ */
+unsigned int RetryPolicy_getMaxAttempts(PollyRetryPolicyHandle xRetryPolicy);
+
+/**
+ * @brief Account a new request to the retry budget
+ *
+ * @param[in] xRetryPolicy The retry policy handle
+ */
+void RetryPolicy_onRequest(PollyRetryPolicyHandle xRetryPolicy);
+
+/**
+ * @brief Withdraw from the retry budget for a retry or a hedged request
+ *
+ * @param[in] xRetryPolicy The retry policy handle
+ * @return true if the budget allows it, false otherwise
+ */
+bool RetryPolicy_acquire(PollyRetryPolicyHandle xRetryPolicy);
+
+/**
+ * @brief Get the exponential backoff with full jitter before a retry
+ *
+ * @param[in] xRetryPolicy The retry policy handle
+ * @param[in] uRetry The retry count, starts from 1
+ * @return Backoff in milliseconds
+ */
+uint32_t RetryPolicy_getBackoffMs(PollyRetryPolicyHandle xRetryPolicy, unsigned int uRetry);
+
+/**
+ * @brief Record the time to first byte of a request
+ *
+ * @param[in] xRetryPolicy The retry policy handle
+ * @param[in] uTtfbMs Time to first byte in milliseconds
+ */
+void RetryPolicy_recordTtfb(PollyRetryPolicyHandle xRetryPolicy, uint32_t uTtfbMs);
+
+/**
+ * @brief Get the delay before sending a hedged request
+ *
+ * @param[in] xRetryPolicy The retry policy handle
+ * @return Delay in milliseconds, or 0 if hedging is disabled
+ */
+uint32_t RetryPolicy_getHedgeDelayMs(PollyRetryPolicyHandle xRetryPolicy);
+
+#endif /* RETRY_POLICY_H */
@@ -0,0 +1,333 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbedtls/sha256.h"
+
+#include "sha256_alt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_ALT_SHA_NI
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define SHA256_ALT_ARMV8_CE
+#endif
+
+typedef void (*Sha256ProcessFunc_t)(uint32_t pState[8], const unsigned char pData[64]);
+
+static const uint32_t gK[64] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static Sha256ProcessFunc_t gpfnProcess = NULL;
+static Sha256Backend_t geBackend = SHA256_BACKEND_PORTABLE;
+
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+#define S0(x)       (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define S1(x)       (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define S2(x)       (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define S3(x)       (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+static void prvProcessPortable(uint32_t pState[8], const unsigned char pData[64])
+{
+    uint32_t W[64];
+    uint32_t A[8];
+    uint32_t uTemp1 = 0;
+    uint32_t uTemp2 = 0;
+    int i = 0;
+
+    for (i = 0; i < 16; i++)
+    {
+        W[i] = ((uint32_t)pData[4 * i] << 24) | ((uint32_t)pData[4 * i + 1] << 16) | ((uint32_t)pData[4 * i + 2] << 8) | (uint32_t)pData[4 * i + 3];
+    }
+    for (i = 16; i < 64; i++)
+    {
+        W[i] = S1(W[i - 2]) + W[i - 7] + S0(W[i - 15]) + W[i - 16];
+    }
+    for (i = 0; i < 8; i++)
+    {
+        A[i] = pState[i];
+    }
+
+    for (i = 0; i < 64; i++)
+    {
+        uTemp1 = A[7] + S3(A[4]) + CH(A[4], A[5], A[6]) + gK[i] + W[i];
+        uTemp2 = S2(A[0]) + MAJ(A[0], A[1], A[2]);
+        A[7] = A[6];
+        A[6] = A[5];
+        A[5] = A[4];
+        A[4] = A[3] + uTemp1;
+        A[3] = A[2];
+        A[2] = A[1];
+        A[1] = A[0];
+        A[0] = uTemp1 + uTemp2;
+    }
+
+    for (i = 0; i < 8; i++)
+    {
+        pState[i] += A[i];
+    }
+}
+
+#if defined(SHA256_ALT_SHA_NI)
+static int prvHasShaNi(void)
+{
+    unsigned int uEax = 0;
+    unsigned int uEbx = 0;
+    unsigned int uEcx = 0;
+    unsigned int uEdx = 0;
+    int bSse41 = 0;
+
+    if (__get_cpuid(1, &uEax, &uEbx, &uEcx, &uEdx))
+    {
+        bSse41 = (uEcx & bit_SSE4_1) != 0;
+    }
+
+    /* SHA is bit 29 of EBX of leaf 7 */
+    return bSse41 && __get_cpuid_count(7, 0, &uEax, &uEbx, &uEcx, &uEdx) && (uEbx & (1u << 29)) != 0;
+}
+
+/* Four rounds with the message words xW of the group i */
+#define SHA_NI_ROUNDS(xW, i)                                                        \
+    do {                                                                            \
+        xMsg = _mm_add_epi32(xW, _mm_loadu_si128((const __m128i *)&gK[4 * (i)]));  \
+        xCdgh = _mm_sha256rnds2_epu32(xCdgh, xAbef, xMsg);                          \
+        xAbef = _mm_sha256rnds2_epu32(xAbef, xCdgh, _mm_shuffle_epi32(xMsg, 0x0E)); \
+    } while (0)
+
+/* Replace the oldest group xW0 with the next one */
+#define SHA_NI_SCHEDULE(xW0, xW1, xW2, xW3)                                         \
+    do {                                                                            \
+        xTemp = _mm_sha256msg1_epu32(xW0, xW1);                                     \
+        xTemp = _mm_add_epi32(xTemp, _mm_alignr_epi8(xW3, xW2, 4));                 \
+        xW0 = _mm_sha256msg2_epu32(xTemp, xW3);                                     \
+    } while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void prvProcessShaNi(uint32_t pState[8], const unsigned char pData[64])
+{
+    const __m128i xByteSwap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    __m128i xAbef;
+    __m128i xCdgh;
+    __m128i xAbefSaved;
+    __m128i xCdghSaved;
+    __m128i W0;
+    __m128i W1;
+    __m128i W2;
+    __m128i W3;
+    __m128i xMsg;
+    __m128i xTemp;
+    int i = 0;
+
+    /* The instructions take the state as ABEF and CDGH. */
+    xTemp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&pState[0]), 0xB1);
+    xCdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&pState[4]), 0x1B);
+    xAbef = _mm_alignr_epi8(xTemp, xCdgh, 8);
+    xCdgh = _mm_blend_epi16(xCdgh, xTemp, 0xF0);
+    xAbefSaved = xAbef;
+    xCdghSaved = xCdgh;
+
+    W0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pData + 0)), xByteSwap);
+    W1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pData + 16)), xByteSwap);
+    W2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pData + 32)), xByteSwap);
+    W3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pData + 48)), xByteSwap);
+    SHA_NI_ROUNDS(W0, 0);
+    SHA_NI_ROUNDS(W1, 1);
+    SHA_NI_ROUNDS(W2, 2);
+    SHA_NI_ROUNDS(W3, 3);
+
+    /* The words are kept in four registers, which rotate by one group of four rounds. */
+    for (i = 4; i < 16; i += 4)
+    {
+        SHA_NI_SCHEDULE(W0, W1, W2, W3);
+        SHA_NI_ROUNDS(W0, i);
+        SHA_NI_SCHEDULE(W1, W2, W3, W0);
+        SHA_NI_ROUNDS(W1, i + 1);
+        SHA_NI_SCHEDULE(W2, W3, W0, W1);
+        SHA_NI_ROUNDS(W2, i + 2);
+        SHA_NI_SCHEDULE(W3, W0, W1, W2);
+        SHA_NI_ROUNDS(W3, i + 3);
+    }
+
+    xAbef = _mm_add_epi32(xAbef, xAbefSaved);
+    xCdgh = _mm_add_epi32(xCdgh, xCdghSaved);
+
+    xTemp = _mm_shuffle_epi32(xAbef, 0x1B);
+    xCdgh = _mm_shuffle_epi32(xCdgh, 0xB1);
+    _mm_storeu_si128((__m128i *)&pState[0], _mm_blend_epi16(xTemp, xCdgh, 0xF0));
+    _mm_storeu_si128((__m128i *)&pState[4], _mm_alignr_epi8(xCdgh, xTemp, 8));
+}
+#endif /* SHA256_ALT_SHA_NI */
+
+#if defined(SHA256_ALT_ARMV8_CE)
+static int prvHasArmv8Ce(void)
+{
+#if defined(__ARM_FEATURE_SHA2) || defined(__APPLE__)
+    return 1;
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+    return 0;
+#endif
+}
+
+/* Four rounds with the message words xW of the group i */
+#define ARMV8_CE_ROUNDS(xW, i)                                                      \
+    do {                                                                            \
+        xMsg = vaddq_u32(xW, vld1q_u32(&gK[4 * (i)]));                              \
+        xTemp = xAbcd;                                                              \
+        xAbcd = vsha256hq_u32(xAbcd, xEfgh, xMsg);                                  \
+        xEfgh = vsha256h2q_u32(xEfgh, xTemp, xMsg);                                 \
+    } while (0)
+
+#if defined(__clang__)
+__attribute__((target("sha2")))
+#else
+__attribute__((target("+crypto")))
+#endif
+static void prvProcessArmv8Ce(uint32_t pState[8], const unsigned char pData[64])
+{
+    uint32x4_t xAbcd = vld1q_u32(&pState[0]);
+    uint32x4_t xEfgh = vld1q_u32(&pState[4]);
+    uint32x4_t xAbcdSaved = xAbcd;
+    uint32x4_t xEfghSaved = xEfgh;
+    uint32x4_t W0;
+    uint32x4_t W1;
+    uint32x4_t W2;
+    uint32x4_t W3;
+    uint32x4_t xMsg;
+    uint32x4_t xTemp;
+    int i = 0;
+
+    W0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(pData + 0)));
+    W1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(pData + 16)));
+    W2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(pData + 32)));
+    W3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(pData + 48)));
+    ARMV8_CE_ROUNDS(W0, 0);
+    ARMV8_CE_ROUNDS(W1, 1);
+    ARMV8_CE_ROUNDS(W2, 2);
+    ARMV8_CE_ROUNDS(W3, 3);
+
+    /* The words are kept in four registers, which rotate by one group of four rounds. */
+    for (i = 4; i < 16; i += 4)
+    {
+        W0 = vsha256su1q_u32(vsha256su0q_u32(W0, W1), W2, W3);
+        ARMV8_CE_ROUNDS(W0, i);
+        W1 = vsha256su1q_u32(vsha256su0q_u32(W1, W2), W3, W0);
+        ARMV8_CE_ROUNDS(W1, i + 1);
+        W2 = vsha256su1q_u32(vsha256su0q_u32(W2, W3), W0, W1);
+        ARMV8_CE_ROUNDS(W2, i + 2);
+        W3 = vsha256su1q_u32(vsha256su0q_u32(W3, W0), W1, W2);
+        ARMV8_CE_ROUNDS(W3, i + 3);
+    }
+
+    vst1q_u32(&pState[0], vaddq_u32(xAbcd, xAbcdSaved));
+    vst1q_u32(&pState[4], vaddq_u32(xEfgh, xEfghSaved));
+}
+#endif /* SHA256_ALT_ARMV8_CE */
+
+static Sha256ProcessFunc_t prvGetProcessFunc(Sha256Backend_t eBackend)
+{
+    Sha256ProcessFunc_t pfnProcess = NULL;
+
+    if (eBackend == SHA256_BACKEND_PORTABLE)
+    {
+        pfnProcess = prvProcessPortable;
+    }
+#if defined(SHA256_ALT_SHA_NI)
+    else if (eBackend == SHA256_BACKEND_SHA_NI && prvHasShaNi())
+    {
+        pfnProcess = prvProcessShaNi;
+    }
+#endif
+#if defined(SHA256_ALT_ARMV8_CE)
+    else if (eBackend == SHA256_BACKEND_ARMV8_CE && prvHasArmv8Ce())
+    {
+        pfnProcess = prvProcessArmv8Ce;
+    }
+#endif
+
+    return pfnProcess;
+}
+
+static Sha256ProcessFunc_t prvResolve(void)
+{
+    Sha256ProcessFunc_t pfnProcess = __atomic_load_n(&gpfnProcess, __ATOMIC_ACQUIRE);
+
+    /* The detection gives the same answer on every thread, so a race here only repeats it. */
+    if (pfnProcess == NULL)
+    {
+        if (Sha256Alt_setBackend(SHA256_BACKEND_SHA_NI) != SHA256_ALT_ERRNO_NONE &&
+            Sha256Alt_setBackend(SHA256_BACKEND_ARMV8_CE) != SHA256_ALT_ERRNO_NONE)
+        {
+            Sha256Alt_setBackend(SHA256_BACKEND_PORTABLE);
+        }
+        pfnProcess = __atomic_load_n(&gpfnProcess, __ATOMIC_ACQUIRE);
+    }
+
+    return pfnProcess;
+}
+
+Sha256Backend_t Sha256Alt_getBackend(void)
+{
+    prvResolve();
+
+    return __atomic_load_n(&geBackend, __ATOMIC_ACQUIRE);
+}
+
+const char *Sha256Alt_getBackendName(Sha256Backend_t eBackend)
+{
+    const char *pName = "portable";
+
+    if (eBackend == SHA256_BACKEND_SHA_NI)
+    {
+        pName = "sha-ni";
+    }
+    else if (eBackend == SHA256_BACKEND_ARMV8_CE)
+    {
+        pName = "armv8-ce";
+    }
+
+    return pName;
+}
+
+int Sha256Alt_setBackend(Sha256Backend_t eBackend)
+{
+    int res = SHA256_ALT_ERRNO_NONE;
+    Sha256ProcessFunc_t pfnProcess = NULL;
+
+    if ((pfnProcess = prvGetProcessFunc(eBackend)) == NULL)
+    {
+        res = SHA256_ALT_ERRNO_NOT_SUPPORTED;
+    }
+    else
+    {
+        __atomic_store_n(&geBackend, eBackend, __ATOMIC_RELEASE);
+        __atomic_store_n(&gpfnProcess, pfnProcess, __ATOMIC_RELEASE);
+    }
+
+    return res;
+}
+
+/* It replaces the portable block function of mbedtls, so every SHA-256 of the library and of TLS goes through here. */
+int mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx, const unsigned char data[64])
+{
+    prvResolve()(ctx->state, data);
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef SHA256_ALT_H
+#define SHA256_ALT_H
+
+/* The block function of mbedtls SHA-256, which is replaced when mbedtls is built with MBEDTLS_SHA256_PROCESS_ALT.
+ * The implementation is chosen at runtime from the instructions the CPU supports. */
+
+#define SHA256_ALT_ERRNO_NONE               (0)
+#define SHA256_ALT_ERRNO_NOT_SUPPORTED      (-1)
+
+typedef enum
+{
+    SHA256_BACKEND_PORTABLE = 0,
+    SHA256_BACKEND_SHA_NI,      // x86 SHA extensions
+    SHA256_BACKEND_ARMV8_CE,    // ARMv8 cryptography extensions
+} Sha256Backend_t;
+
+/**
+ * @brief Get the backend used by SHA-256
+ *
+ * @return The backend
+ */
+Sha256Backend_t Sha256Alt_getBackend(void);
+
+/**
+ * @brief Get the printable name of a backend
+ *
+ * @param[in] eBackend The backend
+ * @return The name
+ */
+const char *Sha256Alt_getBackendName(Sha256Backend_t eBackend);
+
+/**
+ * @brief Force a backend, ex: to compare backends in a benchmark. It affects all threads.
+ *
+ * @param[in] eBackend The backend
+ * @return SHA256_ALT_ERRNO_NONE, or SHA256_ALT_ERRNO_NOT_SUPPORTED if the CPU or the build doesn't support it
+ */
+int Sha256Alt_setBackend(Sha256Backend_t eBackend);
+
+#endif /* SHA256_ALT_H */
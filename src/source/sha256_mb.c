@@ -0,0 +1,424 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mbedtls/sha256.h"
+
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+#include "sha256_alt.h"
+#endif
+
+#include "sha256_mb.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_MB_AVX
+#elif defined(__aarch64__)
+#define SHA256_MB_NEON
+#endif
+
+#define SHA256_MB_BLOCK_LEN     (64)
+
+/* The state and the message words of all lanes are transposed, so word i of lane l is at [i * uLanes + l]. */
+typedef void (*Sha256MbProcessFunc_t)(uint32_t *pState, const uint32_t *pW);
+
+/* A message which is hashed in a lane. Its last partial block and the padding are copied to pTail. */
+typedef struct
+{
+    const unsigned char *pNext;
+    size_t uFullBlocks;
+    unsigned char pTail[2 * SHA256_MB_BLOCK_LEN];
+    size_t uTailBlocks;
+    size_t uTailOffset;
+    size_t uMsg;
+    bool bBusy;
+} Sha256MbLane_t;
+
+static const uint32_t gK[64] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static const uint32_t gH0[8] =
+{
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+/* What an idle lane hashes while the other lanes finish */
+static const unsigned char gpIdleBlock[SHA256_MB_BLOCK_LEN] = { 0 };
+
+/* -1 until the backend is resolved */
+static int giBackend = -1;
+
+/* The operators of GCC vector types apply to every lane, so the same macros serve all the widths. */
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+#define S0(x)       (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define S1(x)       (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define S2(x)       (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define S3(x)       (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* One round of all lanes. The words past 16 are scheduled in place, as a round only needs the last 16. */
+#define SHA256_MB_ROUND(a, b, c, d, e, f, g, h, i)                                                      \
+    do {                                                                                                \
+        if ((i) >= 16)                                                                                  \
+        {                                                                                               \
+            W[(i) & 15] += S1(W[((i) - 2) & 15]) + W[((i) - 7) & 15] + S0(W[((i) - 15) & 15]);          \
+        }                                                                                               \
+        xTemp = h + S3(e) + CH(e, f, g) + gK[i] + W[(i) & 15];                                          \
+        d += xTemp;                                                                                     \
+        h = xTemp + S2(a) + MAJ(a, b, c);                                                               \
+    } while (0)
+
+/* The block function of uLanes lanes of the vector type Vec_t. The variables rotate by renaming, eight rounds at a time. */
+#define SHA256_MB_PROCESS(Vec_t, uLanes)                                                                \
+    do {                                                                                                \
+        Vec_t W[16];                                                                                    \
+        Vec_t a, b, c, d, e, f, g, h;                                                                   \
+        Vec_t xTemp;                                                                                    \
+        int i = 0;                                                                                      \
+                                                                                                        \
+        for (i = 0; i < 16; i++)                                                                        \
+        {                                                                                               \
+            memcpy(&W[i], &pW[i * (uLanes)], sizeof(Vec_t));                                            \
+        }                                                                                               \
+        memcpy(&a, &pState[0 * (uLanes)], sizeof(Vec_t));                                              \
+        memcpy(&b, &pState[1 * (uLanes)], sizeof(Vec_t));                                              \
+        memcpy(&c, &pState[2 * (uLanes)], sizeof(Vec_t));                                              \
+        memcpy(&d, &pState[3 * (uLanes)], sizeof(Vec_t));                                              \
+        memcpy(&e, &pState[4 * (uLanes)], sizeof(Vec_t));                                              \
+        memcpy(&f, &pState[5 * (uLanes)], sizeof(Vec_t));                                              \
+        memcpy(&g, &pState[6 * (uLanes)], sizeof(Vec_t));                                              \
+        memcpy(&h, &pState[7 * (uLanes)], sizeof(Vec_t));                                              \
+                                                                                                        \
+        for (i = 0; i < 64; i += 8)                                                                     \
+        {                                                                                               \
+            SHA256_MB_ROUND(a, b, c, d, e, f, g, h, i + 0);                                             \
+            SHA256_MB_ROUND(h, a, b, c, d, e, f, g, i + 1);                                             \
+            SHA256_MB_ROUND(g, h, a, b, c, d, e, f, i + 2);                                             \
+            SHA256_MB_ROUND(f, g, h, a, b, c, d, e, i + 3);                                             \
+            SHA256_MB_ROUND(e, f, g, h, a, b, c, d, i + 4);                                             \
+            SHA256_MB_ROUND(d, e, f, g, h, a, b, c, i + 5);                                             \
+            SHA256_MB_ROUND(c, d, e, f, g, h, a, b, i + 6);                                             \
+            SHA256_MB_ROUND(b, c, d, e, f, g, h, a, i + 7);                                             \
+        }                                                                                               \
+                                                                                                        \
+        prvAddState(&pState[0 * (uLanes)], &a, sizeof(Vec_t));                                          \
+        prvAddState(&pState[1 * (uLanes)], &b, sizeof(Vec_t));                                          \
+        prvAddState(&pState[2 * (uLanes)], &c, sizeof(Vec_t));                                          \
+        prvAddState(&pState[3 * (uLanes)], &d, sizeof(Vec_t));                                          \
+        prvAddState(&pState[4 * (uLanes)], &e, sizeof(Vec_t));                                          \
+        prvAddState(&pState[5 * (uLanes)], &f, sizeof(Vec_t));                                          \
+        prvAddState(&pState[6 * (uLanes)], &g, sizeof(Vec_t));                                          \
+        prvAddState(&pState[7 * (uLanes)], &h, sizeof(Vec_t));                                          \
+    } while (0)
+
+static inline void prvAddState(uint32_t *pState, const void *pVec, size_t uSize)
+{
+    uint32_t pWords[SHA256_MB_MAX_LANES];
+    size_t i = 0;
+
+    memcpy(pWords, pVec, uSize);
+    for (i = 0; i < uSize / sizeof(uint32_t); i++)
+    {
+        pState[i] += pWords[i];
+    }
+}
+
+#if defined(SHA256_MB_AVX)
+typedef uint32_t Sha256MbVec8_t __attribute__((vector_size(32)));
+typedef uint32_t Sha256MbVec16_t __attribute__((vector_size(64)));
+
+__attribute__((target("avx2")))
+static void prvProcessAvx2(uint32_t *pState, const uint32_t *pW)
+{
+    SHA256_MB_PROCESS(Sha256MbVec8_t, 8);
+}
+
+__attribute__((target("avx512f")))
+static void prvProcessAvx512(uint32_t *pState, const uint32_t *pW)
+{
+    SHA256_MB_PROCESS(Sha256MbVec16_t, 16);
+}
+#endif /* SHA256_MB_AVX */
+
+#if defined(SHA256_MB_NEON)
+typedef uint32_t Sha256MbVec4_t __attribute__((vector_size(16)));
+
+/* NEON is part of ARMv8-A, so it needs no detection. */
+static void prvProcessNeon(uint32_t *pState, const uint32_t *pW)
+{
+    SHA256_MB_PROCESS(Sha256MbVec4_t, 4);
+}
+#endif /* SHA256_MB_NEON */
+
+static Sha256MbProcessFunc_t prvGetProcessFunc(Sha256MbBackend_t eBackend, size_t *puLanes)
+{
+    Sha256MbProcessFunc_t pfnProcess = NULL;
+
+    *puLanes = 1;
+#if defined(SHA256_MB_AVX)
+    if (eBackend == SHA256_MB_BACKEND_AVX2 && __builtin_cpu_supports("avx2"))
+    {
+        pfnProcess = prvProcessAvx2;
+        *puLanes = 8;
+    }
+    else if (eBackend == SHA256_MB_BACKEND_AVX512 && __builtin_cpu_supports("avx512f"))
+    {
+        pfnProcess = prvProcessAvx512;
+        *puLanes = 16;
+    }
+#endif
+#if defined(SHA256_MB_NEON)
+    if (eBackend == SHA256_MB_BACKEND_NEON)
+    {
+        pfnProcess = prvProcessNeon;
+        *puLanes = 4;
+    }
+#endif
+
+    return pfnProcess;
+}
+
+static bool prvIsSupported(Sha256MbBackend_t eBackend)
+{
+    size_t uLanes = 0;
+
+    return eBackend == SHA256_MB_BACKEND_SCALAR || prvGetProcessFunc(eBackend, &uLanes) != NULL;
+}
+
+/* A single stream with SHA instructions is about as fast as 8 lanes of AVX2 or 4 of NEON, so only AVX-512 beats it. */
+static bool prvHasShaInstructions(void)
+{
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+    return Sha256Alt_getBackend() != SHA256_BACKEND_PORTABLE;
+#else
+    return false;
+#endif
+}
+
+static Sha256MbBackend_t prvResolve(void)
+{
+    int iBackend = __atomic_load_n(&giBackend, __ATOMIC_ACQUIRE);
+
+    /* The detection gives the same answer on every thread, so a race here only repeats it. */
+    if (iBackend < 0)
+    {
+        if (Sha256Mb_setBackend(SHA256_MB_BACKEND_AVX512) != SHA256_MB_ERRNO_NONE &&
+            (prvHasShaInstructions() ||
+             (Sha256Mb_setBackend(SHA256_MB_BACKEND_AVX2) != SHA256_MB_ERRNO_NONE && Sha256Mb_setBackend(SHA256_MB_BACKEND_NEON) != SHA256_MB_ERRNO_NONE)))
+        {
+            Sha256Mb_setBackend(SHA256_MB_BACKEND_SCALAR);
+        }
+        iBackend = __atomic_load_n(&giBackend, __ATOMIC_ACQUIRE);
+    }
+
+    return (Sha256MbBackend_t)iBackend;
+}
+
+static void prvLoadLane(Sha256MbLane_t *pxLane, const unsigned char *pMsg, size_t uLen, size_t uMsg)
+{
+    size_t uTailLen = uLen % SHA256_MB_BLOCK_LEN;
+    uint64_t uBits = (uint64_t)uLen * 8;
+    size_t i = 0;
+
+    pxLane->pNext = pMsg;
+    pxLane->uFullBlocks = uLen / SHA256_MB_BLOCK_LEN;
+    pxLane->uTailBlocks = (uTailLen + 1 + sizeof(uint64_t) <= SHA256_MB_BLOCK_LEN) ? 1 : 2;
+    pxLane->uTailOffset = 0;
+    pxLane->uMsg = uMsg;
+    pxLane->bBusy = true;
+
+    memset(pxLane->pTail, 0, sizeof(pxLane->pTail));
+    if (uTailLen > 0)
+    {
+        memcpy(pxLane->pTail, pMsg + uLen - uTailLen, uTailLen);
+    }
+    pxLane->pTail[uTailLen] = 0x80;
+    for (i = 0; i < sizeof(uint64_t); i++)
+    {
+        pxLane->pTail[pxLane->uTailBlocks * SHA256_MB_BLOCK_LEN - 1 - i] = (unsigned char)(uBits >> (8 * i));
+    }
+}
+
+static const unsigned char *prvNextBlock(Sha256MbLane_t *pxLane)
+{
+    const unsigned char *pBlock = gpIdleBlock;
+
+    if (!pxLane->bBusy)
+    {
+        /* Nothing to hash */
+    }
+    else if (pxLane->uFullBlocks > 0)
+    {
+        pBlock = pxLane->pNext;
+        pxLane->pNext += SHA256_MB_BLOCK_LEN;
+        pxLane->uFullBlocks--;
+    }
+    else
+    {
+        pBlock = pxLane->pTail + pxLane->uTailOffset;
+        pxLane->uTailOffset += SHA256_MB_BLOCK_LEN;
+        pxLane->uTailBlocks--;
+    }
+
+    return pBlock;
+}
+
+static void prvStartLane(Sha256MbLane_t *pxLane, uint32_t *pState, size_t uLane, size_t uLanes,
+                         const unsigned char *const *ppMsgs, const size_t *puLens, size_t uCount, size_t *puNextMsg)
+{
+    size_t i = 0;
+
+    if (*puNextMsg < uCount)
+    {
+        prvLoadLane(pxLane, ppMsgs[*puNextMsg], puLens[*puNextMsg], *puNextMsg);
+        (*puNextMsg)++;
+        for (i = 0; i < 8; i++)
+        {
+            pState[i * uLanes + uLane] = gH0[i];
+        }
+    }
+    else
+    {
+        pxLane->bBusy = false;
+    }
+}
+
+/* A lane takes the next message as soon as its message is hashed, so messages of different lengths keep all lanes busy. */
+static void prvHashLanes(Sha256MbProcessFunc_t pfnProcess, size_t uLanes, const unsigned char *const *ppMsgs, const size_t *puLens, size_t uCount,
+                         unsigned char pDigests[][SHA256_MB_DIGEST_LEN])
+{
+    Sha256MbLane_t pxLanes[SHA256_MB_MAX_LANES];
+    uint32_t pState[8 * SHA256_MB_MAX_LANES];
+    uint32_t pW[16 * SHA256_MB_MAX_LANES];
+    const unsigned char *pBlock = NULL;
+    size_t uNextMsg = 0;
+    size_t uBusy = 0;
+    size_t l = 0;
+    size_t i = 0;
+
+    for (l = 0; l < uLanes; l++)
+    {
+        prvStartLane(&pxLanes[l], pState, l, uLanes, ppMsgs, puLens, uCount, &uNextMsg);
+        uBusy += pxLanes[l].bBusy ? 1 : 0;
+    }
+
+    while (uBusy > 0)
+    {
+        for (l = 0; l < uLanes; l++)
+        {
+            pBlock = prvNextBlock(&pxLanes[l]);
+            for (i = 0; i < 16; i++)
+            {
+                pW[i * uLanes + l] = ((uint32_t)pBlock[4 * i] << 24) | ((uint32_t)pBlock[4 * i + 1] << 16) | ((uint32_t)pBlock[4 * i + 2] << 8) | (uint32_t)pBlock[4 * i + 3];
+            }
+        }
+
+        pfnProcess(pState, pW);
+
+        for (l = 0; l < uLanes; l++)
+        {
+            if (pxLanes[l].bBusy && pxLanes[l].uFullBlocks == 0 && pxLanes[l].uTailBlocks == 0)
+            {
+                for (i = 0; i < 8; i++)
+                {
+                    pDigests[pxLanes[l].uMsg][4 * i] = (unsigned char)(pState[i * uLanes + l] >> 24);
+                    pDigests[pxLanes[l].uMsg][4 * i + 1] = (unsigned char)(pState[i * uLanes + l] >> 16);
+                    pDigests[pxLanes[l].uMsg][4 * i + 2] = (unsigned char)(pState[i * uLanes + l] >> 8);
+                    pDigests[pxLanes[l].uMsg][4 * i + 3] = (unsigned char)(pState[i * uLanes + l]);
+                }
+
+                prvStartLane(&pxLanes[l], pState, l, uLanes, ppMsgs, puLens, uCount, &uNextMsg);
+                uBusy -= pxLanes[l].bBusy ? 0 : 1;
+            }
+        }
+    }
+}
+
+int Sha256Mb_hash(const unsigned char *const *ppMsgs, const size_t *puLens, size_t uCount, unsigned char pDigests[][SHA256_MB_DIGEST_LEN])
+{
+    int res = SHA256_MB_ERRNO_NONE;
+    Sha256MbProcessFunc_t pfnProcess = NULL;
+    size_t uLanes = 1;
+    size_t i = 0;
+
+    for (i = 0; i < uCount && ppMsgs != NULL && puLens != NULL; i++)
+    {
+        if (ppMsgs[i] == NULL && puLens[i] > 0)
+        {
+            break;
+        }
+    }
+
+    if (ppMsgs == NULL || puLens == NULL || pDigests == NULL || i < uCount)
+    {
+        res = SHA256_MB_ERRNO_INVALID_PARAMETER;
+    }
+    else if (uCount > 1 && (pfnProcess = prvGetProcessFunc(prvResolve(), &uLanes)) != NULL)
+    {
+        prvHashLanes(pfnProcess, uLanes, ppMsgs, puLens, uCount, pDigests);
+    }
+    else
+    {
+        /* A single message would leave all lanes but one idle. */
+        for (i = 0; i < uCount && res == SHA256_MB_ERRNO_NONE; i++)
+        {
+            if (mbedtls_sha256_ret(ppMsgs[i], puLens[i], pDigests[i], 0) != 0)
+            {
+                res = SHA256_MB_ERRNO_HASH_FAILURE;
+            }
+        }
+    }
+
+    return res;
+}
+
+Sha256MbBackend_t Sha256Mb_getBackend(void)
+{
+    return prvResolve();
+}
+
+const char *Sha256Mb_getBackendName(Sha256MbBackend_t eBackend)
+{
+    const char *pName = "scalar";
+
+    if (eBackend == SHA256_MB_BACKEND_AVX2)
+    {
+        pName = "avx2";
+    }
+    else if (eBackend == SHA256_MB_BACKEND_AVX512)
+    {
+        pName = "avx512";
+    }
+    else if (eBackend == SHA256_MB_BACKEND_NEON)
+    {
+        pName = "neon";
+    }
+
+    return pName;
+}
+
+int Sha256Mb_setBackend(Sha256MbBackend_t eBackend)
+{
+    int res = SHA256_MB_ERRNO_NONE;
+
+    if (!prvIsSupported(eBackend))
+    {
+        res = SHA256_MB_ERRNO_NOT_SUPPORTED;
+    }
+    else
+    {
+        __atomic_store_n(&giBackend, (int)eBackend, __ATOMIC_RELEASE);
+    }
+
+    return res;
+}
@@ -0,0 +1,61 @@
+#ifndef SHA256_MB_H
+#define SHA256_MB_H
+
+#include <stddef.h>
+
+/* Multi-buffer SHA-256. Several messages are hashed at once, one per lane of the SIMD registers, so a batch runs as fast as its
+ * longest messages rather than as the sum of them. The implementation is chosen at runtime from the instructions the CPU supports. */
+
+#define SHA256_MB_ERRNO_NONE                (0)
+#define SHA256_MB_ERRNO_INVALID_PARAMETER   (-1)
+#define SHA256_MB_ERRNO_NOT_SUPPORTED       (-2)
+#define SHA256_MB_ERRNO_HASH_FAILURE        (-3)
+
+#define SHA256_MB_DIGEST_LEN                (32)
+
+/* The most lanes of a backend, ex: to size the groups of a batch */
+#define SHA256_MB_MAX_LANES                 (16)
+
+typedef enum
+{
+    SHA256_MB_BACKEND_SCALAR = 0,   // One message after another with mbedtls
+    SHA256_MB_BACKEND_AVX2,         // 8 lanes
+    SHA256_MB_BACKEND_AVX512,       // 16 lanes
+    SHA256_MB_BACKEND_NEON,         // 4 lanes
+} Sha256MbBackend_t;
+
+/**
+ * @brief Hash messages at once
+ *
+ * @param[in] ppMsgs The messages. A message of length 0 may be NULL.
+ * @param[in] puLens The lengths of the messages
+ * @param[in] uCount The number of messages
+ * @param[out] pDigests The digests, in the order of the messages
+ * @return SHA256_MB_ERRNO_NONE on success, or the error code
+ */
+int Sha256Mb_hash(const unsigned char *const *ppMsgs, const size_t *puLens, size_t uCount, unsigned char pDigests[][SHA256_MB_DIGEST_LEN]);
+
+/**
+ * @brief Get the backend used by Sha256Mb_hash()
+ *
+ * @return The backend
+ */
+Sha256MbBackend_t Sha256Mb_getBackend(void);
+
+/**
+ * @brief Get the printable name of a backend
+ *
+ * @param[in] eBackend The backend
+ * @return The name
+ */
+const char *Sha256Mb_getBackendName(Sha256MbBackend_t eBackend);
+
+/**
+ * @brief Force a backend, ex: to compare backends in a benchmark. It affects all threads.
+ *
+ * @param[in] eBackend The backend
+ * @return SHA256_MB_ERRNO_NONE, or SHA256_MB_ERRNO_NOT_SUPPORTED if the CPU or the build doesn't support it
+ */
+int Sha256Mb_setBackend(Sha256MbBackend_t eBackend);
+
+#endif /* SHA256_MB_H */
@@ -1,11 +1,14 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "mbedtls/md.h"
 #include "mbedtls/sha256.h"
 
+#include "sha256_mb.h"
 #include "sigv4.h"
 
 /* The buffer length used for doing SHA256 hash check. */
@@ -20,13 +23,46 @@
 /* The signature end described by AWS Signature V4. */
 #define AWS_SIG_V4_SIGNATURE_END "aws4_request"
 
-#define SIGNED_HEADERS  "host;x-amz-date"
+#define SIGNED_HEADERS              "host;x-amz-date"
+#define SIGNED_HEADERS_WITH_TOKEN   "host;x-amz-date;x-amz-security-token"
+
+#define ACCESS_KEY_MAX_LEN          (128)
+#define REGION_MAX_LEN              (32)
+#define SERVICE_MAX_LEN             (32)
+
+/* A batch is hashed in groups of this many requests. Lanes which finish early take another request of the group. */
+#define SIGV4_BATCH_GROUP_LEN       (2 * SHA256_MB_MAX_LANES)
+
+/* The signing key only depends on the secret, the day, the region and the service, so it's derived once a day instead of once per request. */
+typedef struct
+{
+    uint32_t uEpoch;
+    char pAccessKey[ACCESS_KEY_MAX_LEN];
+    char pDate[DATE_STRING_LEN + 1];
+    char pRegion[REGION_MAX_LEN];
+    char pService[SERVICE_MAX_LEN];
+    unsigned char pKey[SHA256_DIGEST_LENGTH];
+} SigningKeyCache_t;
+
+static __thread SigningKeyCache_t gxSigningKeyCache;
+
+/* Bumped on credential rotation, so every thread derives its key again. It starts from 1, so an empty cache never matches. */
+static uint32_t guSigningKeyEpoch = 1;
+
+static void prvHexEncode(const unsigned char pHash[SHA256_DIGEST_LENGTH], char pHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE])
+{
+    char *p = pHexEncodedHash;
+
+    for (size_t i = 0; i < SHA256_DIGEST_LENGTH; i++)
+    {
+        p += snprintf(p, 3, "%02x", pHash[i]);
+    }
+}
 
 static int prvHexEncodedSha256(const unsigned char *pMsg, size_t uMsgLen, char pHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE])
 {
     int res = SIGV4_ERRNO_NONE;
     unsigned char pHashBuf[SHA256_DIGEST_LENGTH] = {0};
-    char *p = NULL;
 
     if (mbedtls_sha256_ret(pMsg, uMsgLen, pHashBuf, 0) != 0)
     {
@@ -34,11 +70,7 @@ static int prvHexEncodedSha256(const unsigned char *pMsg, size_t uMsgLen, char p
     }
     else
     {
-        p = pHexEncodedHash;
-        for (size_t i = 0; i < SHA256_DIGEST_LENGTH; i++)
-        {
-            p += snprintf(p, 3, "%02x", pHashBuf[i]);
-        }
+        prvHexEncode(pHashBuf, pHexEncodedHash);
     }
 
     return res;
@@ -58,7 +90,7 @@ static int prvGenScope(SigV4Para_t *pPara, char **ppScope, size_t *puScopeLen)
         AWS_SIG_V4_SIGNATURE_END
     );
 
-    if ((pScope = (char *)malloc(uScopeLen + 1)) == NULL)
+    if ((pScope = (char *)Arena_alloc(pPara->xArena, uScopeLen + 1)) == NULL)
     {
         res = SIGV4_ERRNO_OUT_OF_MEMORY;
     }
@@ -77,122 +109,174 @@ static int prvGenScope(SigV4Para_t *pPara, char **ppScope, size_t *puScopeLen)
     return res;
 }
 
-static int prvGenCanonicalReqHexEncHash(SigV4Para_t *pPara, char pHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE])
+/* The canonical request is allocated from the arena of the request, and the caller frees it. */
+static int prvGenCanonicalReq(SigV4Para_t *pPara, const char *pPayloadHexEncodedHash, char **ppCanonicalReq, size_t *puCanonicalReqLen)
 {
     int res = SIGV4_ERRNO_NONE;
     char *pCanonicalReq = NULL;
     size_t uCanonicalReqLen = 0;
-    char pPayloadHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE];
     const char *pPath = (pPara->pPath == NULL) ? "/" : pPara->pPath;
     const char *pQuery = (pPara->pQuery == NULL) ? "" : pPara->pQuery;
+    const char *pSignedHeaders = (pPara->pToken == NULL) ? SIGNED_HEADERS : SIGNED_HEADERS_WITH_TOKEN;
 
-    if ((res = prvHexEncodedSha256(pPara->pPayload, pPara->uPayloadLen, pPayloadHexEncodedHash)) != SIGV4_ERRNO_NONE)
+    /* Calculate needed length */
+    uCanonicalReqLen = snprintf(NULL, 0, "%s\n%s\n%s\nhost:%s\nx-amz-date:%s\n%s%s%s\n%s\n%s",
+        pPara->pHttpMethod,
+        pPath,
+        pQuery,
+        pPara->pHost,
+        pPara->pDateIso8601,
+        (pPara->pToken != NULL) ? "x-amz-security-token:" : "",
+        (pPara->pToken != NULL) ? pPara->pToken : "",
+        (pPara->pToken != NULL) ? "\n" : "",
+        pSignedHeaders,
+        pPayloadHexEncodedHash
+    );
+
+    if ((pCanonicalReq = (char *)Arena_alloc(pPara->xArena, uCanonicalReqLen + 1)) == NULL)
     {
-        /* Propagate the error code. */
+        res = SIGV4_ERRNO_OUT_OF_MEMORY;
     }
     else
     {
-        /* Calculate needed length */
-        uCanonicalReqLen = snprintf(NULL, 0, "%s\n%s\n%s\nhost:%s\nx-amz-date:%s\n\n%s\n%s",
+        snprintf(pCanonicalReq, uCanonicalReqLen + 1, "%s\n%s\n%s\nhost:%s\nx-amz-date:%s\n%s%s%s\n%s\n%s",
             pPara->pHttpMethod,
             pPath,
             pQuery,
             pPara->pHost,
             pPara->pDateIso8601,
-            SIGNED_HEADERS,
+            (pPara->pToken != NULL) ? "x-amz-security-token:" : "",
+            (pPara->pToken != NULL) ? pPara->pToken : "",
+            (pPara->pToken != NULL) ? "\n" : "",
+            pSignedHeaders,
             pPayloadHexEncodedHash
         );
+        *ppCanonicalReq = pCanonicalReq;
+        *puCanonicalReqLen = uCanonicalReqLen;
+    }
 
-        if ((pCanonicalReq = (char *)malloc(uCanonicalReqLen + 1)) == NULL)
-        {
-            res = SIGV4_ERRNO_OUT_OF_MEMORY;
-        }
-        else
-        {
-            snprintf(pCanonicalReq, uCanonicalReqLen + 1, "%s\n%s\n%s\nhost:%s\nx-amz-date:%s\n\n%s\n%s",
-                pPara->pHttpMethod,
-                pPath,
-                pQuery,
-                pPara->pHost,
-                pPara->pDateIso8601,
-                SIGNED_HEADERS,
-                pPayloadHexEncodedHash
-            );
+    return res;
+}
 
-            /* Calculate SHA256 hex of canonical request */
-            prvHexEncodedSha256(pCanonicalReq, uCanonicalReqLen, pHexEncodedHash);
-        }
+static int prvGenCanonicalReqHexEncHash(SigV4Para_t *pPara, char pHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE])
+{
+    int res = SIGV4_ERRNO_NONE;
+    char *pCanonicalReq = NULL;
+    size_t uCanonicalReqLen = 0;
+    char pPayloadHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE];
+
+    if ((res = prvHexEncodedSha256(pPara->pPayload, pPara->uPayloadLen, pPayloadHexEncodedHash)) != SIGV4_ERRNO_NONE)
+    {
+        /* Propagate the error code. */
+    }
+    else if ((res = prvGenCanonicalReq(pPara, pPayloadHexEncodedHash, &pCanonicalReq, &uCanonicalReqLen)) != SIGV4_ERRNO_NONE)
+    {
+        /* Propagate the error code. */
+    }
+    else
+    {
+        /* Calculate SHA256 hex of canonical request */
+        prvHexEncodedSha256(pCanonicalReq, uCanonicalReqLen, pHexEncodedHash);
     }
 
     if (pCanonicalReq != NULL)
     {
-        free(pCanonicalReq);
+        Arena_free(pPara->xArena, pCanonicalReq);
     }
 
     return res;
 }
 
-static int prvGenSignature(SigV4Para_t *pPara, char *pScope, char pHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE])
+static void prvGetSigningKey(SigV4Para_t *pPara, const mbedtls_md_info_t *pxMdInfo, unsigned char pKey[SHA256_DIGEST_LENGTH])
+{
+    SigningKeyCache_t *pxCache = &gxSigningKeyCache;
+    char pHmac[HEX_ENCODED_SHA_256_STRING_SIZE];
+    size_t uHmacSize = mbedtls_md_get_size(pxMdInfo);
+    bool bCacheable = (strlen(pPara->pAccessKey) < ACCESS_KEY_MAX_LEN && strlen(pPara->pRegion) < REGION_MAX_LEN && strlen(pPara->pService) < SERVICE_MAX_LEN);
+
+    if (bCacheable &&
+        pxCache->uEpoch == __atomic_load_n(&guSigningKeyEpoch, __ATOMIC_ACQUIRE) &&
+        strncmp(pxCache->pDate, pPara->pDateIso8601, DATE_STRING_LEN) == 0 &&
+        strcmp(pxCache->pAccessKey, pPara->pAccessKey) == 0 &&
+        strcmp(pxCache->pRegion, pPara->pRegion) == 0 &&
+        strcmp(pxCache->pService, pPara->pService) == 0)
+    {
+        memcpy(pKey, pxCache->pKey, SHA256_DIGEST_LENGTH);
+    }
+    else
+    {
+        snprintf(pHmac, HEX_ENCODED_SHA_256_STRING_SIZE, "AWS4%s", pPara->pSecretKey);
+        mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, strlen(pHmac), (const unsigned char *)pPara->pDateIso8601, DATE_STRING_LEN, (unsigned char *)pHmac);
+        mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pPara->pRegion, strlen(pPara->pRegion), (unsigned char *)pHmac);
+        mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pPara->pService, strlen(pPara->pService), (unsigned char *)pHmac);
+        mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)AWS_SIG_V4_SIGNATURE_END, sizeof(AWS_SIG_V4_SIGNATURE_END) - 1, (unsigned char *)pHmac);
+        memcpy(pKey, pHmac, SHA256_DIGEST_LENGTH);
+
+        if (bCacheable)
+        {
+            pxCache->uEpoch = __atomic_load_n(&guSigningKeyEpoch, __ATOMIC_ACQUIRE);
+            memcpy(pxCache->pDate, pPara->pDateIso8601, DATE_STRING_LEN);
+            pxCache->pDate[DATE_STRING_LEN] = '\0';
+            strcpy(pxCache->pAccessKey, pPara->pAccessKey);
+            strcpy(pxCache->pRegion, pPara->pRegion);
+            strcpy(pxCache->pService, pPara->pService);
+            memcpy(pxCache->pKey, pKey, SHA256_DIGEST_LENGTH);
+        }
+    }
+
+    /* Don't leave the secret on the stack */
+    memset(pHmac, 0, sizeof(pHmac));
+}
+
+static int prvGenSignature(SigV4Para_t *pPara, char *pScope, const char *pCanonicalReqHexEncodedSha256, char pHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE])
 {
     int res = SIGV4_ERRNO_NONE;
     char *pSignature = NULL;
     size_t uSignatureLen = 0;
-    char pCanonicalReqHexEncodedSha256[HEX_ENCODED_SHA_256_STRING_SIZE];
     char pHmac[HEX_ENCODED_SHA_256_STRING_SIZE];
     const mbedtls_md_info_t *pxMdInfo = NULL;
     size_t uHmacSize = 0;
 
-    if ((res = prvGenCanonicalReqHexEncHash(pPara, pCanonicalReqHexEncodedSha256)) != SIGV4_ERRNO_NONE)
+    /* Calculate needed length */
+    uSignatureLen = snprintf(NULL, 0, "AWS4-HMAC-SHA256\n%s\n%s\n%s",
+        pPara->pDateIso8601,
+        pScope,
+        pCanonicalReqHexEncodedSha256
+    );
+
+    if ((pSignature = (char *)Arena_alloc(pPara->xArena, uSignatureLen + 1)) == NULL)
     {
-        /* Propagate the error code */
+        res = SIGV4_ERRNO_OUT_OF_MEMORY;
     }
     else
     {
-        /* Calculate needed length */
-        uSignatureLen = snprintf(NULL, 0, "AWS4-HMAC-SHA256\n%s\n%s\n%s",
+        snprintf(pSignature, uSignatureLen + 1, "AWS4-HMAC-SHA256\n%s\n%s\n%s",
             pPara->pDateIso8601,
             pScope,
             pCanonicalReqHexEncodedSha256
         );
 
-        if ((pSignature = (char *)malloc(uSignatureLen + 1)) == NULL)
-        {
-            res = SIGV4_ERRNO_OUT_OF_MEMORY;
-        }
-        else
-        {
-            snprintf(pSignature, uSignatureLen + 1, "AWS4-HMAC-SHA256\n%s\n%s\n%s",
-                pPara->pDateIso8601,
-                pScope,
-                pCanonicalReqHexEncodedSha256
-            );
+        pxMdInfo = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+        uHmacSize = mbedtls_md_get_size(pxMdInfo);
+        prvGetSigningKey(pPara, pxMdInfo, (unsigned char *)pHmac);
+        mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pSignature, uSignatureLen, (unsigned char *)pHmac);
 
-            pxMdInfo = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
-            uHmacSize = mbedtls_md_get_size(pxMdInfo);
-            snprintf(pHmac, HEX_ENCODED_SHA_256_STRING_SIZE, "AWS4%s", pPara->pSecretKey);
-            mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, strlen(pHmac), (const unsigned char *)pPara->pDateIso8601, DATE_STRING_LEN, (unsigned char *)pHmac);
-            mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pPara->pRegion, strlen(pPara->pRegion), (unsigned char *)pHmac);
-            mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pPara->pService, strlen(pPara->pService), (unsigned char *)pHmac);
-            mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)AWS_SIG_V4_SIGNATURE_END, sizeof(AWS_SIG_V4_SIGNATURE_END) - 1, (unsigned char *)pHmac);
-            mbedtls_md_hmac(pxMdInfo, (const unsigned char *)pHmac, uHmacSize, (const unsigned char *)pSignature, uSignatureLen, (unsigned char *)pHmac);
-
-            char *p = pHexEncodedHash;
-            for (size_t i = 0; i<uHmacSize; i++)
-            {
-                p += sprintf(p, "%02x", pHmac[i] & 0xFF);
-            }
+        char *p = pHexEncodedHash;
+        for (size_t i = 0; i<uHmacSize; i++)
+        {
+            p += sprintf(p, "%02x", pHmac[i] & 0xFF);
         }
     }
 
     if (pSignature != NULL)
     {
-        free(pSignature);
+        Arena_free(pPara->xArena, pSignature);
     }
 
     return res;
 }
 
-int SigV4_Sign(SigV4Para_t *pPara, char **ppAuth, size_t *puAuthLen)
+static int prvGenAuth(SigV4Para_t *pPara, const char *pCanonicalReqHexEncodedSha256, char **ppAuth, size_t *puAuthLen)
 {
     int res = SIGV4_ERRNO_NONE;
     char *pScope = NULL;
@@ -205,7 +289,7 @@ int SigV4_Sign(SigV4Para_t *pPara, char **ppAuth, size_t *puAuthLen)
     {
         /* Propagate the error code */
     }
-    else if ((res = prvGenSignature(pPara, pScope, pSigHexEncodedHash)) != SIGV4_ERRNO_NONE)
+    else if ((res = prvGenSignature(pPara, pScope, pCanonicalReqHexEncodedSha256, pSigHexEncodedHash)) != SIGV4_ERRNO_NONE)
     {
         /* Propagate the error code */
     }
@@ -215,11 +299,11 @@ int SigV4_Sign(SigV4Para_t *pPara, char **ppAuth, size_t *puAuthLen)
         uAuthLen = snprintf(NULL, 0, "AWS4-HMAC-SHA256 Credential=%s/%s, SignedHeaders=%s, Signature=%s",
             pPara->pAccessKey,
             pScope,
-            SIGNED_HEADERS,
+            (pPara->pToken == NULL) ? SIGNED_HEADERS : SIGNED_HEADERS_WITH_TOKEN,
             pSigHexEncodedHash
         );
 
-        if ((pAuth = (char *)malloc(uAuthLen + 1)) == NULL)
+        if ((pAuth = (char *)Arena_alloc(pPara->xArena, uAuthLen + 1)) == NULL)
         {
             res = SIGV4_ERRNO_OUT_OF_MEMORY;
         }
@@ -228,7 +312,7 @@ int SigV4_Sign(SigV4Para_t *pPara, char **ppAuth, size_t *puAuthLen)
             snprintf(pAuth, uAuthLen + 1, "AWS4-HMAC-SHA256 Credential=%s/%s, SignedHeaders=%s, Signature=%s",
                 pPara->pAccessKey,
                 pScope,
-                SIGNED_HEADERS,
+                (pPara->pToken == NULL) ? SIGNED_HEADERS : SIGNED_HEADERS_WITH_TOKEN,
                 pSigHexEncodedHash
             );
             *ppAuth = pAuth;
@@ -238,8 +322,116 @@ int SigV4_Sign(SigV4Para_t *pPara, char **ppAuth, size_t *puAuthLen)
 
     if (pScope != NULL)
     {
-        free(pScope);
+        Arena_free(pPara->xArena, pScope);
     }
 
     return res;
-}
\ No newline at end of file
+}
+
+int SigV4_Sign(SigV4Para_t *pPara, char **ppAuth, size_t *puAuthLen)
+{
+    int res = SIGV4_ERRNO_NONE;
+    char pCanonicalReqHexEncodedSha256[HEX_ENCODED_SHA_256_STRING_SIZE];
+
+    if ((res = prvGenCanonicalReqHexEncHash(pPara, pCanonicalReqHexEncodedSha256)) == SIGV4_ERRNO_NONE)
+    {
+        res = prvGenAuth(pPara, pCanonicalReqHexEncodedSha256, ppAuth, puAuthLen);
+    }
+
+    return res;
+}
+
+/* Sign up to SIGV4_BATCH_GROUP_LEN requests. The payloads are hashed at once, and then the canonical requests. */
+static int prvSignGroup(SigV4Para_t *pParas, size_t uCount, char **ppAuths, size_t *puAuthLens)
+{
+    int res = SIGV4_ERRNO_NONE;
+    const unsigned char *ppMsgs[SIGV4_BATCH_GROUP_LEN] = { NULL };
+    size_t puMsgLens[SIGV4_BATCH_GROUP_LEN] = { 0 };
+    unsigned char pDigests[SIGV4_BATCH_GROUP_LEN][SHA256_MB_DIGEST_LEN];
+    char *ppCanonicalReqs[SIGV4_BATCH_GROUP_LEN] = { NULL };
+    int pResults[SIGV4_BATCH_GROUP_LEN];
+    char pHexEncodedHash[HEX_ENCODED_SHA_256_STRING_SIZE];
+    size_t i = 0;
+
+    for (i = 0; i < uCount; i++)
+    {
+        ppMsgs[i] = (const unsigned char *)pParas[i].pPayload;
+        puMsgLens[i] = pParas[i].uPayloadLen;
+        pResults[i] = SIGV4_ERRNO_NONE;
+        ppAuths[i] = NULL;
+    }
+
+    if (Sha256Mb_hash(ppMsgs, puMsgLens, uCount, pDigests) != SHA256_MB_ERRNO_NONE)
+    {
+        res = SIGV4_ERRNO_FAIL_TO_CALCULATE_SHA256;
+    }
+    else
+    {
+        for (i = 0; i < uCount; i++)
+        {
+            prvHexEncode(pDigests[i], pHexEncodedHash);
+            if ((pResults[i] = prvGenCanonicalReq(&(pParas[i]), pHexEncodedHash, &(ppCanonicalReqs[i]), &(puMsgLens[i]))) != SIGV4_ERRNO_NONE)
+            {
+                /* It's hashed as an empty message, and the result is dropped. */
+                puMsgLens[i] = 0;
+            }
+            ppMsgs[i] = (const unsigned char *)ppCanonicalReqs[i];
+        }
+
+        if (Sha256Mb_hash(ppMsgs, puMsgLens, uCount, pDigests) != SHA256_MB_ERRNO_NONE)
+        {
+            res = SIGV4_ERRNO_FAIL_TO_CALCULATE_SHA256;
+        }
+        else
+        {
+            for (i = 0; i < uCount; i++)
+            {
+                if (pResults[i] == SIGV4_ERRNO_NONE)
+                {
+                    prvHexEncode(pDigests[i], pHexEncodedHash);
+                    pResults[i] = prvGenAuth(&(pParas[i]), pHexEncodedHash, &(ppAuths[i]), &(puAuthLens[i]));
+                }
+                res = (res == SIGV4_ERRNO_NONE) ? pResults[i] : res;
+            }
+        }
+    }
+
+    for (i = 0; i < uCount; i++)
+    {
+        if (ppCanonicalReqs[i] != NULL)
+        {
+            Arena_free(pParas[i].xArena, ppCanonicalReqs[i]);
+        }
+    }
+
+    return res;
+}
+
+int SigV4_signBatch(SigV4Para_t *pParas, size_t uCount, char **ppAuths, size_t *puAuthLens)
+{
+    int res = SIGV4_ERRNO_NONE;
+    int resGroup = SIGV4_ERRNO_NONE;
+    size_t uGroupLen = 0;
+    size_t i = 0;
+
+    if (uCount > 0 && (pParas == NULL || ppAuths == NULL || puAuthLens == NULL))
+    {
+        res = SIGV4_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        for (i = 0; i < uCount; i += uGroupLen)
+        {
+            uGroupLen = (uCount - i < SIGV4_BATCH_GROUP_LEN) ? uCount - i : SIGV4_BATCH_GROUP_LEN;
+            resGroup = prvSignGroup(&(pParas[i]), uGroupLen, &(ppAuths[i]), &(puAuthLens[i]));
+            res = (res == SIGV4_ERRNO_NONE) ? resGroup : res;
+        }
+    }
+
+    return res;
+}
+
+void SigV4_invalidateSigningKeys(void)
+{
+    __atomic_add_fetch(&guSigningKeyEpoch, 1, __ATOMIC_ACQ_REL);
+}
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 
+#include "arena.h"
+
 #define SIGV4_ERRNO_NONE                        (0)
 #define SIGV4_ERRNO_INVALID_PARAMETER           (-1)
 #define SIGV4_ERRNO_OUT_OF_MEMORY               (-2)
@@ -15,6 +17,7 @@ typedef struct
 {
     const char *pAccessKey;
     const char *pSecretKey;
+    const char *pToken; // Optional, the session token of temporary credentials. It's signed as x-amz-security-token.
 
     const char *pRegion;
     const char *pService;
@@ -26,8 +29,27 @@ typedef struct
     const char *pHost;
     const char *pPayload;
     size_t uPayloadLen;
+
+    /* Optional. If it's set, all memory is allocated from it including the returned authorization. */
+    ArenaHandle xArena;
 } SigV4Para_t;
 
 int SigV4_Sign(SigV4Para_t *pPara, char **ppAuth, size_t *puAuthLen);
 
+/**
+ * @brief Sign requests like SigV4_Sign(), and hash the payloads and the canonical requests of several requests at once with the SIMD lanes of the CPU
+ *
+ * @param[in] pParas The requests
+ * @param[in] uCount The number of requests
+ * @param[out] ppAuths The authorization of every request, or NULL if it failed. It's allocated like the one of SigV4_Sign().
+ * @param[out] puAuthLens The length of every authorization
+ * @return SIGV4_ERRNO_NONE if all requests are signed, or the error of the first request which failed
+ */
+int SigV4_signBatch(SigV4Para_t *pParas, size_t uCount, char **ppAuths, size_t *puAuthLens);
+
+/**
+ * @brief Drop the signing keys derived from previous credentials. The key of a day is cached per thread, and it must not outlive rotated credentials.
+ */
+void SigV4_invalidateSigningKeys(void);
+
 #endif /* SIGV4_H */
\ No newline at end of file
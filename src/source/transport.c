@@ -0,0 +1,570 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "netio.h"
+#include "transport.h"
+
+/* A recording is this magic and then the records, in the order they happened. The fields are in the byte order of the host, so a recording
+ * is played back on the kind of machine it was made on. */
+#define RECORDING_MAGIC                 "PLYREC01"
+#define RECORDING_MAGIC_LEN             (sizeof(RECORDING_MAGIC) - 1)
+
+#define RECORD_TYPE_OPEN                (1) // The ALPN protocol, NUL included, or no data
+#define RECORD_TYPE_SEND                (2) // iValue is the length, the data is not recorded
+#define RECORD_TYPE_RECV                (3)
+#define RECORD_TYPE_EOF                 (4) // A receive which returned 0 bytes
+#define RECORD_TYPE_ERROR               (5) // A receive which failed with the NETIO_ERRNO_* code in iValue
+
+typedef struct
+{
+    uint32_t uSession;
+    uint32_t uType;
+    int32_t iValue;
+    uint32_t uLen; // Bytes of data which follow
+} RecordHeader_t;
+
+typedef struct
+{
+    PollyTransport_t xTransport;
+    PollyTransport_t *pxInner;
+
+    pthread_mutex_t xLock;
+    FILE *pxFile;
+    uint32_t uNextSession;
+} Recorder_t;
+
+typedef struct
+{
+    Recorder_t *pxRecorder;
+    void *pInnerConn;
+    uint32_t uSession;
+} RecorderConn_t;
+
+typedef struct
+{
+    uint32_t uType;
+    int32_t iValue;
+    const uint8_t *pData;
+    uint32_t uLen;
+} Record_t;
+
+/* The records of a session are a slice of the records sorted by session. */
+typedef struct
+{
+    size_t uFirst;
+    size_t uCount;
+    const char *pAlpnProtocol;
+} Session_t;
+
+typedef struct
+{
+    PollyTransport_t xTransport;
+
+    uint8_t *pFileData;
+    Record_t *pxRecords;
+    Session_t *pxSessions;
+    size_t uSessionCount;
+    uint32_t uNextSession;
+} Replayer_t;
+
+typedef struct
+{
+    Session_t *pxSession;
+    Record_t *pxRecords;
+    size_t uNext; // The next record of the session
+    size_t uOffset; // Bytes of the next record already received, if it's longer than the buffer of a receive
+} ReplayerConn_t;
+
+static void prvWriteRecord(Recorder_t *pxRecorder, uint32_t uSession, uint32_t uType, int32_t iValue, const void *pData, uint32_t uLen)
+{
+    RecordHeader_t xHeader;
+
+    xHeader.uSession = uSession;
+    xHeader.uType = uType;
+    xHeader.iValue = iValue;
+    xHeader.uLen = uLen;
+
+    /* A record is written whole, so the records of concurrent connections don't interleave. */
+    pthread_mutex_lock(&(pxRecorder->xLock));
+    if (fwrite(&xHeader, sizeof(xHeader), 1, pxRecorder->pxFile) != 1 || (uLen > 0 && fwrite(pData, uLen, 1, pxRecorder->pxFile) != 1))
+    {
+        /* A short recording is still played back, up to where it stops. */
+    }
+    pthread_mutex_unlock(&(pxRecorder->xLock));
+}
+
+static int prvRecorderConnect(PollyTransportHandle xTransport, NetIoHandle xNetIo, const char *pcHost, const char *pcPort, void **ppConn)
+{
+    int res = NETIO_ERRNO_NONE;
+    Recorder_t *pxRecorder = (Recorder_t *)xTransport;
+    RecorderConn_t *pxConn = NULL;
+    void *pInnerConn = NULL;
+    const char *pAlpnProtocol = NULL;
+
+    if ((res = pxRecorder->pxInner->connect(pxRecorder->pxInner, xNetIo, pcHost, pcPort, &pInnerConn)) != NETIO_ERRNO_NONE)
+    {
+        /* Propagate the res error. A failed connect is not recorded, so the replayer never plays it. */
+    }
+    else if ((pxConn = (RecorderConn_t *)Allocator_malloc(sizeof(RecorderConn_t))) == NULL)
+    {
+        res = NETIO_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        pxConn->pxRecorder = pxRecorder;
+        pxConn->pInnerConn = pInnerConn;
+        pxConn->uSession = __atomic_fetch_add(&(pxRecorder->uNextSession), 1, __ATOMIC_RELAXED);
+        pAlpnProtocol = pxRecorder->pxInner->getAlpnProtocol(xNetIo, pInnerConn);
+        prvWriteRecord(pxRecorder, pxConn->uSession, RECORD_TYPE_OPEN, 0, pAlpnProtocol, (pAlpnProtocol != NULL) ? (uint32_t)strlen(pAlpnProtocol) + 1 : 0);
+        *ppConn = pxConn;
+    }
+
+    if (res != NETIO_ERRNO_NONE && pInnerConn != NULL)
+    {
+        pxRecorder->pxInner->close(xNetIo, pInnerConn);
+    }
+
+    return res;
+}
+
+static void prvRecorderDisconnect(NetIoHandle xNetIo, void *pConn)
+{
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    pxConn->pxRecorder->pxInner->disconnect(xNetIo, pxConn->pInnerConn);
+}
+
+static void prvRecorderClose(NetIoHandle xNetIo, void *pConn)
+{
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    if (pxConn->pInnerConn != NULL)
+    {
+        pxConn->pxRecorder->pxInner->close(xNetIo, pxConn->pInnerConn);
+    }
+    Allocator_free(pxConn);
+}
+
+static int prvRecorderSend(NetIoHandle xNetIo, void *pConn, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    int res = NETIO_ERRNO_NONE;
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    if ((res = pxConn->pxRecorder->pxInner->send(xNetIo, pxConn->pInnerConn, pBuffer, uBytesToSend)) == NETIO_ERRNO_NONE)
+    {
+        prvWriteRecord(pxConn->pxRecorder, pxConn->uSession, RECORD_TYPE_SEND, (int32_t)uBytesToSend, NULL, 0);
+    }
+
+    return res;
+}
+
+static int prvRecorderRecv(NetIoHandle xNetIo, void *pConn, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    int res = NETIO_ERRNO_NONE;
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    if ((res = pxConn->pxRecorder->pxInner->recv(xNetIo, pxConn->pInnerConn, pBuffer, uBufferSize, puBytesReceived)) != NETIO_ERRNO_NONE)
+    {
+        prvWriteRecord(pxConn->pxRecorder, pxConn->uSession, RECORD_TYPE_ERROR, res, NULL, 0);
+    }
+    else if (*puBytesReceived == 0)
+    {
+        prvWriteRecord(pxConn->pxRecorder, pxConn->uSession, RECORD_TYPE_EOF, 0, NULL, 0);
+    }
+    else
+    {
+        prvWriteRecord(pxConn->pxRecorder, pxConn->uSession, RECORD_TYPE_RECV, 0, pBuffer, (uint32_t)*puBytesReceived);
+    }
+
+    return res;
+}
+
+static bool prvRecorderHasPendingData(NetIoHandle xNetIo, void *pConn)
+{
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    return pxConn->pxRecorder->pxInner->hasPendingData(xNetIo, pxConn->pInnerConn);
+}
+
+static bool prvRecorderIsIdleConnectionAlive(NetIoHandle xNetIo, void *pConn)
+{
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    return pxConn->pxRecorder->pxInner->isIdleConnectionAlive(xNetIo, pxConn->pInnerConn);
+}
+
+static const char *prvRecorderGetAlpnProtocol(NetIoHandle xNetIo, void *pConn)
+{
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    return pxConn->pxRecorder->pxInner->getAlpnProtocol(xNetIo, pxConn->pInnerConn);
+}
+
+static const char *prvRecorderGetCiphersuite(NetIoHandle xNetIo, void *pConn)
+{
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    return pxConn->pxRecorder->pxInner->getCiphersuite(xNetIo, pxConn->pInnerConn);
+}
+
+static size_t prvRecorderGetMemoryUsage(NetIoHandle xNetIo, void *pConn)
+{
+    RecorderConn_t *pxConn = (RecorderConn_t *)pConn;
+
+    return sizeof(RecorderConn_t) + pxConn->pxRecorder->pxInner->getMemoryUsage(xNetIo, pxConn->pInnerConn);
+}
+
+static void prvRecorderTerminate(PollyTransportHandle xTransport)
+{
+    Recorder_t *pxRecorder = (Recorder_t *)xTransport;
+
+    fclose(pxRecorder->pxFile);
+    pthread_mutex_destroy(&(pxRecorder->xLock));
+    Allocator_free(pxRecorder);
+}
+
+static const PollyTransport_t gxRecorderTransport =
+{
+    prvRecorderConnect,
+    prvRecorderDisconnect,
+    prvRecorderClose,
+    prvRecorderSend,
+    prvRecorderRecv,
+    NULL, // The spliced data would not be recorded
+    prvRecorderHasPendingData,
+    prvRecorderIsIdleConnectionAlive,
+    prvRecorderGetAlpnProtocol,
+    prvRecorderGetCiphersuite,
+    prvRecorderGetMemoryUsage,
+    prvRecorderTerminate
+};
+
+static int prvReplayerConnect(PollyTransportHandle xTransport, NetIoHandle xNetIo, const char *pcHost, const char *pcPort, void **ppConn)
+{
+    int res = NETIO_ERRNO_NONE;
+    Replayer_t *pxReplayer = (Replayer_t *)xTransport;
+    ReplayerConn_t *pxConn = NULL;
+    uint32_t uSession = 0;
+
+    if (pxReplayer->uSessionCount == 0)
+    {
+        res = NETIO_ERRNO_NET_CONNECT_FAILED;
+    }
+    else if ((pxConn = (ReplayerConn_t *)Allocator_calloc(1, sizeof(ReplayerConn_t))) == NULL)
+    {
+        res = NETIO_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        uSession = __atomic_fetch_add(&(pxReplayer->uNextSession), 1, __ATOMIC_RELAXED);
+        pxConn->pxSession = &(pxReplayer->pxSessions[uSession % pxReplayer->uSessionCount]);
+        pxConn->pxRecords = &(pxReplayer->pxRecords[pxConn->pxSession->uFirst]);
+        pxConn->uNext = 1; // Past the open record
+        *ppConn = pxConn;
+    }
+
+    return res;
+}
+
+static void prvReplayerDisconnect(NetIoHandle xNetIo, void *pConn)
+{
+}
+
+static void prvReplayerClose(NetIoHandle xNetIo, void *pConn)
+{
+    Allocator_free(pConn);
+}
+
+static int prvReplayerSend(NetIoHandle xNetIo, void *pConn, const unsigned char *pBuffer, size_t uBytesToSend)
+{
+    /* The responses are played back whatever is sent, as a request differs on every run by its date and signature. */
+    return NETIO_ERRNO_NONE;
+}
+
+static int prvReplayerRecv(NetIoHandle xNetIo, void *pConn, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived)
+{
+    int res = NETIO_ERRNO_NONE;
+    ReplayerConn_t *pxConn = (ReplayerConn_t *)pConn;
+    Record_t *pxRecord = NULL;
+    size_t uLen = 0;
+
+    while (pxConn->uNext < pxConn->pxSession->uCount && pxConn->pxRecords[pxConn->uNext].uType == RECORD_TYPE_SEND)
+    {
+        pxConn->uNext++;
+    }
+
+    *puBytesReceived = 0;
+    if (pxConn->uNext >= pxConn->pxSession->uCount)
+    {
+        /* The recording stops here, so the server is gone. */
+    }
+    else if ((pxRecord = &(pxConn->pxRecords[pxConn->uNext]))->uType == RECORD_TYPE_ERROR)
+    {
+        res = pxRecord->iValue;
+        pxConn->uNext++;
+    }
+    else if (pxRecord->uType == RECORD_TYPE_EOF)
+    {
+        pxConn->uNext++;
+    }
+    else
+    {
+        uLen = pxRecord->uLen - pxConn->uOffset;
+        uLen = (uLen < uBufferSize) ? uLen : uBufferSize;
+        memcpy(pBuffer, pxRecord->pData + pxConn->uOffset, uLen);
+        *puBytesReceived = uLen;
+        if ((pxConn->uOffset += uLen) == pxRecord->uLen)
+        {
+            pxConn->uOffset = 0;
+            pxConn->uNext++;
+        }
+    }
+
+    return res;
+}
+
+static bool prvReplayerHasPendingData(NetIoHandle xNetIo, void *pConn)
+{
+    /* A receive never waits, so there is always something to read, if only the end of the session. */
+    return true;
+}
+
+static bool prvReplayerIsIdleConnectionAlive(NetIoHandle xNetIo, void *pConn)
+{
+    ReplayerConn_t *pxConn = (ReplayerConn_t *)pConn;
+    size_t i = 0;
+
+    /* The recorded client sent another request on the connection only if it was alive, otherwise the session ends here. */
+    for (i = pxConn->uNext; i < pxConn->pxSession->uCount; i++)
+    {
+        if (pxConn->pxRecords[i].uType == RECORD_TYPE_SEND)
+        {
+            break;
+        }
+    }
+
+    return pxConn->uOffset == 0 && i < pxConn->pxSession->uCount;
+}
+
+static const char *prvReplayerGetAlpnProtocol(NetIoHandle xNetIo, void *pConn)
+{
+    return ((ReplayerConn_t *)pConn)->pxSession->pAlpnProtocol;
+}
+
+static const char *prvReplayerGetCiphersuite(NetIoHandle xNetIo, void *pConn)
+{
+    return NULL;
+}
+
+static size_t prvReplayerGetMemoryUsage(NetIoHandle xNetIo, void *pConn)
+{
+    return sizeof(ReplayerConn_t);
+}
+
+static void prvReplayerTerminate(PollyTransportHandle xTransport)
+{
+    Replayer_t *pxReplayer = (Replayer_t *)xTransport;
+
+    Allocator_free(pxReplayer->pxSessions);
+    Allocator_free(pxReplayer->pxRecords);
+    Allocator_free(pxReplayer->pFileData);
+    Allocator_free(pxReplayer);
+}
+
+static const PollyTransport_t gxReplayerTransport =
+{
+    prvReplayerConnect,
+    prvReplayerDisconnect,
+    prvReplayerClose,
+    prvReplayerSend,
+    prvReplayerRecv,
+    NULL,
+    prvReplayerHasPendingData,
+    prvReplayerIsIdleConnectionAlive,
+    prvReplayerGetAlpnProtocol,
+    prvReplayerGetCiphersuite,
+    prvReplayerGetMemoryUsage,
+    prvReplayerTerminate
+};
+
+static uint8_t *prvReadFile(const char *pFileName, size_t *puLen)
+{
+    FILE *pxFile = NULL;
+    uint8_t *pData = NULL;
+    long lLen = 0;
+
+    if ((pxFile = fopen(pFileName, "rb")) != NULL)
+    {
+        if (fseek(pxFile, 0, SEEK_END) == 0 && (lLen = ftell(pxFile)) > 0 && fseek(pxFile, 0, SEEK_SET) == 0 &&
+            (pData = (uint8_t *)Allocator_malloc((size_t)lLen)) != NULL)
+        {
+            if (fread(pData, (size_t)lLen, 1, pxFile) == 1)
+            {
+                *puLen = (size_t)lLen;
+            }
+            else
+            {
+                Allocator_free(pData);
+                pData = NULL;
+            }
+        }
+        fclose(pxFile);
+    }
+
+    return pData;
+}
+
+/* Index the records of the file by session. A session whose open record is missing, ex: cut off, is dropped. */
+static int prvLoadRecording(Replayer_t *pxReplayer, size_t uFileLen)
+{
+    int res = POLLY_ERRNO_NONE;
+    RecordHeader_t xHeader;
+    size_t uOffset = 0;
+    size_t uRecordCount = 0;
+    uint32_t uMaxSession = 0;
+    size_t uSessionCount = 0;
+    size_t *puFill = NULL;
+    Session_t *pxSession = NULL;
+    Record_t *pxRecord = NULL;
+    size_t i = 0;
+
+    /* The first pass counts the records of every session, and the second one places them. */
+    for (uOffset = RECORDING_MAGIC_LEN; uOffset + sizeof(xHeader) <= uFileLen; uOffset += sizeof(xHeader) + xHeader.uLen)
+    {
+        memcpy(&xHeader, pxReplayer->pFileData + uOffset, sizeof(xHeader));
+        if (uOffset + sizeof(xHeader) + xHeader.uLen > uFileLen)
+        {
+            break;
+        }
+        uMaxSession = (xHeader.uSession > uMaxSession) ? xHeader.uSession : uMaxSession;
+        uRecordCount++;
+    }
+
+    /* The recorder numbers the sessions from 0 and every session has a record, so a larger id comes from a corrupted file. */
+    uSessionCount = (size_t)uMaxSession + 1;
+    if (uRecordCount == 0 || uMaxSession == UINT32_MAX || uMaxSession >= uRecordCount)
+    {
+        res = POLLY_ERRNO_INVALID_PARAMETER;
+    }
+    else if ((pxReplayer->pxRecords = (Record_t *)Allocator_calloc(uRecordCount, sizeof(Record_t))) == NULL ||
+             (pxReplayer->pxSessions = (Session_t *)Allocator_calloc(uSessionCount, sizeof(Session_t))) == NULL ||
+             (puFill = (size_t *)Allocator_calloc(uSessionCount, sizeof(size_t))) == NULL)
+    {
+        res = POLLY_ERRNO_OUT_OF_MEMORY;
+    }
+    else
+    {
+        for (uOffset = RECORDING_MAGIC_LEN; uOffset + sizeof(xHeader) <= uFileLen; uOffset += sizeof(xHeader) + xHeader.uLen)
+        {
+            memcpy(&xHeader, pxReplayer->pFileData + uOffset, sizeof(xHeader));
+            if (uOffset + sizeof(xHeader) + xHeader.uLen > uFileLen || xHeader.uSession >= uSessionCount)
+            {
+                break;
+            }
+            pxReplayer->pxSessions[xHeader.uSession].uCount++;
+        }
+        for (i = 1; i < uSessionCount; i++)
+        {
+            pxReplayer->pxSessions[i].uFirst = pxReplayer->pxSessions[i - 1].uFirst + pxReplayer->pxSessions[i - 1].uCount;
+        }
+
+        for (uOffset = RECORDING_MAGIC_LEN; uOffset + sizeof(xHeader) <= uFileLen; uOffset += sizeof(xHeader) + xHeader.uLen)
+        {
+            memcpy(&xHeader, pxReplayer->pFileData + uOffset, sizeof(xHeader));
+            if (uOffset + sizeof(xHeader) + xHeader.uLen > uFileLen || xHeader.uSession >= uSessionCount)
+            {
+                break;
+            }
+            pxSession = &(pxReplayer->pxSessions[xHeader.uSession]);
+            pxRecord = &(pxReplayer->pxRecords[pxSession->uFirst + puFill[xHeader.uSession]++]);
+            pxRecord->uType = xHeader.uType;
+            pxRecord->iValue = xHeader.iValue;
+            pxRecord->pData = pxReplayer->pFileData + uOffset + sizeof(xHeader);
+            pxRecord->uLen = xHeader.uLen;
+        }
+
+        /* Drop the sessions which don't start with an open record, and keep the others in the order they were opened. */
+        for (i = 0; i < uSessionCount; i++)
+        {
+            pxSession = &(pxReplayer->pxSessions[i]);
+            pxRecord = &(pxReplayer->pxRecords[pxSession->uFirst]);
+            if (pxSession->uCount > 0 && pxRecord->uType == RECORD_TYPE_OPEN)
+            {
+                pxSession->pAlpnProtocol = (pxRecord->uLen > 0 && pxRecord->pData[pxRecord->uLen - 1] == '\0') ? (const char *)pxRecord->pData : NULL;
+                pxReplayer->pxSessions[pxReplayer->uSessionCount++] = *pxSession;
+            }
+        }
+    }
+
+    Allocator_free(puFill);
+
+    return res;
+}
+
+PollyTransportHandle PollyTransport_getPlain(void)
+{
+    return NetIo_getPlainTransport();
+}
+
+PollyTransportHandle PollyTransport_createRecorder(PollyTransportHandle xInner, const char *pFileName)
+{
+    Recorder_t *pxRecorder = NULL;
+
+    if (pFileName != NULL && (pxRecorder = (Recorder_t *)Allocator_calloc(1, sizeof(Recorder_t))) != NULL)
+    {
+        memcpy(&(pxRecorder->xTransport), &gxRecorderTransport, sizeof(PollyTransport_t));
+        pxRecorder->pxInner = (PollyTransport_t *)((xInner != NULL) ? xInner : NetIo_getTlsTransport());
+
+        if ((pxRecorder->pxFile = fopen(pFileName, "wb")) == NULL)
+        {
+            Allocator_free(pxRecorder);
+            pxRecorder = NULL;
+        }
+        else if (fwrite(RECORDING_MAGIC, RECORDING_MAGIC_LEN, 1, pxRecorder->pxFile) != 1 || pthread_mutex_init(&(pxRecorder->xLock), NULL) != 0)
+        {
+            fclose(pxRecorder->pxFile);
+            Allocator_free(pxRecorder);
+            pxRecorder = NULL;
+        }
+    }
+
+    return (PollyTransportHandle)pxRecorder;
+}
+
+PollyTransportHandle PollyTransport_createReplayer(const char *pFileName)
+{
+    Replayer_t *pxReplayer = NULL;
+    size_t uFileLen = 0;
+
+    if (pFileName != NULL && (pxReplayer = (Replayer_t *)Allocator_calloc(1, sizeof(Replayer_t))) != NULL)
+    {
+        memcpy(&(pxReplayer->xTransport), &gxReplayerTransport, sizeof(PollyTransport_t));
+
+        if ((pxReplayer->pFileData = prvReadFile(pFileName, &uFileLen)) == NULL || uFileLen < RECORDING_MAGIC_LEN ||
+            memcmp(pxReplayer->pFileData, RECORDING_MAGIC, RECORDING_MAGIC_LEN) != 0 ||
+            prvLoadRecording(pxReplayer, uFileLen) != POLLY_ERRNO_NONE || pxReplayer->uSessionCount == 0)
+        {
+            prvReplayerTerminate((PollyTransportHandle)pxReplayer);
+            pxReplayer = NULL;
+        }
+    }
+
+    return (PollyTransportHandle)pxReplayer;
+}
+
+void PollyTransport_terminate(PollyTransportHandle xTransport)
+{
+    PollyTransport_t *pxTransport = (PollyTransport_t *)xTransport;
+
+    if (pxTransport != NULL && pxTransport->terminate != NULL)
+    {
+        pxTransport->terminate(xTransport);
+    }
+}
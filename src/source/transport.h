@@ -0,0 +1,37 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "polly/polly.h"
+
+#include "netio.h"
+
+/*
+ * A transport carries the bytes of a NetIo connection. NetIo keeps the options, the deadline and the socket, and hands every call to the
+ * transport it's set to. pConn is the state which the transport keeps for the connection, or NULL if it needs none.
+ *
+ * The functions follow the NetIo function of the same name, and return NETIO_ERRNO_* codes.
+ */
+typedef struct PollyTransport
+{
+    int (*connect)(PollyTransportHandle xTransport, NetIoHandle xNetIo, const char *pcHost, const char *pcPort, void **ppConn);
+    void (*disconnect)(NetIoHandle xNetIo, void *pConn);
+    void (*close)(NetIoHandle xNetIo, void *pConn); // Free pConn, it's only called if pConn is set
+    int (*send)(NetIoHandle xNetIo, void *pConn, const unsigned char *pBuffer, size_t uBytesToSend);
+    int (*recv)(NetIoHandle xNetIo, void *pConn, unsigned char *pBuffer, size_t uBufferSize, size_t *puBytesReceived);
+    int (*splice)(NetIoHandle xNetIo, void *pConn, int xFd, size_t uLen, size_t *puBytesSpliced); // NULL if the data has to be received
+
+    /* Data which is buffered in the transport, so it won't wake up a poll() of the socket */
+    bool (*hasPendingData)(NetIoHandle xNetIo, void *pConn);
+    bool (*isIdleConnectionAlive)(NetIoHandle xNetIo, void *pConn);
+
+    const char *(*getAlpnProtocol)(NetIoHandle xNetIo, void *pConn);
+    const char *(*getCiphersuite)(NetIoHandle xNetIo, void *pConn);
+    size_t (*getMemoryUsage)(NetIoHandle xNetIo, void *pConn); // Beyond the NetIo handle
+
+    void (*terminate)(PollyTransportHandle xTransport); // NULL for the transports which are built in
+} PollyTransport_t;
+
+#endif /* TRANSPORT_H */
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+
+#include "polly/polly.h"
+
+#include "allocator.h"
+#include "port.h"
+#include "trust_store.h"
+
+#define DEFAULT_VERIFIED_CHAIN_TTL_MS   (60 * 60 * 1000)
+
+#define CHAIN_FINGERPRINT_LEN           (32)
+
+typedef struct
+{
+    uint8_t pFingerprint[CHAIN_FINGERPRINT_LEN];
+    uint64_t uExpiryMs; // 0 for an empty slot
+} VerifiedChain_t;
+
+typedef struct PollyTrustStore
+{
+    /* It's immutable after creation, so every connection config refers to it without a lock. */
+    mbedtls_x509_crt xCaChain;
+    uint32_t uRefs;
+
+    /* The cache of verified server chains is the only mutable part. */
+    pthread_mutex_t xLock;
+    VerifiedChain_t *pxVerifiedChains;
+    unsigned int uVerifiedChainCount;
+    unsigned int uNextSlot;
+    uint32_t uVerifiedChainTtlMs;
+} PollyTrustStore_t;
+
+/* The fingerprint covers the host and every certificate of the chain, so the same chain presented for another host is validated again. */
+static int prvGetChainFingerprint(const mbedtls_x509_crt *pxPeerChain, const char *pHost, uint8_t pFingerprint[CHAIN_FINGERPRINT_LEN])
+{
+    int res = TRUST_STORE_ERRNO_NONE;
+    mbedtls_sha256_context xSha256;
+    const mbedtls_x509_crt *pxCrt = NULL;
+
+    mbedtls_sha256_init(&xSha256);
+
+    if (mbedtls_sha256_starts_ret(&xSha256, 0) != 0 ||
+        mbedtls_sha256_update_ret(&xSha256, (const unsigned char *)pHost, strlen(pHost) + 1) != 0)
+    {
+        res = TRUST_STORE_ERRNO_INVALID_PARAMETER;
+    }
+    else
+    {
+        for (pxCrt = pxPeerChain; pxCrt != NULL && pxCrt->raw.p != NULL && res == TRUST_STORE_ERRNO_NONE; pxCrt = pxCrt->next)
+        {
+            if (mbedtls_sha256_update_ret(&xSha256, pxCrt->raw.p, pxCrt->raw.len) != 0)
+            {
+                res = TRUST_STORE_ERRNO_INVALID_PARAMETER;
+            }
+        }
+
+        if (res == TRUST_STORE_ERRNO_NONE && mbedtls_sha256_finish_ret(&xSha256, pFingerprint) != 0)
+        {
+            res = TRUST_STORE_ERRNO_INVALID_PARAMETER;
+        }
+    }
+
+    mbedtls_sha256_free(&xSha256);
+
+    return res;
+}
+
+static bool prvIsVerifiedChain(PollyTrustStore_t *pxTrustStore, const uint8_t pFingerprint[CHAIN_FINGERPRINT_LEN])
+{
+    bool bVerified = false;
+    uint64_t uNowMs = Port_getTimeMs();
+    unsigned int i = 0;
+
+    pthread_mutex_lock(&(pxTrustStore->xLock));
+    for (i = 0; i < pxTrustStore->uVerifiedChainCount && !bVerified; i++)
+    {
+        bVerified = pxTrustStore->pxVerifiedChains[i].uExpiryMs > uNowMs &&
+                    memcmp(pxTrustStore->pxVerifiedChains[i].pFingerprint, pFingerprint, CHAIN_FINGERPRINT_LEN) == 0;
+    }
+    pthread_mutex_unlock(&(pxTrustStore->xLock));
+
+    return bVerified;
+}
+
+static void prvAddVerifiedChain(PollyTrustStore_t *pxTrustStore, const uint8_t pFingerprint[CHAIN_FINGERPRINT_LEN])
+{
+    VerifiedChain_t *pxSlot = NULL;
+
+    /* The slots are reused round-robin, so the oldest verification is evicted first. */
+    pthread_mutex_lock(&(pxTrustStore->xLock));
+    pxSlot = &(pxTrustStore->pxVerifiedChains[pxTrustStore->uNextSlot]);
+    memcpy(pxSlot->pFingerprint, pFingerprint, CHAIN_FINGERPRINT_LEN);
+    pxSlot->uExpiryMs = Port_getTimeMs() + pxTrustStore->uVerifiedChainTtlMs;
+    pxTrustStore->uNextSlot = (pxTrustStore->uNextSlot + 1) % pxTrustStore->uVerifiedChainCount;
+    pthread_mutex_unlock(&(pxTrustStore->xLock));
+}
+
+PollyTrustStoreHandle PollyTrustStore_create(const PollyTrustStoreConfig_t *pConfig)
+{
+    PollyTrustStore_t *pxTrustStore = NULL;
+    int retVal = 0;
+
+    if (pConfig != NULL && (pConfig->pCaFile != NULL || pConfig->pCaPem != NULL) &&
+        (pxTrustStore = (PollyTrustStore_t *)Allocator_malloc(sizeof(PollyTrustStore_t))) != NULL)
+    {
+        memset(pxTrustStore, 0, sizeof(PollyTrustStore_t));
+        mbedtls_x509_crt_init(&(pxTrustStore->xCaChain));
+        pxTrustStore->uRefs = 1;
+        pxTrustStore->uVerifiedChainCount = pConfig->uVerifiedChainCacheSize;
+        pxTrustStore->uVerifiedChainTtlMs = (pConfig->uVerifiedChainTtlMs != 0) ? pConfig->uVerifiedChainTtlMs : DEFAULT_VERIFIED_CHAIN_TTL_MS;
+
+        /* A bundle may have a few certificates mbedtls can't parse. They are skipped as long as some others are usable, which is what a positive value tells. */
+        if (pConfig->pCaFile != NULL)
+        {
+            retVal = mbedtls_x509_crt_parse_file(&(pxTrustStore->xCaChain), pConfig->pCaFile);
+        }
+        if (retVal >= 0 && pConfig->pCaPem != NULL)
+        {
+            retVal = mbedtls_x509_crt_parse(&(pxTrustStore->xCaChain), (const unsigned char *)pConfig->pCaPem, strlen(pConfig->pCaPem) + 1);
+        }
+
+        if (retVal < 0 || pxTrustStore->xCaChain.raw.p == NULL ||
+            (pxTrustStore->uVerifiedChainCount > 0 &&
+             (pxTrustStore->pxVerifiedChains = (VerifiedChain_t *)Allocator_calloc(pxTrustStore->uVerifiedChainCount, sizeof(VerifiedChain_t))) == NULL) ||
+            pthread_mutex_init(&(pxTrustStore->xLock), NULL) != 0)
+        {
+            mbedtls_x509_crt_free(&(pxTrustStore->xCaChain));
+            Allocator_free(pxTrustStore->pxVerifiedChains);
+            Allocator_free(pxTrustStore);
+            pxTrustStore = NULL;
+        }
+    }
+
+    return pxTrustStore;
+}
+
+void PollyTrustStore_terminate(PollyTrustStoreHandle xTrustStore)
+{
+    TrustStore_release(xTrustStore);
+}
+
+PollyTrustStoreHandle TrustStore_acquire(PollyTrustStoreHandle xTrustStore)
+{
+    PollyTrustStore_t *pxTrustStore = (PollyTrustStore_t *)xTrustStore;
+
+    if (pxTrustStore != NULL)
+    {
+        __atomic_add_fetch(&(pxTrustStore->uRefs), 1, __ATOMIC_ACQ_REL);
+    }
+
+    return pxTrustStore;
+}
+
+void TrustStore_release(PollyTrustStoreHandle xTrustStore)
+{
+    PollyTrustStore_t *pxTrustStore = (PollyTrustStore_t *)xTrustStore;
+
+    if (pxTrustStore != NULL && __atomic_sub_fetch(&(pxTrustStore->uRefs), 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_destroy(&(pxTrustStore->xLock));
+        mbedtls_x509_crt_free(&(pxTrustStore->xCaChain));
+        Allocator_free(pxTrustStore->pxVerifiedChains);
+        Allocator_free(pxTrustStore);
+    }
+}
+
+int TrustStore_verifyPeer(PollyTrustStoreHandle xTrustStore, const mbedtls_x509_crt *pxPeerChain, const char *pHost)
+{
+    int res = TRUST_STORE_ERRNO_NONE;
+    PollyTrustStore_t *pxTrustStore = (PollyTrustStore_t *)xTrustStore;
+    uint8_t pFingerprint[CHAIN_FINGERPRINT_LEN];
+    bool bCached = false;
+    uint32_t uFlags = 0;
+
+    if (pxTrustStore == NULL || pxPeerChain == NULL || pxPeerChain->raw.p == NULL || pHost == NULL)
+    {
+        res = TRUST_STORE_ERRNO_INVALID_PARAMETER;
+    }
+    else if (pxTrustStore->uVerifiedChainCount > 0 &&
+             (res = prvGetChainFingerprint(pxPeerChain, pHost, pFingerprint)) != TRUST_STORE_ERRNO_NONE)
+    {
+        /* Propagate the error code */
+    }
+    else if (pxTrustStore->uVerifiedChainCount > 0 && prvIsVerifiedChain(pxTrustStore, pFingerprint) && !mbedtls_x509_time_is_past(&(pxPeerChain->valid_to)))
+    {
+        /* The same chain was validated for this host recently. Only the expiration of the leaf is checked again. */
+        bCached = true;
+    }
+    else if (mbedtls_x509_crt_verify((mbedtls_x509_crt *)pxPeerChain, &(pxTrustStore->xCaChain), NULL, pHost, &uFlags, NULL, NULL) != 0)
+    {
+        res = TRUST_STORE_ERRNO_NOT_TRUSTED;
+    }
+
+    if (res == TRUST_STORE_ERRNO_NONE && !bCached && pxTrustStore->uVerifiedChainCount > 0)
+    {
+        prvAddVerifiedChain(pxTrustStore, pFingerprint);
+    }
+
+    return res;
+}
@@ -0,0 +1,38 @@
+#ifndef TRUST_STORE_H
+#define TRUST_STORE_H
+
+#include "mbedtls/x509_crt.h"
+
+#include "polly/polly.h"
+
+#define TRUST_STORE_ERRNO_NONE                  (0)
+#define TRUST_STORE_ERRNO_INVALID_PARAMETER     (-1)
+#define TRUST_STORE_ERRNO_NOT_TRUSTED           (-2)
+
+/**
+ * @brief Take a reference of a trust store, so it outlives the handle returned to the user
+ *
+ * @param[in] xTrustStore The trust store handle
+ * @return The same handle
+ */
+PollyTrustStoreHandle TrustStore_acquire(PollyTrustStoreHandle xTrustStore);
+
+/**
+ * @brief Drop a reference of a trust store. The last one frees it.
+ *
+ * @param[in] xTrustStore The trust store handle
+ */
+void TrustStore_release(PollyTrustStoreHandle xTrustStore);
+
+/**
+ * @brief Verify the certificate chain presented by a server against the trusted CAs and the host name.
+ * A chain which was verified recently for the same host is accepted from the cache without validating it again.
+ *
+ * @param[in] xTrustStore The trust store handle
+ * @param[in] pxPeerChain The certificate chain of the server, leaf first
+ * @param[in] pHost The host name the certificate must be issued for
+ * @return TRUST_STORE_ERRNO_NONE if the chain is trusted, non-zero value otherwise
+ */
+int TrustStore_verifyPeer(PollyTrustStoreHandle xTrustStore, const mbedtls_x509_crt *pxPeerChain, const char *pHost);
+
+#endif /* TRUST_STORE_H */
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+
+#include "credential_provider.h"
+#include "port.h"
+}
+
+#include "local_server.h"
+
+namespace
+{
+
+/* The document of the container credential endpoint */
+const char *kCredentialsJson =
+    "{\n"
+    "  \"RoleArn\" : \"arn:aws:iam::123456789012:role/polly\",\n"
+    "  \"AccessKeyId\" : \"ASIAEXAMPLE\",\n"
+    "  \"SecretAccessKey\":\"wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY\",\n"
+    "  \"Token\"\t:\t\"FwoGZXIvYXdzEXAMPLETOKEN\",\n"
+    "  \"Expiration\" : \"2026-10-19T08:00:00Z\"\n"
+    "}";
+
+/* The endpoint waits this long for a connect or a read, and a load may return that much later */
+const uint64_t kEndpointTimeoutMs = 5 * 1000;
+const uint64_t kLatenessMs = 1000;
+
+PollyCredentialProviderConfig_t prvEndpointConfig(const char *pPort)
+{
+    PollyCredentialProviderConfig_t xConfig;
+
+    memset(&xConfig, 0, sizeof(xConfig));
+    xConfig.pEndpointHost = "127.0.0.1";
+    xConfig.pEndpointPort = pPort;
+    xConfig.pEndpointPath = "/v2/credentials/polly";
+
+    return xConfig;
+}
+
+} // namespace
+
+TEST(CredentialProviderTest, GetJsonString)
+{
+    char pValue[64];
+
+    ASSERT_TRUE(CredentialProvider_getJsonString(kCredentialsJson, "AccessKeyId", pValue, sizeof(pValue)));
+    EXPECT_STREQ(pValue, "ASIAEXAMPLE");
+    ASSERT_TRUE(CredentialProvider_getJsonString(kCredentialsJson, "SecretAccessKey", pValue, sizeof(pValue)));
+    EXPECT_STREQ(pValue, "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY");
+    ASSERT_TRUE(CredentialProvider_getJsonString(kCredentialsJson, "Token", pValue, sizeof(pValue)));
+    EXPECT_STREQ(pValue, "FwoGZXIvYXdzEXAMPLETOKEN");
+    ASSERT_TRUE(CredentialProvider_getJsonString(kCredentialsJson, "Expiration", pValue, sizeof(pValue)));
+    EXPECT_STREQ(pValue, "2026-10-19T08:00:00Z");
+
+    EXPECT_FALSE(CredentialProvider_getJsonString(kCredentialsJson, "SessionToken", pValue, sizeof(pValue)));
+}
+
+TEST(CredentialProviderTest, GetJsonStringMatchesWholeNames)
+{
+    char pValue[64];
+
+    /* A name which is a prefix of another, or which appears as a value, is not the field */
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"TokenType\":\"Bearer\"}", "Token", pValue, sizeof(pValue)));
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Code\":\"Token\"}", "Token", pValue, sizeof(pValue)));
+    ASSERT_TRUE(CredentialProvider_getJsonString("{\"Code\":\"Token\",\"Token\":\"abc\"}", "Token", pValue, sizeof(pValue)));
+    EXPECT_STREQ(pValue, "abc");
+    ASSERT_TRUE(CredentialProvider_getJsonString("{\"Token\":\"\"}", "Token", pValue, sizeof(pValue)));
+    EXPECT_STREQ(pValue, "");
+}
+
+TEST(CredentialProviderTest, GetJsonStringRejectsMalformed)
+{
+    char pValue[64];
+
+    EXPECT_FALSE(CredentialProvider_getJsonString("", "Token", pValue, sizeof(pValue)));
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Token\"", "Token", pValue, sizeof(pValue)));
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Token\":", "Token", pValue, sizeof(pValue)));
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Token\":\"abc", "Token", pValue, sizeof(pValue)));
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Token\" \"abc\"}", "Token", pValue, sizeof(pValue)));
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Tok", "Token", pValue, sizeof(pValue)));
+
+    /* A value which isn't a string doesn't take the name of the next field */
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Token\":null,\"Code\":\"Success\"}", "Token", pValue, sizeof(pValue)));
+}
+
+TEST(CredentialProviderTest, GetJsonStringFitsValue)
+{
+    char pValue[4];
+
+    ASSERT_TRUE(CredentialProvider_getJsonString("{\"Token\":\"abc\"}", "Token", pValue, sizeof(pValue)));
+    EXPECT_STREQ(pValue, "abc");
+
+    /* A value which doesn't fit is not truncated */
+    memset(pValue, 'x', sizeof(pValue));
+    EXPECT_FALSE(CredentialProvider_getJsonString("{\"Token\":\"abcd\"}", "Token", pValue, sizeof(pValue)));
+}
+
+TEST(CredentialProviderTest, ParseIso8601)
+{
+    EXPECT_EQ(CredentialProvider_parseIso8601("1970-01-01T00:00:00Z"), (time_t)0);
+    EXPECT_EQ(CredentialProvider_parseIso8601("1970-01-02T00:00:01Z"), (time_t)86401);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2000-02-29T12:34:56Z"), (time_t)951827696);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2000-03-01T00:00:00Z"), (time_t)951868800);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2021-01-01T00:00:00Z"), (time_t)1609459200);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2026-10-19T08:00:00Z"), (time_t)1792396800);
+
+    /* The fractions of a second which some endpoints send are ignored */
+    EXPECT_EQ(CredentialProvider_parseIso8601("2021-01-01T00:00:00.123Z"), (time_t)1609459200);
+}
+
+TEST(CredentialProviderTest, ParseIso8601MatchesEveryDay)
+{
+    char pDateTime[32];
+    struct tm xTm;
+
+    /* A day after another at a different time, from 2000 to 2100 so the century rules are covered, or to 2038 with a 32-bit time_t */
+    const time_t xEnd = (sizeof(time_t) >= 8) ? (time_t)4107542400LL : (time_t)INT32_MAX;
+
+    for (time_t xTime = 946684800; xTime <= xEnd - 90061; xTime += 86400 + 3661)
+    {
+        ASSERT_NE(gmtime_r(&xTime, &xTm), nullptr);
+        strftime(pDateTime, sizeof(pDateTime), "%Y-%m-%dT%H:%M:%SZ", &xTm);
+        ASSERT_EQ(CredentialProvider_parseIso8601(pDateTime), xTime) << pDateTime;
+    }
+}
+
+TEST(CredentialProviderTest, ParseIso8601RejectsMalformed)
+{
+    EXPECT_EQ(CredentialProvider_parseIso8601(""), (time_t)0);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2021-01-01"), (time_t)0);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2021-13-01T00:00:00Z"), (time_t)0);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2021-00-01T00:00:00Z"), (time_t)0);
+    EXPECT_EQ(CredentialProvider_parseIso8601("2021-01-32T00:00:00Z"), (time_t)0);
+    EXPECT_EQ(CredentialProvider_parseIso8601("20210101T000000Z"), (time_t)0);
+}
+
+TEST(CredentialProviderTest, LoadsFromEndpoint)
+{
+    LocalServer xServer({ { 0, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(strlen(kCredentialsJson)) +
+                                   "\r\n\r\n" + kCredentialsJson } });
+    PollyCredentialProviderConfig_t xConfig = prvEndpointConfig(xServer.GetPort());
+    PollyCredentialProviderHandle xProvider = NULL;
+    Credentials_t *pxCredentials = NULL;
+
+    ASSERT_NE(xServer.GetPort(), nullptr);
+    ASSERT_NE(xProvider = PollyCredentialProvider_create(&xConfig), nullptr);
+    ASSERT_NE(pxCredentials = CredentialProvider_acquire(xProvider), nullptr);
+    EXPECT_STREQ(pxCredentials->pAccessKey, "ASIAEXAMPLE");
+    EXPECT_STREQ(pxCredentials->pToken, "FwoGZXIvYXdzEXAMPLETOKEN");
+    CredentialProvider_release(pxCredentials);
+    PollyCredentialProvider_terminate(xProvider);
+}
+
+TEST(CredentialProviderTest, EndpointConnectTimesOut)
+{
+    UnansweredServer xServer;
+    PollyCredentialProviderConfig_t xConfig = prvEndpointConfig(xServer.GetPort());
+    PollyCredentialProviderHandle xProvider = NULL;
+    uint64_t uStartMs = Port_getTimeMs();
+
+    /* The connect is dropped, so the first load gives up at the timeout rather than after the retries of TCP */
+    ASSERT_NE(xServer.GetPort(), nullptr);
+    ASSERT_NE(xProvider = PollyCredentialProvider_create(&xConfig), nullptr);
+    EXPECT_GE(Port_getTimeMs() - uStartMs, kEndpointTimeoutMs - 10);
+    EXPECT_LT(Port_getTimeMs() - uStartMs, kEndpointTimeoutMs + kLatenessMs);
+    EXPECT_EQ(CredentialProvider_acquire(xProvider), nullptr);
+    PollyCredentialProvider_terminate(xProvider);
+}
@@ -0,0 +1,264 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+
+#include "endpoint_router.h"
+#include "port.h"
+}
+
+namespace
+{
+
+const PollyEndpoint_t kEndpoints[] =
+{
+    { "us-east-1", "polly.us-east-1.amazonaws.com", NULL, NULL },
+    { "us-west-2", "polly.us-west-2.amazonaws.com", NULL, NULL },
+    { "eu-west-1", "polly.eu-west-1.amazonaws.com", "8443", NULL },
+};
+
+const unsigned int kEndpointCount = sizeof(kEndpoints) / sizeof(kEndpoints[0]);
+
+/* The circuits are probed through a replayer, whose connections always succeed, so a probe never leaves the process. */
+class EndpointRouterTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        std::string xFileName = ::testing::TempDir() + "endpoint_router_test.rec";
+        FILE *pxFile = NULL;
+        const uint32_t puOpenRecord[4] = { 0, 1, 0, 0 }; // Session 0 opens without ALPN
+
+        ASSERT_NE(pxFile = fopen(xFileName.c_str(), "wb"), nullptr);
+        fwrite("PLYREC01", 8, 1, pxFile);
+        fwrite(puOpenRecord, sizeof(puOpenRecord), 1, pxFile);
+        fclose(pxFile);
+        ASSERT_NE(xTransport = PollyTransport_createReplayer(xFileName.c_str()), nullptr);
+        remove(xFileName.c_str());
+
+        memset(&xServPara, 0, sizeof(xServPara));
+        xServPara.xTransport = xTransport;
+
+        memset(&xConfig, 0, sizeof(xConfig));
+        xConfig.pxEndpoints = kEndpoints;
+        xConfig.uEndpointCount = kEndpointCount;
+        xConfig.uExplorePercent = 1;
+        xConfig.uFailureThreshold = 3;
+        xConfig.uOpenMs = 60 * 1000;
+    }
+
+    void TearDown() override
+    {
+        PollyEndpointRouter_terminate(xRouter);
+        PollyTransport_terminate(xTransport);
+    }
+
+    void Create()
+    {
+        ASSERT_NE(xRouter = PollyEndpointRouter_create(&xServPara, &xConfig), nullptr);
+    }
+
+    PollyEndpointState_t GetState(unsigned int uIndex)
+    {
+        PollyEndpointStats_t xStats;
+
+        EXPECT_EQ(PollyEndpointRouter_getStats(xRouter, uIndex, &xStats), POLLY_ERRNO_NONE);
+
+        return xStats.eState;
+    }
+
+    /* Wait for the probe thread */
+    bool WaitForState(unsigned int uIndex, PollyEndpointState_t eState)
+    {
+        uint64_t uDeadlineMs = Port_getTimeMs() + 5000;
+
+        while (GetState(uIndex) != eState && Port_getTimeMs() < uDeadlineMs)
+        {
+            Port_sleepMs(10);
+        }
+
+        return GetState(uIndex) == eState;
+    }
+
+    /* Count the selections of every endpoint */
+    void Select(unsigned int uSelections, unsigned int puCounts[kEndpointCount])
+    {
+        unsigned int uIndex = 0;
+
+        memset(puCounts, 0, kEndpointCount * sizeof(unsigned int));
+        for (unsigned int i = 0; i < uSelections; i++)
+        {
+            ASSERT_LT(uIndex = EndpointRouter_select(xRouter), kEndpointCount);
+            puCounts[uIndex]++;
+        }
+    }
+
+    PollyTransportHandle xTransport = NULL;
+    PollyServiceParameter_t xServPara;
+    PollyEndpointRouterConfig_t xConfig;
+    PollyEndpointRouterHandle xRouter = NULL;
+};
+
+} // namespace
+
+TEST_F(EndpointRouterTest, CopiesEndpoints)
+{
+    Create();
+
+    for (unsigned int i = 0; i < kEndpointCount; i++)
+    {
+        const PollyEndpoint_t *pxEndpoint = EndpointRouter_getEndpoint(xRouter, i);
+
+        EXPECT_STREQ(pxEndpoint->pRegion, kEndpoints[i].pRegion);
+        EXPECT_STREQ(pxEndpoint->pHost, kEndpoints[i].pHost);
+        EXPECT_STREQ(pxEndpoint->pPort, (kEndpoints[i].pPort != NULL) ? kEndpoints[i].pPort : POLLY_DEFAULT_PORT);
+        EXPECT_NE(pxEndpoint->pHost, kEndpoints[i].pHost);
+    }
+}
+
+TEST_F(EndpointRouterTest, PrefersOrderUntilLatencyIsKnown)
+{
+    unsigned int puCounts[kEndpointCount];
+
+    Create();
+
+    Select(99, puCounts);
+    EXPECT_EQ(puCounts[0], 99u);
+}
+
+TEST_F(EndpointRouterTest, PrefersLowestLatency)
+{
+    unsigned int puCounts[kEndpointCount];
+
+    Create();
+    EndpointRouter_report(xRouter, 0, false, 100);
+    EndpointRouter_report(xRouter, 1, false, 20);
+    EndpointRouter_report(xRouter, 2, false, 50);
+
+    Select(99, puCounts);
+    EXPECT_EQ(puCounts[1], 99u);
+
+    /* The moving average follows the latency of the endpoint */
+    for (int i = 0; i < 20; i++)
+    {
+        EndpointRouter_report(xRouter, 1, false, 200);
+    }
+    /* The 100th selection explores the others */
+    Select(99, puCounts);
+    EXPECT_EQ(puCounts[2], 98u);
+}
+
+TEST_F(EndpointRouterTest, ExploresOtherHealthyEndpoints)
+{
+    unsigned int puCounts[kEndpointCount];
+
+    xConfig.uExplorePercent = 10;
+    Create();
+    EndpointRouter_report(xRouter, 0, false, 20);
+    EndpointRouter_report(xRouter, 1, false, 50);
+    EndpointRouter_report(xRouter, 2, false, 100);
+
+    /* The explored share goes round the others */
+    Select(1000, puCounts);
+    EXPECT_EQ(puCounts[0], 900u);
+    EXPECT_EQ(puCounts[1], 50u);
+    EXPECT_EQ(puCounts[2], 50u);
+}
+
+TEST_F(EndpointRouterTest, OpensOnConsecutiveFailures)
+{
+    unsigned int puCounts[kEndpointCount];
+
+    Create();
+    EndpointRouter_report(xRouter, 0, true, 0);
+    EndpointRouter_report(xRouter, 0, true, 0);
+    EndpointRouter_report(xRouter, 0, false, 0);
+    EndpointRouter_report(xRouter, 0, true, 0);
+    EndpointRouter_report(xRouter, 0, true, 0);
+    EXPECT_EQ(GetState(0), POLLY_ENDPOINT_HEALTHY);
+
+    EndpointRouter_report(xRouter, 0, true, 0);
+    EXPECT_EQ(GetState(0), POLLY_ENDPOINT_OPEN);
+
+    Select(100, puCounts);
+    EXPECT_EQ(puCounts[0], 0u);
+    EXPECT_EQ(puCounts[1], 99u);
+}
+
+TEST_F(EndpointRouterTest, OpensOnErrorRate)
+{
+    unsigned int i = 0;
+
+    xConfig.uFailureThreshold = 100;
+    Create();
+
+    /* One request in two fails, which is at the limit once enough requests are counted */
+    for (i = 0; i < 19; i++)
+    {
+        EndpointRouter_report(xRouter, 0, i % 2 == 0, 0);
+    }
+    EXPECT_EQ(GetState(0), POLLY_ENDPOINT_HEALTHY);
+
+    for (; i < 40 && GetState(0) == POLLY_ENDPOINT_HEALTHY; i++)
+    {
+        EndpointRouter_report(xRouter, 0, i % 2 == 0, 0);
+    }
+    EXPECT_EQ(GetState(0), POLLY_ENDPOINT_OPEN);
+}
+
+TEST_F(EndpointRouterTest, AllOpenUsesFirstProbe)
+{
+    Create();
+
+    for (unsigned int i = 0; i < kEndpointCount; i++)
+    {
+        /* The circuits open in turn, so the first one is probed first */
+        for (unsigned int j = 0; j < xConfig.uFailureThreshold; j++)
+        {
+            EndpointRouter_report(xRouter, (i + 1) % kEndpointCount, true, 0);
+        }
+        Port_sleepMs(2);
+    }
+
+    EXPECT_EQ(EndpointRouter_select(xRouter), 1u);
+}
+
+TEST_F(EndpointRouterTest, RecoversThroughHalfOpen)
+{
+    unsigned int puCounts[kEndpointCount];
+
+    xConfig.uOpenMs = 50;
+    Create();
+    EndpointRouter_report(xRouter, 0, false, 20);
+    EndpointRouter_report(xRouter, 1, false, 50);
+    for (unsigned int j = 0; j < xConfig.uFailureThreshold; j++)
+    {
+        EndpointRouter_report(xRouter, 0, true, 0);
+    }
+    ASSERT_EQ(GetState(0), POLLY_ENDPOINT_OPEN);
+
+    /* A successful probe lets one request try it at a time */
+    ASSERT_TRUE(WaitForState(0, POLLY_ENDPOINT_HALF_OPEN));
+    EXPECT_EQ(EndpointRouter_select(xRouter), 0u);
+    EXPECT_EQ(EndpointRouter_select(xRouter), 1u);
+
+    /* A failed trial opens it again */
+    EndpointRouter_report(xRouter, 0, true, 0);
+    EXPECT_EQ(GetState(0), POLLY_ENDPOINT_OPEN);
+
+    /* and a successful one closes it with a clean error history */
+    ASSERT_TRUE(WaitForState(0, POLLY_ENDPOINT_HALF_OPEN));
+    EXPECT_EQ(EndpointRouter_select(xRouter), 0u);
+    EndpointRouter_report(xRouter, 0, false, 20);
+    EXPECT_EQ(GetState(0), POLLY_ENDPOINT_HEALTHY);
+
+    Select(90, puCounts);
+    EXPECT_EQ(puCounts[0], 90u);
+}
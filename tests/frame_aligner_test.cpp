@@ -0,0 +1,226 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "frame_aligner.h"
+}
+
+namespace
+{
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Stream
+{
+    Bytes xData;
+    std::vector<Bytes> xFrames; // The frames which the aligner must deliver, in order
+};
+
+int prvOnFrames(const uint8_t **ppFrames, const size_t *puFrameLens, size_t uFrameCount, void *pUserData)
+{
+    std::vector<Bytes> *pxFrames = (std::vector<Bytes> *)pUserData;
+
+    for (size_t i = 0; i < uFrameCount; i++)
+    {
+        pxFrames->push_back(Bytes(ppFrames[i], ppFrames[i] + puFrameLens[i]));
+    }
+
+    return 0;
+}
+
+void prvAppend(Bytes &xData, const Bytes &xBytes)
+{
+    xData.insert(xData.end(), xBytes.begin(), xBytes.end());
+}
+
+/* A frame whose body differs from the others, so a frame delivered twice or out of order is caught */
+Bytes prvMakeMp3Frame(uint8_t uByte1, uint8_t uByte2, size_t uLen, uint8_t uSeed)
+{
+    Bytes xFrame(uLen);
+
+    xFrame[0] = 0xFF;
+    xFrame[1] = uByte1;
+    xFrame[2] = uByte2;
+    xFrame[3] = 0x64;
+    for (size_t i = 4; i < uLen; i++)
+    {
+        xFrame[i] = (uint8_t)(i * 13 + uSeed);
+    }
+
+    return xFrame;
+}
+
+Bytes prvMakeOggPage(const std::vector<uint8_t> &xLacing, uint8_t uSeed)
+{
+    Bytes xPage = { 'O', 'g', 'g', 'S', 0 };
+    size_t uBodyLen = 0;
+
+    xPage.resize(26, uSeed);
+    xPage.push_back((uint8_t)xLacing.size());
+    for (uint8_t uLacing : xLacing)
+    {
+        xPage.push_back(uLacing);
+        uBodyLen += uLacing;
+    }
+    for (size_t i = 0; i < uBodyLen; i++)
+    {
+        xPage.push_back((uint8_t)(i * 7 + uSeed));
+    }
+
+    return xPage;
+}
+
+/* MP3 frames of MPEG-1 and MPEG-2, with and without padding, between ID3 tags and stray bytes which resemble a frame sync */
+Stream prvMakeMp3Stream()
+{
+    Stream xStream;
+    Bytes xId3v2 = { 'I', 'D', '3', 4, 0, 0, 0, 0, 0, 20 };
+    Bytes xId3v1(128, 0x20);
+    std::vector<Bytes> xFrames;
+
+    xId3v2.resize(xId3v2.size() + 20, 0xFF);
+    xId3v1[0] = 'T';
+    xId3v1[1] = 'A';
+    xId3v1[2] = 'G';
+
+    xFrames.push_back(prvMakeMp3Frame(0xFB, 0x90, 417, 1)); // MPEG-1 layer III, 128 kbps, 44.1 kHz
+    xFrames.push_back(prvMakeMp3Frame(0xFB, 0x92, 418, 2)); // The same with padding
+    xFrames.push_back(prvMakeMp3Frame(0xF3, 0x88, 288, 3)); // MPEG-2 layer III, 64 kbps, 16 kHz
+    xFrames.push_back(prvMakeMp3Frame(0xFB, 0x90, 417, 4));
+
+    prvAppend(xStream.xData, xId3v2);
+    prvAppend(xStream.xData, xFrames[0]);
+    prvAppend(xStream.xData, xFrames[1]);
+    prvAppend(xStream.xData, Bytes { 0x00, 0xFF, 0xFF, 0xFF, 0xFB, 0xF0 }); // Syncs without a valid header
+    prvAppend(xStream.xData, xFrames[2]);
+    prvAppend(xStream.xData, Bytes { 0xFF });
+    prvAppend(xStream.xData, xFrames[3]);
+    prvAppend(xStream.xData, xId3v1);
+    xStream.xFrames = xFrames;
+
+    return xStream;
+}
+
+/* Ogg pages of several segments, one segment and none, and a capture pattern of an unknown version */
+Stream prvMakeOggStream()
+{
+    Stream xStream;
+    Bytes xUnknownVersion = prvMakeOggPage({ 10 }, 9);
+    std::vector<Bytes> xPages;
+
+    xUnknownVersion[4] = 1;
+
+    xPages.push_back(prvMakeOggPage({ 255, 255, 10 }, 1));
+    xPages.push_back(prvMakeOggPage({ 30 }, 2));
+    xPages.push_back(prvMakeOggPage({}, 3));
+    xPages.push_back(prvMakeOggPage({ 255, 0 }, 4));
+
+    prvAppend(xStream.xData, xPages[0]);
+    prvAppend(xStream.xData, xPages[1]);
+    prvAppend(xStream.xData, Bytes(xUnknownVersion.begin(), xUnknownVersion.begin() + 27));
+    prvAppend(xStream.xData, xPages[2]);
+    prvAppend(xStream.xData, Bytes { 'O', 'g', 'g' });
+    prvAppend(xStream.xData, xPages[3]);
+    xStream.xFrames = xPages;
+
+    return xStream;
+}
+
+/* Push the stream in pieces which end at the given offsets */
+std::vector<Bytes> prvPush(FrameFormat_t eFormat, const Bytes &xData, const std::vector<size_t> &xSplits)
+{
+    FrameAlignerHandle xFrameAligner = FrameAligner_create(eFormat);
+    std::vector<Bytes> xFrames;
+    size_t uStart = 0;
+    size_t uBytesDelivered = 0;
+    size_t uTotalDelivered = 0;
+
+    EXPECT_NE(xFrameAligner, nullptr);
+    for (size_t uEnd : xSplits)
+    {
+        EXPECT_EQ(FrameAligner_push(xFrameAligner, xData.data() + uStart, uEnd - uStart, prvOnFrames, &xFrames, &uBytesDelivered), FRAME_ALIGNER_ERRNO_NONE);
+        uTotalDelivered += uBytesDelivered;
+        uStart = uEnd;
+    }
+    FrameAligner_terminate(xFrameAligner);
+
+    for (const Bytes &xFrame : xFrames)
+    {
+        uTotalDelivered -= xFrame.size();
+    }
+    EXPECT_EQ(uTotalDelivered, 0u);
+
+    return xFrames;
+}
+
+void prvCheckEverySplit(FrameFormat_t eFormat, const Stream &xStream)
+{
+    size_t uLen = xStream.xData.size();
+    std::vector<size_t> xBytewise;
+
+    EXPECT_EQ(prvPush(eFormat, xStream.xData, { uLen }), xStream.xFrames);
+
+    for (size_t uSplit = 0; uSplit <= uLen; uSplit++)
+    {
+        ASSERT_EQ(prvPush(eFormat, xStream.xData, { uSplit, uLen }), xStream.xFrames) << "split at " << uSplit;
+    }
+
+    for (size_t i = 1; i <= uLen; i++)
+    {
+        xBytewise.push_back(i);
+    }
+    EXPECT_EQ(prvPush(eFormat, xStream.xData, xBytewise), xStream.xFrames);
+}
+
+} // namespace
+
+TEST(FrameAlignerTest, Mp3SplitAtEveryByte)
+{
+    prvCheckEverySplit(FRAME_FORMAT_MP3, prvMakeMp3Stream());
+}
+
+TEST(FrameAlignerTest, OggSplitAtEveryByte)
+{
+    prvCheckEverySplit(FRAME_FORMAT_OGG, prvMakeOggStream());
+}
+
+TEST(FrameAlignerTest, ManyFramesInOnePush)
+{
+    Stream xStream;
+
+    /* More frames than one callback delivers */
+    for (uint8_t i = 0; i < 100; i++)
+    {
+        xStream.xFrames.push_back(prvMakeMp3Frame(0xFB, 0x90, 417, i));
+        prvAppend(xStream.xData, xStream.xFrames.back());
+    }
+
+    EXPECT_EQ(prvPush(FRAME_FORMAT_MP3, xStream.xData, { xStream.xData.size() }), xStream.xFrames);
+    EXPECT_EQ(prvPush(FRAME_FORMAT_MP3, xStream.xData, { 1000, xStream.xData.size() }), xStream.xFrames);
+}
+
+TEST(FrameAlignerTest, GetMp3Duration)
+{
+    Bytes xFrame = prvMakeMp3Frame(0xFB, 0x90, 417, 0);
+    uint32_t uSamples = 0;
+    uint32_t uSampleRate = 0;
+
+    ASSERT_EQ(FrameAligner_getMp3Duration(xFrame.data(), xFrame.size(), &uSamples, &uSampleRate), FRAME_ALIGNER_ERRNO_NONE);
+    EXPECT_EQ(uSamples, 1152u);
+    EXPECT_EQ(uSampleRate, 44100u);
+
+    xFrame = prvMakeMp3Frame(0xF3, 0x88, 288, 0);
+    ASSERT_EQ(FrameAligner_getMp3Duration(xFrame.data(), xFrame.size(), &uSamples, &uSampleRate), FRAME_ALIGNER_ERRNO_NONE);
+    EXPECT_EQ(uSamples, 576u);
+    EXPECT_EQ(uSampleRate, 16000u);
+
+    /* Free format has no frame length */
+    xFrame[2] = 0x08;
+    EXPECT_EQ(FrameAligner_getMp3Duration(xFrame.data(), xFrame.size(), &uSamples, &uSampleRate), FRAME_ALIGNER_ERRNO_INVALID_PARAMETER);
+    EXPECT_EQ(FrameAligner_getMp3Duration(xFrame.data(), 3, &uSamples, &uSampleRate), FRAME_ALIGNER_ERRNO_INVALID_PARAMETER);
+}
@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+}
+
+#include "replay_recording.h"
+
+namespace
+{
+
+using replay::Session;
+
+const char *kAudioHead = "200 OK";
+const char *kAudioHeaders = "Content-Type: audio/mpeg\r\n";
+
+/* Keep every delivery apart, to see when the audio was delivered */
+int prvOnData(uint8_t *pData, size_t uLen, void *pUserData)
+{
+    ((std::vector<std::string> *)pUserData)->push_back(std::string((const char *)pData, uLen));
+
+    return 0;
+}
+
+/* Split a response into receives which end right after each of the marks */
+std::vector<replay::Bytes> prvSplit(const replay::Bytes &xResponse, const std::vector<std::string> &xMarks)
+{
+    std::vector<replay::Bytes> xRecvs;
+    std::string xText(xResponse.begin(), xResponse.end());
+    size_t uStart = 0;
+    size_t uEnd = 0;
+
+    for (const std::string &xMark : xMarks)
+    {
+        uEnd = xText.find(xMark, uStart) + xMark.size();
+        xRecvs.push_back(replay::Bytes(xResponse.begin() + uStart, xResponse.begin() + uEnd));
+        uStart = uEnd;
+    }
+    xRecvs.push_back(replay::Bytes(xResponse.begin() + uStart, xResponse.end()));
+
+    return xRecvs;
+}
+
+/* Text which doesn't repeat at any power of two, so a misplaced byte shows */
+std::string prvPattern(size_t uLen)
+{
+    std::string xText;
+
+    for (size_t i = 0; i < uLen; i++)
+    {
+        xText += (char)('a' + i % 23);
+    }
+
+    return xText;
+}
+
+/* The server is played back from a recording, so the HTTP/1.1 path of Polly_synthesizeSpeech() runs without a network. */
+class Http1Test : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        PollyTransport_terminate(xTransport);
+    }
+
+    int Synthesize(const std::vector<Session> &xSessions)
+    {
+        PollyServiceParameter_t xServPara;
+        PollySynthesizeSpeechParameter_t xPara;
+        PollySynthesizeSpeechOutput_t xOut;
+
+        EXPECT_NE(xTransport = replay::CreateReplayer(xSessions), nullptr);
+        replay::InitServiceParameter(&xServPara, xTransport);
+        replay::InitParameter(&xPara, "Hello");
+        memset(&xOut, 0, sizeof(xOut));
+        xOut.onDataCallback = prvOnData;
+        xOut.pUserData = &xDeliveries;
+
+        return Polly_synthesizeSpeech(&xServPara, &xPara, &xOut);
+    }
+
+    /* Synthesize a text per request, pipelined uDepth deep on the first session. The requests left over take the next sessions one by one. */
+    int SynthesizeMulti(const std::vector<Session> &xSessions, size_t uCount, unsigned int uDepth)
+    {
+        PollyServiceParameter_t xServPara;
+
+        EXPECT_NE(xTransport = replay::CreateReplayer(xSessions), nullptr);
+        replay::InitServiceParameter(&xServPara, xTransport);
+        xServPara.uPipelineDepth = uDepth;
+
+        xTexts.resize(uCount);
+        xParas.resize(uCount);
+        xOuts.resize(uCount);
+        xAudios.resize(uCount);
+        xResults.resize(uCount, POLLY_ERRNO_NONE);
+        for (size_t i = 0; i < uCount; i++)
+        {
+            xTexts[i] = "Hello " + std::to_string(i);
+            replay::InitParameter(&(xParas[i]), xTexts[i].c_str());
+            memset(&(xOuts[i]), 0, sizeof(PollySynthesizeSpeechOutput_t));
+            xOuts[i].onDataCallback = replay::AppendData;
+            xOuts[i].pUserData = &(xAudios[i]);
+        }
+
+        return Polly_synthesizeSpeechMulti(&xServPara, xParas.data(), xOuts.data(), uCount, xResults.data());
+    }
+
+    std::string GetAudio() const
+    {
+        std::string xAudio;
+
+        for (const std::string &xDelivery : xDeliveries)
+        {
+            xAudio += xDelivery;
+        }
+
+        return xAudio;
+    }
+
+    PollyTransportHandle xTransport = NULL;
+    std::vector<std::string> xDeliveries;
+    std::vector<std::string> xTexts;
+    std::vector<PollySynthesizeSpeechParameter_t> xParas;
+    std::vector<PollySynthesizeSpeechOutput_t> xOuts;
+    std::vector<std::string> xAudios;
+    std::vector<int> xResults;
+};
+
+} // namespace
+
+TEST_F(Http1Test, StreamsContentLengthBody)
+{
+    /* Every part is delivered as it arrives, before the rest of the body */
+    EXPECT_EQ(Synthesize({ { NULL, prvSplit(replay::Response(kAudioHead, kAudioHeaders, "part1part2part3"), { "part1", "part2" }) } }), POLLY_ERRNO_NONE);
+    EXPECT_EQ(xDeliveries, std::vector<std::string>({ "part1", "part2", "part3" }));
+}
+
+TEST_F(Http1Test, StreamsChunkedBody)
+{
+    /* A chunk is delivered in parts too, and the chunk sizes are never delivered */
+    EXPECT_EQ(Synthesize({ { NULL, prvSplit(replay::ChunkedResponse(kAudioHead, kAudioHeaders, { "part1part2", "part3" }), { "part1", "part2" }) } }),
+              POLLY_ERRNO_NONE);
+    EXPECT_EQ(xDeliveries, std::vector<std::string>({ "part1", "part2", "part3" }));
+}
+
+TEST_F(Http1Test, DeliversBodyLargerThanHeadLimit)
+{
+    std::string xBody = prvPattern(40000);
+
+    /* The whole response is one receive, which fills the receive buffer many times */
+    EXPECT_EQ(Synthesize({ { NULL, { replay::Response(kAudioHead, kAudioHeaders, xBody) } } }), POLLY_ERRNO_NONE);
+    EXPECT_EQ(GetAudio(), xBody);
+}
+
+TEST_F(Http1Test, DeliversChunkLargerThanHeadLimit)
+{
+    std::string xChunk = prvPattern(40000);
+
+    EXPECT_EQ(Synthesize({ { NULL, { replay::ChunkedResponse(kAudioHead, kAudioHeaders, { xChunk, "end" }) } } }), POLLY_ERRNO_NONE);
+    EXPECT_EQ(GetAudio(), xChunk + "end");
+}
+
+TEST_F(Http1Test, AcceptsTrailerLargerThanHeadLimit)
+{
+    replay::Bytes xResponse = replay::ChunkedResponse(kAudioHead, kAudioHeaders, { "audio" });
+    std::string xTrailer = "x-amzn-Padding: " + prvPattern(20000) + "\r\n\r\n";
+
+    /* The parser holds a trailer back until its end arrives, so the buffer grows past the limit of a head after the head */
+    xResponse.resize(xResponse.size() - 2);
+    xResponse.insert(xResponse.end(), xTrailer.begin(), xTrailer.end());
+    EXPECT_EQ(Synthesize({ { NULL, { xResponse } } }), POLLY_ERRNO_NONE);
+    EXPECT_EQ(GetAudio(), "audio");
+}
+
+TEST_F(Http1Test, RejectsHeadLargerThanLimit)
+{
+    EXPECT_EQ(Synthesize({ { NULL, { replay::Response(kAudioHead, std::string(kAudioHeaders) + "x-amzn-Padding: " + prvPattern(20000) + "\r\n", "audio") } } }),
+              POLLY_ERRNO_HTTP_PARSE_FAILURE);
+    EXPECT_EQ(GetAudio(), "");
+}
+
+TEST_F(Http1Test, ReplaysRequestsAfterCloseMidPipeline)
+{
+    replay::Bytes xPipelined = replay::Response(kAudioHead, kAudioHeaders, "audio0");
+    replay::Bytes xSecond = replay::Response(kAudioHead, kAudioHeaders, "audio1");
+
+    /* The first two responses arrive in one receive, then the server closes with two requests in flight. Those are sent again on new connections. */
+    xPipelined.insert(xPipelined.end(), xSecond.begin(), xSecond.end());
+    EXPECT_EQ(SynthesizeMulti({ { NULL, { xPipelined } },
+                                { NULL, { replay::Response(kAudioHead, kAudioHeaders, "audio2") } },
+                                { NULL, { replay::Response(kAudioHead, kAudioHeaders, "audio3") } } },
+                              4, 4),
+              POLLY_ERRNO_NONE);
+    EXPECT_EQ(xAudios, std::vector<std::string>({ "audio0", "audio1", "audio2", "audio3" }));
+    EXPECT_EQ(xResults, std::vector<int>({ POLLY_ERRNO_NONE, POLLY_ERRNO_NONE, POLLY_ERRNO_NONE, POLLY_ERRNO_NONE }));
+}
+
+TEST_F(Http1Test, FailsResponseCutMidPipeline)
+{
+    replay::Bytes xCut = replay::Response(kAudioHead, kAudioHeaders, "audio1");
+
+    /* The second response is cut in its body, after a part of its audio was delivered, so it isn't sent again without a retry policy. The third is. */
+    xCut.resize(xCut.size() - 3);
+    EXPECT_EQ(SynthesizeMulti({ { NULL, { replay::Response(kAudioHead, kAudioHeaders, "audio0"), xCut } },
+                                { NULL, { replay::Response(kAudioHead, kAudioHeaders, "audio2") } } },
+                              3, 3),
+              POLLY_ERRNO_NET_RECV_FAILED);
+    EXPECT_EQ(xAudios, std::vector<std::string>({ "audio0", "aud", "audio2" }));
+    EXPECT_EQ(xResults, std::vector<int>({ POLLY_ERRNO_NONE, POLLY_ERRNO_NET_RECV_FAILED, POLLY_ERRNO_NONE }));
+}
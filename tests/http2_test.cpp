@@ -0,0 +1,244 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+}
+
+#include "replay_recording.h"
+
+namespace
+{
+
+using replay::Bytes;
+using replay::Session;
+
+const uint8_t kFrameData = 0x0;
+const uint8_t kFrameHeaders = 0x1;
+const uint8_t kFrameRstStream = 0x3;
+const uint8_t kFrameSettings = 0x4;
+const uint8_t kFrameGoAway = 0x7;
+const uint8_t kFrameContinuation = 0x9;
+
+const uint8_t kFlagAck = 0x1;
+const uint8_t kFlagEndStream = 0x1;
+const uint8_t kFlagEndHeaders = 0x4;
+const uint8_t kFlagPadded = 0x8;
+
+const uint32_t kErrorCodeNoError = 0x0;
+const uint32_t kErrorCodeInternalError = 0x2;
+
+/* HPACK: ":status: 200" and ":status: 400" of the static table, and "content-type: audio/mpeg" as a literal of an indexed name */
+const Bytes kStatus200 = { 0x88 };
+const Bytes kStatus400 = { 0x8C };
+const Bytes kContentTypeMpeg = { 0x0F, 0x10, 0x0A, 'a', 'u', 'd', 'i', 'o', '/', 'm', 'p', 'e', 'g' };
+
+void prvAppend(Bytes &xData, const Bytes &xBytes)
+{
+    xData.insert(xData.end(), xBytes.begin(), xBytes.end());
+}
+
+Bytes prvUint32(uint32_t uValue)
+{
+    return Bytes { (uint8_t)(uValue >> 24), (uint8_t)(uValue >> 16), (uint8_t)(uValue >> 8), (uint8_t)uValue };
+}
+
+Bytes prvFrame(uint8_t uType, uint8_t uFlags, uint32_t uStreamId, const Bytes &xPayload)
+{
+    Bytes xFrame = { (uint8_t)(xPayload.size() >> 16), (uint8_t)(xPayload.size() >> 8), (uint8_t)xPayload.size(), uType, uFlags };
+
+    prvAppend(xFrame, prvUint32(uStreamId));
+    prvAppend(xFrame, xPayload);
+
+    return xFrame;
+}
+
+Bytes prvHeaderBlock(std::initializer_list<Bytes> xFields)
+{
+    Bytes xBlock;
+
+    for (const Bytes &xField : xFields)
+    {
+        prvAppend(xBlock, xField);
+    }
+
+    return xBlock;
+}
+
+/* A literal without indexing of a new name, whose name and value are shorter than 127 bytes */
+Bytes prvLiteralHeader(const std::string &xName, const std::string &xValue)
+{
+    Bytes xField = { 0x00, (uint8_t)xName.size() };
+
+    xField.insert(xField.end(), xName.begin(), xName.end());
+    xField.push_back((uint8_t)xValue.size());
+    xField.insert(xField.end(), xValue.begin(), xValue.end());
+
+    return xField;
+}
+
+/* The server settings and the acknowledgement of ours, which a server sends first */
+Bytes prvServerPreface()
+{
+    Bytes xData = prvFrame(kFrameSettings, 0, 0, {});
+
+    prvAppend(xData, prvFrame(kFrameSettings, kFlagAck, 0, {}));
+
+    return xData;
+}
+
+/* The server is played back from a recording of frames, so the HTTP/2 path of Polly_synthesizeSpeechMulti() runs without a network. */
+class Http2Test : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        PollyTransport_terminate(xTransport);
+    }
+
+    void Replay(const std::vector<Session> &xSessions)
+    {
+        ASSERT_NE(xTransport = replay::CreateReplayer(xSessions), nullptr);
+    }
+
+    /* Synthesize a text per audio, and keep what every request received */
+    int SynthesizeMulti(size_t uCount)
+    {
+        PollyServiceParameter_t xServPara;
+
+        replay::InitServiceParameter(&xServPara, xTransport);
+
+        xTexts.resize(uCount);
+        xParas.resize(uCount);
+        xOuts.resize(uCount);
+        xAudios.resize(uCount);
+        xResults.resize(uCount, POLLY_ERRNO_NONE);
+        for (size_t i = 0; i < uCount; i++)
+        {
+            xTexts[i] = "Hello " + std::to_string(i);
+            replay::InitParameter(&(xParas[i]), xTexts[i].c_str());
+            memset(&(xOuts[i]), 0, sizeof(PollySynthesizeSpeechOutput_t));
+            xOuts[i].onDataCallback = replay::AppendData;
+            xOuts[i].pUserData = &(xAudios[i]);
+        }
+
+        return Polly_synthesizeSpeechMulti(&xServPara, xParas.data(), xOuts.data(), uCount, xResults.data());
+    }
+
+    PollyTransportHandle xTransport = NULL;
+    std::vector<std::string> xTexts;
+    std::vector<PollySynthesizeSpeechParameter_t> xParas;
+    std::vector<PollySynthesizeSpeechOutput_t> xOuts;
+    std::vector<std::string> xAudios;
+    std::vector<int> xResults;
+};
+
+} // namespace
+
+TEST_F(Http2Test, MultiplexesStreams)
+{
+    Bytes xFirst = prvServerPreface();
+    Bytes xSecond;
+    Bytes xThird;
+    Bytes xPadded = { 4 };
+
+    /* The streams answer interleaved, one of them with its header block continued in another frame */
+    prvAppend(xFirst, prvFrame(kFrameHeaders, kFlagEndHeaders, 1, prvHeaderBlock({ kStatus200, kContentTypeMpeg })));
+    prvAppend(xFirst, prvFrame(kFrameHeaders, 0, 3, kStatus200));
+    prvAppend(xFirst, prvFrame(kFrameContinuation, kFlagEndHeaders, 3, kContentTypeMpeg));
+    prvAppend(xFirst, prvFrame(kFrameData, 0, 3, replay::Text("stream3-a")));
+    prvAppend(xFirst, prvFrame(kFrameData, 0, 1, replay::Text("stream1-a")));
+    prvAppend(xFirst, prvFrame(kFrameHeaders, kFlagEndHeaders, 5, kStatus200));
+
+    /* A frame split across receives, and a padded one */
+    prvAppend(xPadded, replay::Text("stream1-b"));
+    prvAppend(xPadded, Bytes(4, 0));
+    prvAppend(xSecond, prvFrame(kFrameData, 0, 5, replay::Text("stream5-a")));
+    prvAppend(xSecond, prvFrame(kFrameData, kFlagEndStream | kFlagPadded, 1, xPadded));
+    prvAppend(xThird, Bytes(xSecond.begin() + 20, xSecond.end()));
+    xSecond.resize(20);
+    prvAppend(xThird, prvFrame(kFrameData, kFlagEndStream, 3, replay::Text("stream3-b")));
+    prvAppend(xThird, prvFrame(kFrameData, kFlagEndStream, 5, {}));
+
+    Replay({ { "h2", { xFirst, xSecond, xThird } } });
+
+    EXPECT_EQ(SynthesizeMulti(3), POLLY_ERRNO_NONE);
+    EXPECT_EQ(xAudios[0], "stream1-astream1-b");
+    EXPECT_EQ(xAudios[1], "stream3-astream3-b");
+    EXPECT_EQ(xAudios[2], "stream5-a");
+    for (size_t i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(xResults[i], POLLY_ERRNO_NONE);
+        EXPECT_EQ(xOuts[i].uStatusCode, 200u);
+        EXPECT_STREQ(xOuts[i].pErrorType, "");
+        EXPECT_EQ(xOuts[i].uAttempts, 1u);
+    }
+}
+
+TEST_F(Http2Test, ReportsStreamErrors)
+{
+    Bytes xRecv = prvServerPreface();
+
+    /* The error type comes from the header, or from the body without it */
+    prvAppend(xRecv, prvFrame(kFrameHeaders, kFlagEndHeaders | kFlagEndStream, 1,
+                              prvHeaderBlock({ kStatus400, prvLiteralHeader("x-amzn-errortype", "ThrottlingException:http://internal.amazon.com/coral/com.amazonaws.polly/") })));
+    prvAppend(xRecv, prvFrame(kFrameHeaders, kFlagEndHeaders, 3, kStatus400));
+    prvAppend(xRecv, prvFrame(kFrameData, kFlagEndStream, 3, replay::Text("{\"__type\":\"com.amazonaws.polly#TextLengthExceededException\",\"message\":\"Too long\"}")));
+    prvAppend(xRecv, prvFrame(kFrameRstStream, 0, 5, prvUint32(kErrorCodeInternalError)));
+    prvAppend(xRecv, prvFrame(kFrameHeaders, kFlagEndHeaders, 7, kStatus200));
+    prvAppend(xRecv, prvFrame(kFrameData, kFlagEndStream, 7, replay::Text("stream7")));
+
+    Replay({ { "h2", { xRecv } } });
+
+    EXPECT_EQ(SynthesizeMulti(4), POLLY_ERRNO_HTTP_REQ_FAILURE);
+
+    EXPECT_EQ(xResults[0], POLLY_ERRNO_HTTP_REQ_FAILURE);
+    EXPECT_EQ(xOuts[0].uStatusCode, 400u);
+    EXPECT_STREQ(xOuts[0].pErrorType, "ThrottlingException");
+
+    EXPECT_EQ(xResults[1], POLLY_ERRNO_HTTP_REQ_FAILURE);
+    EXPECT_EQ(xOuts[1].uStatusCode, 400u);
+    EXPECT_STREQ(xOuts[1].pErrorType, "TextLengthExceededException");
+
+    EXPECT_EQ(xResults[2], POLLY_ERRNO_NET_RECV_FAILED);
+
+    EXPECT_EQ(xResults[3], POLLY_ERRNO_NONE);
+    EXPECT_EQ(xOuts[3].uStatusCode, 200u);
+    EXPECT_EQ(xAudios[3], "stream7");
+
+    /* No audio is delivered for a failed request */
+    EXPECT_EQ(xAudios[0], "");
+    EXPECT_EQ(xAudios[1], "");
+}
+
+TEST_F(Http2Test, ResendsRefusedStreams)
+{
+    Bytes xRecv = prvServerPreface();
+    Bytes xGoAway = prvUint32(1);
+
+    /* The server goes away after the first stream, so the others are sent again on connections of their own */
+    prvAppend(xGoAway, prvUint32(kErrorCodeNoError));
+    prvAppend(xRecv, prvFrame(kFrameHeaders, kFlagEndHeaders, 1, kStatus200));
+    prvAppend(xRecv, prvFrame(kFrameData, kFlagEndStream, 1, replay::Text("stream1-a")));
+    prvAppend(xRecv, prvFrame(kFrameGoAway, 0, 0, xGoAway));
+
+    Replay({ { "h2", { xRecv } },
+             { NULL, { replay::Response("200 OK", "Content-Type: audio/mpeg\r\n", "request-2") } },
+             { NULL, { replay::Response("200 OK", "Content-Type: audio/mpeg\r\n", "request-3") } } });
+
+    EXPECT_EQ(SynthesizeMulti(3), POLLY_ERRNO_NONE);
+    EXPECT_EQ(xAudios[0], "stream1-a");
+    EXPECT_EQ(xAudios[1], "request-2");
+    EXPECT_EQ(xAudios[2], "request-3");
+    for (size_t i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(xResults[i], POLLY_ERRNO_NONE);
+        EXPECT_EQ(xOuts[i].uStatusCode, 200u);
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef LOCAL_SERVER_H
+#define LOCAL_SERVER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* A server on the loopback which answers every connection it accepts by a script, so the client runs over real sockets. */
+class LocalServer
+{
+public:
+    struct Reply
+    {
+        uint32_t uDelayMs; // Before the data is sent
+        std::string xData; // Empty keeps the connection silent until the client closes it
+    };
+
+    /* The connections get the replies in the order they are accepted, and the last reply is repeated. */
+    explicit LocalServer(const std::vector<Reply> &xReplies) : xReplies(xReplies)
+    {
+        struct sockaddr_in xAddr;
+        socklen_t uAddrLen = sizeof(xAddr);
+
+        memset(&xAddr, 0, sizeof(xAddr));
+        xAddr.sin_family = AF_INET;
+        xAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (pipe(pxStopPipe) == 0 && (xListenFd = socket(AF_INET, SOCK_STREAM, 0)) >= 0 &&
+            bind(xListenFd, (struct sockaddr *)&xAddr, sizeof(xAddr)) == 0 && listen(xListenFd, 16) == 0 &&
+            getsockname(xListenFd, (struct sockaddr *)&xAddr, &uAddrLen) == 0)
+        {
+            xPort = std::to_string(ntohs(xAddr.sin_port));
+            xAcceptThread = std::thread(&LocalServer::AcceptLoop, this);
+        }
+    }
+
+    ~LocalServer()
+    {
+        if (write(pxStopPipe[1], "", 1) < 0)
+        {
+            /* The threads only stop on the pipe */
+        }
+        if (xAcceptThread.joinable())
+        {
+            xAcceptThread.join();
+        }
+        for (std::thread &xThread : xConnThreads)
+        {
+            xThread.join();
+        }
+        close(xListenFd);
+        close(pxStopPipe[0]);
+        close(pxStopPipe[1]);
+    }
+
+    /* NULL if the server couldn't listen */
+    const char *GetPort() const
+    {
+        return xPort.empty() ? NULL : xPort.c_str();
+    }
+
+    size_t GetAcceptCount() const
+    {
+        return uAcceptCount.load();
+    }
+
+private:
+    /* Wait for the fd to be readable, false if the server stops or the time runs out first */
+    bool WaitReadable(int fd, int iTimeoutMs)
+    {
+        struct pollfd pxPollFds[2] = { { fd, POLLIN, 0 }, { pxStopPipe[0], POLLIN, 0 } };
+
+        return poll(pxPollFds, 2, iTimeoutMs) > 0 && pxPollFds[1].revents == 0 && pxPollFds[0].revents != 0;
+    }
+
+    /* Sleep, false if the server stops first */
+    bool Sleep(uint32_t uMs)
+    {
+        struct pollfd xPollFd = { pxStopPipe[0], POLLIN, 0 };
+
+        return poll(&xPollFd, 1, (int)uMs) == 0;
+    }
+
+    void AcceptLoop()
+    {
+        int fd = -1;
+
+        while (WaitReadable(xListenFd, -1))
+        {
+            if ((fd = accept(xListenFd, NULL, NULL)) >= 0)
+            {
+                size_t uIndex = uAcceptCount.fetch_add(1);
+
+                xConnThreads.emplace_back(&LocalServer::Serve, this, fd, xReplies[(uIndex < xReplies.size()) ? uIndex : xReplies.size() - 1]);
+            }
+        }
+    }
+
+    /* The request is drained until the client closes, so the reply is never reset by unread data. */
+    void Serve(int fd, Reply xReply)
+    {
+        char pBuf[4096];
+
+        if (Sleep(xReply.uDelayMs))
+        {
+            if (!xReply.xData.empty())
+            {
+                (void)send(fd, xReply.xData.data(), xReply.xData.size(), MSG_NOSIGNAL);
+            }
+            while (WaitReadable(fd, -1) && recv(fd, pBuf, sizeof(pBuf), 0) > 0)
+            {
+            }
+        }
+        close(fd);
+    }
+
+    std::vector<Reply> xReplies;
+    int pxStopPipe[2] = { -1, -1 };
+    int xListenFd = -1;
+    std::string xPort;
+    std::atomic<size_t> uAcceptCount { 0 };
+    std::thread xAcceptThread;
+    std::vector<std::thread> xConnThreads;
+};
+
+/* A listener which never accepts, and whose backlog is full, so the kernel drops the connects to it like a host behind a firewall does. */
+class UnansweredServer
+{
+public:
+    UnansweredServer()
+    {
+        struct sockaddr_in xAddr;
+        socklen_t uAddrLen = sizeof(xAddr);
+        int fd = -1;
+
+        memset(&xAddr, 0, sizeof(xAddr));
+        xAddr.sin_family = AF_INET;
+        xAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((xListenFd = socket(AF_INET, SOCK_STREAM, 0)) >= 0 && bind(xListenFd, (struct sockaddr *)&xAddr, sizeof(xAddr)) == 0 &&
+            listen(xListenFd, 0) == 0 && getsockname(xListenFd, (struct sockaddr *)&xAddr, &uAddrLen) == 0)
+        {
+            /* The first connect fills the backlog of 0, and the second one makes sure it's full before the client connects */
+            for (int i = 0; i < 2 && (fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0; i++)
+            {
+                xFillFds.push_back(fd);
+                if (fcntl(fd, F_SETFL, O_NONBLOCK) == 0)
+                {
+                    (void)connect(fd, (struct sockaddr *)&xAddr, sizeof(xAddr));
+                }
+            }
+            usleep(50 * 1000);
+            xPort = std::to_string(ntohs(xAddr.sin_port));
+        }
+    }
+
+    ~UnansweredServer()
+    {
+        for (int fd : xFillFds)
+        {
+            close(fd);
+        }
+        close(xListenFd);
+    }
+
+    /* NULL if the server couldn't listen */
+    const char *GetPort() const
+    {
+        return xPort.empty() ? NULL : xPort.c_str();
+    }
+
+private:
+    int xListenFd = -1;
+    std::vector<int> xFillFds;
+    std::string xPort;
+};
+
+#endif /* LOCAL_SERVER_H */
@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+
+#include "netio.h"
+#include "port.h"
+}
+
+#include "local_server.h"
+#include "replay_recording.h"
+
+namespace
+{
+
+/* How long a test lets a wait run before it's stopped, and how much later than that it may return */
+const uint32_t kStopAfterMs = 200;
+const uint64_t kLatenessMs = 1000;
+
+/* Long enough that a wait bounded by it instead of kStopAfterMs fails the test */
+const unsigned int kLongTimeoutMs = 10 * 1000;
+
+/* Cancel the token from another thread after a delay */
+class DelayedCancel
+{
+public:
+    DelayedCancel(PollyCancelTokenHandle xCancelToken, uint32_t uDelayMs)
+        : xThread([xCancelToken, uDelayMs]() {
+              std::this_thread::sleep_for(std::chrono::milliseconds(uDelayMs));
+              PollyCancelToken_cancel(xCancelToken);
+          })
+    {
+    }
+
+    ~DelayedCancel()
+    {
+        xThread.join();
+    }
+
+private:
+    std::thread xThread;
+};
+
+/* Connects over plain TCP to servers on the loopback which don't answer */
+class NetIoConnectTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ASSERT_NE(xNetIo = NetIo_create(), nullptr);
+        ASSERT_NE(xServer.GetPort(), nullptr);
+        ASSERT_EQ(NetIo_setTransport(xNetIo, PollyTransport_getPlain()), NETIO_ERRNO_NONE);
+    }
+
+    void TearDown() override
+    {
+        NetIo_terminate(xNetIo);
+    }
+
+    int Connect()
+    {
+        uint64_t uStartMs = Port_getTimeMs();
+        int res = NetIo_connect(xNetIo, "127.0.0.1", xServer.GetPort());
+
+        uElapsedMs = Port_getTimeMs() - uStartMs;
+
+        return res;
+    }
+
+    UnansweredServer xServer;
+    NetIoHandle xNetIo = NULL;
+    uint64_t uElapsedMs = 0;
+};
+
+/* Requests to a server which accepts the connection but never answers the request */
+class SilentServerTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        PollyCancelToken_terminate(xCancelToken);
+    }
+
+    int Synthesize(uint32_t uTimeoutMs)
+    {
+        PollyServiceParameter_t xServPara;
+        PollySynthesizeSpeechParameter_t xPara;
+        uint64_t uStartMs = Port_getTimeMs();
+        int res = POLLY_ERRNO_NONE;
+
+        replay::InitServiceParameter(&xServPara, PollyTransport_getPlain());
+        xServPara.pHost = "127.0.0.1";
+        xServPara.pPort = xServer.GetPort();
+        xServPara.uRecvTimeoutMs = kLongTimeoutMs;
+        replay::InitParameter(&xPara, "Hello");
+        xPara.uTimeoutMs = uTimeoutMs;
+        xPara.xCancelToken = xCancelToken;
+        memset(&xOut, 0, sizeof(xOut));
+        xOut.onDataCallback = replay::AppendData;
+        xOut.pUserData = &xAudio;
+
+        res = Polly_synthesizeSpeech(&xServPara, &xPara, &xOut);
+        uElapsedMs = Port_getTimeMs() - uStartMs;
+
+        return res;
+    }
+
+    LocalServer xServer { { { 0, "" } } };
+    PollyCancelTokenHandle xCancelToken = NULL;
+    PollySynthesizeSpeechOutput_t xOut;
+    std::string xAudio;
+    uint64_t uElapsedMs = 0;
+};
+
+} // namespace
+
+TEST_F(NetIoConnectTest, ConnectTimesOut)
+{
+    /* The connect is bounded by its own timeout, rather than the receive timeout */
+    ASSERT_EQ(NetIo_setRecvTimeout(xNetIo, kLongTimeoutMs), NETIO_ERRNO_NONE);
+    ASSERT_EQ(NetIo_setConnectTimeout(xNetIo, kStopAfterMs), NETIO_ERRNO_NONE);
+    EXPECT_EQ(Connect(), NETIO_ERRNO_NET_CONNECT_FAILED);
+    EXPECT_GE(uElapsedMs, kStopAfterMs - 10);
+    EXPECT_LT(uElapsedMs, kStopAfterMs + kLatenessMs);
+}
+
+TEST_F(NetIoConnectTest, DeadlineBoundsConnect)
+{
+    ASSERT_EQ(NetIo_setConnectTimeout(xNetIo, kLongTimeoutMs), NETIO_ERRNO_NONE);
+    ASSERT_EQ(NetIo_setDeadline(xNetIo, Port_getTimeMs() + kStopAfterMs, NULL), NETIO_ERRNO_NONE);
+    EXPECT_EQ(Connect(), NETIO_ERRNO_DEADLINE_EXCEEDED);
+    EXPECT_LT(uElapsedMs, kStopAfterMs + kLatenessMs);
+}
+
+TEST_F(NetIoConnectTest, CancelStopsConnect)
+{
+    PollyCancelTokenHandle xCancelToken = PollyCancelToken_create();
+
+    ASSERT_NE(xCancelToken, nullptr);
+    ASSERT_EQ(NetIo_setConnectTimeout(xNetIo, kLongTimeoutMs), NETIO_ERRNO_NONE);
+    ASSERT_EQ(NetIo_setDeadline(xNetIo, 0, xCancelToken), NETIO_ERRNO_NONE);
+    {
+        DelayedCancel xCancel(xCancelToken, kStopAfterMs);
+
+        EXPECT_EQ(Connect(), NETIO_ERRNO_CANCELLED);
+    }
+    EXPECT_LT(uElapsedMs, kStopAfterMs + kLatenessMs);
+    PollyCancelToken_terminate(xCancelToken);
+}
+
+TEST_F(NetIoConnectTest, RequestFailsAtConnectTimeout)
+{
+    PollyServiceParameter_t xServPara;
+    PollySynthesizeSpeechParameter_t xPara;
+    PollySynthesizeSpeechOutput_t xOut;
+    uint64_t uStartMs = Port_getTimeMs();
+
+    replay::InitServiceParameter(&xServPara, PollyTransport_getPlain());
+    xServPara.pHost = "127.0.0.1";
+    xServPara.pPort = xServer.GetPort();
+    xServPara.uRecvTimeoutMs = kLongTimeoutMs;
+    xServPara.uConnectTimeoutMs = kStopAfterMs;
+    replay::InitParameter(&xPara, "Hello");
+    memset(&xOut, 0, sizeof(xOut));
+
+    EXPECT_EQ(Polly_synthesizeSpeech(&xServPara, &xPara, &xOut), POLLY_ERRNO_NET_CONNECT_FAILED);
+    EXPECT_LT(Port_getTimeMs() - uStartMs, kStopAfterMs + kLatenessMs);
+}
+
+TEST_F(SilentServerTest, DeadlineStopsRequest)
+{
+    EXPECT_EQ(Synthesize(kStopAfterMs), POLLY_ERRNO_DEADLINE_EXCEEDED);
+    EXPECT_GE(uElapsedMs, kStopAfterMs - 10);
+    EXPECT_LT(uElapsedMs, kStopAfterMs + kLatenessMs);
+    EXPECT_EQ(xAudio, "");
+}
+
+TEST_F(SilentServerTest, CancelWakesRequest)
+{
+    ASSERT_NE(xCancelToken = PollyCancelToken_create(), nullptr);
+    {
+        /* The wait for the response wakes up on the pipe of the token, long before the receive timeout */
+        DelayedCancel xCancel(xCancelToken, kStopAfterMs);
+
+        EXPECT_EQ(Synthesize(0), POLLY_ERRNO_CANCELLED);
+    }
+    EXPECT_LT(uElapsedMs, kStopAfterMs + kLatenessMs);
+    EXPECT_EQ(xServer.GetAcceptCount(), 1u);
+}
+
+TEST_F(SilentServerTest, CancelledTokenFailsAtOnce)
+{
+    ASSERT_NE(xCancelToken = PollyCancelToken_create(), nullptr);
+    ASSERT_EQ(PollyCancelToken_cancel(xCancelToken), POLLY_ERRNO_NONE);
+    EXPECT_EQ(Synthesize(0), POLLY_ERRNO_CANCELLED);
+    EXPECT_LT(uElapsedMs, kLatenessMs);
+}
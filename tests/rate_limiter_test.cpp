@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+
+#include "port.h"
+#include "rate_limiter.h"
+}
+
+namespace
+{
+
+/* Long enough for a thread to queue up in the limiter, and short enough to keep the tests quick */
+const uint32_t kQueueDelayMs = 100;
+
+/* A limit which doesn't adapt, so only the admission rules decide */
+PollyRateLimiterConfig_t prvMakeConfig(unsigned int uConcurrency)
+{
+    PollyRateLimiterConfig_t xConfig;
+
+    memset(&xConfig, 0, sizeof(xConfig));
+    xConfig.uInitialConcurrency = uConcurrency;
+    xConfig.uMinConcurrency = uConcurrency;
+    xConfig.uMaxConcurrency = uConcurrency;
+    xConfig.uMaxQueueWaitMs = 2000;
+
+    return xConfig;
+}
+
+int prvTryAcquire(PollyRateLimiterHandle xRateLimiter, unsigned int uPermits, PollyPriority_t ePriority)
+{
+    return RateLimiter_acquire(xRateLimiter, uPermits, ePriority, Port_getTimeMs() + 20);
+}
+
+} // namespace
+
+TEST(RateLimiterTest, ReservedConcurrency)
+{
+    PollyRateLimiterConfig_t xConfig = prvMakeConfig(4);
+    PollyRateLimiterHandle xRateLimiter = NULL;
+
+    xConfig.uReservedConcurrency = 1;
+    ASSERT_NE(xRateLimiter = PollyRateLimiter_create(&xConfig), nullptr);
+
+    /* Bulk requests leave the reserved slot free */
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 2, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_NONE);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_NONE);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_REJECTED);
+
+    /* and an interactive one takes it */
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_NONE);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_REJECTED);
+
+    RateLimiter_release(xRateLimiter, 4, 0, 0);
+    PollyRateLimiter_terminate(xRateLimiter);
+}
+
+TEST(RateLimiterTest, ReservedTokens)
+{
+    PollyRateLimiterConfig_t xConfig = prvMakeConfig(64);
+    PollyRateLimiterHandle xRateLimiter = NULL;
+
+    /* The bucket refills too slowly to matter during the test */
+    xConfig.uRequestsPerSecond = 1;
+    xConfig.uBurst = 4;
+    xConfig.uReservedBurst = 2;
+    ASSERT_NE(xRateLimiter = PollyRateLimiter_create(&xConfig), nullptr);
+
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_NONE);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_NONE);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_REJECTED);
+
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 2, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_NONE);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_REJECTED);
+
+    RateLimiter_release(xRateLimiter, 4, 0, 0);
+    PollyRateLimiter_terminate(xRateLimiter);
+}
+
+TEST(RateLimiterTest, ReserveLargerThanLimits)
+{
+    PollyRateLimiterConfig_t xConfig = prvMakeConfig(2);
+    PollyRateLimiterHandle xRateLimiter = NULL;
+
+    /* A reserve as large as the limits still lets a bulk request through when nothing else is in flight and the bucket is full */
+    xConfig.uRequestsPerSecond = 1;
+    xConfig.uBurst = 2;
+    xConfig.uReservedBurst = 5;
+    xConfig.uReservedConcurrency = 2;
+    ASSERT_NE(xRateLimiter = PollyRateLimiter_create(&xConfig), nullptr);
+
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_NONE);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_BULK), RATE_LIMITER_ERRNO_REJECTED);
+
+    RateLimiter_release(xRateLimiter, 1, 0, 0);
+    PollyRateLimiter_terminate(xRateLimiter);
+}
+
+TEST(RateLimiterTest, BatchLargerThanLimits)
+{
+    PollyRateLimiterConfig_t xConfig = prvMakeConfig(2);
+    PollyRateLimiterHandle xRateLimiter = NULL;
+
+    xConfig.uRequestsPerSecond = 1;
+    xConfig.uBurst = 3;
+    ASSERT_NE(xRateLimiter = PollyRateLimiter_create(&xConfig), nullptr);
+
+    /* The batch goes alone, and the bucket is left in debt */
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 10, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_NONE);
+    RateLimiter_release(xRateLimiter, 10, 0, 0);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_REJECTED);
+
+    PollyRateLimiter_terminate(xRateLimiter);
+}
+
+TEST(RateLimiterTest, BulkWaitsForQueuedInteractive)
+{
+    PollyRateLimiterConfig_t xConfig = prvMakeConfig(2);
+    PollyRateLimiterHandle xRateLimiter = NULL;
+    int iInteractiveRes = RATE_LIMITER_ERRNO_REJECTED;
+    int iBulkRes = RATE_LIMITER_ERRNO_NONE;
+
+    ASSERT_NE(xRateLimiter = PollyRateLimiter_create(&xConfig), nullptr);
+    ASSERT_EQ(prvTryAcquire(xRateLimiter, 2, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_NONE);
+
+    /* An interactive batch which needs the whole limit queues up, and a bulk request behind it */
+    std::thread xInteractive([&]() { iInteractiveRes = RateLimiter_acquire(xRateLimiter, 2, POLLY_PRIORITY_INTERACTIVE, 0); });
+    Port_sleepMs(kQueueDelayMs);
+    std::thread xBulk([&]() { iBulkRes = RateLimiter_acquire(xRateLimiter, 1, POLLY_PRIORITY_BULK, Port_getTimeMs() + 3 * kQueueDelayMs); });
+    Port_sleepMs(kQueueDelayMs);
+
+    /* A slot is free for the bulk request, but it's held back while the interactive one is queued */
+    RateLimiter_release(xRateLimiter, 1, 0, 0);
+    xBulk.join();
+    EXPECT_EQ(iBulkRes, RATE_LIMITER_ERRNO_REJECTED);
+
+    RateLimiter_release(xRateLimiter, 1, 0, 0);
+    xInteractive.join();
+    EXPECT_EQ(iInteractiveRes, RATE_LIMITER_ERRNO_NONE);
+
+    RateLimiter_release(xRateLimiter, 2, 0, 0);
+    PollyRateLimiter_terminate(xRateLimiter);
+}
+
+TEST(RateLimiterTest, InteractiveWeightGivesBulkATurn)
+{
+    PollyRateLimiterConfig_t xConfig = prvMakeConfig(2);
+    PollyRateLimiterHandle xRateLimiter = NULL;
+    int iInteractiveRes = RATE_LIMITER_ERRNO_REJECTED;
+    int iBulkRes = RATE_LIMITER_ERRNO_REJECTED;
+
+    xConfig.uInteractiveWeight = 1;
+    ASSERT_NE(xRateLimiter = PollyRateLimiter_create(&xConfig), nullptr);
+    ASSERT_EQ(prvTryAcquire(xRateLimiter, 2, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_NONE);
+
+    std::thread xInteractive([&]() { iInteractiveRes = RateLimiter_acquire(xRateLimiter, 2, POLLY_PRIORITY_INTERACTIVE, 0); });
+    Port_sleepMs(kQueueDelayMs);
+    std::thread xBulk([&]() { iBulkRes = RateLimiter_acquire(xRateLimiter, 1, POLLY_PRIORITY_BULK, 0); });
+    Port_sleepMs(kQueueDelayMs);
+
+    /* The bulk request has no turn until an interactive one has gone ahead of it */
+    RateLimiter_release(xRateLimiter, 1, 0, 0);
+    Port_sleepMs(kQueueDelayMs);
+    EXPECT_EQ(prvTryAcquire(xRateLimiter, 1, POLLY_PRIORITY_INTERACTIVE), RATE_LIMITER_ERRNO_NONE);
+
+    /* Then it takes the next free slot, although the interactive batch is still queued */
+    RateLimiter_release(xRateLimiter, 1, 0, 0);
+    xBulk.join();
+    EXPECT_EQ(iBulkRes, RATE_LIMITER_ERRNO_NONE);
+
+    RateLimiter_release(xRateLimiter, 2, 0, 0);
+    xInteractive.join();
+    EXPECT_EQ(iInteractiveRes, RATE_LIMITER_ERRNO_NONE);
+
+    RateLimiter_release(xRateLimiter, 2, 0, 0);
+    PollyRateLimiter_terminate(xRateLimiter);
+}
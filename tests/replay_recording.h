@@ -0,0 +1,139 @@
+#ifndef REPLAY_RECORDING_H
+#define REPLAY_RECORDING_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+}
+
+/* A scripted server is written to a recording, and the replayer transport plays it back, so the client runs without a network. */
+namespace replay
+{
+
+typedef std::vector<uint8_t> Bytes;
+
+/* The records of a recording, as the replayer reads them */
+const uint32_t kRecordOpen = 1;
+const uint32_t kRecordSend = 2;
+const uint32_t kRecordRecv = 3;
+const uint32_t kRecordEof = 4;
+const uint32_t kRecordError = 5;
+
+struct Session
+{
+    const char *pAlpnProtocol; // NULL for HTTP/1.1
+    std::vector<Bytes> xRecvs; // What every receive of the client returns, in order
+};
+
+inline Bytes Text(const std::string &xText)
+{
+    return Bytes(xText.begin(), xText.end());
+}
+
+/* An HTTP/1.1 response whose body is delimited by Content-Length. xHeaders are whole lines, ex: "Connection: close\r\n". */
+inline Bytes Response(const std::string &xStatus, const std::string &xHeaders, const std::string &xBody)
+{
+    return Text("HTTP/1.1 " + xStatus + "\r\n" + xHeaders + "Content-Length: " + std::to_string(xBody.size()) + "\r\n\r\n" + xBody);
+}
+
+/* An HTTP/1.1 response whose body is sent in these chunks */
+inline Bytes ChunkedResponse(const std::string &xStatus, const std::string &xHeaders, const std::vector<std::string> &xChunks)
+{
+    std::string xResponse = "HTTP/1.1 " + xStatus + "\r\n" + xHeaders + "Transfer-Encoding: chunked\r\n\r\n";
+    char pSize[17];
+
+    for (const std::string &xChunk : xChunks)
+    {
+        snprintf(pSize, sizeof(pSize), "%zx", xChunk.size());
+        xResponse += std::string(pSize) + "\r\n" + xChunk + "\r\n";
+    }
+
+    return Text(xResponse + "0\r\n\r\n");
+}
+
+inline void WriteRecord(FILE *pxFile, uint32_t uSession, uint32_t uType, int32_t iValue, const uint8_t *pData, size_t uLen)
+{
+    const uint32_t puHeader[4] = { uSession, uType, (uint32_t)iValue, (uint32_t)uLen };
+
+    fwrite(puHeader, sizeof(puHeader), 1, pxFile);
+    if (uLen > 0)
+    {
+        fwrite(pData, uLen, 1, pxFile);
+    }
+}
+
+/* The name of a recording of the running test */
+inline std::string FileName()
+{
+    return ::testing::TempDir() + ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".rec";
+}
+
+/* Play the sessions back, one per connection in order. NULL if the recording can't be written or loaded. */
+inline PollyTransportHandle CreateReplayer(const std::vector<Session> &xSessions)
+{
+    std::string xFileName = FileName();
+    PollyTransportHandle xTransport = NULL;
+    FILE *pxFile = NULL;
+
+    if ((pxFile = fopen(xFileName.c_str(), "wb")) != NULL)
+    {
+        fwrite("PLYREC01", 8, 1, pxFile);
+        for (uint32_t i = 0; i < xSessions.size(); i++)
+        {
+            const char *pAlpnProtocol = xSessions[i].pAlpnProtocol;
+
+            WriteRecord(pxFile, i, kRecordOpen, 0, (const uint8_t *)pAlpnProtocol, (pAlpnProtocol != NULL) ? strlen(pAlpnProtocol) + 1 : 0);
+            for (const Bytes &xRecv : xSessions[i].xRecvs)
+            {
+                WriteRecord(pxFile, i, kRecordRecv, 0, xRecv.data(), xRecv.size());
+            }
+        }
+        fclose(pxFile);
+        xTransport = PollyTransport_createReplayer(xFileName.c_str());
+        remove(xFileName.c_str());
+    }
+
+    return xTransport;
+}
+
+/* Test credentials for a server on xTransport */
+inline void InitServiceParameter(PollyServiceParameter_t *pxServPara, PollyTransportHandle xTransport)
+{
+    memset(pxServPara, 0, sizeof(PollyServiceParameter_t));
+    pxServPara->pAccessKey = "AKIDEXAMPLE";
+    pxServPara->pSecretKey = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+    pxServPara->pRegion = "us-east-1";
+    pxServPara->pService = "polly";
+    pxServPara->pHost = "polly.us-east-1.amazonaws.com";
+    pxServPara->uRecvTimeoutMs = 1000;
+    pxServPara->xTransport = xTransport;
+}
+
+inline void InitParameter(PollySynthesizeSpeechParameter_t *pxPara, const char *pText)
+{
+    memset(pxPara, 0, sizeof(PollySynthesizeSpeechParameter_t));
+    pxPara->pOutputFormat = "mp3";
+    pxPara->pText = pText;
+    pxPara->pVoiceId = "Joanna";
+}
+
+/* An onDataCallback which appends the audio to the std::string of pUserData */
+inline int AppendData(uint8_t *pData, size_t uLen, void *pUserData)
+{
+    ((std::string *)pUserData)->append((const char *)pData, uLen);
+
+    return 0;
+}
+
+} // namespace replay
+
+#endif /* REPLAY_RECORDING_H */
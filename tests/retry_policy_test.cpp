@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+
+#include "port.h"
+#include "retry_policy.h"
+}
+
+#include "local_server.h"
+#include "replay_recording.h"
+
+namespace
+{
+
+using replay::Session;
+
+/* The delay of a hedge until enough latencies are known */
+const uint32_t kColdHedgeDelayMs = 1000;
+
+/* How late the slow server of the hedging tests answers, well beyond the hedge delay */
+const uint32_t kSlowReplyMs = 500;
+const uint32_t kHedgeMinDelayMs = 50;
+
+/* Backoffs of a millisecond keep the retries quick */
+PollyRetryPolicyConfig_t prvMakeConfig(unsigned int uMaxAttempts)
+{
+    PollyRetryPolicyConfig_t xConfig;
+
+    memset(&xConfig, 0, sizeof(xConfig));
+    xConfig.uMaxAttempts = uMaxAttempts;
+    xConfig.uBaseBackoffMs = 1;
+    xConfig.uMaxBackoffMs = 1;
+
+    return xConfig;
+}
+
+/* An audio response, or an error one whose type comes from the header */
+std::string prvAudioResponse(const std::string &xAudio)
+{
+    replay::Bytes xResponse = replay::Response("200 OK", "Content-Type: audio/mpeg\r\n", xAudio);
+
+    return std::string(xResponse.begin(), xResponse.end());
+}
+
+replay::Bytes prvErrorResponse(const std::string &xStatus, const std::string &xErrorType)
+{
+    return replay::Response(xStatus, xErrorType.empty() ? "" : "x-amzn-ErrorType: " + xErrorType + ":http://internal.amazon.com/coral/com.amazonaws.tts/\r\n",
+                            "{\"message\":\"" + xStatus + "\"}");
+}
+
+/* Every attempt is served by the next session of the replayer. */
+class RetryPolicyTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        PollyRetryPolicy_terminate(xRetryPolicy);
+        PollyTransport_terminate(xTransport);
+    }
+
+    int Synthesize(const std::vector<Session> &xSessions, const PollyRetryPolicyConfig_t &xConfig)
+    {
+        PollyServiceParameter_t xServPara;
+        PollySynthesizeSpeechParameter_t xPara;
+
+        EXPECT_NE(xTransport = replay::CreateReplayer(xSessions), nullptr);
+        EXPECT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+
+        replay::InitServiceParameter(&xServPara, xTransport);
+        xServPara.xRetryPolicy = xRetryPolicy;
+        replay::InitParameter(&xPara, "Hello");
+        memset(&xOut, 0, sizeof(xOut));
+        xOut.onDataCallback = replay::AppendData;
+        xOut.pUserData = &xAudio;
+
+        return Polly_synthesizeSpeech(&xServPara, &xPara, &xOut);
+    }
+
+    PollyTransportHandle xTransport = NULL;
+    PollyRetryPolicyHandle xRetryPolicy = NULL;
+    PollySynthesizeSpeechOutput_t xOut;
+    std::string xAudio;
+};
+
+/* A server which answers the first connection late, and the others right away */
+class HedgeTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        PollyRetryPolicy_terminate(xRetryPolicy);
+    }
+
+    /* The latencies seen so far are short, so the hedge is sent after the minimum delay. */
+    void CreatePolicy()
+    {
+        PollyRetryPolicyConfig_t xConfig = prvMakeConfig(1);
+
+        xConfig.uBudgetBurst = 1;
+        xConfig.bHedge = true;
+        xConfig.uHedgeMinDelayMs = kHedgeMinDelayMs;
+        ASSERT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+        for (int i = 0; i < 20; i++)
+        {
+            RetryPolicy_recordTtfb(xRetryPolicy, 1);
+        }
+    }
+
+    int Synthesize(LocalServer &xServer)
+    {
+        PollyServiceParameter_t xServPara;
+        PollySynthesizeSpeechParameter_t xPara;
+
+        replay::InitServiceParameter(&xServPara, PollyTransport_getPlain());
+        xServPara.pHost = "127.0.0.1";
+        xServPara.pPort = xServer.GetPort();
+        xServPara.uRecvTimeoutMs = 2000;
+        xServPara.xRetryPolicy = xRetryPolicy;
+        replay::InitParameter(&xPara, "Hello");
+        memset(&xOut, 0, sizeof(xOut));
+        xOut.onDataCallback = replay::AppendData;
+        xOut.pUserData = &xAudio;
+
+        return Polly_synthesizeSpeech(&xServPara, &xPara, &xOut);
+    }
+
+    PollyRetryPolicyHandle xRetryPolicy = NULL;
+    PollySynthesizeSpeechOutput_t xOut;
+    std::string xAudio;
+};
+
+} // namespace
+
+TEST(RetryPolicyBudgetTest, BurstThenRequestsRefillIt)
+{
+    PollyRetryPolicyConfig_t xConfig = prvMakeConfig(3);
+    PollyRetryPolicyHandle xRetryPolicy = NULL;
+
+    xConfig.uBudgetPercent = 50;
+    xConfig.uBudgetBurst = 2;
+    ASSERT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+
+    /* The budget starts full */
+    EXPECT_TRUE(RetryPolicy_acquire(xRetryPolicy));
+    EXPECT_TRUE(RetryPolicy_acquire(xRetryPolicy));
+    EXPECT_FALSE(RetryPolicy_acquire(xRetryPolicy));
+
+    /* Every request adds half a retry */
+    RetryPolicy_onRequest(xRetryPolicy);
+    EXPECT_FALSE(RetryPolicy_acquire(xRetryPolicy));
+    RetryPolicy_onRequest(xRetryPolicy);
+    EXPECT_TRUE(RetryPolicy_acquire(xRetryPolicy));
+
+    /* And it never holds more than the burst */
+    for (int i = 0; i < 100; i++)
+    {
+        RetryPolicy_onRequest(xRetryPolicy);
+    }
+    EXPECT_TRUE(RetryPolicy_acquire(xRetryPolicy));
+    EXPECT_TRUE(RetryPolicy_acquire(xRetryPolicy));
+    EXPECT_FALSE(RetryPolicy_acquire(xRetryPolicy));
+
+    PollyRetryPolicy_terminate(xRetryPolicy);
+}
+
+TEST(RetryPolicyBackoffTest, JitterStaysUnderCeiling)
+{
+    PollyRetryPolicyConfig_t xConfig = prvMakeConfig(10);
+    PollyRetryPolicyHandle xRetryPolicy = NULL;
+
+    xConfig.uBaseBackoffMs = 100;
+    xConfig.uMaxBackoffMs = 400;
+    ASSERT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_LE(RetryPolicy_getBackoffMs(xRetryPolicy, 1), 100u);
+        EXPECT_LE(RetryPolicy_getBackoffMs(xRetryPolicy, 2), 200u);
+        EXPECT_LE(RetryPolicy_getBackoffMs(xRetryPolicy, 9), 400u);
+    }
+
+    PollyRetryPolicy_terminate(xRetryPolicy);
+}
+
+TEST(RetryPolicyHedgeTest, DelayFollowsP95)
+{
+    PollyRetryPolicyConfig_t xConfig = prvMakeConfig(1);
+    PollyRetryPolicyHandle xRetryPolicy = NULL;
+
+    ASSERT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+    EXPECT_EQ(RetryPolicy_getHedgeDelayMs(xRetryPolicy), 0u);
+    PollyRetryPolicy_terminate(xRetryPolicy);
+
+    xConfig.bHedge = true;
+    xConfig.uHedgeMinDelayMs = 1;
+    ASSERT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+
+    /* Too few latencies are known to tell a slow request */
+    for (int i = 0; i < 19; i++)
+    {
+        RetryPolicy_recordTtfb(xRetryPolicy, 10);
+    }
+    EXPECT_EQ(RetryPolicy_getHedgeDelayMs(xRetryPolicy), kColdHedgeDelayMs);
+
+    /* 95 of 100 requests are fast, so the hedge waits for a fast one. A sixth slow one moves the p95 to the slow ones. The delay is
+     * the upper bound of the bucket of the p95, whose width is a quarter of its power of two. */
+    for (int i = 19; i < 95; i++)
+    {
+        RetryPolicy_recordTtfb(xRetryPolicy, 10);
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        RetryPolicy_recordTtfb(xRetryPolicy, 500);
+    }
+    EXPECT_GE(RetryPolicy_getHedgeDelayMs(xRetryPolicy), 10u);
+    EXPECT_LT(RetryPolicy_getHedgeDelayMs(xRetryPolicy), 12u);
+    RetryPolicy_recordTtfb(xRetryPolicy, 500);
+    EXPECT_GE(RetryPolicy_getHedgeDelayMs(xRetryPolicy), 500u);
+    EXPECT_LT(RetryPolicy_getHedgeDelayMs(xRetryPolicy), 512u);
+    PollyRetryPolicy_terminate(xRetryPolicy);
+
+    /* It never hedges sooner than the minimum */
+    xConfig.uHedgeMinDelayMs = 30;
+    ASSERT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+    for (int i = 0; i < 20; i++)
+    {
+        RetryPolicy_recordTtfb(xRetryPolicy, 1);
+    }
+    EXPECT_EQ(RetryPolicy_getHedgeDelayMs(xRetryPolicy), 30u);
+    PollyRetryPolicy_terminate(xRetryPolicy);
+}
+
+TEST_F(RetryPolicyTest, RetriesServerErrors)
+{
+    EXPECT_EQ(Synthesize({ { NULL, { prvErrorResponse("500 Internal Server Error", "") } },
+                           { NULL, { prvErrorResponse("503 Service Unavailable", "ServiceFailureException") } },
+                           { NULL, { replay::Text(prvAudioResponse("audio")) } } },
+                         prvMakeConfig(3)),
+              POLLY_ERRNO_NONE);
+    EXPECT_EQ(xOut.uAttempts, 3u);
+    EXPECT_EQ(xOut.uStatusCode, 200u);
+    EXPECT_EQ(xAudio, "audio");
+}
+
+TEST_F(RetryPolicyTest, RetriesThrottling)
+{
+    /* By the status, and by the error type of a 400 */
+    EXPECT_EQ(Synthesize({ { NULL, { prvErrorResponse("429 Too Many Requests", "") } },
+                           { NULL, { prvErrorResponse("400 Bad Request", "ThrottlingException") } },
+                           { NULL, { replay::Text(prvAudioResponse("audio")) } } },
+                         prvMakeConfig(3)),
+              POLLY_ERRNO_NONE);
+    EXPECT_EQ(xOut.uAttempts, 3u);
+    EXPECT_EQ(xAudio, "audio");
+}
+
+TEST_F(RetryPolicyTest, DoesNotRetryClientErrors)
+{
+    EXPECT_EQ(Synthesize({ { NULL, { prvErrorResponse("400 Bad Request", "TextLengthExceededException") } },
+                           { NULL, { replay::Text(prvAudioResponse("audio")) } } },
+                         prvMakeConfig(3)),
+              POLLY_ERRNO_HTTP_REQ_FAILURE);
+    EXPECT_EQ(xOut.uAttempts, 1u);
+    EXPECT_EQ(xOut.uStatusCode, 400u);
+    EXPECT_STREQ(xOut.pErrorType, "TextLengthExceededException");
+    EXPECT_EQ(xAudio, "");
+}
+
+TEST_F(RetryPolicyTest, StopsWhenBudgetIsSpent)
+{
+    PollyRetryPolicyConfig_t xConfig = prvMakeConfig(5);
+
+    /* One retry beyond the percentage, which a single request doesn't refill */
+    xConfig.uBudgetPercent = 1;
+    xConfig.uBudgetBurst = 1;
+    EXPECT_EQ(Synthesize({ { NULL, { prvErrorResponse("500 Internal Server Error", "") } },
+                           { NULL, { prvErrorResponse("500 Internal Server Error", "") } },
+                           { NULL, { replay::Text(prvAudioResponse("audio")) } } },
+                         xConfig),
+              POLLY_ERRNO_HTTP_REQ_FAILURE);
+    EXPECT_EQ(xOut.uAttempts, 2u);
+    EXPECT_EQ(xOut.uStatusCode, 500u);
+    EXPECT_EQ(xAudio, "");
+}
+
+TEST_F(HedgeTest, FasterAttemptWins)
+{
+    LocalServer xServer({ { kSlowReplyMs, prvAudioResponse("slow") }, { 0, prvAudioResponse("fast") } });
+    uint64_t uStartMs = Port_getTimeMs();
+
+    ASSERT_NE(xServer.GetPort(), nullptr);
+    CreatePolicy();
+
+    EXPECT_EQ(Synthesize(xServer), POLLY_ERRNO_NONE);
+    EXPECT_LT(Port_getTimeMs() - uStartMs, kSlowReplyMs);
+    EXPECT_EQ(xAudio, "fast");
+    EXPECT_EQ(xServer.GetAcceptCount(), 2u);
+
+    /* The hedge was paid from the budget */
+    EXPECT_FALSE(RetryPolicy_acquire(xRetryPolicy));
+}
+
+TEST_F(HedgeTest, NoHedgeWithoutBudget)
+{
+    LocalServer xServer({ { kSlowReplyMs, prvAudioResponse("slow") }, { 0, prvAudioResponse("fast") } });
+
+    ASSERT_NE(xServer.GetPort(), nullptr);
+    CreatePolicy();
+    ASSERT_TRUE(RetryPolicy_acquire(xRetryPolicy));
+
+    EXPECT_EQ(Synthesize(xServer), POLLY_ERRNO_NONE);
+    EXPECT_EQ(xAudio, "slow");
+    EXPECT_EQ(xServer.GetAcceptCount(), 1u);
+}
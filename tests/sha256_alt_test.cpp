@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "mbedtls/sha256.h"
+
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+#include "sha256_alt.h"
+#endif
+}
+
+namespace
+{
+
+struct KnownAnswer
+{
+    const char *pMsg;
+    size_t uRepeat; // The message is hashed this many times as one input
+    const char *pDigestHex;
+};
+
+/* FIPS 180-2 test vectors */
+const KnownAnswer gxKnownAnswers[] =
+{
+    { "", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+std::string prvDigestHex(const unsigned char pDigest[32])
+{
+    char pDigestHex[65];
+
+    for (size_t i = 0; i < 32; i++)
+    {
+        snprintf(pDigestHex + 2 * i, 3, "%02x", pDigest[i]);
+    }
+
+    return std::string(pDigestHex);
+}
+
+std::string prvHashRepeated(const char *pMsg, size_t uRepeat)
+{
+    mbedtls_sha256_context xCtx;
+    unsigned char pDigest[32];
+
+    mbedtls_sha256_init(&xCtx);
+    mbedtls_sha256_starts_ret(&xCtx, 0);
+    for (size_t i = 0; i < uRepeat; i++)
+    {
+        mbedtls_sha256_update_ret(&xCtx, (const unsigned char *)pMsg, strlen(pMsg));
+    }
+    mbedtls_sha256_finish_ret(&xCtx, pDigest);
+    mbedtls_sha256_free(&xCtx);
+
+    return prvDigestHex(pDigest);
+}
+
+/* Every length up to 4 blocks, so the padding lands at every offset of the last block */
+std::vector<std::string> prvHashAllLengths()
+{
+    std::vector<std::string> xDigests;
+    unsigned char pMsg[256];
+    unsigned char pDigest[32];
+
+    for (size_t i = 0; i < sizeof(pMsg); i++)
+    {
+        pMsg[i] = (unsigned char)(i * 31 + 7);
+    }
+    for (size_t uLen = 0; uLen <= sizeof(pMsg); uLen++)
+    {
+        mbedtls_sha256_ret(pMsg, uLen, pDigest, 0);
+        xDigests.push_back(prvDigestHex(pDigest));
+    }
+
+    return xDigests;
+}
+
+} // namespace
+
+TEST(Sha256Test, KnownAnswers)
+{
+    for (const KnownAnswer &xAnswer : gxKnownAnswers)
+    {
+        EXPECT_EQ(prvHashRepeated(xAnswer.pMsg, xAnswer.uRepeat), xAnswer.pDigestHex) << "message: \"" << xAnswer.pMsg << "\" x " << xAnswer.uRepeat;
+    }
+}
+
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+
+/* Each backend which the CPU supports is forced in turn, so a machine with SHA-NI or ARMv8 crypto extensions also checks the portable one. */
+class Sha256AltTest : public ::testing::TestWithParam<Sha256Backend_t>
+{
+protected:
+    void SetUp() override
+    {
+        eDefault = Sha256Alt_getBackend();
+        if (Sha256Alt_setBackend(GetParam()) != SHA256_ALT_ERRNO_NONE)
+        {
+            GTEST_SKIP() << Sha256Alt_getBackendName(GetParam()) << " is not supported";
+        }
+    }
+
+    void TearDown() override
+    {
+        Sha256Alt_setBackend(eDefault);
+    }
+
+    Sha256Backend_t eDefault;
+};
+
+TEST_P(Sha256AltTest, KnownAnswers)
+{
+    ASSERT_EQ(Sha256Alt_getBackend(), GetParam());
+    for (const KnownAnswer &xAnswer : gxKnownAnswers)
+    {
+        EXPECT_EQ(prvHashRepeated(xAnswer.pMsg, xAnswer.uRepeat), xAnswer.pDigestHex) << "message: \"" << xAnswer.pMsg << "\" x " << xAnswer.uRepeat;
+    }
+}
+
+TEST_P(Sha256AltTest, MatchesPortable)
+{
+    std::vector<std::string> xDigests = prvHashAllLengths();
+    std::vector<std::string> xExpected;
+
+    ASSERT_EQ(Sha256Alt_setBackend(SHA256_BACKEND_PORTABLE), SHA256_ALT_ERRNO_NONE);
+    xExpected = prvHashAllLengths();
+
+    for (size_t uLen = 0; uLen < xDigests.size(); uLen++)
+    {
+        EXPECT_EQ(xDigests[uLen], xExpected[uLen]) << "length: " << uLen;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, Sha256AltTest,
+                         ::testing::Values(SHA256_BACKEND_PORTABLE, SHA256_BACKEND_SHA_NI, SHA256_BACKEND_ARMV8_CE),
+                         [](const ::testing::TestParamInfo<Sha256Backend_t> &xInfo)
+                         {
+                             // The printable names have dashes, which test names can't have
+                             std::string xName = Sha256Alt_getBackendName(xInfo.param);
+                             for (char &c : xName)
+                             {
+                                 c = (c == '-') ? '_' : c;
+                             }
+                             return xName;
+                         });
+
+#endif /* MBEDTLS_SHA256_PROCESS_ALT */
@@ -0,0 +1,136 @@
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "mbedtls/sha256.h"
+
+#include "arena.h"
+#include "sha256_mb.h"
+#include "sigv4.h"
+}
+
+namespace
+{
+
+/* The messages of the hash check cover every length of the last block, with and without a second padding block */
+const size_t kCheckMsgCount = 3 * 64 + 5;
+
+const size_t kBatchLen = 256;
+const size_t kMaxPayloadLen = 4096;
+
+std::vector<char> prvMakePayload()
+{
+    std::vector<char> xPayload(kMaxPayloadLen + kCheckMsgCount);
+
+    for (size_t i = 0; i < xPayload.size(); i++)
+    {
+        xPayload[i] = (char)('a' + (i * 7) % 26);
+    }
+
+    return xPayload;
+}
+
+/* The payloads differ in length and content, and every fifth request carries a session token */
+std::vector<SigV4Para_t> prvMakeParas(const char *pPayload)
+{
+    std::vector<SigV4Para_t> xParas(kBatchLen);
+
+    for (size_t i = 0; i < kBatchLen; i++)
+    {
+        memset(&(xParas[i]), 0, sizeof(SigV4Para_t));
+        xParas[i].pAccessKey = "AKIDEXAMPLE";
+        xParas[i].pSecretKey = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+        xParas[i].pToken = (i % 5 == 0) ? "FwoGZXIvYXdzEXAMPLETOKEN" : NULL;
+        xParas[i].pRegion = "us-east-1";
+        xParas[i].pService = "polly";
+        xParas[i].pDateIso8601 = "20261019T080000Z";
+        xParas[i].pHttpMethod = "POST";
+        xParas[i].pPath = "/v1/speech";
+        xParas[i].pHost = "polly.us-east-1.amazonaws.com";
+        xParas[i].pPayload = pPayload + i % 64;
+        xParas[i].uPayloadLen = (i * 131) % (kMaxPayloadLen - 64);
+    }
+
+    return xParas;
+}
+
+} // namespace
+
+/* Each backend which the CPU supports is forced in turn, so a machine with AVX-512 also checks AVX2 and the scalar one. */
+class Sha256MbTest : public ::testing::TestWithParam<Sha256MbBackend_t>
+{
+protected:
+    void SetUp() override
+    {
+        eDefault = Sha256Mb_getBackend();
+        if (Sha256Mb_setBackend(GetParam()) != SHA256_MB_ERRNO_NONE)
+        {
+            GTEST_SKIP() << Sha256Mb_getBackendName(GetParam()) << " is not supported";
+        }
+    }
+
+    void TearDown() override
+    {
+        Sha256Mb_setBackend(eDefault);
+    }
+
+    Sha256MbBackend_t eDefault;
+};
+
+TEST_P(Sha256MbTest, MatchesMbedtls)
+{
+    std::vector<char> xPayload = prvMakePayload();
+    std::vector<const unsigned char *> xMsgs(kCheckMsgCount);
+    std::vector<size_t> xLens(kCheckMsgCount);
+    std::vector<unsigned char> xDigests(kCheckMsgCount * SHA256_MB_DIGEST_LEN);
+    unsigned char pExpected[SHA256_MB_DIGEST_LEN];
+
+    for (size_t i = 0; i < kCheckMsgCount; i++)
+    {
+        xMsgs[i] = (const unsigned char *)xPayload.data() + i;
+        xLens[i] = i;
+    }
+
+    ASSERT_EQ(Sha256Mb_hash(xMsgs.data(), xLens.data(), kCheckMsgCount, (unsigned char (*)[SHA256_MB_DIGEST_LEN])xDigests.data()), SHA256_MB_ERRNO_NONE);
+
+    for (size_t i = 0; i < kCheckMsgCount; i++)
+    {
+        mbedtls_sha256_ret(xMsgs[i], xLens[i], pExpected, 0);
+        EXPECT_EQ(memcmp(&(xDigests[i * SHA256_MB_DIGEST_LEN]), pExpected, SHA256_MB_DIGEST_LEN), 0) << "length: " << xLens[i];
+    }
+}
+
+/* The batch must sign every request exactly like SigV4_Sign() */
+TEST_P(Sha256MbTest, SignBatchMatchesSign)
+{
+    std::vector<char> xPayload = prvMakePayload();
+    std::vector<SigV4Para_t> xParas = prvMakeParas(xPayload.data());
+    std::vector<char *> xAuths(kBatchLen, NULL);
+    std::vector<size_t> xAuthLens(kBatchLen, 0);
+    char *pAuth = NULL;
+    size_t uAuthLen = 0;
+
+    ASSERT_EQ(SigV4_signBatch(xParas.data(), kBatchLen, xAuths.data(), xAuthLens.data()), SIGV4_ERRNO_NONE);
+
+    for (size_t i = 0; i < kBatchLen; i++)
+    {
+        ASSERT_EQ(SigV4_Sign(&(xParas[i]), &pAuth, &uAuthLen), SIGV4_ERRNO_NONE);
+        EXPECT_EQ(uAuthLen, xAuthLens[i]) << "request: " << i;
+        EXPECT_STREQ(pAuth, xAuths[i]) << "request: " << i;
+        Arena_free(NULL, pAuth);
+    }
+
+    for (size_t i = 0; i < kBatchLen; i++)
+    {
+        Arena_free(NULL, xAuths[i]);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, Sha256MbTest,
+                         ::testing::Values(SHA256_MB_BACKEND_SCALAR, SHA256_MB_BACKEND_AVX2, SHA256_MB_BACKEND_AVX512, SHA256_MB_BACKEND_NEON),
+                         [](const ::testing::TestParamInfo<Sha256MbBackend_t> &xInfo) { return std::string(Sha256Mb_getBackendName(xInfo.param)); });
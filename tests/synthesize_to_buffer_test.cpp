@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+}
+
+#include "replay_recording.h"
+
+namespace
+{
+
+using replay::Session;
+
+const char *kAudioHead = "200 OK";
+const char *kAudioHeaders = "Content-Type: audio/mpeg\r\n";
+
+/* Text which doesn't repeat at any power of two, so a misplaced byte shows */
+std::string prvPattern(size_t uLen)
+{
+    std::string xText;
+
+    for (size_t i = 0; i < uLen; i++)
+    {
+        xText += (char)('a' + i % 23);
+    }
+
+    return xText;
+}
+
+/* Split a response into receives of at most uLen bytes, so the body after the head is received in place in several parts */
+std::vector<replay::Bytes> prvSplitEvery(const replay::Bytes &xResponse, size_t uLen)
+{
+    std::vector<replay::Bytes> xRecvs;
+
+    for (size_t i = 0; i < xResponse.size(); i += uLen)
+    {
+        xRecvs.push_back(replay::Bytes(xResponse.begin() + i, xResponse.begin() + ((i + uLen < xResponse.size()) ? i + uLen : xResponse.size())));
+    }
+
+    return xRecvs;
+}
+
+/* The server is played back from a recording, so Polly_synthesizeSpeechToBuffer() sizes its buffer and bypasses the body parser without a network. */
+class SynthesizeToBufferTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        if (pAudio != pCallerBuf)
+        {
+            Polly_freeAudio(pAudio);
+        }
+        PollyRetryPolicy_terminate(xRetryPolicy);
+        PollyTransport_terminate(xTransport);
+    }
+
+    int Synthesize(const std::vector<Session> &xSessions, uint8_t *pBuf, size_t uBufSize)
+    {
+        PollyServiceParameter_t xServPara;
+        PollySynthesizeSpeechParameter_t xPara;
+        PollySynthesizeSpeechOutput_t xOut;
+        PollyRetryPolicyConfig_t xConfig;
+
+        /* A failed attempt is retried once, right away */
+        memset(&xConfig, 0, sizeof(xConfig));
+        xConfig.uMaxAttempts = 2;
+        xConfig.uBaseBackoffMs = 1;
+        xConfig.uMaxBackoffMs = 1;
+
+        EXPECT_NE(xTransport = replay::CreateReplayer(xSessions), nullptr);
+        EXPECT_NE(xRetryPolicy = PollyRetryPolicy_create(&xConfig), nullptr);
+        replay::InitServiceParameter(&xServPara, xTransport);
+        xServPara.xRetryPolicy = xRetryPolicy;
+        replay::InitParameter(&xPara, "Hello");
+        memset(&xOut, 0, sizeof(xOut));
+        pCallerBuf = pBuf;
+
+        return Polly_synthesizeSpeechToBuffer(&xServPara, &xPara, &xOut, pBuf, uBufSize, &pAudio, &uAudioLen);
+    }
+
+    std::string GetAudio() const
+    {
+        return (pAudio != NULL) ? std::string((const char *)pAudio, uAudioLen) : std::string();
+    }
+
+    PollyTransportHandle xTransport = NULL;
+    PollyRetryPolicyHandle xRetryPolicy = NULL;
+    uint8_t *pCallerBuf = NULL;
+    uint8_t *pAudio = NULL;
+    size_t uAudioLen = 0;
+};
+
+} // namespace
+
+TEST_F(SynthesizeToBufferTest, ReceivesContentLengthBody)
+{
+    std::string xBody = prvPattern(10000);
+
+    /* The first receive carries the head and a part of the body, and the rest is received straight into the audio buffer */
+    EXPECT_EQ(Synthesize({ { NULL, prvSplitEvery(replay::Response(kAudioHead, kAudioHeaders, xBody), 3000) } }, NULL, 0), POLLY_ERRNO_NONE);
+    EXPECT_EQ(GetAudio(), xBody);
+}
+
+TEST_F(SynthesizeToBufferTest, ReceivesChunkedBodyOverEstimate)
+{
+    std::string xFirst = prvPattern(9000);
+    std::string xSecond = prvPattern(11000);
+
+    /* The estimate for a short text is well under the audio, so the buffer grows, and the chunk framing is split across the receives too */
+    EXPECT_EQ(Synthesize({ { NULL, prvSplitEvery(replay::ChunkedResponse(kAudioHead, kAudioHeaders, { xFirst, xSecond }), 1001) } }, NULL, 0),
+              POLLY_ERRNO_NONE);
+    EXPECT_EQ(GetAudio(), xFirst + xSecond);
+}
+
+TEST_F(SynthesizeToBufferTest, FillsCallerBuffer)
+{
+    std::vector<uint8_t> xBuf(64);
+
+    EXPECT_EQ(Synthesize({ { NULL, { replay::ChunkedResponse(kAudioHead, kAudioHeaders, { "part1", "part2" }) } } }, xBuf.data(), xBuf.size()),
+              POLLY_ERRNO_NONE);
+    EXPECT_EQ(pAudio, xBuf.data());
+    EXPECT_EQ(GetAudio(), "part1part2");
+}
+
+TEST_F(SynthesizeToBufferTest, ReportsAnnouncedLengthForSmallBuffer)
+{
+    std::vector<uint8_t> xBuf(16);
+
+    /* The caller can retry with a buffer of the length the response announced */
+    EXPECT_EQ(Synthesize({ { NULL, { replay::Response(kAudioHead, kAudioHeaders, prvPattern(100)) } } }, xBuf.data(), xBuf.size()),
+              POLLY_ERRNO_BUFFER_TOO_SMALL);
+    EXPECT_EQ(pAudio, nullptr);
+    EXPECT_EQ(uAudioLen, 100u);
+}
+
+TEST_F(SynthesizeToBufferTest, FailsChunkedBodyOverSmallBuffer)
+{
+    std::vector<uint8_t> xBuf(16);
+
+    /* A chunked response doesn't announce its length, so none is reported */
+    EXPECT_EQ(Synthesize({ { NULL, { replay::ChunkedResponse(kAudioHead, kAudioHeaders, { prvPattern(10), prvPattern(10) }) } } }, xBuf.data(), xBuf.size()),
+              POLLY_ERRNO_BUFFER_TOO_SMALL);
+    EXPECT_EQ(pAudio, nullptr);
+    EXPECT_EQ(uAudioLen, 0u);
+}
+
+TEST_F(SynthesizeToBufferTest, RefillsBufferOnRetry)
+{
+    replay::Bytes xResponse = replay::Response(kAudioHead, kAudioHeaders, prvPattern(5000));
+
+    /* The first connection closes in the middle of the body, and the audio of the retry replaces what it received */
+    EXPECT_EQ(Synthesize({ { NULL, { replay::Bytes(xResponse.begin(), xResponse.end() - 2000) } }, { NULL, { xResponse } } }, NULL, 0), POLLY_ERRNO_NONE);
+    EXPECT_EQ(GetAudio(), prvPattern(5000));
+}
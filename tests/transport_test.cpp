@@ -0,0 +1,165 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C"
+{
+#include "polly/polly.h"
+}
+
+#include "replay_recording.h"
+
+namespace
+{
+
+const char *kMagic = "PLYREC01";
+
+/* A recording whose bytes are written as they are, so it can be malformed in any way */
+class ReplayerLoadTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        PollyTransport_terminate(xTransport);
+        remove(replay::FileName().c_str());
+    }
+
+    void AppendRecord(uint32_t uSession, uint32_t uType, const replay::Bytes &xData)
+    {
+        const uint32_t puHeader[4] = { uSession, uType, 0, (uint32_t)xData.size() };
+
+        xFile.insert(xFile.end(), (const uint8_t *)puHeader, (const uint8_t *)puHeader + sizeof(puHeader));
+        xFile.insert(xFile.end(), xData.begin(), xData.end());
+    }
+
+    PollyTransportHandle Load()
+    {
+        FILE *pxFile = fopen(replay::FileName().c_str(), "wb");
+
+        EXPECT_NE(pxFile, nullptr);
+        if (pxFile != NULL)
+        {
+            fwrite(xFile.data(), 1, xFile.size(), pxFile);
+            fclose(pxFile);
+        }
+
+        return xTransport = PollyTransport_createReplayer(replay::FileName().c_str());
+    }
+
+    int Synthesize()
+    {
+        PollyServiceParameter_t xServPara;
+        PollySynthesizeSpeechParameter_t xPara;
+        PollySynthesizeSpeechOutput_t xOut;
+
+        replay::InitServiceParameter(&xServPara, xTransport);
+        replay::InitParameter(&xPara, "Hello");
+        memset(&xOut, 0, sizeof(xOut));
+        xOut.onDataCallback = replay::AppendData;
+        xOut.pUserData = &xAudio;
+
+        return Polly_synthesizeSpeech(&xServPara, &xPara, &xOut);
+    }
+
+    replay::Bytes xFile = replay::Text(kMagic);
+    PollyTransportHandle xTransport = NULL;
+    std::string xAudio;
+};
+
+replay::Bytes prvAudioResponse()
+{
+    return replay::Response("200 OK", "Content-Type: audio/mpeg\r\n", "audio");
+}
+
+} // namespace
+
+TEST_F(ReplayerLoadTest, LoadsWellFormedRecording)
+{
+    AppendRecord(0, replay::kRecordOpen, {});
+    AppendRecord(0, replay::kRecordRecv, prvAudioResponse());
+    ASSERT_NE(Load(), nullptr);
+    EXPECT_EQ(Synthesize(), POLLY_ERRNO_NONE);
+    EXPECT_EQ(xAudio, "audio");
+}
+
+TEST_F(ReplayerLoadTest, RejectsMissingFile)
+{
+    EXPECT_EQ(PollyTransport_createReplayer((replay::FileName() + ".missing").c_str()), nullptr);
+    EXPECT_EQ(PollyTransport_createReplayer(NULL), nullptr);
+}
+
+TEST_F(ReplayerLoadTest, RejectsTruncatedMagic)
+{
+    xFile.resize(4);
+    EXPECT_EQ(Load(), nullptr);
+}
+
+TEST_F(ReplayerLoadTest, RejectsOtherMagic)
+{
+    xFile = replay::Text("PLYREC02");
+    AppendRecord(0, replay::kRecordOpen, {});
+    AppendRecord(0, replay::kRecordRecv, prvAudioResponse());
+    EXPECT_EQ(Load(), nullptr);
+}
+
+TEST_F(ReplayerLoadTest, RejectsRecordingWithoutRecords)
+{
+    EXPECT_EQ(Load(), nullptr);
+}
+
+TEST_F(ReplayerLoadTest, RejectsRecordingWithTruncatedHeader)
+{
+    /* The only record ends within its header */
+    AppendRecord(0, replay::kRecordOpen, {});
+    xFile.resize(xFile.size() - 4);
+    EXPECT_EQ(Load(), nullptr);
+}
+
+TEST_F(ReplayerLoadTest, RejectsSessionIdOutOfRange)
+{
+    /* A corrupted id would size the sessions by it */
+    AppendRecord(0xFFFFFFFF, replay::kRecordOpen, {});
+    EXPECT_EQ(Load(), nullptr);
+
+    xFile = replay::Text(kMagic);
+    AppendRecord(1000, replay::kRecordOpen, {});
+    EXPECT_EQ(Load(), nullptr);
+}
+
+TEST_F(ReplayerLoadTest, RejectsSessionsWithoutOpen)
+{
+    AppendRecord(0, replay::kRecordRecv, prvAudioResponse());
+    EXPECT_EQ(Load(), nullptr);
+}
+
+TEST_F(ReplayerLoadTest, EndsSessionAtTruncatedRecord)
+{
+    replay::Bytes xResponse = prvAudioResponse();
+
+    /* The receive announces the whole response but the file ends within it, so the session ends before it and the request fails */
+    AppendRecord(0, replay::kRecordOpen, {});
+    AppendRecord(0, replay::kRecordRecv, xResponse);
+    xFile.resize(xFile.size() - 3);
+    ASSERT_NE(Load(), nullptr);
+    EXPECT_EQ(Synthesize(), POLLY_ERRNO_NET_RECV_FAILED);
+    EXPECT_EQ(xAudio, "");
+}
+
+TEST_F(ReplayerLoadTest, DropsRecordsAfterLengthPastEnd)
+{
+    replay::Bytes xResponse = prvAudioResponse();
+
+    /* A corrupted length runs past the end of the file, so it and everything after it are dropped rather than read out of bounds */
+    AppendRecord(0, replay::kRecordOpen, {});
+    AppendRecord(0, replay::kRecordRecv, replay::Bytes(xResponse.begin(), xResponse.begin() + 10));
+    memset(&xFile[xFile.size() - 10 - sizeof(uint32_t)], 0xFF, sizeof(uint32_t));
+    AppendRecord(0, replay::kRecordRecv, replay::Bytes(xResponse.begin() + 10, xResponse.end()));
+    ASSERT_NE(Load(), nullptr);
+    EXPECT_EQ(Synthesize(), POLLY_ERRNO_NET_RECV_FAILED);
+    EXPECT_EQ(xAudio, "");
+}